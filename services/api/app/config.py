@@ -37,4 +37,9 @@ FETCH_UA = os.getenv(
 MIN_CONTENT_LEN = int(os.getenv("MIN_CONTENT_LEN", "300"))
 
 # Upper bound to avoid overloading free tiers (still generous)
-MAX_ITEMS_CAP = int(os.getenv("MAX_ITEMS_CAP", "60"))
\ No newline at end of file
+MAX_ITEMS_CAP = int(os.getenv("MAX_ITEMS_CAP", "60"))
+
+# Articles sharing at least this share of their shingles with one already
+# ingested by the worker are skipped (needs the htmlfast module; 0 disables)
+NEAR_DUP_THRESHOLD = float(os.getenv("NEAR_DUP_THRESHOLD", "0.8"))
+NEAR_DUP_CAPACITY = int(os.getenv("NEAR_DUP_CAPACITY", "50000"))
\ No newline at end of file
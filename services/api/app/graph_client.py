@@ -1,6 +1,10 @@
+import logging
 import os
+import random
 import socket
-from typing import List, Tuple, Dict, Any
+import threading
+import time
+from typing import Any, Dict, Iterator, List, Tuple
 
 # Try to import generated stubs; if not present, we’ll fall back.
 try:
@@ -47,42 +51,151 @@ def _set_if_present(msg, field_name: str, value) -> None:
         setattr(msg, field_name, value)
 
 
-def _find_expand_method_path() -> str | None:
+# Budgets passed to the engine so a hub seed can't blow past gRPC message limits.
+EXPAND_MAX_NODES = int(os.environ.get("GRAPH_EXPAND_MAX_NODES", "2000"))
+EXPAND_MAX_EDGES = int(os.environ.get("GRAPH_EXPAND_MAX_EDGES", "5000"))
+EXPAND_TOP_K = int(os.environ.get("GRAPH_EXPAND_TOP_K", "0"))
+EXPAND_TIMEOUT_S = float(os.environ.get("GRAPH_EXPAND_TIMEOUT_S", "10"))
+# Windows ending "now" end at the close of the current minute instead, so
+# expands asked moments apart are the same query to the engine's cache.
+EXPAND_NOW_ROUND_MS = 60_000
+# Expands slower than this, end to end, are logged with where the time went;
+# a negative value turns tracing off.
+TRACE_SLOW_MS = float(os.environ.get("GRAPH_TRACE_SLOW_MS", "500"))
+
+_log = logging.getLogger("graph_client")
+_channels: Dict[Tuple[int, str], Any] = {}  # by (pid, target)
+_channels_lock = threading.Lock()
+
+
+def _channel():
+    """
+    This process's channel to GRAPH_ENGINE_ADDR, opened on first use and then
+    shared: gRPC multiplexes concurrent calls over it and reconnects on its
+    own. Keyed by pid too, as a forked worker cannot use its parent's.
+    """
+    key = (os.getpid(), os.environ.get("GRAPH_ENGINE_ADDR", "graph-engine:50061"))
+    with _channels_lock:
+        ch = _channels.get(key)
+        if ch is None:
+            ch = _channels[key] = grpc.insecure_channel(key[1], options=[("grpc.keepalive_time_ms", 30000)])  # type: ignore
+        return ch
+
+
+def _raw(b: bytes) -> bytes:
+    return b
+
+
+class _Trace:
+    """
+    One traced engine call. It sends a W3C traceparent (continuing the
+    caller's trace if given one), times the client's own steps, and reads the
+    engine's spans back from its server-timing trailer. done() logs the lot
+    as folded stacks (`a;b;c <microseconds>`, ready for flamegraph.pl) when
+    the call took longer than GRAPH_TRACE_SLOW_MS.
+    """
+
+    def __init__(self, name: str, traceparent: str | None = None):
+        parts = (traceparent or "").split("-")
+        trace_id = parts[1] if len(parts) == 4 and len(parts[1]) == 32 else os.urandom(16).hex()
+        self.trace_id = trace_id
+        self.metadata = (("traceparent", f"00-{trace_id}-{os.urandom(8).hex()}-01"),)
+        self.name = name
+        self.spans: List[Tuple[str, int]] = []
+        self.start = self.mark = time.perf_counter()
+
+    def span(self, name: str) -> None:
+        now = time.perf_counter()
+        self.spans.append((name, int((now - self.mark) * 1e6)))
+        self.mark = now
+
+    def add(self, name: str, seconds: float) -> None:
+        """A span timed elsewhere, such as one accumulated across a stream."""
+        self.spans.append((name, int(seconds * 1e6)))
+
+    def rpc(self, call, seconds: float | None = None) -> None:
+        """
+        Ends the RPC span, which lasted `seconds` if given; what the engine did
+        not account for is the network and gRPC.
+        """
+        now = time.perf_counter()
+        total = int(((now - self.mark) if seconds is None else seconds) * 1e6)
+        engine = []
+        try:
+            for k, v in call.trailing_metadata() or ():
+                if k != "server-timing":
+                    continue
+                for entry in v.split(","):
+                    name, _, dur = entry.strip().partition(";dur=")
+                    if dur:
+                        engine.append(("rpc;engine;" + name.replace(".", ";"), int(float(dur) * 1000)))
+        except Exception:
+            engine = []
+        self.spans.append(("rpc", max(0, total - sum(us for _, us in engine))))
+        self.spans.extend(engine)
+        self.mark = now
+
+    def done(self) -> None:
+        total_ms = (time.perf_counter() - self.start) * 1000
+        if total_ms < TRACE_SLOW_MS:
+            return
+        stacks = "\n".join(f"{self.name};{stack} {us}" for stack, us in self.spans)
+        _log.warning("slow %s (trace %s): %.1f ms\n%s", self.name, self.trace_id, total_ms, stacks)
+
+
+def _now_ms() -> int:
+    now = int(time.time() * 1000)
+    return now - now % EXPAND_NOW_ROUND_MS + EXPAND_NOW_ROUND_MS - 1
+
+
+def _find_expand_method() -> Tuple[str, bool] | None:
     """
-    Inspect the compiled proto descriptors to find the RPC whose request type is
-    ExpandRequest and response type is ExpandResponse. Return the fully-qualified
-    method path for grpc.channel.unary_unary: '/<service_full_name>/<method_name>'
+    Inspect the compiled proto descriptors for an RPC taking ExpandRequest and
+    returning GraphFragment. Prefer the server-streaming variant (one fragment per
+    hop); fall back to the unary one. Return ('/<service_full_name>/<method>', streaming).
     """
     if not hasattr(pb, "DESCRIPTOR"):
         return None
 
-    # Find ExpandRequest / ExpandResponse message descriptors.
     msg_by_name = pb.DESCRIPTOR.message_types_by_name
-    if "ExpandRequest" not in msg_by_name or "ExpandResponse" not in msg_by_name:
+    if "ExpandRequest" not in msg_by_name or "GraphFragment" not in msg_by_name:
         return None
     req_desc = msg_by_name["ExpandRequest"]
-    resp_desc = msg_by_name["ExpandResponse"]
+    resp_desc = msg_by_name["GraphFragment"]
 
-    # Iterate services & methods to locate a matching RPC.
+    unary = None
     for svc in pb.DESCRIPTOR.services_by_name.values():
         for m in svc.methods:
-            if m.input_type is req_desc and m.output_type is resp_desc:
-                # svc.full_name looks like 'graph.GraphEngine'
-                return f"/{svc.full_name}/{m.name}"
-    return None
+            if m.input_type is not req_desc or m.output_type is not resp_desc:
+                continue
+            # svc.full_name looks like 'graph.GraphEngine'
+            path = f"/{svc.full_name}/{m.name}"
+            if m.name.endswith("Stream"):
+                return path, True
+            unary = unary or path
+    return (unary, False) if unary else None
 
 
-def expand(
+def _build_request(
     seed_ids: List[str],
-    max_hops: int = 2,
-    window_days: int | None = 14,
-    start_ms: int | None = None,   # ignored if engine doesn’t support it
-    end_ms: int | None = None,     # ignored if engine doesn’t support it
-) -> Tuple[List[Dict[str, Any]], List[Dict[str, Any]]]:
-
-    # If we don't have grpc or compiled stubs, return demo.
-    if not HAVE_GRPC:
-        return _expand_via_stub(seed_ids)
+    max_hops: int,
+    window_days: int | None,
+    start_ms: int | None,
+    end_ms: int | None,
+    max_nodes: int | None,
+    max_edges: int | None,
+    top_k: int | None,
+    edge_attrs: Dict[str, str] | None,
+    edge_types: List[str] | None = None,
+    node_types: List[str] | None = None,
+    path: List[Dict[str, List[str]]] | None = None,
+):
+    """ExpandRequest for expand()'s arguments."""
+    # Explicit bounds win; otherwise the window ends now and spans window_days.
+    if end_ms is None:
+        end_ms = _now_ms()
+    if start_ms is None:
+        start_ms = end_ms - int(window_days) * 86_400_000 if window_days is not None else 0
 
     # Build request safely.
     req = pb.ExpandRequest()  # type: ignore[attr-defined]
@@ -92,53 +205,449 @@ def expand(
             getattr(req, "seed_ids").extend(seed_ids)
         # scalars
         _set_if_present(req, "max_hops", int(max_hops))
-        if window_days is not None:
-            _set_if_present(req, "window_days", int(window_days))
-        if start_ms is not None:
-            _set_if_present(req, "start_ms", int(start_ms))
-        if end_ms is not None:
-            _set_if_present(req, "end_ms", int(end_ms))
-
-    # Resolve the RPC method path dynamically (works even if the generated Stub
-    # method is named something else).
-    method_path = _find_expand_method_path()
-    if not method_path:
-        # Couldn’t find a compatible RPC; keep UI alive.
-        return _expand_via_stub(seed_ids)
+        _set_if_present(req, "max_nodes", int(EXPAND_MAX_NODES if max_nodes is None else max_nodes))
+        _set_if_present(req, "max_edges", int(EXPAND_MAX_EDGES if max_edges is None else max_edges))
+        _set_if_present(req, "top_k", int(EXPAND_TOP_K if top_k is None else top_k))
+        _set_if_present(req, "dedup_edges", True)
+        if edge_attrs and "edge_attrs" in req.DESCRIPTOR.fields_by_name:
+            req.edge_attrs.update(edge_attrs)
+        if "path" in req.DESCRIPTOR.fields_by_name:
+            req.edge_types.extend(edge_types or [])
+            req.node_types.extend(node_types or [])
+            for step in path or []:
+                s = req.path.add()
+                s.edge_types.extend(step.get("edge_types") or [])
+                s.node_types.extend(step.get("node_types") or [])
+        if "window" in req.DESCRIPTOR.fields_by_name:
+            req.window.start_ms = int(start_ms)
+            req.window.end_ms = int(end_ms)
 
-    # Call the method directly through the channel.
-    target = os.environ.get("GRAPH_ENGINE_ADDR", "graph-engine:50061")
-    with grpc.insecure_channel(target) as ch:  # type: ignore
-        call = ch.unary_unary(
-            method_path,
-            request_serializer=pb.ExpandRequest.SerializeToString,   # type: ignore
-            response_deserializer=pb.ExpandResponse.FromString,      # type: ignore
-        )
-        try:
-            resp = call(req, timeout=10.0)
-        except Exception:
-            # Engine not ready / RPC mismatch at runtime -> graceful fallback.
-            return _expand_via_stub(seed_ids)
+    return req
 
-    # Convert response to our API shape, tolerating minor schema diffs.
+
+def _to_graph(fragments) -> Tuple[List[Dict[str, Any]], List[Dict[str, Any]]]:
+    """Convert fragments to our API shape, tolerating minor schema diffs."""
     nodes: List[Dict[str, Any]] = []
     edges: List[Dict[str, Any]] = []
 
-    for n in getattr(resp, "nodes", []):
-        node = {
-            "id": getattr(n, "id", ""),
-            "type": getattr(n, "type", ""),
-            "attrs": dict(getattr(n, "attrs", {})),
-        }
-        nodes.append(node)
-
-    for e in getattr(resp, "edges", []):
-        edge = {
-            "src": getattr(e, "src", ""),
-            "dst": getattr(e, "dst", ""),
-            "type": getattr(e, "type", ""),
-            "ts": getattr(e, "ts", None),
-        }
-        edges.append(edge)
+    for resp in fragments:
+        for n in getattr(resp, "nodes", []):
+            node = {
+                "id": getattr(n, "id", ""),
+                "type": getattr(n, "type", ""),
+                "attrs": dict(getattr(n, "attrs", {})),
+            }
+            nodes.append(node)
+
+        for e in getattr(resp, "edges", []):
+            edge = {
+                "src": getattr(e, "src", ""),
+                "dst": getattr(e, "dst", ""),
+                "type": getattr(e, "type", ""),
+                "ts": getattr(e, "ts", None),
+            }
+            edges.append(edge)
 
     return nodes, edges
+
+
+def expand_hops(
+    seed_ids: List[str],
+    max_hops: int = 2,
+    window_days: int | None = 14,
+    start_ms: int | None = None,
+    end_ms: int | None = None,
+    max_nodes: int | None = None,
+    max_edges: int | None = None,
+    top_k: int | None = None,
+    edge_attrs: Dict[str, str] | None = None,
+    edge_types: List[str] | None = None,
+    node_types: List[str] | None = None,
+    path: List[Dict[str, List[str]]] | None = None,
+    traceparent: str | None = None,
+) -> Iterator[Tuple[List[Dict[str, Any]], List[Dict[str, Any]]]]:
+    """
+    expand(), a hop at a time: yields each hop's new nodes and edges as the
+    engine streams them, so a caller can use the near hops while the far ones
+    are still being walked, and stop early. Raises grpc.RpcError if the
+    engine fails, or RuntimeError if the stubs have no expand RPC.
+    """
+    found = _find_expand_method() if HAVE_GRPC else None
+    if not found:
+        raise RuntimeError("graph engine stubs have no expand RPC")
+    method_path, streaming = found
+
+    trace = _Trace("expand", traceparent) if TRACE_SLOW_MS >= 0 else None
+    req = _build_request(seed_ids, max_hops, window_days, start_ms, end_ms, max_nodes, max_edges, top_k, edge_attrs,
+                         edge_types, node_types, path).SerializeToString()
+    if trace:
+        trace.span("marshal")
+
+    # Called through the channel with raw bytes, parsed here, so a trace can
+    # tell waiting on the engine from decoding what it sent.
+    ch = _channel()
+    metadata = trace.metadata if trace else None
+    waited = decoded = 0.0
+    start = time.perf_counter()
+    if streaming:
+        call = ch.unary_stream(method_path, request_serializer=_raw, response_deserializer=_raw)
+        stream = call(req, timeout=EXPAND_TIMEOUT_S, metadata=metadata)
+        frames = iter(stream)
+    else:
+        call = ch.unary_unary(method_path, request_serializer=_raw, response_deserializer=_raw)
+        one, stream = call.with_call(req, timeout=EXPAND_TIMEOUT_S, metadata=metadata)
+        frames = iter([one])
+    try:
+        while True:
+            raw = next(frames, None)
+            got = time.perf_counter()
+            waited += got - start
+            if raw is None:
+                break
+            hop = _to_graph([pb.GraphFragment.FromString(raw)])  # type: ignore
+            decoded += time.perf_counter() - got
+            yield hop
+            start = time.perf_counter()  # the caller's time between hops is its own
+    finally:
+        if streaming:
+            stream.cancel()  # a no-op once the stream has ended; frees the call if the caller stopped early
+    if trace:
+        trace.rpc(stream, waited)
+        trace.add("unmarshal", decoded)
+        trace.done()
+
+
+def expand(
+    seed_ids: List[str],
+    max_hops: int = 2,
+    window_days: int | None = 14,
+    start_ms: int | None = None,
+    end_ms: int | None = None,
+    max_nodes: int | None = None,
+    max_edges: int | None = None,
+    top_k: int | None = None,
+    edge_attrs: Dict[str, str] | None = None,
+    edge_types: List[str] | None = None,
+    node_types: List[str] | None = None,
+    path: List[Dict[str, List[str]]] | None = None,
+    traceparent: str | None = None,
+) -> Tuple[List[Dict[str, Any]], List[Dict[str, Any]]]:
+    """
+    The subgraph around the seeds. edge_types and node_types restrict every
+    hop to those types; path gives each hop its own, e.g.
+    [{"node_types": ["doc"]}, {"node_types": ["entity"]}] for co-mentions.
+    traceparent continues the caller's trace; see _Trace. If the engine or
+    the RPC is unavailable, returns a demo graph.
+    """
+    nodes: List[Dict[str, Any]] = []
+    edges: List[Dict[str, Any]] = []
+    try:
+        for hop_nodes, hop_edges in expand_hops(seed_ids, max_hops, window_days, start_ms, end_ms, max_nodes,
+                                                max_edges, top_k, edge_attrs, edge_types, node_types, path,
+                                                traceparent):
+            nodes += hop_nodes
+            edges += hop_edges
+    except Exception:
+        # Engine not ready / RPC mismatch at runtime -> graceful fallback.
+        return _expand_via_stub(seed_ids)
+    return nodes, edges
+
+
+def expand_batch(
+    queries: List[Dict[str, Any]], traceparent: str | None = None,
+) -> List[Tuple[List[Dict[str, Any]], List[Dict[str, Any]]]] | None:
+    """
+    Several expands in one round trip, each given as expand()'s keyword args.
+    The engine runs them on one graph version and shares work between queries
+    with the same window and seeds. Returns None if the engine or the RPC is
+    unavailable, so callers can fall back to per-query expands.
+    """
+    if not HAVE_GRPC or "ExpandBatchRequest" not in pb.DESCRIPTOR.message_types_by_name:
+        return None
+    trace = _Trace("expand_batch", traceparent) if TRACE_SLOW_MS >= 0 else None
+    # One "now" for the whole batch, so equal windows stay equal and can share work.
+    now_ms = _now_ms()
+    batch = pb.ExpandBatchRequest()  # type: ignore[attr-defined]
+    for q in queries:
+        batch.requests.append(_build_request(
+            q.get("seed_ids", []), q.get("max_hops", 2), q.get("window_days", 14), q.get("start_ms"),
+            q.get("end_ms", now_ms), q.get("max_nodes"), q.get("max_edges"), q.get("top_k"), q.get("edge_attrs"),
+            q.get("edge_types"), q.get("node_types"), q.get("path"),
+        ))
+    req = batch.SerializeToString()
+    if trace:
+        trace.span("marshal")
+    try:
+        call = _channel().unary_unary("/graph.GraphEngine/ExpandBatch", request_serializer=_raw,
+                                      response_deserializer=_raw)
+        raw, done = call.with_call(req, timeout=EXPAND_TIMEOUT_S, metadata=trace.metadata if trace else None)
+    except Exception:
+        return None
+    if trace:
+        trace.rpc(done)
+    results = [_to_graph([frag]) for frag in pb.ExpandBatchResponse.FromString(raw).results]  # type: ignore
+    if trace:
+        trace.span("unmarshal")
+        trace.done()
+    return results
+
+
+def stats(timeout_s: float = 2.0) -> Dict[str, Any] | None:
+    """Engine sizes, per-RPC latency summaries and the Prometheus text; None if unreachable."""
+    if not HAVE_GRPC or "StatsRequest" not in pb.DESCRIPTOR.message_types_by_name:
+        return None
+    ch = _channel()
+    try:
+        call = ch.unary_unary(
+            "/graph.GraphEngine/Stats",
+            request_serializer=pb.StatsRequest.SerializeToString,   # type: ignore
+            response_deserializer=pb.StatsResponse.FromString,      # type: ignore
+        )
+        resp = call(pb.StatsRequest(), timeout=timeout_s)
+    except Exception:
+        return None
+    sizes = ("nodes", "edges", "delta_segments", "node_bytes", "edge_bytes", "attr_bytes", "adjacency_bytes",
+             "string_bytes", "cache_bytes", "related_bytes", "bytes")
+    out: Dict[str, Any] = {k: int(getattr(resp, k)) for k in sizes}
+    out["rpcs"] = {
+        r.rpc: {
+            "count": r.count, "errors": r.errors,
+            "p50_us": r.p50_us, "p90_us": r.p90_us, "p99_us": r.p99_us, "p999_us": r.p999_us, "max_us": r.max_us,
+        }
+        for r in resp.rpcs
+    }
+    out["prometheus"] = resp.prometheus
+    return out
+
+
+def rank(
+    seed_ids: List[str],
+    method: str = "top_neighbors",
+    k: int = 20,
+    window_days: int | None = 14,
+    start_ms: int | None = None,
+    end_ms: int | None = None,
+    alpha: float = 0.0,
+    epsilon: float = 0.0,
+    max_edges: int = 0,
+    edge_attrs: Dict[str, str] | None = None,
+) -> Tuple[List[Dict[str, Any]], List[Dict[str, Any]], bool] | None:
+    """
+    The k nodes best related to the seeds, by summed edge weight
+    ("top_neighbors") or personalized PageRank ("pagerank"), best first, each
+    with a "score"; the seeds come first. Returns (nodes, edges among them,
+    truncated), or None if the engine or the RPC is unavailable.
+    """
+    if not HAVE_GRPC or "RankRequest" not in pb.DESCRIPTOR.message_types_by_name:
+        return None
+    rpc = {"top_neighbors": "TopNeighbors", "pagerank": "PersonalizedPageRank"}[method]
+    req = pb.RankRequest(seed_ids=seed_ids, k=k, alpha=alpha, epsilon=epsilon, max_edges=max_edges)  # type: ignore[attr-defined]
+    if end_ms is None:
+        end_ms = int(time.time() * 1000)
+    if start_ms is None:
+        start_ms = end_ms - int(window_days) * 86400000 if window_days is not None else 0
+    req.window.start_ms = int(start_ms)
+    req.window.end_ms = int(end_ms)
+    if edge_attrs:
+        req.edge_attrs.update(edge_attrs)
+    ch = _channel()
+    try:
+        call = ch.unary_unary(
+            f"/graph.GraphEngine/{rpc}",
+            request_serializer=pb.RankRequest.SerializeToString,   # type: ignore
+            response_deserializer=pb.RankResponse.FromString,      # type: ignore
+        )
+        resp = call(req, timeout=EXPAND_TIMEOUT_S)
+    except Exception:
+        return None
+    nodes, edges = _to_graph([resp])
+    for n, score in zip(nodes, resp.scores):
+        n["score"] = score
+    return nodes, edges, resp.truncated
+
+
+def related(
+    ids: List[str],
+    docs: bool = False,
+    k: int = 20,
+    window_days: int | None = 14,
+    start_ms: int | None = None,
+    end_ms: int | None = None,
+) -> Tuple[List[Dict[str, Any]], bool] | None:
+    """
+    The k nodes most related to ids by the engine's co-occurrence index, each
+    with a "score", best first after the ids themselves (scored 0). With docs,
+    docs: those sharing entities with a doc, by entities shared, and those
+    mentioning an entity; otherwise entities: those co-occurring with an
+    entity and those a doc mentions. Returns (nodes, approximate), or None if
+    the engine or the RPC is unavailable.
+    """
+    if not HAVE_GRPC or "RelatedRequest" not in pb.DESCRIPTOR.message_types_by_name:
+        return None
+    req = pb.RelatedRequest(ids=ids, k=k, docs=docs)  # type: ignore[attr-defined]
+    if end_ms is None:
+        end_ms = int(time.time() * 1000)
+    if start_ms is None:
+        start_ms = end_ms - int(window_days) * 86400000 if window_days is not None else 0
+    req.window.start_ms = int(start_ms)
+    req.window.end_ms = int(end_ms)
+    ch = _channel()
+    try:
+        call = ch.unary_unary(
+            "/graph.GraphEngine/RelatedNodes",
+            request_serializer=pb.RelatedRequest.SerializeToString,  # type: ignore
+            response_deserializer=pb.RankResponse.FromString,        # type: ignore
+        )
+        resp = call(req, timeout=EXPAND_TIMEOUT_S)
+    except Exception:
+        return None
+    nodes, _ = _to_graph([resp])
+    for n, score in zip(nodes, resp.scores):
+        n["score"] = score
+    return nodes, resp.truncated
+
+
+# Bulk ingest: upsert_graph() buffers documents and sends them as the chunks of
+# one BulkIngest stream once GRAPH_BULK_DOCS are waiting, or on flush_graph().
+# While the engine is unreachable at most GRAPH_BULK_MAX_DOCS stay queued; the
+# oldest are dropped past that.
+BULK_DOCS = int(os.environ.get("GRAPH_BULK_DOCS", "256"))
+BULK_MAX_DOCS = max(BULK_DOCS, int(os.environ.get("GRAPH_BULK_MAX_DOCS", str(BULK_DOCS * 16))))
+BULK_TIMEOUT_S = float(os.environ.get("GRAPH_BULK_TIMEOUT_S", "60"))
+BULK_RETRIES = int(os.environ.get("GRAPH_BULK_RETRIES", "6"))
+
+_bulk: List[Any] = []  # IngestChunks (or their serialized bytes) not yet acknowledged, in order
+_bulk_lock = threading.Lock()
+
+
+def _chunk(nodes: List[Dict[str, Any]], edges: List[Dict[str, Any]]):
+    c = pb.IngestChunk()  # type: ignore[attr-defined]
+    for n in nodes:
+        m = c.nodes.add()
+        m.id = n["id"]
+        m.type = n.get("type") or ""
+        m.ts = int(n.get("ts") or 0)
+        m.attrs.update({k: str(v) for k, v in (n.get("attrs") or {}).items()})
+    for e in edges:
+        m = c.edges.add()
+        m.src, m.dst = e["src"], e["dst"]
+        m.type = e.get("type") or ""
+        m.weight = float(e.get("weight", 1.0))
+        m.ts = int(e.get("ts") or 0)
+        m.attrs.update({k: str(v) for k, v in (e.get("attrs") or {}).items()})
+    return c
+
+
+def _wire(chunk) -> bytes:
+    return chunk if isinstance(chunk, bytes) else chunk.SerializeToString()
+
+
+def _acked(err) -> int:
+    """Chunks a failed stream still applied, from its trailer."""
+    try:
+        for key, value in err.trailing_metadata() or ():
+            if key == "graph-ingest-chunks":
+                return int(value)
+    except Exception:
+        pass
+    return 0
+
+
+def _trim_bulk() -> None:
+    """Drops the oldest queued documents past BULK_MAX_DOCS; call under _bulk_lock."""
+    over = len(_bulk) - BULK_MAX_DOCS
+    if over > 0:
+        del _bulk[:over]
+        _log.warning("graph ingest queue full; dropped the %d oldest documents", over)
+
+
+def _auto_flush(flush: bool) -> None:
+    """flush_graph() for an upsert: with flush=True it raises like flush_graph(),
+    but a flush because the queue filled only logs, and what was not sent stays
+    queued for the next one."""
+    try:
+        flush_graph()
+    except Exception:
+        if flush:
+            raise
+        _log.exception("graph engine flush failed; documents stay queued")
+
+
+def upsert_graph(nodes: List[Dict[str, Any]], edges: List[Dict[str, Any]], flush: bool = False) -> None:
+    """
+    Queue one document's nodes and edges for the engine; they are applied
+    together, nodes first. Sends the queue once it is full, logging rather
+    than raising if that fails, or with flush=True, raising like flush_graph().
+    Without gRPC stubs this is a no-op, like the demo fallbacks above.
+    """
+    if not HAVE_GRPC or "IngestChunk" not in pb.DESCRIPTOR.message_types_by_name:
+        return
+    with _bulk_lock:
+        _bulk.append(_chunk(nodes, edges))
+        _trim_bulk()
+        full = len(_bulk) >= BULK_DOCS
+    if full or flush:
+        _auto_flush(flush)
+
+
+def upsert_graph_chunks(chunks: List[bytes], flush: bool = False) -> None:
+    """
+    upsert_graph() for documents already serialized as IngestChunks, such as
+    htmlfast.graph.build_chunks() returns.
+    """
+    if not HAVE_GRPC or "IngestChunk" not in pb.DESCRIPTOR.message_types_by_name:
+        return
+    with _bulk_lock:
+        _bulk.extend(chunks)
+        _trim_bulk()
+        full = len(_bulk) >= BULK_DOCS
+    if full or flush:
+        _auto_flush(flush)
+
+
+def flush_graph() -> int:
+    """
+    Send every queued document in one BulkIngest stream; returns how many.
+    A busy engine (RESOURCE_EXHAUSTED) or a lost connection is retried with
+    jittered exponential backoff, resending only what the engine did not
+    acknowledge. Raises grpc.RpcError once retries run out; what was not
+    applied goes back to the front of the queue for the next flush. Any other
+    error rejects the first unacknowledged document, which is logged and
+    dropped, and the rest are sent on. The queue is only locked to take and
+    return documents, so upserts from other threads never wait on the stream.
+    """
+    if not HAVE_GRPC:
+        return 0
+    retryable = {grpc.StatusCode.RESOURCE_EXHAUSTED, grpc.StatusCode.UNAVAILABLE, grpc.StatusCode.DEADLINE_EXCEEDED}
+    with _bulk_lock:
+        pending = _bulk[:]
+        del _bulk[:]
+    call = _channel().stream_unary(
+        "/graph.GraphEngine/BulkIngest",
+        request_serializer=_wire,
+        response_deserializer=pb.IngestAck.FromString,         # type: ignore
+    )
+    sent = attempt = 0
+    while pending:
+        try:
+            call(iter(pending), timeout=BULK_TIMEOUT_S)
+            done = len(pending)  # an OK stream was applied whole
+        except grpc.RpcError as err:  # type: ignore
+            done = min(_acked(err), len(pending))
+            if err.code() not in retryable:
+                _log.error("graph engine rejected a document (%s: %s); dropping it",
+                           err.code().name, err.details())
+                del pending[:done + 1]
+                sent += done
+                attempt = 0
+                continue
+            if attempt >= BULK_RETRIES:
+                with _bulk_lock:
+                    _bulk[:0] = pending[done:]
+                    _trim_bulk()
+                raise
+            attempt = 0 if done else attempt + 1
+            time.sleep(min(5.0, 0.05 * 2 ** attempt) * (0.5 + random.random()))
+        del pending[:done]
+        sent += done
+    return sent
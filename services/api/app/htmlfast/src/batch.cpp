@@ -0,0 +1,121 @@
+#include "html_parser.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+// Threads shared by every parse_html_batch call, so each keeps its parse
+// scratch between batches. A batch is split by document: every thread, the
+// caller's included, takes the next one not yet taken.
+class ParsePool {
+public:
+    // Never destroyed: joining workers while the interpreter exits can hang.
+    static ParsePool& get() {
+        static ParsePool* pool = new ParsePool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        return *pool;
+    }
+
+    // Runs f(0) .. f(n - 1) and rethrows the first exception any of them threw.
+    void run(size_t n, const std::function<void(size_t)>& f) {
+        if (n < 2 || workers_.empty()) {
+            for (size_t i = 0; i < n; ++i) f(i);
+            return;
+        }
+        std::lock_guard<std::mutex> one(batch_mu_);  // one batch at a time
+        Batch batch(f, n);
+        {
+            std::lock_guard<std::mutex> lk(mu_);
+            batch_ = &batch;
+            ++gen_;
+        }
+        wake_.notify_all();
+        work(batch);
+        std::unique_lock<std::mutex> lk(mu_);
+        done_.wait(lk, [&] { return batch.left == 0 && busy_ == 0; });
+        batch_ = nullptr;
+        if (batch.error) std::rethrow_exception(batch.error);
+    }
+
+private:
+    // One run()'s documents, on its stack. Workers only reach it through
+    // batch_, under mu_, and run() waits for them to let go before returning.
+    struct Batch {
+        Batch(const std::function<void(size_t)>& f, size_t n) : job(f), n(n), left(n) {}
+        const std::function<void(size_t)>& job;
+        const size_t n;
+        std::atomic<size_t> next{0}, left;
+        std::exception_ptr error;  // guarded by mu_
+    };
+
+    explicit ParsePool(unsigned threads) {
+        for (unsigned i = 0; i < threads; ++i) workers_.emplace_back([this] { loop(); });
+    }
+
+    void loop() {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> lk(mu_);
+        for (;;) {
+            wake_.wait(lk, [&] { return gen_ != seen; });
+            seen = gen_;
+            Batch* batch = batch_;
+            if (!batch) continue;  // woke after that batch finished
+            ++busy_;
+            lk.unlock();
+            work(*batch);
+            lk.lock();
+            if (--busy_ == 0) done_.notify_all();
+        }
+    }
+
+    void work(Batch& b) {
+        for (size_t i; (i = b.next.fetch_add(1)) < b.n;) {
+            try {
+                b.job(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk(mu_);
+                if (!b.error) b.error = std::current_exception();
+            }
+            if (b.left.fetch_sub(1) == 1) {
+                std::lock_guard<std::mutex> lk(mu_);
+                done_.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex batch_mu_, mu_;
+    std::condition_variable wake_, done_;
+    uint64_t gen_ = 0;
+    unsigned busy_ = 0;
+    Batch* batch_ = nullptr;
+};
+
+}  // namespace
+
+void parse_html_batch(const std::vector<std::string_view>& htmls, const std::vector<std::string_view>& base_urls,
+                      const ParseOptions& opt, const HtmlBatchSink& sink) {
+    if (!base_urls.empty() && base_urls.size() != htmls.size())
+        throw std::invalid_argument("base_urls must be empty or one per document");
+    ParsePool::get().run(htmls.size(), [&](size_t i) {
+        parse_html_view(htmls[i], base_urls.empty() ? std::string_view() : base_urls[i], opt,
+                        [&](const HtmlView& v) { sink(i, v); });
+    });
+}
+
+std::vector<ParsedHtml> parse_html_batch(const std::vector<std::string_view>& htmls,
+                                         const std::vector<std::string_view>& base_urls,
+                                         const ParseOptions& opt) {
+    if (!base_urls.empty() && base_urls.size() != htmls.size())
+        throw std::invalid_argument("base_urls must be empty or one per document");
+    std::vector<ParsedHtml> out(htmls.size());
+    ParsePool::get().run(htmls.size(), [&](size_t i) {
+        out[i] = parse_html_gumbo(htmls[i], base_urls.empty() ? std::string_view() : base_urls[i], opt);
+    });
+    return out;
+}
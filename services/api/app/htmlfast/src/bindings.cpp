@@ -1,15 +1,251 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include "cooccur.hpp"
 #include "html_parser.hpp"
+#include "url.hpp"
 
 namespace py = pybind11;
 
+namespace {
+
+// What Python gets: each field made once, straight from the parser's views,
+// and handed out as is on every attribute access.
+struct PyParsedHtml {
+    py::str title, canonical, text, author, published;
+    py::dict meta;
+    py::list links, internal_links, external_links;
+    py::int_ simhash;
+    py::bytes minhash;
+};
+
+py::str to_str(std::string_view s) {
+    PyObject* o = PyUnicode_DecodeUTF8(s.data(), Py_ssize_t(s.size()), "replace");
+    if (!o) throw py::error_already_set();
+    return py::reinterpret_steal<py::str>(o);
+}
+
+py::bytes to_bytes(const MinHash& m) {
+    return py::bytes(reinterpret_cast<const char*>(m.data()), sizeof(MinHash));
+}
+
+py::list to_list(const std::vector<std::string_view>& v) {
+    py::list out(v.size());
+    for (size_t i = 0; i < v.size(); ++i) out[i] = to_str(v[i]);
+    return out;
+}
+
+PyParsedHtml to_python(const HtmlView& v) {
+    PyParsedHtml out;
+    out.title = to_str(v.title);
+    out.canonical = to_str(v.canonical);
+    out.text = to_str(v.text);
+    out.author = to_str(v.author);
+    out.published = to_str(v.published);
+    for (auto& [k, val] : v.meta) out.meta[to_str(k)] = to_str(val);
+    out.links = to_list(v.links);
+    out.internal_links = to_list(v.internal_links);
+    out.external_links = to_list(v.external_links);
+    out.simhash = py::int_(v.fingerprint.simhash);
+    out.minhash = to_bytes(v.fingerprint.minhash);
+    return out;
+}
+
+// A document's bytes, borrowed without copying from a str (its UTF-8 form),
+// bytes, or any other object with a contiguous buffer: bytearray, memoryview,
+// mmap. Holds a reference to the object; must be destroyed with the GIL held.
+class Doc {
+public:
+    explicit Doc(py::handle h) : owner_(py::reinterpret_borrow<py::object>(h)) {
+        PyObject* o = h.ptr();
+        if (PyUnicode_Check(o)) {
+            Py_ssize_t n;
+            const char* p = PyUnicode_AsUTF8AndSize(o, &n);
+            if (!p) throw py::error_already_set();
+            view_ = {p, size_t(n)};
+        } else if (PyBytes_Check(o)) {
+            view_ = {PyBytes_AS_STRING(o), size_t(PyBytes_GET_SIZE(o))};
+        } else {
+            if (PyObject_GetBuffer(o, &buf_, PyBUF_SIMPLE) != 0) throw py::error_already_set();
+            held_ = true;
+            view_ = {static_cast<const char*>(buf_.buf), size_t(buf_.len)};
+        }
+    }
+    Doc(const Doc&) = delete;
+    Doc& operator=(const Doc&) = delete;
+    ~Doc() { if (held_) PyBuffer_Release(&buf_); }
+    std::string_view view() const { return view_; }
+private:
+    py::object owner_;
+    Py_buffer buf_{};
+    bool held_ = false;
+    std::string_view view_;
+};
+
+PyParsedHtml parse(py::handle html, py::handle base_url, bool stream, bool main_content) {
+    Doc doc(html), base(base_url);
+    PyParsedHtml out;
+    {
+        py::gil_scoped_release nogil;
+        parse_html_view(doc.view(), base.view(), ParseOptions{stream, main_content}, [&](const HtmlView& v) {
+            py::gil_scoped_acquire gil;
+            out = to_python(v);
+        });
+    }
+    return out;
+}
+
+py::list parse_batch(py::iterable htmls, py::iterable base_urls, bool stream, bool main_content) {
+    std::deque<Doc> docs, bases;
+    std::vector<std::string_view> hv, bv;
+    for (auto h : htmls) hv.push_back(docs.emplace_back(h).view());
+    for (auto b : base_urls) bv.push_back(bases.emplace_back(b).view());
+    py::list out(hv.size());
+    {
+        py::gil_scoped_release nogil;
+        parse_html_batch(hv, bv, ParseOptions{stream, main_content}, [&](size_t i, const HtmlView& v) {
+            py::gil_scoped_acquire gil;
+            out[i] = py::cast(to_python(v));
+        });
+    }
+    return out;
+}
+
+// A signature as ParsedHtml.minhash gives it: the lanes' bytes as they lie
+// in memory.
+MinHash to_minhash(py::handle h) {
+    Doc d(h);
+    if (d.view().size() != sizeof(MinHash))
+        throw py::value_error("minhash must be " + std::to_string(sizeof(MinHash)) + " bytes");
+    MinHash m;
+    std::memcpy(m.data(), d.view().data(), sizeof(MinHash));
+    return m;
+}
+
+py::tuple text_fingerprint(py::handle text) {
+    Doc doc(text);
+    Fingerprint fp;
+    {
+        py::gil_scoped_release nogil;
+        fingerprint(doc.view(), fp);
+    }
+    return py::make_tuple(py::int_(fp.simhash), to_bytes(fp.minhash));
+}
+
+// A str's UTF-8, borrowed: valid while the str lives.
+std::string_view utf8(py::handle s, const char* what) {
+    if (!PyUnicode_Check(s.ptr())) throw py::type_error(std::string(what) + " must be str");
+    Py_ssize_t n;
+    const char* p = PyUnicode_AsUTF8AndSize(s.ptr(), &n);
+    if (!p) throw py::error_already_set();
+    return {p, size_t(n)};
+}
+
+py::list build_chunks(py::iterable docs) {
+    std::vector<py::object> held;  // everything the views below point into
+    std::deque<std::string> keys;
+    std::vector<DocMentions> in;
+    for (auto d : docs) {
+        auto t = d.cast<py::tuple>();
+        if (t.size() != 4) throw py::value_error("a document is (id, ts_ms, title, entities)");
+        held.push_back(t);
+        DocMentions& doc = in.emplace_back();
+        doc.id = utf8(t[0], "id");
+        doc.ts = t[1].cast<int64_t>();
+        doc.title = utf8(t[2], "title");
+        for (auto e : t[3].cast<py::iterable>()) {
+            py::object text, label;
+            if (PyDict_Check(e.ptr())) {
+                auto m = py::reinterpret_borrow<py::dict>(e);
+                text = m["text"];
+                label = m["label"];
+            } else {
+                auto pair = e.cast<py::tuple>();
+                if (pair.size() != 2) throw py::value_error("an entity is a dict or (text, label)");
+                text = pair[0];
+                label = pair[1];
+            }
+            Mention& mention = doc.mentions.emplace_back();
+            mention.text = utf8(text, "entity text");
+            mention.label = utf8(label, "entity label");
+            std::string& key = keys.emplace_back();
+            if (ascii_entity_key(mention.text, key)) {
+                mention.key = key;
+            } else {
+                py::object folded = text.attr("upper")().attr("strip")();
+                mention.key = utf8(folded, "entity text");
+                held.push_back(std::move(folded));
+            }
+            held.push_back(std::move(text));
+            held.push_back(std::move(label));
+        }
+    }
+    std::vector<std::string> chunks(in.size());
+    {
+        py::gil_scoped_release nogil;
+        for (size_t i = 0; i < in.size(); ++i) build_ingest_chunk(in[i], chunks[i]);
+    }
+    py::list out(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) out[i] = py::bytes(chunks[i]);
+    return out;
+}
+
+std::optional<std::string> normalize(std::string_view url, std::string_view base_url) {
+    UrlParts base;
+    std::string b, out;
+    bool has_base = normalize_url(base_url, nullptr, b) && split_url(b, base);
+    if (!normalize_url(url, has_base ? &base : nullptr, out)) return std::nullopt;
+    return out;
+}
+
+}  // namespace
+
 PYBIND11_MODULE(htmlfast, m) {
-    py::class_<ParsedHtml>(m, "ParsedHtml")
-        .def_readonly("title", &ParsedHtml::title)
-        .def_readonly("meta", &ParsedHtml::meta)
-        .def_readonly("canonical", &ParsedHtml::canonical)
-        .def_readonly("links", &ParsedHtml::links)
-        .def_readonly("text", &ParsedHtml::text);
-    m.def("parse_html", &parse_html_gumbo, py::arg("html"), py::arg("base_url") = "");
+    py::class_<PyParsedHtml>(m, "ParsedHtml")
+        .def_readonly("title", &PyParsedHtml::title)
+        .def_readonly("meta", &PyParsedHtml::meta)
+        .def_readonly("canonical", &PyParsedHtml::canonical)
+        .def_readonly("links", &PyParsedHtml::links)
+        .def_readonly("internal_links", &PyParsedHtml::internal_links)
+        .def_readonly("external_links", &PyParsedHtml::external_links)
+        .def_readonly("simhash", &PyParsedHtml::simhash)
+        .def_readonly("minhash", &PyParsedHtml::minhash)
+        .def_readonly("text", &PyParsedHtml::text)
+        .def_readonly("author", &PyParsedHtml::author)
+        .def_readonly("published", &PyParsedHtml::published);
+    // Documents may be str, bytes or any contiguous buffer, read in place.
+    // Parsing runs without the GIL, so other Python threads keep going; the
+    // batch form also spreads its documents over all cores. stream=True skips
+    // the DOM; main_content=True keeps only the article body; see ParseOptions.
+    m.def("parse_html", &parse, py::arg("html"), py::arg("base_url") = "", py::arg("stream") = false,
+          py::arg("main_content") = false);
+    m.def("parse_html_batch", &parse_batch, py::arg("htmls"), py::arg("base_urls") = py::tuple(),
+          py::arg("stream") = false, py::arg("main_content") = false,
+          "Parses HTML documents in parallel; returns a list of ParsedHtml in the same order.");
+    m.def("normalize_url", &normalize, py::arg("url"), py::arg("base_url") = "",
+          "The form parse_html gives links in when given a base_url, or None for what is not an http(s) URL.");
+
+    // Near-duplicate detection: parse_html fingerprints the text it returns;
+    // fingerprint() does the same for text from elsewhere.
+    m.def("fingerprint", &text_fingerprint, py::arg("text"), "Returns (simhash, minhash) for a text.");
+    py::class_<LshIndex>(m, "LshIndex")
+        .def(py::init<size_t, size_t>(), py::arg("bands") = 16, py::arg("capacity") = 0)
+        .def("add", [](LshIndex& ix, const std::string& key, py::handle mh) { ix.add(key, to_minhash(mh)); },
+             py::arg("key"), py::arg("minhash"))
+        .def("remove", &LshIndex::remove, py::arg("key"))
+        .def("query",
+             [](const LshIndex& ix, py::handle mh, double threshold) { return ix.query(to_minhash(mh), threshold); },
+             py::arg("minhash"), py::arg("threshold") = 0.8,
+             "Returns [(key, similarity)] for keys at or above threshold, most similar first.")
+        .def("__len__", &LshIndex::size);
+
+    // Graph building for the ingest pipeline, done here rather than in Python
+    // dicts and protobuf objects.
+    py::module_ graph = m.def_submodule("graph", "Native builders of graph engine ingest messages");
+    graph.def("build_chunks", &build_chunks, py::arg("docs"),
+              "For each (id, ts_ms, title, entities) document, with entities as dicts holding \"text\" and "
+              "\"label\" or (text, label) pairs, returns a serialized IngestChunk of its doc and entity nodes, "
+              "its MENTIONS edges weighted by mentions and its CO_OCCUR edges weighted by the lesser count.");
 }
@@ -0,0 +1,391 @@
+// Main-content extraction over a Gumbo DOM: paragraphs score the blocks that
+// hold them, scaled down by how much of a block is link text, and only the
+// best block and its like siblings are read out.
+#include "scratch.hpp"
+#include <gumbo.h>
+#include <unordered_map>
+
+namespace {
+
+struct Block {
+    size_t chars = 0, link_chars = 0;  // non-whitespace bytes in the subtree, and those inside <a>
+    double score = 0;
+    bool scored = false;
+
+    double link_density() const { return chars ? double(link_chars) / double(chars) : 0; }
+    double final_score() const { return score * (1 - link_density()); }
+};
+
+bool contains_ci(const char* hay, const char* needle) {
+    size_t n = std::strlen(needle);
+    for (; *hay; ++hay) {
+        size_t i = 0;
+        while (i < n && std::tolower(static_cast<unsigned char>(hay[i])) == needle[i]) ++i;
+        if (i == n) return true;
+    }
+    return false;
+}
+
+const char* attr(const GumboNode* n, const char* name) {
+    GumboAttribute* a = gumbo_get_attribute(&n->v.element.attributes, name);
+    return a ? a->value : nullptr;
+}
+
+bool hinted(const GumboNode* n, const char* const* words) {
+    for (const char* name : {"class", "id"}) {
+        const char* v = attr(n, name);
+        if (!v) continue;
+        for (const char* const* w = words; *w; ++w)
+            if (contains_ci(v, *w)) return true;
+    }
+    return false;
+}
+
+const char* const kNever[] = {"comment", "share", "social", "related", "newsletter", "sidebar", "cookie",
+                              "promo", "advert", "sponsor", "breadcrumb", "popup", "modal", "subscribe",
+                              "outbrain", "taboola", nullptr};
+const char* const kGood[] = {"article", "body", "content", "entry", "main", "post", "story", "text", nullptr};
+const char* const kBad[] = {"foot", "masthead", "meta", "nav", "menu", "tags", "tool", "widget", "banner",
+                            "caption", "byline", "author", nullptr};
+
+// Subtrees that never hold the article body; nothing in them is scored or read.
+bool boilerplate(const GumboNode* n) {
+    switch (n->v.element.tag) {
+    case GUMBO_TAG_HEAD: case GUMBO_TAG_SCRIPT: case GUMBO_TAG_STYLE: case GUMBO_TAG_NOSCRIPT:
+    case GUMBO_TAG_TEMPLATE: case GUMBO_TAG_NAV: case GUMBO_TAG_ASIDE: case GUMBO_TAG_FOOTER:
+    case GUMBO_TAG_FORM: case GUMBO_TAG_BUTTON: case GUMBO_TAG_SELECT: case GUMBO_TAG_TEXTAREA:
+    case GUMBO_TAG_IFRAME: case GUMBO_TAG_SVG:
+        return true;
+    case GUMBO_TAG_BODY: case GUMBO_TAG_ARTICLE: case GUMBO_TAG_MAIN:
+        return false;
+    default:
+        break;
+    }
+    if (attr(n, "hidden")) return true;
+    if (const char* a = attr(n, "aria-hidden"); a && contains_ci(a, "true")) return true;
+    return hinted(n, kNever) && !hinted(n, kGood);
+}
+
+// Blocks whose link density is kept for read-out, besides the scored ones.
+bool container(GumboTag t) {
+    switch (t) {
+    case GUMBO_TAG_DIV: case GUMBO_TAG_SECTION: case GUMBO_TAG_UL: case GUMBO_TAG_OL: case GUMBO_TAG_DL:
+    case GUMBO_TAG_TABLE: case GUMBO_TAG_HEADER: case GUMBO_TAG_FIGURE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+double tag_weight(GumboTag t) {
+    switch (t) {
+    case GUMBO_TAG_ARTICLE: case GUMBO_TAG_MAIN: return 10;
+    case GUMBO_TAG_DIV: return 5;
+    case GUMBO_TAG_PRE: case GUMBO_TAG_TD: case GUMBO_TAG_BLOCKQUOTE: return 3;
+    case GUMBO_TAG_ADDRESS: case GUMBO_TAG_OL: case GUMBO_TAG_UL: case GUMBO_TAG_DL: case GUMBO_TAG_DD:
+    case GUMBO_TAG_DT: case GUMBO_TAG_LI: return -3;
+    case GUMBO_TAG_H1: case GUMBO_TAG_H2: case GUMBO_TAG_H3: case GUMBO_TAG_H4: case GUMBO_TAG_H5:
+    case GUMBO_TAG_H6: case GUMBO_TAG_TH: return -5;
+    default: return 0;
+    }
+}
+
+// author and datePublished, from anywhere in a JSON-LD value. Tolerant: it
+// stops at the first thing it does not understand and keeps what it found.
+class JsonLd {
+public:
+    JsonLd(std::string_view src, std::string& authors, std::string& published)
+        : p_(src.data()), end_(src.data() + src.size()), authors_(authors), published_(published) {}
+
+    void run() { value(kAny, 0); }
+
+private:
+    enum Want { kAny, kAuthor, kName, kDate, kSkip };
+
+    bool value(Want want, int depth) {
+        if (depth > 32 || !skip_ws()) return false;
+        if (*p_ == '{') return object(want, depth);
+        if (*p_ == '[') {
+            ++p_;
+            if (skip_ws() && *p_ == ']') return ++p_, true;
+            for (;;) {
+                if (!value(want, depth + 1) || !skip_ws()) return false;
+                if (*p_ == ']') return ++p_, true;
+                if (*p_++ != ',') return false;
+            }
+        }
+        if (*p_ == '"') {
+            if (!string(str_)) return false;
+            if (want == kAuthor || want == kName) add_author(str_);
+            else if (want == kDate && published_.empty()) published_ = str_;
+            return true;
+        }
+        const char* s = p_;  // number, true, false, null
+        while (p_ < end_ && *p_ != ',' && *p_ != '}' && *p_ != ']' && !std::isspace(static_cast<unsigned char>(*p_)))
+            ++p_;
+        return p_ > s;
+    }
+
+    bool object(Want want, int depth) {
+        ++p_;
+        if (skip_ws() && *p_ == '}') return ++p_, true;
+        std::string key;
+        for (;;) {
+            if (!skip_ws() || *p_ != '"' || !string(key) || !skip_ws() || *p_++ != ':') return false;
+            Want next = kSkip;
+            if (want == kAuthor) {
+                if (key == "name") next = kName;
+            } else if (want == kAny || want == kDate) {
+                if (key == "author") next = authors_.empty() ? kAuthor : kSkip;
+                else if (key == "datePublished") next = kDate;
+                else next = kAny;
+            }
+            if (!value(next, depth + 1) || !skip_ws()) return false;
+            if (*p_ == '}') return ++p_, true;
+            if (*p_++ != ',') return false;
+        }
+    }
+
+    void add_author(const std::string& name) {
+        if (name.empty()) return;
+        if (!authors_.empty()) authors_ += ", ";
+        authors_ += name;
+    }
+
+    bool skip_ws() {
+        while (p_ < end_ && std::isspace(static_cast<unsigned char>(*p_))) ++p_;
+        return p_ < end_;
+    }
+
+    bool string(std::string& out) {
+        out.clear();
+        for (++p_; p_ < end_; ++p_) {
+            char c = *p_;
+            if (c == '"') return ++p_, true;
+            if (c != '\\') { out += c; continue; }
+            if (++p_ == end_) return false;
+            switch (*p_) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned cp;
+                if (!hex4(cp)) return false;
+                if (cp >= 0xD800 && cp < 0xDC00 && end_ - p_ > 6 && p_[1] == '\\' && p_[2] == 'u') {
+                    p_ += 2;
+                    unsigned lo;
+                    if (!hex4(lo)) return false;
+                    cp = lo >= 0xDC00 && lo < 0xE000 ? 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00) : 0xFFFD;
+                } else if (cp >= 0xD800 && cp < 0xE000) {
+                    cp = 0xFFFD;
+                }
+                utf8(out, cp);
+                break;
+            }
+            default: out += *p_; break;  // \" \\ \/
+            }
+        }
+        return false;
+    }
+
+    // Reads the four digits after p_ and leaves p_ on the last.
+    bool hex4(unsigned& cp) {
+        if (end_ - p_ < 5) return false;
+        cp = 0;
+        for (int i = 1; i <= 4; ++i) {
+            char c = p_[i];
+            unsigned d = c >= '0' && c <= '9' ? c - '0' : (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : 16;
+            if (d == 16) return false;
+            cp = cp << 4 | d;
+        }
+        p_ += 4;
+        return true;
+    }
+
+    static void utf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += char(cp);
+        } else if (cp < 0x800) {
+            out += char(0xC0 | cp >> 6);
+            out += char(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += char(0xE0 | cp >> 12);
+            out += char(0x80 | (cp >> 6 & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        } else {
+            out += char(0xF0 | cp >> 18);
+            out += char(0x80 | (cp >> 12 & 0x3F));
+            out += char(0x80 | (cp >> 6 & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+    const char* p_;
+    const char* end_;
+    std::string& authors_;
+    std::string& published_;
+    std::string str_;
+};
+
+class Extractor {
+public:
+    explicit Extractor(Scratch& s) : s_(s) {}
+
+    void run(GumboNode* root) {
+        measure(root, false);
+        const GumboNode* top = nullptr;
+        double best = 0;
+        for (auto& [n, b] : blocks_)
+            if (b.scored && b.final_score() > best) best = b.final_score(), top = n;
+        bool ws = false;
+        if (!top) {
+            read(root, ws);
+        } else if (const GumboNode* parent = top->parent; !parent || parent->type != GUMBO_NODE_ELEMENT) {
+            read(top, ws);
+        } else {
+            // Articles split over sibling blocks: take those that score close
+            // to the best, and plain paragraphs of prose next to it.
+            double bar = std::max(10.0, best * 0.2);
+            const GumboVector& kids = parent->v.element.children;
+            for (unsigned i = 0; i < kids.length; ++i) {
+                const GumboNode* c = static_cast<GumboNode*>(kids.data[i]);
+                if (c == top) { read(c, ws); continue; }
+                auto it = blocks_.find(c);
+                if (it == blocks_.end()) continue;
+                const Block& b = it->second;
+                bool prose = c->v.element.tag == GUMBO_TAG_P && b.chars > 80 && b.link_density() < 0.25;
+                if (prose || (b.scored && b.final_score() >= bar)) read(c, ws);
+            }
+        }
+        meta_fallback();
+        HtmlView& v = s_.view;
+        v.author = s_.arena.keep(authors_);
+        v.published = s_.arena.keep(published_);
+    }
+
+private:
+    struct Counts {
+        size_t chars = 0, link_chars = 0, commas = 0;
+    };
+
+    Block& block(const GumboNode* n) {
+        Block& b = blocks_[n];
+        if (!b.scored) {
+            b.scored = true;
+            b.score += tag_weight(n->v.element.tag);
+            if (hinted(n, kGood)) b.score += 25;
+            if (hinted(n, kBad)) b.score -= 25;
+        }
+        return b;
+    }
+
+    Counts measure(const GumboNode* n, bool in_link) {
+        Counts c;
+        if (n->type == GUMBO_NODE_TEXT) {
+            for (const char* p = n->v.text.text; *p; ++p) {
+                if (std::isspace(static_cast<unsigned char>(*p))) continue;
+                ++c.chars;
+                c.commas += *p == ',';
+            }
+            if (in_link) c.link_chars = c.chars;
+            return c;
+        }
+        if (n->type != GUMBO_NODE_ELEMENT) return c;
+        GumboTag tag = n->v.element.tag;
+        if (tag == GUMBO_TAG_SCRIPT) {
+            json_ld(n);
+            return c;
+        }
+        if (tag == GUMBO_TAG_HEAD) {
+            const GumboVector& kids = n->v.element.children;
+            for (unsigned i = 0; i < kids.length; ++i) {
+                const GumboNode* k = static_cast<GumboNode*>(kids.data[i]);
+                if (k->type == GUMBO_NODE_ELEMENT && k->v.element.tag == GUMBO_TAG_SCRIPT) json_ld(k);
+            }
+            return c;
+        }
+        if (boilerplate(n)) return c;
+        in_link = in_link || tag == GUMBO_TAG_A;
+        const GumboVector& kids = n->v.element.children;
+        for (unsigned i = 0; i < kids.length; ++i) {
+            Counts k = measure(static_cast<GumboNode*>(kids.data[i]), in_link);
+            c.chars += k.chars;
+            c.link_chars += k.link_chars;
+            c.commas += k.commas;
+        }
+        if ((tag == GUMBO_TAG_P || tag == GUMBO_TAG_PRE || tag == GUMBO_TAG_TD) && c.chars >= 25) {
+            double score = 1 + double(c.commas) + std::min(double(c.chars) / 100, 3.0);
+            const GumboNode* parent = n->parent;
+            if (parent && parent->type == GUMBO_NODE_ELEMENT) {
+                block(parent).score += score;
+                const GumboNode* grand = parent->parent;
+                if (grand && grand->type == GUMBO_NODE_ELEMENT) block(grand).score += score / 2;
+            }
+        }
+        auto it = blocks_.find(n);
+        if (it != blocks_.end() || container(tag) || tag == GUMBO_TAG_P) {
+            Block& b = it != blocks_.end() ? it->second : blocks_[n];
+            b.chars = c.chars;
+            b.link_chars = c.link_chars;
+        }
+        return c;
+    }
+
+    void json_ld(const GumboNode* script) {
+        const char* type = attr(script, "type");
+        if (!type || !contains_ci(type, "ld+json") || !script->v.element.children.length) return;
+        const GumboNode* t = static_cast<GumboNode*>(script->v.element.children.data[0]);
+        if (t->type == GUMBO_NODE_TEXT) JsonLd(t->v.text.text, authors_, published_).run();
+    }
+
+    // Appends the text under n as extract_text does, leaving out boilerplate
+    // and blocks inside it that are mostly links (related stories, tag lists).
+    void read(const GumboNode* n, bool& ws) {
+        if (n->type == GUMBO_NODE_TEXT) {
+            append_squeezed(s_.text, n->v.text.text, ws);
+            append_squeezed(s_.text, " ", ws);
+            return;
+        }
+        if (n->type != GUMBO_NODE_ELEMENT) return;
+        if (n->v.element.tag == GUMBO_TAG_SCRIPT || boilerplate(n)) return;
+        if (container(n->v.element.tag)) {
+            auto it = blocks_.find(n);
+            if (it != blocks_.end() && it->second.link_density() > 0.5) return;
+        }
+        const GumboVector& kids = n->v.element.children;
+        for (unsigned i = 0; i < kids.length; ++i) read(static_cast<GumboNode*>(kids.data[i]), ws);
+    }
+
+    void meta_fallback() {
+        // Later meta tags win, as in ParsedHtml::meta; earlier names in these
+        // lists win over later ones.
+        static const char* const kAuthor[] = {"author", "article:author", "parsely-author", "sailthru.author",
+                                              "dc.creator", "byl", nullptr};
+        static const char* const kPublished[] = {"article:published_time", "og:published_time", "parsely-pub-date",
+                                                 "sailthru.date", "pubdate", "publishdate", "dc.date.issued",
+                                                 "dc.date", "date", nullptr};
+        auto pick = [&](const char* const* names, std::string& out) {
+            if (!out.empty()) return;
+            for (const char* const* n = names; *n && out.empty(); ++n)
+                for (auto it = s_.view.meta.rbegin(); it != s_.view.meta.rend(); ++it)
+                    if (it->first == *n && !it->second.empty()) {
+                        out = it->second;
+                        break;
+                    }
+        };
+        pick(kAuthor, authors_);
+        pick(kPublished, published_);
+    }
+
+    Scratch& s_;
+    std::unordered_map<const GumboNode*, Block> blocks_;
+    std::string authors_, published_;
+};
+
+}  // namespace
+
+void extract_content(GumboNode* root, Scratch& s) {
+    Extractor(s).run(root);
+}
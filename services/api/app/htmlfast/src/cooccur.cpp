@@ -0,0 +1,125 @@
+#include "cooccur.hpp"
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// Field numbers; these must track proto/graph_engine.proto.
+namespace node { enum : uint32_t { kId = 1, kTs = 2, kType = 3, kAttrs = 4 }; }
+namespace edge { enum : uint32_t { kSrc = 1, kDst = 2, kWeight = 3, kTs = 4, kType = 5 }; }
+namespace chunk { enum : uint32_t { kNodes = 1, kEdges = 2 }; }
+enum : uint32_t { kVarint = 0, kFixed64 = 1, kLen = 2 };
+
+void varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+void tag(std::string& out, uint32_t field, uint32_t type) { varint(out, uint64_t(field) << 3 | type); }
+
+// proto3 leaves out default values, and so do these.
+void bytes(std::string& out, uint32_t field, std::string_view s) {
+    if (s.empty()) return;
+    tag(out, field, kLen);
+    varint(out, s.size());
+    out.append(s.data(), s.size());
+}
+void int64(std::string& out, uint32_t field, int64_t v) {
+    if (!v) return;
+    tag(out, field, kVarint);
+    varint(out, uint64_t(v));
+}
+void float64(std::string& out, uint32_t field, double v) {
+    if (v == 0) return;
+    uint64_t bits;
+    std::memcpy(&bits, &v, 8);
+    tag(out, field, kFixed64);
+    for (int i = 0; i < 8; ++i) out.push_back(char(bits >> (8 * i)));
+}
+void message(std::string& out, uint32_t field, std::string_view body) {
+    tag(out, field, kLen);
+    varint(out, body.size());
+    out.append(body.data(), body.size());
+}
+void map_entry(std::string& out, uint32_t field, std::string_view k, std::string_view v, std::string& tmp) {
+    tmp.clear();
+    bytes(tmp, 1, k);
+    bytes(tmp, 2, v);
+    message(out, field, tmp);
+}
+
+bool python_space(unsigned char c) { return (c >= 0x09 && c <= 0x0D) || (c >= 0x1C && c <= 0x20); }
+
+struct Entity {
+    std::string key;
+    const Mention* first;
+    uint32_t mentions;
+};
+
+}  // namespace
+
+bool ascii_entity_key(std::string_view text, std::string& out) {
+    size_t b = 0, e = text.size();
+    for (unsigned char c : text)
+        if (c >= 0x80) return false;
+    while (b < e && python_space(static_cast<unsigned char>(text[b]))) ++b;
+    while (e > b && python_space(static_cast<unsigned char>(text[e - 1]))) --e;
+    out.assign(text.data() + b, e - b);
+    for (char& c : out)
+        if (c >= 'a' && c <= 'z') c = char(c - 32);
+    return true;
+}
+
+void build_ingest_chunk(const DocMentions& doc, std::string& out) {
+    std::vector<Entity> ents;
+    std::unordered_map<std::string_view, size_t> index;
+    ents.reserve(doc.mentions.size());  // never reallocated, so index's views of the keys stay valid
+    index.reserve(doc.mentions.size());
+    for (const Mention& m : doc.mentions) {
+        std::string key = "ent:";
+        key.append(m.label.data(), m.label.size()).append(":").append(m.key.data(), m.key.size());
+        auto it = index.find(key);
+        if (it != index.end()) {
+            ++ents[it->second].mentions;
+            continue;
+        }
+        ents.push_back({std::move(key), &m, 1});
+        index.emplace(ents.back().key, ents.size() - 1);
+    }
+
+    std::string body, tmp;
+    using Attrs = std::initializer_list<std::pair<std::string_view, std::string_view>>;
+    auto add_node = [&](std::string_view id, std::string_view type, Attrs attrs) {
+        body.clear();
+        bytes(body, node::kId, id);
+        int64(body, node::kTs, doc.ts);
+        bytes(body, node::kType, type);
+        for (auto& [k, v] : attrs) map_entry(body, node::kAttrs, k, v, tmp);
+        message(out, chunk::kNodes, body);
+    };
+    auto add_edge = [&](std::string_view src, std::string_view dst, std::string_view type, double weight) {
+        body.clear();
+        bytes(body, edge::kSrc, src);
+        bytes(body, edge::kDst, dst);
+        float64(body, edge::kWeight, weight);
+        int64(body, edge::kTs, doc.ts);
+        bytes(body, edge::kType, type);
+        message(out, chunk::kEdges, body);
+    };
+
+    add_node(doc.id, "doc", {{"title", doc.title}});
+    for (const Entity& e : ents) add_node(e.key, "entity", {{"name", e.first->text}, {"label", e.first->label}});
+    for (const Entity& e : ents) add_edge(doc.id, e.key, "MENTIONS", e.mentions);
+    for (size_t i = 0; i < ents.size(); ++i) {
+        for (size_t j = i + 1; j < ents.size(); ++j) {
+            const Entity& a = ents[i].key < ents[j].key ? ents[i] : ents[j];
+            const Entity& b = &a == &ents[i] ? ents[j] : ents[i];
+            add_edge(a.key, b.key, "CO_OCCUR", std::min(a.mentions, b.mentions));
+        }
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// One document's entity mentions, as the NER stage found them.
+struct Mention {
+    std::string_view text;   // as found; the entity node's name
+    std::string_view label;
+    std::string_view key;    // text upper-cased and stripped, as in "ent:<label>:<key>"
+};
+struct DocMentions {
+    std::string_view id, title;
+    int64_t ts = 0;
+    std::vector<Mention> mentions;
+};
+
+// text.upper().strip() as Python computes it, for ASCII text; false when text
+// has other characters, which the caller must fold itself.
+bool ascii_entity_key(std::string_view text, std::string& out);
+
+// Appends the document's graph to out as one serialized IngestChunk for the
+// engine's BulkIngest: the doc node, one node per entity (named by its first
+// mention), a MENTIONS edge from the doc to each entity weighted by its
+// mentions, and a CO_OCCUR edge per entity pair, from the smaller key to the
+// larger, weighted by the fewer mentions of the two.
+void build_ingest_chunk(const DocMentions& doc, std::string& out);
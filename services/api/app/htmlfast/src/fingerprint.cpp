@@ -0,0 +1,224 @@
+#include "fingerprint.hpp"
+#include <algorithm>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t kShingle = 4;  // words
+constexpr size_t kChunk = 256;  // shingles hashed before they are folded in
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+uint64_t rotl(uint64_t x, int r) { return x << r | x >> (64 - r); }
+
+// The MinHash permutations: x -> a*x + b followed by an xorshift, in 32 bits
+// so four lanes fit a vector register.
+struct Permutations {
+    alignas(16) uint32_t a[kMinHashSize], b[kMinHashSize];
+    Permutations() {
+        uint64_t s = 0x6A09E667F3BCC908ull;
+        for (size_t j = 0; j < kMinHashSize; ++j) {
+            a[j] = uint32_t(mix(s += 0x9E3779B97F4A7C15ull)) | 1;
+            b[j] = uint32_t(mix(s += 0x9E3779B97F4A7C15ull));
+        }
+    }
+};
+const Permutations kPerm;
+
+// Folds n shingle hashes into the MinHash lanes and the SimHash per-bit
+// counts of ones, a group of lanes at a time over every shingle.
+void fold(const uint64_t* h, size_t n, uint32_t* ones, MinHash& mh) {
+    alignas(16) uint32_t x[kChunk];
+    for (size_t i = 0; i < n; ++i) x[i] = uint32_t(h[i] ^ h[i] >> 32);
+#if defined(__SSE2__)
+    // SSE2 has neither a 32-bit low multiply nor an unsigned min: products
+    // come from two 32x32->64 multiplies, and the minimum is kept with the
+    // sign bit flipped so a signed compare orders it.
+    const __m128i lo = _mm_set1_epi64x(0xFFFFFFFF), sign = _mm_set1_epi32(INT32_MIN);
+    for (size_t j = 0; j < kMinHashSize; j += 8) {
+        const __m128i* pa = reinterpret_cast<const __m128i*>(kPerm.a + j);
+        const __m128i* pb = reinterpret_cast<const __m128i*>(kPerm.b + j);
+        __m128i a0 = _mm_load_si128(pa), a1 = _mm_load_si128(pa + 1);
+        __m128i a0odd = _mm_srli_epi64(a0, 32), a1odd = _mm_srli_epi64(a1, 32);
+        __m128i b0 = _mm_load_si128(pb), b1 = _mm_load_si128(pb + 1);
+        __m128i m0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mh.data() + j)), sign);
+        __m128i m1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(mh.data() + j + 4)), sign);
+        auto lane = [&](__m128i xv, __m128i a, __m128i aodd, __m128i b, __m128i& m) {
+            __m128i v = _mm_or_si128(_mm_and_si128(_mm_mul_epu32(a, xv), lo),
+                                     _mm_slli_epi64(_mm_mul_epu32(aodd, xv), 32));
+            v = _mm_add_epi32(v, b);
+            v = _mm_xor_si128(_mm_xor_si128(v, _mm_srli_epi32(v, 15)), sign);
+            __m128i gt = _mm_cmpgt_epi32(m, v);
+            m = _mm_or_si128(_mm_and_si128(gt, v), _mm_andnot_si128(gt, m));
+        };
+        for (size_t i = 0; i < n; ++i) {
+            __m128i xv = _mm_set1_epi32(int32_t(x[i]));
+            lane(xv, a0, a0odd, b0, m0);
+            lane(xv, a1, a1odd, b1, m1);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mh.data() + j), _mm_xor_si128(m0, sign));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(mh.data() + j + 4), _mm_xor_si128(m1, sign));
+    }
+    // Bit k of each hash, as 0 or -1 in lane k, is subtracted from that
+    // lane's count.
+    for (int k = 0; k < 64; k += 8) {
+        __m128i bits0 = _mm_setr_epi32(1 << (k & 31), 2 << (k & 31), 4 << (k & 31), 8 << (k & 31));
+        __m128i bits1 = _mm_slli_epi32(bits0, 4);
+        __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ones + k));
+        __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ones + k + 4));
+        for (size_t i = 0; i < n; ++i) {
+            __m128i w = _mm_set1_epi32(int32_t(uint32_t(h[i] >> (k & 32))));
+            c0 = _mm_sub_epi32(c0, _mm_cmpeq_epi32(_mm_and_si128(w, bits0), bits0));
+            c1 = _mm_sub_epi32(c1, _mm_cmpeq_epi32(_mm_and_si128(w, bits1), bits1));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ones + k), c0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ones + k + 4), c1);
+    }
+#else
+    for (size_t j = 0; j < kMinHashSize; ++j) {
+        const uint32_t a = kPerm.a[j], b = kPerm.b[j];
+        uint32_t m = mh[j];
+        for (size_t i = 0; i < n; ++i) {
+            uint32_t v = a * x[i] + b;
+            v ^= v >> 15;
+            m = std::min(m, v);
+        }
+        mh[j] = m;
+    }
+    for (size_t i = 0; i < n; ++i)
+        for (int k = 0; k < 64; ++k) ones[k] += uint32_t(h[i] >> k & 1);
+#endif
+}
+
+bool word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c >= 0x80;
+}
+
+}  // namespace
+
+void fingerprint(std::string_view text, Fingerprint& out) {
+    uint32_t ones[64] = {};
+    out.minhash.fill(UINT32_MAX);
+    uint64_t words[kShingle] = {};  // the last kShingle word hashes, newest at (n - 1) % kShingle
+    uint64_t buf[kChunk];
+    size_t n = 0, nbuf = 0, total = 0;
+    auto shingle = [&](size_t count) {
+        uint64_t h = 0;
+        for (size_t k = 0; k < count; ++k) h += rotl(words[(n - count + k) % kShingle], int(17 * k + 1));
+        buf[nbuf++] = mix(h);
+        ++total;
+        if (nbuf == kChunk) {
+            fold(buf, nbuf, ones, out.minhash);
+            nbuf = 0;
+        }
+    };
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    const unsigned char* end = p + text.size();
+    while (p < end) {
+        while (p < end && !word_byte(*p)) ++p;
+        if (p == end) break;
+        uint64_t h = 0xCBF29CE484222325ull;  // FNV-1a
+        for (; p < end && word_byte(*p); ++p) {
+            unsigned char c = *p >= 'A' && *p <= 'Z' ? *p | 0x20 : *p;
+            h = (h ^ c) * 0x100000001B3ull;
+        }
+        words[n++ % kShingle] = h;
+        if (n >= kShingle) shingle(kShingle);
+    }
+    if (n > 0 && n < kShingle) shingle(n);
+    if (nbuf) fold(buf, nbuf, ones, out.minhash);
+    out.simhash = 0;
+    if (n == 0) return;
+    for (int k = 0; k < 64; ++k)
+        if (2 * size_t(ones[k]) > total) out.simhash |= uint64_t(1) << k;
+}
+
+bool minhash_empty(const MinHash& m) {
+    return std::all_of(m.begin(), m.end(), [](uint32_t v) { return v == UINT32_MAX; });
+}
+
+double minhash_similarity(const MinHash& a, const MinHash& b) {
+    size_t same = 0;
+    for (size_t j = 0; j < kMinHashSize; ++j) same += a[j] == b[j];
+    return double(same) / double(kMinHashSize);
+}
+
+LshIndex::LshIndex(size_t bands, size_t capacity)
+    : bands_(bands), rows_(bands ? kMinHashSize / bands : 0), capacity_(capacity) {
+    if (bands == 0 || kMinHashSize % bands != 0)
+        throw std::invalid_argument("bands must divide " + std::to_string(kMinHashSize));
+}
+
+uint64_t LshIndex::band_key(const MinHash& sig, size_t band) const {
+    uint64_t h = mix(band + 1);
+    for (size_t r = 0; r < rows_; ++r) h = mix(h ^ sig[band * rows_ + r]);
+    return h;
+}
+
+void LshIndex::erase(uint64_t id) {
+    auto it = entries_.find(id);
+    if (it == entries_.end()) return;
+    for (size_t band = 0; band < bands_; ++band) {
+        auto b = buckets_.find(band_key(it->second.sig, band));
+        if (b == buckets_.end()) continue;
+        auto& ids = b->second;
+        ids.erase(std::remove(ids.begin(), ids.end(), id), ids.end());
+        if (ids.empty()) buckets_.erase(b);
+    }
+    ids_.erase(it->second.key);
+    entries_.erase(it);
+}
+
+void LshIndex::add(const std::string& key, const MinHash& sig) {
+    remove(key);
+    if (minhash_empty(sig)) return;
+    uint64_t id = next_++;
+    ids_.emplace(key, id);
+    entries_.emplace(id, Entry{key, sig});
+    for (size_t band = 0; band < bands_; ++band) buckets_[band_key(sig, band)].push_back(id);
+    if (!capacity_) return;
+    order_.push_back(id);
+    while (entries_.size() > capacity_) {
+        erase(order_.front());
+        order_.pop_front();
+    }
+    if (order_.size() > 2 * entries_.size() + 64) {  // drop ids replaced or removed since
+        order_.erase(std::remove_if(order_.begin(), order_.end(), [&](uint64_t i) { return !entries_.count(i); }),
+                     order_.end());
+    }
+}
+
+bool LshIndex::remove(const std::string& key) {
+    auto it = ids_.find(key);
+    if (it == ids_.end()) return false;
+    erase(it->second);
+    return true;
+}
+
+std::vector<std::pair<std::string, double>> LshIndex::query(const MinHash& sig, double threshold) const {
+    std::vector<std::pair<std::string, double>> out;
+    if (minhash_empty(sig)) return out;
+    std::vector<uint64_t> cand;
+    for (size_t band = 0; band < bands_; ++band) {
+        auto b = buckets_.find(band_key(sig, band));
+        if (b != buckets_.end()) cand.insert(cand.end(), b->second.begin(), b->second.end());
+    }
+    std::sort(cand.begin(), cand.end());
+    cand.erase(std::unique(cand.begin(), cand.end()), cand.end());
+    for (uint64_t id : cand) {
+        const Entry& e = entries_.at(id);
+        double s = minhash_similarity(sig, e.sig);
+        if (s >= threshold) out.emplace_back(e.key, s);
+    }
+    std::sort(out.begin(), out.end(), [](auto& x, auto& y) { return x.second != y.second ? x.second > y.second : x.first < y.first; });
+    return out;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+constexpr size_t kMinHashSize = 64;
+using MinHash = std::array<uint32_t, kMinHashSize>;
+
+// Near-duplicate signatures of a text, over its overlapping four-word
+// shingles (ASCII letters lower-cased). Text without words gets simhash 0 and
+// an empty minhash, which matches nothing.
+struct Fingerprint {
+    uint64_t simhash = 0;
+    MinHash minhash;
+};
+void fingerprint(std::string_view text, Fingerprint& out);
+
+bool minhash_empty(const MinHash& m);
+// The share of lanes two signatures agree on: an estimate of the Jaccard
+// similarity of their shingle sets.
+double minhash_similarity(const MinHash& a, const MinHash& b);
+
+// Banded locality-sensitive hashing over MinHash signatures: keys whose
+// signatures agree on every row of some band are candidates, and candidates
+// are then checked against the threshold. With the default 16 bands of 4
+// rows, pairs above 0.8 are found all but always. Not thread-safe.
+class LshIndex {
+public:
+    // bands must divide kMinHashSize. Past capacity (0: none) the oldest key
+    // is dropped.
+    explicit LshIndex(size_t bands = 16, size_t capacity = 0);
+
+    void add(const std::string& key, const MinHash& sig);  // replaces what key had
+    bool remove(const std::string& key);
+    // Keys at or above threshold similarity, most similar first.
+    std::vector<std::pair<std::string, double>> query(const MinHash& sig, double threshold) const;
+    size_t size() const { return entries_.size(); }
+
+private:
+    struct Entry {
+        std::string key;
+        MinHash sig;
+    };
+    uint64_t band_key(const MinHash& sig, size_t band) const;
+    void erase(uint64_t id);
+
+    size_t bands_, rows_, capacity_;
+    uint64_t next_ = 0;
+    std::unordered_map<std::string, uint64_t> ids_;
+    std::unordered_map<uint64_t, Entry> entries_;
+    std::unordered_map<uint64_t, std::vector<uint64_t>> buckets_;  // band key -> ids
+    std::deque<uint64_t> order_;  // ids by age when capped; may hold ones since erased
+};
@@ -1,18 +1,27 @@
 #include "html_parser.hpp"
+#include "scratch.hpp"
+#include "url.hpp"
 #include <gumbo.h>
 #include <algorithm>
 #include <cctype>
 
+namespace {
+
+void* arena_alloc(void* arena, size_t n) { return static_cast<Arena*>(arena)->alloc(n); }
+void arena_free(void*, void*) {}
+
+}  // namespace
+
 static std::string to_lower(std::string s) {
     std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c){return std::tolower(c);});
     return s;
 }
 
-static void extract_text(GumboNode* node, std::string& out) {
+static void extract_text(GumboNode* node, std::string& out, bool& ws) {
     if (!node) return;
     if (node->type == GUMBO_NODE_TEXT) {
-        out.append(node->v.text.text);
-        out.push_back(' ');
+        append_squeezed(out, node->v.text.text, ws);
+        append_squeezed(out, " ", ws);
         return;
     }
     if (node->type == GUMBO_NODE_ELEMENT &&
@@ -22,11 +31,11 @@ static void extract_text(GumboNode* node, std::string& out) {
     if (node->type == GUMBO_NODE_ELEMENT) {
         GumboVector* children = &node->v.element.children;
         for (unsigned i = 0; i < children->length; ++i)
-            extract_text(static_cast<GumboNode*>(children->data[i]), out);
+            extract_text(static_cast<GumboNode*>(children->data[i]), out, ws);
     }
 }
 
-static void walk(GumboNode* node, ParsedHtml& out) {
+static void walk(GumboNode* node, HtmlView& out, std::string_view& base) {
     if (!node || node->type != GUMBO_NODE_ELEMENT) return;
     GumboTag tag = node->v.element.tag;
 
@@ -41,8 +50,8 @@ static void walk(GumboNode* node, ParsedHtml& out) {
         GumboAttribute* p = gumbo_get_attribute(&node->v.element.attributes, "property");
         GumboAttribute* c = gumbo_get_attribute(&node->v.element.attributes, "content");
         if (c) {
-            if (n) out.meta[to_lower(n->value)] = c->value;
-            if (p) out.meta[to_lower(p->value)] = c->value;
+            if (n) out.meta.emplace_back(to_lower(n->value), c->value);
+            if (p) out.meta.emplace_back(to_lower(p->value), c->value);
         }
     }
     if (tag == GUMBO_TAG_LINK) {
@@ -53,6 +62,10 @@ static void walk(GumboNode* node, ParsedHtml& out) {
             if (relv.find("canonical") != std::string::npos) out.canonical = href->value;
         }
     }
+    if (tag == GUMBO_TAG_BASE && !base.data()) {
+        GumboAttribute* href = gumbo_get_attribute(&node->v.element.attributes, "href");
+        if (href) base = href->value;
+    }
     if (tag == GUMBO_TAG_A) {
         GumboAttribute* href = gumbo_get_attribute(&node->v.element.attributes, "href");
         if (href && href->value && href->value[0] != '\0')
@@ -60,27 +73,125 @@ static void walk(GumboNode* node, ParsedHtml& out) {
     }
     GumboVector* children = &node->v.element.children;
     for (unsigned i = 0; i < children->length; ++i)
-        walk(static_cast<GumboNode*>(children->data[i]), out);
+        walk(static_cast<GumboNode*>(children->data[i]), out, base);
 }
 
-ParsedHtml parse_html_gumbo(const std::string& html, const std::string& /*base_url*/) {
-    ParsedHtml out;
-    GumboOutput* dom = gumbo_parse(html.c_str());
-    walk(dom->root, out);
-    std::string text;
-    extract_text(dom->root, text);
+static void clear(Scratch& s) {
+    HtmlView& out = s.view;
+    out.title = out.canonical = out.author = out.published = {};
+    out.meta.clear();
+    out.links.clear();
+    out.internal_links.clear();
+    out.external_links.clear();
+    s.text.clear();
+    s.base_href = {};
+}
 
-    std::string sq;
-    sq.reserve(text.size());
-    bool ws = false;
-    for (char ch : text) {
-        if (std::isspace(static_cast<unsigned char>(ch))) {
-            if (!ws) { sq.push_back(' '); ws = true; }
-        } else { sq.push_back(ch); ws = false; }
-    }
+// Without a base_url the links stay as written, sorted and each once, as
+// before base_url existed: relative ones count as internal, absolute ones as
+// internal when on the canonical URL's site.
+static void keep_links(Scratch& s) {
+    HtmlView& out = s.view;
     std::sort(out.links.begin(), out.links.end());
     out.links.erase(std::unique(out.links.begin(), out.links.end()), out.links.end());
-    out.text = sq;
-    gumbo_destroy_output(&kGumboDefaultOptions, dom);
+    UrlParts site{}, link{};
+    bool has_site = split_url(out.canonical, site);
+    for (std::string_view url : out.links) {
+        bool internal = !split_url(url, link) || (has_site && same_site(link.host, site.host));
+        (internal ? out.internal_links : out.external_links).push_back(url);
+    }
+}
+
+// Resolves the links and canonical against <base href> or base_url, and keeps
+// each web page linked to once, in document order and apart from the page
+// itself. A base_url that is not absolute leaves relative links unresolvable,
+// so they are dropped, and those on the canonical URL's site count as internal.
+static void resolve_links(std::string_view base_url, Scratch& s) {
+    HtmlView& out = s.view;
+    if (base_url.empty()) {
+        keep_links(s);
+        return;
+    }
+    UrlParts page{}, base{}, link{};
+    std::string_view self;
+    const UrlParts* against = nullptr;
+    if (normalize_url(base_url, nullptr, s.url)) {
+        self = s.arena.keep(s.url);
+        split_url(self, page);
+        against = &page;
+    }
+    if (s.base_href.data() && normalize_url(s.base_href, against, s.url)) {
+        split_url(s.arena.keep(s.url), base);
+        against = &base;
+    }
+    auto resolve = [&](std::string_view ref) -> std::string_view {
+        if (!normalize_url(ref, against, s.url)) return {};
+        return s.url == ref ? ref : s.arena.keep(s.url);
+    };
+    if (!out.canonical.empty()) {
+        std::string_view c = resolve(out.canonical);
+        if (!c.empty()) out.canonical = c;
+    }
+    std::string_view site = page.host;
+    if (site.empty() && split_url(out.canonical, link)) site = link.host;
+
+    s.seen.clear();
+    size_t n = 0;
+    for (std::string_view ref : out.links) {
+        std::string_view url = resolve(ref);
+        if (url.empty() || url == self || !s.seen.insert(url).second) continue;
+        out.links[n++] = url;
+        split_url(url, link);
+        (!site.empty() && same_site(link.host, site) ? out.internal_links : out.external_links).push_back(url);
+    }
+    out.links.resize(n);
+}
+
+void parse_html_view(std::string_view html, std::string_view base_url, const ParseOptions& opt,
+                     const HtmlViewSink& sink) {
+    Scratch& s = scratch();
+    // The views point into the arena: it is reset once the sink is done with
+    // them, or throws.
+    struct Reset {
+        Arena& arena;
+        ~Reset() { arena.reset(); }
+    } reset{s.arena};
+    HtmlView& out = s.view;
+    clear(s);
+    if (opt.main_content || !opt.stream || !parse_stream(html, s)) {
+        clear(s);
+        GumboOptions gopt = kGumboDefaultOptions;
+        gopt.allocator = arena_alloc;
+        gopt.deallocator = arena_free;
+        gopt.userdata = &s.arena;
+        GumboOutput* dom = gumbo_parse_with_options(&gopt, html.data(), html.size());
+        walk(dom->root, out, s.base_href);
+        if (opt.main_content) {
+            extract_content(dom->root, s);
+        } else {
+            bool ws = false;
+            extract_text(dom->root, s.text, ws);
+        }
+    }
+    resolve_links(base_url, s);
+    out.text = s.text;
+    fingerprint(out.text, out.fingerprint);
+    sink(out);
+}
+
+ParsedHtml parse_html_gumbo(std::string_view html, std::string_view base_url, const ParseOptions& opt) {
+    ParsedHtml out;
+    parse_html_view(html, base_url, opt, [&](const HtmlView& v) {
+        out.title = v.title;
+        out.canonical = v.canonical;
+        for (auto& [k, val] : v.meta) out.meta[k] = val;
+        out.links.assign(v.links.begin(), v.links.end());
+        out.internal_links.assign(v.internal_links.begin(), v.internal_links.end());
+        out.external_links.assign(v.external_links.begin(), v.external_links.end());
+        out.text = v.text;
+        out.author = v.author;
+        out.published = v.published;
+        out.fingerprint = v.fingerprint;
+    });
     return out;
 }
@@ -1,5 +1,9 @@
 #pragma once
+#include "fingerprint.hpp"
+#include <functional>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <unordered_map>
 
@@ -7,7 +11,53 @@ struct ParsedHtml {
     std::string title;
     std::unordered_map<std::string, std::string> meta;
     std::string canonical;
-    std::vector<std::string> links;
+    std::vector<std::string> links, internal_links, external_links;
     std::string text;
+    std::string author, published;
+    Fingerprint fingerprint;
 };
-ParsedHtml parse_html_gumbo(const std::string& html, const std::string& base_url = "");
+
+// A parsed document as views into the parser's own buffers, valid only for
+// the callback it is passed to.
+struct HtmlView {
+    std::string_view title, canonical;
+    std::vector<std::pair<std::string, std::string_view>> meta;  // lower-cased names in document order; later ones win
+    // Given a base_url, absolute and normalized (see normalize_url), each once
+    // in document order; without one, as written, sorted and each once.
+    // internal_links are those on the page's own site.
+    std::vector<std::string_view> links, internal_links, external_links;
+    std::string_view text;                                       // visible text, whitespace collapsed
+    std::string_view author, published;                          // main_content only; see ParseOptions
+    Fingerprint fingerprint;                                     // of text
+};
+using HtmlViewSink = std::function<void(const HtmlView&)>;
+
+struct ParseOptions {
+    // Read the page in one pass over its tokens instead of building it a Gumbo
+    // DOM. The fields come out the same for pages Gumbo need not repair
+    // (misnested or stray tags may move a space); text the tokenizer does
+    // not handle itself (an entity it does not know, <plaintext>, NULs) sends
+    // the page to Gumbo.
+    bool stream = false;
+    // Keep only the article body in `text`: blocks are scored by the prose
+    // they hold and how little of it is link text, and nav, footers, asides,
+    // forms and comment or share widgets are dropped. Also fills `author`
+    // (names joined by ", ") and `published` (as written) from JSON-LD, else
+    // from meta tags. Needs the DOM, so it takes precedence over `stream`.
+    bool main_content = false;
+};
+
+// Each thread parses with an arena and output buffers it keeps between
+// documents, so none is reallocated per page. `html` is read in place.
+void parse_html_view(std::string_view html, std::string_view base_url, const ParseOptions& opt,
+                     const HtmlViewSink& sink);
+ParsedHtml parse_html_gumbo(std::string_view html, std::string_view base_url = {}, const ParseOptions& opt = {});
+// Parses every document on a shared pool of threads, one per core, calling
+// sink(i, view) for htmls[i] on whichever thread parsed it. base_urls is empty
+// or holds one URL per document.
+using HtmlBatchSink = std::function<void(size_t, const HtmlView&)>;
+void parse_html_batch(const std::vector<std::string_view>& htmls, const std::vector<std::string_view>& base_urls,
+                      const ParseOptions& opt, const HtmlBatchSink& sink);
+std::vector<ParsedHtml> parse_html_batch(const std::vector<std::string_view>& htmls,
+                                         const std::vector<std::string_view>& base_urls = {},
+                                         const ParseOptions& opt = {});
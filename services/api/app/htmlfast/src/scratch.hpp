@@ -0,0 +1,92 @@
+#pragma once
+// Parser state kept per thread between documents; internal to htmlfast.
+#include "html_parser.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <unordered_set>
+
+// Bump allocator for one document: its Gumbo tree, or the decoded strings
+// the stream parser returns. Gumbo frees node by node; here nothing is freed
+// until reset(), which keeps the memory for the next document on the same
+// thread.
+class Arena {
+public:
+    void* alloc(size_t n) {
+        n = (n + kAlign - 1) & ~(kAlign - 1);
+        if (!cur_ || n > size_t(end_ - cur_)) grow(n);
+        void* p = cur_;
+        cur_ += n;
+        return p;
+    }
+    // A copy of s that lives until reset().
+    std::string_view keep(std::string_view s) {
+        char* p = static_cast<char*>(alloc(s.size()));
+        if (!s.empty()) std::memcpy(p, s.data(), s.size());
+        return {p, s.size()};
+    }
+    // Merges the blocks into one as large as they were, so a document like the
+    // last fits in a single block; a huge one is not held on to.
+    void reset() {
+        size_t total = 0;
+        for (auto& b : blocks_) total += b.second;
+        if (blocks_.size() > 1 || total > kMaxKept) {
+            blocks_.clear();
+            cur_ = end_ = nullptr;
+            if (total <= kMaxKept) grow(total);
+        }
+        if (!blocks_.empty()) cur_ = blocks_.back().first.get();
+    }
+private:
+    static constexpr size_t kAlign = alignof(std::max_align_t), kBlock = 256 << 10, kMaxKept = 64 << 20;
+    void grow(size_t n) {
+        size_t size = std::max(n, blocks_.empty() ? kBlock : blocks_.back().second * 2);
+        blocks_.emplace_back(std::make_unique<char[]>(size), size);
+        cur_ = blocks_.back().first.get();
+        end_ = cur_ + size;
+    }
+    std::vector<std::pair<std::unique_ptr<char[]>, size_t>> blocks_;
+    char* cur_ = nullptr;
+    char* end_ = nullptr;
+};
+
+// What a thread reuses from one parse to the next.
+struct Scratch {
+    Arena arena;
+    std::string text, buf, url;
+    HtmlView view;
+    std::string_view base_href;  // the first <base href>, as written
+    std::unordered_set<std::string_view> seen;
+};
+
+inline Scratch& scratch() {
+    thread_local Scratch s;
+    return s;
+}
+
+// Appends s with each whitespace run collapsed to one space; `ws` carries
+// whether out ends in one across calls. Returns whether s had anything but
+// whitespace.
+inline bool append_squeezed(std::string& out, std::string_view s, bool& ws) {
+    bool any = false;
+    for (size_t i = 0; i < s.size();) {
+        size_t j = i;
+        while (j < s.size() && !std::isspace(static_cast<unsigned char>(s[j]))) ++j;
+        if (j > i) { out.append(s.data() + i, j - i); ws = false; any = true; }
+        if (j == s.size()) break;
+        if (!ws) { out.push_back(' '); ws = true; }
+        for (i = j + 1; i < s.size() && std::isspace(static_cast<unsigned char>(s[i])); ++i) {}
+    }
+    return any;
+}
+
+// Fills s.text with the main content of the page under root, and s.view's
+// author and published; s.view.meta must already be filled.
+struct GumboInternalNode;
+void extract_content(GumboInternalNode* root, Scratch& s);
+
+// Fills s.view and s.text from html in one pass, without a DOM. Returns false,
+// leaving both to be reset, on markup it leaves to Gumbo.
+bool parse_stream(std::string_view html, Scratch& s);
@@ -0,0 +1,532 @@
+// Single-pass extraction straight from the HTML tokens, after the HTML5
+// tokenizer rules, with just enough of the tree builder (open elements, raw
+// text elements, templates, svg/math) to give the fields the Gumbo walk does.
+#include "scratch.hpp"
+#include <cstdint>
+#include <unordered_map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// The first '<' or '&' in [p, end), or end.
+const char* find_markup(const char* p, const char* end) {
+#if defined(__SSE2__)
+    const __m128i lt = _mm_set1_epi8('<'), amp = _mm_set1_epi8('&');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, lt), _mm_cmpeq_epi8(v, amp)));
+        if (m) return p + __builtin_ctz(unsigned(m));
+    }
+#endif
+    while (p < end && *p != '<' && *p != '&') ++p;
+    return p;
+}
+
+bool is_ws(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\f' || c == '\r'; }
+bool is_alpha(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+bool is_alnum(char c) { return is_alpha(c) || (c >= '0' && c <= '9'); }
+char lower(char c) { return c >= 'A' && c <= 'Z' ? char(c | 0x20) : c; }
+
+bool iequals(std::string_view a, std::string_view lower_b) {
+    if (a.size() != lower_b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (lower(a[i]) != lower_b[i]) return false;
+    return true;
+}
+
+void utf8(uint32_t cp, std::string& out) {
+    if (cp < 0x80) {
+        out.push_back(char(cp));
+    } else if (cp < 0x800) {
+        out.push_back(char(0xC0 | cp >> 6));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    } else if (cp < 0x10000) {
+        out.push_back(char(0xE0 | cp >> 12));
+        out.push_back(char(0x80 | (cp >> 6 & 0x3F)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    } else {
+        out.push_back(char(0xF0 | cp >> 18));
+        out.push_back(char(0x80 | (cp >> 12 & 0x3F)));
+        out.push_back(char(0x80 | (cp >> 6 & 0x3F)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Named references: the Latin-1 ones, which may also appear without their
+// ';', and the common rest. A ';'-terminated name missing here goes to Gumbo.
+struct Entities {
+    std::unordered_map<std::string_view, uint32_t> all, legacy;
+    Entities() {
+        static const char* const latin1[] = {
+            "nbsp", "iexcl", "cent", "pound", "curren", "yen", "brvbar", "sect", "uml", "copy", "ordf", "laquo",
+            "not", "shy", "reg", "macr", "deg", "plusmn", "sup2", "sup3", "acute", "micro", "para", "middot",
+            "cedil", "sup1", "ordm", "raquo", "frac14", "frac12", "frac34", "iquest", "Agrave", "Aacute", "Acirc",
+            "Atilde", "Auml", "Aring", "AElig", "Ccedil", "Egrave", "Eacute", "Ecirc", "Euml", "Igrave", "Iacute",
+            "Icirc", "Iuml", "ETH", "Ntilde", "Ograve", "Oacute", "Ocirc", "Otilde", "Ouml", "times", "Oslash",
+            "Ugrave", "Uacute", "Ucirc", "Uuml", "Yacute", "THORN", "szlig", "agrave", "aacute", "acirc", "atilde",
+            "auml", "aring", "aelig", "ccedil", "egrave", "eacute", "ecirc", "euml", "igrave", "iacute", "icirc",
+            "iuml", "eth", "ntilde", "ograve", "oacute", "ocirc", "otilde", "ouml", "divide", "oslash", "ugrave",
+            "uacute", "ucirc", "uuml", "yacute", "thorn", "yuml"};
+        for (uint32_t i = 0; i < 96; ++i) legacy[latin1[i]] = 0xA0 + i;
+        for (auto [n, cp] : {std::pair<const char*, uint32_t>{"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'},
+                             {"AMP", '&'}, {"LT", '<'}, {"GT", '>'}, {"QUOT", '"'}, {"COPY", 0xA9}, {"REG", 0xAE}})
+            legacy[n] = cp;
+        all = legacy;
+        static const std::pair<const char*, uint32_t> rest[] = {
+            {"apos", '\''}, {"Tab", '\t'}, {"NewLine", '\n'}, {"OElig", 0x152}, {"oelig", 0x153},
+            {"Scaron", 0x160}, {"scaron", 0x161}, {"Yuml", 0x178}, {"fnof", 0x192}, {"circ", 0x2C6},
+            {"tilde", 0x2DC}, {"Alpha", 0x391}, {"Beta", 0x392}, {"Gamma", 0x393}, {"Delta", 0x394},
+            {"Omega", 0x3A9}, {"alpha", 0x3B1}, {"beta", 0x3B2}, {"gamma", 0x3B3}, {"delta", 0x3B4},
+            {"epsilon", 0x3B5}, {"lambda", 0x3BB}, {"mu", 0x3BC}, {"pi", 0x3C0}, {"sigma", 0x3C3},
+            {"omega", 0x3C9}, {"ensp", 0x2002}, {"emsp", 0x2003}, {"thinsp", 0x2009}, {"zwnj", 0x200C},
+            {"zwj", 0x200D}, {"lrm", 0x200E}, {"rlm", 0x200F}, {"ndash", 0x2013}, {"mdash", 0x2014},
+            {"lsquo", 0x2018}, {"rsquo", 0x2019}, {"sbquo", 0x201A}, {"ldquo", 0x201C}, {"rdquo", 0x201D},
+            {"bdquo", 0x201E}, {"dagger", 0x2020}, {"Dagger", 0x2021}, {"bull", 0x2022}, {"hellip", 0x2026},
+            {"permil", 0x2030}, {"prime", 0x2032}, {"Prime", 0x2033}, {"lsaquo", 0x2039}, {"rsaquo", 0x203A},
+            {"oline", 0x203E}, {"frasl", 0x2044}, {"euro", 0x20AC}, {"trade", 0x2122}, {"larr", 0x2190},
+            {"uarr", 0x2191}, {"rarr", 0x2192}, {"darr", 0x2193}, {"harr", 0x2194}, {"minus", 0x2212},
+            {"infin", 0x221E}, {"asymp", 0x2248}, {"ne", 0x2260}, {"le", 0x2264}, {"ge", 0x2265},
+            {"sdot", 0x22C5}, {"loz", 0x25CA}, {"spades", 0x2660}, {"clubs", 0x2663}, {"hearts", 0x2665},
+            {"diams", 0x2666}, {"check", 0x2713}, {"star", 0x2606}, {"starf", 0x2605}};
+        for (auto& [n, cp] : rest) all[n] = cp;
+    }
+};
+
+// What &#128; .. &#159; stand for: windows-1252, as browsers read them.
+constexpr uint16_t kC1[32] = {0x20AC, 0x81, 0x201A, 0x192, 0x201E, 0x2026, 0x2020, 0x2021, 0x2C6, 0x2030, 0x160,
+                              0x2039, 0x152, 0x8D, 0x17D, 0x8F, 0x90, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022,
+                              0x2013, 0x2014, 0x2DC, 0x2122, 0x161, 0x203A, 0x153, 0x9D, 0x17E, 0x178};
+
+// Decodes the character reference at p, which points at '&', onto out.
+// Returns the end of what it read, or nullptr to leave the page to Gumbo.
+const char* char_ref(const char* p, const char* end, bool in_attr, std::string& out) {
+    static const Entities kEntities;
+    const char* q = p + 1;
+    if (q < end && *q == '#') {
+        ++q;
+        bool hex = q < end && (*q | 0x20) == 'x';
+        if (hex) ++q;
+        uint32_t cp = 0;
+        const char* digits = q;
+        for (; q < end; ++q) {
+            int d = *q >= '0' && *q <= '9' ? *q - '0' : hex && (*q | 0x20) >= 'a' && (*q | 0x20) <= 'f' ? (*q | 0x20) - 'a' + 10 : -1;
+            if (d < 0) break;
+            cp = std::min<uint32_t>(cp * (hex ? 16 : 10) + uint32_t(d), 0x110000);
+        }
+        if (q == digits) {  // not a reference after all
+            out.append(p, size_t(digits - p));
+            return digits;
+        }
+        if (q < end && *q == ';') ++q;
+        if (cp >= 0x80 && cp < 0xA0) cp = kC1[cp - 0x80];
+        if (cp == 0 || cp > 0x10FFFF || (cp >= 0xD800 && cp < 0xE000)) cp = 0xFFFD;
+        utf8(cp, out);
+        return q;
+    }
+    while (q < end && is_alnum(*q)) ++q;
+    std::string_view name(p + 1, size_t(q - p - 1));
+    if (q < end && *q == ';' && !name.empty()) {
+        auto it = kEntities.all.find(name);
+        if (it == kEntities.all.end()) return nullptr;
+        utf8(it->second, out);
+        return q + 1;
+    }
+    // Without its ';' only a Latin-1 name counts, longest match first, and in
+    // an attribute only when nothing that could continue it follows.
+    for (size_t n = std::min<size_t>(name.size(), 6); n >= 2; --n) {
+        auto it = kEntities.legacy.find(name.substr(0, n));
+        if (it == kEntities.legacy.end()) continue;
+        const char* after = p + 1 + n;
+        if (in_attr && after < end && (is_alnum(*after) || *after == '=')) break;
+        utf8(it->second, out);
+        return after;
+    }
+    out.push_back('&');
+    return p + 1;
+}
+
+bool is_void(std::string_view t) {
+    static const char* const kVoid[] = {"area", "base", "br", "col", "embed", "hr", "img", "input", "keygen",
+                                        "link", "meta", "param", "source", "track", "wbr"};
+    for (const char* v : kVoid)
+        if (t == v) return true;
+    return false;
+}
+
+class Stream {
+public:
+    Stream(std::string_view html, Scratch& s)
+        : p_(html.data()), end_(html.data() + html.size()), s_(s), out_(s.view) {}
+
+    bool run() {
+        while (p_ < end_) {
+            if (!raw_.empty()) {
+                if (!raw_text()) return false;
+                continue;
+            }
+            const char* q = find_markup(p_, end_);
+            text(p_, q);
+            p_ = q;
+            if (p_ == end_) break;
+            if (*p_ == '&') {
+                if (!ref()) return false;
+            } else if (!markup()) {
+                return false;
+            }
+        }
+        boundary();
+        return true;
+    }
+
+private:
+    enum Raw { kSkip, kRcdata, kRawtext };
+
+    void text(const char* a, const char* b) { add(std::string_view(a, size_t(b - a))); }
+    // Adds to the current run of text.
+    void add(std::string_view t) {
+        if (visible()) run_text_ |= append_squeezed(s_.text, t, ws_);
+        if (capture_)
+            for (char c : t) capture_text(c);
+    }
+    // A title keeps its own whitespace, with CR and CRLF read as LF.
+    void capture_text(char c) {
+        if (c == '\n' && cr_) { cr_ = false; return; }
+        cr_ = c == '\r';
+        title_.push_back(cr_ ? '\n' : c);
+    }
+    bool visible() const { return !skip_ && !hidden_; }
+
+    bool ref() {
+        ref_.clear();
+        const char* q = char_ref(p_, end_, false, ref_);
+        if (!q) return false;
+        add(ref_);
+        p_ = q;
+        return true;
+    }
+
+    // Gumbo makes each run of text between tags or comments a node and adds
+    // a space after it; runs that are all whitespace are nodes it skips.
+    void boundary() {
+        if (run_text_) {
+            append_squeezed(s_.text, " ", ws_);
+        } else {
+            s_.text.resize(run_start_);
+            ws_ = run_ws_;
+        }
+        if (capture_) {
+            // Like the walk, only a first child that is text names the page.
+            bool any = std::any_of(title_.begin(), title_.end(), [](char c) { return !is_ws(c); });
+            if (any && !skip_) out_.title = s_.arena.keep(title_);
+            capture_ = false;
+        }
+        run_start_ = s_.text.size();
+        run_ws_ = ws_;
+        run_text_ = false;
+    }
+
+    // Content of a raw text element, up to its end tag.
+    bool raw_text() {
+        for (const char* q = p_;;) {
+            const char* lt = static_cast<const char*>(std::memchr(q, '<', size_t(end_ - q)));
+            if (!lt) lt = end_;
+            if (raw_kind_ == kRcdata) {
+                while (p_ < lt) {
+                    const char* amp = static_cast<const char*>(std::memchr(p_, '&', size_t(lt - p_)));
+                    if (!amp) break;
+                    text(p_, amp);
+                    p_ = amp;
+                    if (!ref()) return false;
+                }
+            }
+            if (raw_kind_ != kSkip) text(p_, lt);
+            p_ = lt;
+            if (lt == end_) return true;
+            // Only "</name" followed by whitespace, '/' or '>' ends it.
+            const char* n = lt + 2;
+            if (lt + 1 < end_ && lt[1] == '/' && size_t(end_ - n) > raw_.size() &&
+                iequals(std::string_view(n, raw_.size()), raw_) &&
+                (is_ws(n[raw_.size()]) || n[raw_.size()] == '/' || n[raw_.size()] == '>')) {
+                const char* t = n + raw_.size();
+                raw_.clear();
+                skip_tag(t);
+                boundary();
+                return true;
+            }
+            if (raw_kind_ != kSkip) text(lt, lt + 1);
+            p_ = q = lt + 1;
+        }
+    }
+
+    // Skips the rest of a tag, attributes included; false at end of input.
+    bool skip_tag(const char* t) {
+        return attributes(t, [](std::string_view, std::string_view) {});
+    }
+
+    // Reads the attributes from t to the tag's '>', calling f(name, raw value)
+    // for each; `self_closing_` is set if the tag ends in "/>". Returns false
+    // if the input ends first, where the tokenizer drops the tag.
+    template <class F>
+    bool attributes(const char* t, F&& f) {
+        self_closing_ = false;
+        for (;;) {
+            while (t < end_ && (is_ws(*t) || *t == '/')) {
+                if (*t == '/' && t + 1 < end_ && t[1] == '>') self_closing_ = true;
+                ++t;
+            }
+            if (t >= end_) { p_ = end_; return false; }
+            if (*t == '>') { p_ = t + 1; return true; }
+            const char* a = t++;
+            while (t < end_ && !is_ws(*t) && *t != '/' && *t != '>' && *t != '=') ++t;
+            std::string_view name(a, size_t(t - a));
+            while (t < end_ && is_ws(*t)) ++t;
+            std::string_view value;
+            if (t < end_ && *t == '=') {
+                ++t;
+                while (t < end_ && is_ws(*t)) ++t;
+                if (t < end_ && (*t == '"' || *t == '\'')) {
+                    const char* close = static_cast<const char*>(std::memchr(t + 1, *t, size_t(end_ - t - 1)));
+                    if (!close) { p_ = end_; return false; }
+                    value = std::string_view(t + 1, size_t(close - t - 1));
+                    t = close + 1;
+                } else {
+                    const char* v = t;
+                    while (t < end_ && !is_ws(*t) && *t != '>') ++t;
+                    value = std::string_view(v, size_t(t - v));
+                }
+            }
+            f(name, value);
+        }
+    }
+
+    // An attribute value with references decoded and CRs read as LFs, kept
+    // for the view; as is when there is nothing to decode.
+    bool attr_value(std::string_view raw, std::string_view& out) {
+        if (raw.find_first_of("&\r") == std::string_view::npos) { out = raw; return true; }
+        std::string& v = s_.buf;
+        v.clear();
+        for (const char* p = raw.data(), *e = p + raw.size(); p < e;) {
+            if (*p == '&') {
+                p = char_ref(p, e, true, v);
+                if (!p) return false;
+            } else if (*p == '\r') {
+                v.push_back('\n');
+                if (++p < e && *p == '\n') ++p;
+            } else {
+                v.push_back(*p++);
+            }
+        }
+        out = s_.arena.keep(v);
+        return true;
+    }
+
+    bool markup() {
+        const char* lt = p_;
+        if (lt + 1 >= end_) { text(lt, end_); p_ = end_; return true; }
+        char c = lt[1];
+        if (c == '!') return declaration();
+        if (c == '?') return bogus_comment(lt + 2);
+        if (c == '/') {
+            if (lt + 2 >= end_) { text(lt, end_); p_ = end_; return true; }
+            if (lt[2] == '>') { p_ = lt + 3; return true; }
+            if (!is_alpha(lt[2])) return bogus_comment(lt + 2);
+            return end_tag(lt + 2);
+        }
+        if (!is_alpha(c)) { text(lt, lt + 1); p_ = lt + 1; return true; }
+        return start_tag(lt + 1);
+    }
+
+    bool declaration() {
+        std::string_view rest(p_, size_t(end_ - p_));
+        if (rest.substr(0, 4) == "<!--") {
+            // "<!-->" and "<!--->" are empty comments; otherwise "-->" or
+            // "--!>" ends one, and the end of input does as well.
+            size_t i = 4;
+            if (rest.substr(4, 1) == ">") i = 5;
+            else if (rest.substr(4, 2) == "->") i = 6;
+            else {
+                for (i = rest.find("--", 4); i != std::string_view::npos; i = rest.find("--", i + 1)) {
+                    if (rest.substr(i + 2, 1) == ">") { i += 3; break; }
+                    if (rest.substr(i + 2, 2) == "!>") { i += 4; break; }
+                }
+                if (i == std::string_view::npos) i = rest.size();
+            }
+            p_ += i;
+            boundary();
+            return true;
+        }
+        if (foreign_ && rest.substr(0, 9) == "<![CDATA[") {
+            size_t i = rest.find("]]>", 9);
+            p_ += i == std::string_view::npos ? rest.size() : i + 3;
+            boundary();
+            return true;
+        }
+        if (rest.size() >= 9 && iequals(rest.substr(2, 7), "doctype")) {
+            const char* gt = static_cast<const char*>(std::memchr(p_, '>', rest.size()));
+            p_ = gt ? gt + 1 : end_;
+            return true;
+        }
+        return bogus_comment(p_ + 2);
+    }
+
+    bool bogus_comment(const char* t) {
+        const char* gt = static_cast<const char*>(std::memchr(t, '>', size_t(end_ - t)));
+        p_ = gt ? gt + 1 : end_;
+        boundary();
+        return true;
+    }
+
+    // The tag name at t, lower-cased into name_; returns where it ends.
+    const char* tag_name(const char* t) {
+        name_.clear();
+        while (t < end_ && !is_ws(*t) && *t != '/' && *t != '>') name_.push_back(lower(*t++));
+        return t;
+    }
+
+    bool start_tag(const char* t) {
+        t = tag_name(t);
+        const std::string& tag = name_;
+        std::string_view name, property, content, rel, href;
+        bool wanted = !skip_ && (tag == "meta" || tag == "link" || tag == "a" || tag == "base");
+        bool ok = wanted ? attributes(t, [&](std::string_view k, std::string_view v) {
+            auto take = [&](std::string_view& field, const char* want) {
+                if (field.data() == nullptr && iequals(k, want)) field = v.data() ? v : std::string_view("", 0);
+            };
+            take(name, "name"); take(property, "property"); take(content, "content");
+            take(rel, "rel"); take(href, "href");
+        }) : skip_tag(t);
+        if (!ok) return true;  // the input ended inside the tag, which is dropped
+        if (tag == "html" || tag == "head" || tag == "body") return true;
+        boundary();
+        if (skip_) {
+            if (tag == "template") ++skip_;
+            else if (!foreign_ && (tag == "script" || tag == "style" || tag == "title" || tag == "textarea" ||
+                                   tag == "xmp" || tag == "iframe" || tag == "noembed" || tag == "noframes"))
+                enter_raw(tag, kSkip);
+            return true;
+        }
+        if (wanted && !record(tag, name, property, content, rel, href)) return false;
+        bool closed = foreign_ && self_closing_;
+        if (!foreign_) {
+            if (tag == "template") { open_.push_back(tag); ++skip_; return true; }
+            if (tag == "script" || tag == "style") { enter_raw(tag, kSkip); return true; }
+            if (tag == "title" || tag == "textarea") {
+                if (tag == "title") start_capture();
+                enter_raw(tag, kRcdata);
+                return true;
+            }
+            if (tag == "xmp" || tag == "iframe" || tag == "noembed" || tag == "noframes") {
+                enter_raw(tag, kRawtext);
+                return true;
+            }
+            if (tag == "plaintext") return false;
+            if (is_void(tag)) return true;
+            closed = (tag == "svg" || tag == "math") && self_closing_;
+        }
+        if (closed) return true;
+        open_.push_back(tag);
+        if (tag == "svg" || tag == "math") ++foreign_;
+        else if (foreign_ && (tag == "script" || tag == "style")) ++hidden_;
+        else if (foreign_ && tag == "title") start_capture();
+        return true;
+    }
+
+    bool end_tag(const char* t) {
+        t = tag_name(t);
+        std::string tag = name_;
+        if (!skip_tag(t)) return true;
+        if (tag == "html" || tag == "head" || tag == "body") return true;
+        if (skip_) {
+            if (tag == "template" && --skip_ == 0) {
+                pop_to("template");
+                boundary();
+            }
+            return true;
+        }
+        if (pop_to(tag) || tag == "p" || tag == "br") boundary();
+        return true;
+    }
+
+    // Pops the open elements down to the innermost `tag`, if there is one.
+    bool pop_to(const std::string& tag) {
+        auto it = std::find(open_.rbegin(), open_.rend(), tag);
+        if (it == open_.rend()) return false;
+        size_t keep = size_t(open_.rend() - it) - 1;
+        for (size_t i = open_.size(); i-- > keep;) {
+            const std::string& t = open_[i];
+            if (t == "svg" || t == "math") --foreign_;
+            else if (foreign_ && (t == "script" || t == "style")) --hidden_;
+        }
+        open_.resize(keep);
+        return true;
+    }
+
+    void enter_raw(const std::string& tag, Raw kind) {
+        raw_ = tag;
+        raw_kind_ = kind;
+    }
+
+    void start_capture() {
+        capture_ = true;
+        cr_ = false;
+        title_.clear();
+    }
+
+    bool record(const std::string& tag, std::string_view name, std::string_view property, std::string_view content,
+                std::string_view rel, std::string_view href) {
+        if (tag == "meta" && content.data()) {
+            std::string_view c, n, p;
+            if (!attr_value(content, c)) return false;
+            if (name.data()) {
+                if (!attr_value(name, n)) return false;
+                out_.meta.emplace_back(lowered(n), c);
+            }
+            if (property.data()) {
+                if (!attr_value(property, p)) return false;
+                out_.meta.emplace_back(lowered(p), c);
+            }
+        } else if (tag == "link" && rel.data() && href.data()) {
+            std::string_view r, h;
+            if (!attr_value(rel, r)) return false;
+            if (lowered(r).find("canonical") != std::string::npos) {
+                if (!attr_value(href, h)) return false;
+                out_.canonical = h;
+            }
+        } else if (tag == "a" && href.data() && !href.empty()) {
+            std::string_view h;
+            if (!attr_value(href, h)) return false;
+            if (!h.empty()) out_.links.push_back(h);
+        } else if (tag == "base" && href.data() && !s_.base_href.data()) {
+            if (!attr_value(href, s_.base_href)) return false;
+        }
+        return true;
+    }
+
+    static std::string lowered(std::string_view v) {
+        std::string out(v);
+        for (char& c : out) c = char(std::tolower(static_cast<unsigned char>(c)));
+        return out;
+    }
+
+    const char* p_;
+    const char* end_;
+    Scratch& s_;
+    HtmlView& out_;
+    std::string name_, raw_, ref_, title_;
+    Raw raw_kind_ = kSkip;
+    std::vector<std::string> open_;
+    int skip_ = 0, foreign_ = 0, hidden_ = 0;  // template depth, svg/math depth, foreign script/style depth
+    bool self_closing_ = false, capture_ = false, cr_ = false;
+    bool ws_ = false, run_ws_ = false, run_text_ = false;
+    size_t run_start_ = 0;
+};
+
+}  // namespace
+
+bool parse_stream(std::string_view html, Scratch& s) {
+    // Gumbo drops or replaces NULs depending on where they are.
+    if (std::memchr(html.data(), '\0', html.size())) return false;
+    return Stream(html, s).run();
+}
@@ -0,0 +1,232 @@
+#include "url.hpp"
+#include <cctype>
+#include <cstring>
+
+namespace {
+
+bool ieq(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i])))
+            return false;
+    return true;
+}
+
+bool tracking(std::string_view name) {
+    static const char* const kNames[] = {
+        "fbclid", "gclid", "gclsrc", "dclid", "gbraid", "wbraid", "msclkid", "mc_cid", "mc_eid", "yclid",
+        "igshid", "twclid", "ttclid", "li_fat_id", "_ga", "_gl", "_hsenc", "_hsmi", "mkt_tok", "oly_anon_id",
+        "oly_enc_id", "vero_id", "ref_src", "ocid", "cmpid", "smid", nullptr};
+    if (name.size() > 4 && ieq(name.substr(0, 4), "utm_")) return true;
+    for (const char* const* n = kNames; *n; ++n)
+        if (ieq(name, *n)) return true;
+    return false;
+}
+
+int hex(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c = char(c | 0x20);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+bool unreserved(unsigned char c) {
+    return std::isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+// Appends s with escapes of unreserved characters decoded, the rest in upper
+// case, and what may not appear raw in a URL escaped.
+void append_escaped(std::string& out, std::string_view s) {
+    static const char kHex[] = "0123456789ABCDEF";
+    for (size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+        if (c == '%') {
+            int hi = i + 2 < s.size() ? hex(s[i + 1]) : -1, lo = hi >= 0 ? hex(s[i + 2]) : -1;
+            if (lo >= 0) {
+                unsigned char d = static_cast<unsigned char>(hi << 4 | lo);
+                if (unreserved(d)) {
+                    out += char(d);
+                } else {
+                    out += '%';
+                    out += kHex[hi];
+                    out += kHex[lo];
+                }
+                i += 2;
+                continue;
+            }
+        } else if (c > 0x20 && c < 0x7F && !std::strchr("\"<>`{}", c)) {
+            out += char(c);
+            continue;
+        }
+        out += '%';
+        out += kHex[c >> 4];
+        out += kHex[c & 15];
+    }
+}
+
+// RFC 3986 5.2.4, on a path that starts with '/'.
+void remove_dot_segments(std::string& path) {
+    std::string out;
+    out.reserve(path.size());
+    size_t i = 0;
+    while (i < path.size()) {
+        size_t j = path.find('/', i + 1);
+        if (j == std::string::npos) j = path.size();
+        std::string_view seg(path.data() + i + 1, j - i - 1);  // after the '/'
+        if (seg == ".") {
+            if (j == path.size()) out += '/';
+        } else if (seg == "..") {
+            size_t k = out.rfind('/');
+            out.erase(k == std::string::npos ? 0 : k);
+            if (j == path.size()) out += '/';
+        } else {
+            out += '/';
+            out += seg;
+        }
+        i = j;
+    }
+    if (out.empty()) out = "/";
+    path.swap(out);
+}
+
+// Splits "host[:port]" out of an authority, dropping userinfo. Host comes
+// back lower-cased without a trailing dot.
+bool authority(std::string_view a, std::string_view scheme, std::string& host, std::string_view& port) {
+    if (size_t at = a.rfind('@'); at != std::string_view::npos) a.remove_prefix(at + 1);
+    size_t colon = a.rfind(':');
+    if (colon != std::string_view::npos && a.find(']', colon) == std::string_view::npos) {
+        port = a.substr(colon + 1);
+        a = a.substr(0, colon);
+        for (char c : port)
+            if (!std::isdigit(static_cast<unsigned char>(c))) return false;
+        while (port.size() > 1 && port[0] == '0') port.remove_prefix(1);
+        if ((scheme == "http" && port == "80") || (scheme == "https" && port == "443")) port = {};
+    } else {
+        port = {};
+    }
+    while (!a.empty() && a.back() == '.') a.remove_suffix(1);
+    if (a.empty()) return false;
+    bool ip6 = a[0] == '[';
+    if (ip6 && (a.size() < 3 || a.back() != ']')) return false;
+    host.clear();
+    for (size_t i = 0; i < a.size(); ++i) {
+        unsigned char u = static_cast<unsigned char>(a[i]);
+        bool ok = ip6 ? i == 0 || i + 1 == a.size() || std::isxdigit(u) || u == ':' || u == '.'
+                      : u > 0x20 && !std::strchr("/\\?#%<>^|[]:", u);
+        if (!ok) return false;
+        host += char(std::tolower(u));
+    }
+    return true;
+}
+
+}  // namespace
+
+bool split_url(std::string_view url, UrlParts& out) {
+    size_t sep = url.find("://");
+    if (sep == std::string_view::npos) return false;
+    out.scheme = url.substr(0, sep);
+    std::string_view rest = url.substr(sep + 3);
+    size_t p = rest.find_first_of("/?");
+    std::string_view auth = rest.substr(0, p);
+    rest = p == std::string_view::npos ? std::string_view() : rest.substr(p);
+    size_t colon = auth.rfind(':');
+    if (colon != std::string_view::npos && auth.find(']', colon) == std::string_view::npos) {
+        out.host = auth.substr(0, colon);
+        out.port = auth.substr(colon + 1);
+    } else {
+        out.host = auth;
+        out.port = {};
+    }
+    size_t q = rest.find('?');
+    out.path = rest.substr(0, q);
+    out.query = q == std::string_view::npos ? std::string_view() : rest.substr(q + 1);
+    if (out.path.empty()) out.path = "/";
+    return !out.host.empty();
+}
+
+bool normalize_url(std::string_view ref, const UrlParts* base, std::string& out) {
+    // Leading and trailing spaces and controls are dropped, tabs and newlines
+    // anywhere, as browsers do.
+    while (!ref.empty() && static_cast<unsigned char>(ref.front()) <= 0x20) ref.remove_prefix(1);
+    while (!ref.empty() && static_cast<unsigned char>(ref.back()) <= 0x20) ref.remove_suffix(1);
+    std::string cleaned;
+    if (ref.find_first_of("\t\n\r") != std::string_view::npos) {
+        for (char c : ref)
+            if (c != '\t' && c != '\n' && c != '\r') cleaned += c;
+        ref = cleaned;
+    }
+    ref = ref.substr(0, ref.find('#'));
+
+    std::string scheme;
+    size_t i = 0;
+    while (i < ref.size() && (std::isalnum(static_cast<unsigned char>(ref[i])) || std::strchr("+-.", ref[i]))) ++i;
+    if (i > 0 && i < ref.size() && ref[i] == ':' && std::isalpha(static_cast<unsigned char>(ref[0]))) {
+        for (size_t k = 0; k < i; ++k) scheme += char(std::tolower(static_cast<unsigned char>(ref[k])));
+        if (scheme != "http" && scheme != "https") return false;
+        ref.remove_prefix(i + 1);
+    } else if (base) {
+        scheme = base->scheme;
+    } else {
+        return false;
+    }
+    auto slash = [](char c) { return c == '/' || c == '\\'; };
+    bool has_authority = ref.size() >= 2 && slash(ref[0]) && slash(ref[1]);
+    if (!has_authority && (!base || base->scheme != scheme)) return false;
+
+    std::string host, path;
+    std::string_view port, query;
+    bool has_query = false;
+    if (has_authority) {
+        ref.remove_prefix(2);
+        size_t end = ref.find_first_of("/\\?");
+        if (!authority(ref.substr(0, end), scheme, host, port)) return false;
+        ref = end == std::string_view::npos ? std::string_view() : ref.substr(end);
+    } else {
+        host = base->host;
+        port = base->port;
+    }
+    size_t q = ref.find('?');
+    std::string_view rpath = ref.substr(0, q);
+    if (q != std::string_view::npos) has_query = true, query = ref.substr(q + 1);
+    if (has_authority || (!rpath.empty() && slash(rpath[0]))) {
+        append_escaped(path, rpath);
+    } else if (rpath.empty()) {
+        path = base->path;
+        if (!has_query) query = base->query, has_query = !query.empty();
+    } else {
+        std::string_view dir = base->path.substr(0, base->path.rfind('/') + 1);
+        path.assign(dir.data(), dir.size());
+        append_escaped(path, rpath);
+    }
+    for (char& c : path)
+        if (c == '\\') c = '/';
+    if (path.empty() || path[0] != '/') path.insert(path.begin(), '/');
+    remove_dot_segments(path);
+
+    out.clear();
+    out += scheme;
+    out += "://";
+    out += host;
+    if (!port.empty()) {
+        out += ':';
+        out += port;
+    }
+    out += path;
+    bool first = true;
+    while (has_query) {
+        size_t amp = query.find('&');
+        std::string_view param = query.substr(0, amp);
+        if (!param.empty() && !tracking(param.substr(0, param.find('=')))) {
+            out += first ? '?' : '&';
+            first = false;
+            append_escaped(out, param);
+        }
+        if (amp == std::string_view::npos) break;
+        query.remove_prefix(amp + 1);
+    }
+    return true;
+}
+
+bool same_site(std::string_view a, std::string_view b) {
+    auto bare = [](std::string_view h) { return h.substr(0, 4) == "www." ? h.substr(4) : h; };
+    return bare(a) == bare(b);
+}
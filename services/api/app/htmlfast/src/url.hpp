@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// An absolute URL in the form normalize_url writes, split into its parts.
+struct UrlParts {
+    std::string_view scheme, host, port, path, query;  // port is empty when it is the scheme's default
+};
+bool split_url(std::string_view url, UrlParts& out);
+
+// Writes ref resolved against base (nullptr: ref must be absolute) to out as
+// http(s)://host[:port]/path[?query]: scheme and host lower-cased, default
+// port, userinfo, fragment and tracking parameters (utm_*, fbclid, gclid, ...)
+// dropped, dot segments removed and percent-escapes made canonical. Returns
+// false for other schemes and for what is not a URL.
+bool normalize_url(std::string_view ref, const UrlParts* base, std::string& out);
+
+// Whether two hosts are the same site, ignoring a leading "www.".
+bool same_site(std::string_view a, std::string_view b);
@@ -1,5 +1,6 @@
 # services/api/app/ingest_jobs.py
 import hashlib
+import logging
 import time
 import feedparser
 import trafilatura
@@ -7,8 +8,16 @@ import spacy
 from urllib.parse import urlparse, quote_plus
 from typing import List, Dict, Any
 
+from .config import NEAR_DUP_CAPACITY, NEAR_DUP_THRESHOLD
 from .opensearch_index import ensure_index, upsert_docs
-from .graph_client import upsert_graph  # uses your existing client to graph-engine
+from .graph_client import flush_graph, upsert_graph, upsert_graph_chunks  # batched into BulkIngest streams
+
+try:
+    import htmlfast  # native, built by htmlfast/build.sh
+except ImportError:
+    htmlfast = None
+
+_log = logging.getLogger("ingest_jobs")
 
 # Lazy load spaCy to keep worker memory lower on boot
 _nlp = None
@@ -24,6 +33,28 @@ def nlp():
             pass
     return _nlp
 
+# Syndicated copies of a story, seen by this worker, are dropped before NER,
+# indexing and graph upserts multiply them
+_seen = htmlfast.LshIndex(capacity=NEAR_DUP_CAPACITY) if htmlfast and NEAR_DUP_THRESHOLD > 0 else None
+
+def _near_duplicate(doc_id: str, text: str):
+    """
+    (True, None) for a near copy of a document already ingested under another
+    id, else (False, minhash); pass the minhash to _remember() once the
+    document is stored, so a failed ingest is not a duplicate of its retry.
+    """
+    if _seen is None:
+        return False, None
+    _, minhash = htmlfast.fingerprint(text)
+    # the same URL again is an update, not a copy
+    if any(key != doc_id for key, _ in _seen.query(minhash, NEAR_DUP_THRESHOLD)):
+        return True, None
+    return False, minhash
+
+def _remember(doc_id: str, minhash) -> None:
+    if minhash is not None:
+        _seen.add(doc_id, minhash)
+
 def _doc_id(url: str) -> str:
     return "doc:" + hashlib.md5(url.encode("utf-8")).hexdigest()[:16]
 
@@ -61,36 +92,60 @@ def _index_and_graph(record: Dict[str, Any]):
     # Build nodes/edges from entities
     ts_ms = int(record.get("published_ms") or time.time() * 1000)
     doc_id = record["id"]
+    if htmlfast is not None:
+        # the same graph, built natively straight into the wire format
+        doc = (doc_id, ts_ms, record.get("title", record["url"]), record.get("entities", []))
+        upsert_graph_chunks(htmlfast.graph.build_chunks([doc]))
+        return
     nodes = [{"id": doc_id, "type": "doc", "ts": ts_ms, "attrs": {"title": record.get("title", record["url"])}}]
     edges = []
-    seen_entities = set()
+    mentions: Dict[str, int] = {}  # entity key -> mentions, in first-mention order
 
     for e in record.get("entities", []):
         # very basic entity key
         key = f'ent:{e["label"]}:{e["text"].upper().strip()}'
-        if key not in seen_entities:
+        if key not in mentions:
             nodes.append({"id": key, "type": "entity", "ts": ts_ms, "attrs": {"name": e["text"], "label": e["label"]}})
-            seen_entities.add(key)
-        edges.append({"src": doc_id, "dst": key, "type": "MENTIONS", "weight": 1.0, "ts": ts_ms})
+            mentions[key] = 0
+        mentions[key] += 1
 
-    # naive co-occur edges between all entity pairs in this doc
-    ents = list(seen_entities)
+    # MENTIONS weighted by mention count; CO_OCCUR once per pair, from the
+    # smaller key, weighted by the fewer mentions of the two
+    for key, n in mentions.items():
+        edges.append({"src": doc_id, "dst": key, "type": "MENTIONS", "weight": float(n), "ts": ts_ms})
+    ents = list(mentions)
     for i in range(len(ents)):
         for j in range(i + 1, len(ents)):
-            edges.append({"src": ents[i], "dst": ents[j], "type": "CO_OCCUR", "weight": 1.0, "ts": ts_ms})
+            a, b = sorted((ents[i], ents[j]))
+            edges.append({"src": a, "dst": b, "type": "CO_OCCUR", "weight": float(min(mentions[a], mentions[b])),
+                          "ts": ts_ms})
 
     # upsert to graph-engine
     upsert_graph(nodes, edges)
 
+def _flush_graph() -> None:
+    # The documents are already in the database and the search index; an
+    # engine outage leaves their graph rows queued for the next flush rather
+    # than failing the job.
+    try:
+        flush_graph()
+    except Exception:
+        _log.exception("graph engine flush failed; documents stay queued")
+
 def job_ingest_url(url: str) -> int:
     rec = {"id": _doc_id(url), "url": url, "site": _site(url)}
     ex = _extract(url)
     rec["text"] = ex["text"]
+    dup, minhash = _near_duplicate(rec["id"], rec["text"])
+    if dup:
+        return 0
     rec["title"] = rec.get("title") or rec["url"]
     rec["published"] = None
     rec["published_ms"] = int(time.time() * 1000)
     rec["entities"] = _ner(rec["text"])
     _index_and_graph(rec)
+    _remember(rec["id"], minhash)
+    _flush_graph()
     return 1
 
 def job_ingest_rss(rss_url: str, limit: int = 20) -> int:
@@ -105,12 +160,17 @@ def job_ingest_rss(rss_url: str, limit: int = 20) -> int:
             rec["published_ms"] = int(time.mktime(published) * 1000) if published else int(time.time() * 1000)
             ex = _extract(url)
             rec["text"] = ex["text"]
+            dup, minhash = _near_duplicate(rec["id"], rec["text"])
+            if dup:
+                continue
             rec["entities"] = _ner(rec["text"])
             _index_and_graph(rec)
+            _remember(rec["id"], minhash)
             count += 1
         except Exception:
             # continue best-effort
             continue
+    _flush_graph()
     return count
 
 def job_ingest_search(query: str, limit: int = 20) -> int:
@@ -8,15 +8,17 @@ from uuid import uuid4
 from datetime import datetime
 from typing import Dict, Any, List, Optional
 
-from fastapi import FastAPI, BackgroundTasks, HTTPException, Query
+from fastapi import FastAPI, BackgroundTasks, Header, HTTPException, Query
 from fastapi.middleware.cors import CORSMiddleware
+from fastapi.responses import PlainTextResponse
 
 from sqlalchemy import text as sa_text, func, select, desc
 
 from .schemas import (
     Health, IngestTopicRequest, IngestRssRequest, IngestUrlRequest,
     JobCreateResponse, JobStatusResponse,
-    ExpandRequest, ExpandResponse, GraphNode, GraphEdge
+    ExpandRequest, ExpandResponse, ExpandBatchRequest, ExpandBatchResponse, GraphNode, GraphEdge,
+    RankRequest, RankResponse, RankedNode
 )
 from .db import (
     init_schema, SessionLocal, upsert_document, upsert_entity,
@@ -25,6 +27,7 @@ from .db import (
 from .crawler import fetch_url, fetch_rss, fetch_topic
 from .nlp import extract_entities, embed
 from .search import index_document, ensure_index
+from . import graph_client
 
 # --------------------------------------------------------------------------------------
 # Feature flags to keep Render instance stable (avoid OOM from local embeddings)
@@ -256,15 +259,80 @@ def jobs(job_id: str):
     return JobStatusResponse(job_id=job_id, status=j["status"], result=j.get("result"))
 
 
-@app.post("/graph/expand", response_model=ExpandResponse)
-def graph_expand(req: ExpandRequest):
+def _engine_to_api(nodes: List[Dict[str, Any]], edges: List[Dict[str, Any]]) -> ExpandResponse:
+    """Graph engine records in the shape expand_graph() returns."""
+    return ExpandResponse(
+        nodes=[GraphNode(id=n["id"], type=n["type"],
+                         label=n["attrs"].get("name") or n["attrs"].get("title") or n["id"]) for n in nodes],
+        edges=[GraphEdge(source=e["src"], target=e["dst"], label=e["type"].lower()) for e in edges],
+    )
+
+
+def _db_expand(req: ExpandRequest) -> ExpandResponse:
+    """
+    expand_graph() with the request's type filters. It has no notion of hops,
+    so of the type filters only those applying to every hop are kept.
+    """
     nodes, edges = expand_graph(req.seed_ids, req.window_days)
+    if req.node_types:
+        nodes = [n for n in nodes if n["type"] in req.node_types]
+        kept = {n["id"] for n in nodes}
+        edges = [e for e in edges if e["source"] in kept and e["target"] in kept]
+    if req.edge_types:
+        types = {t.lower() for t in req.edge_types}
+        edges = [e for e in edges if e["label"] in types]
     return ExpandResponse(
         nodes=[GraphNode(**n) for n in nodes],
         edges=[GraphEdge(**e) for e in edges],
     )
 
 
+@app.post("/graph/expand", response_model=ExpandResponse)
+def graph_expand(req: ExpandRequest):
+    return _db_expand(req)
+
+
+@app.post("/graph/expand_batch", response_model=ExpandBatchResponse)
+def graph_expand_batch(req: ExpandBatchRequest, traceparent: Optional[str] = Header(None)):
+    """
+    All of a dashboard's expands in one graph-engine round trip; falls back to
+    one database expand per request when the engine is unavailable. A W3C
+    traceparent header carries the caller's trace through to the engine.
+    """
+    results = graph_client.expand_batch([r.dict() for r in req.requests], traceparent=traceparent)
+    if results is None:
+        return ExpandBatchResponse(results=[_db_expand(r) for r in req.requests])
+    return ExpandBatchResponse(results=[_engine_to_api(nodes, edges) for nodes, edges in results])
+
+
+@app.post("/graph/rank", response_model=RankResponse)
+def graph_rank(req: RankRequest):
+    """
+    The seeds' most related nodes, scored by the graph engine; 503 when it is
+    unavailable. related_docs and related_entities read the engine's
+    precomputed co-occurrence index instead of walking the graph, and return no
+    edges; truncated then means the scores are lower bounds.
+    """
+    methods = ("top_neighbors", "pagerank", "related_docs", "related_entities")
+    if req.method not in methods:
+        raise HTTPException(400, "method must be one of " + ", ".join(methods))
+    if req.method.startswith("related_"):
+        found = graph_client.related(req.seed_ids, docs=req.method == "related_docs", k=req.k,
+                                     window_days=req.window_days)
+        ranked = None if found is None else (found[0], [], found[1])
+    else:
+        ranked = graph_client.rank(req.seed_ids, method=req.method, k=req.k, window_days=req.window_days)
+    if ranked is None:
+        raise HTTPException(503, "graph engine unavailable")
+    nodes, edges, truncated = ranked
+    api = _engine_to_api(nodes, edges)
+    return RankResponse(
+        nodes=[RankedNode(**g.dict(), score=n["score"]) for g, n in zip(api.nodes, nodes)],
+        edges=api.edges,
+        truncated=truncated,
+    )
+
+
 # --------------------------------------------------------------------------------------
 # Admin: Flush, Stats, Entities, Recent, Checks
 # --------------------------------------------------------------------------------------
@@ -307,6 +375,24 @@ def admin_stats():
     return {"status": "ok", "documents": int(docs), "entities": int(ents), "doc_entities": int(links)}
 
 
+@app.get("/admin/graph_stats")
+def admin_graph_stats():
+    st = graph_client.stats()
+    if st is None:
+        raise HTTPException(status_code=503, detail="graph engine unavailable")
+    st.pop("prometheus", None)
+    return {"status": "ok", **st}
+
+
+@app.get("/admin/graph_metrics", response_class=PlainTextResponse)
+def admin_graph_metrics():
+    """Graph engine metrics in the Prometheus text format, for scraping through the API."""
+    st = graph_client.stats()
+    if st is None:
+        raise HTTPException(status_code=503, detail="graph engine unavailable")
+    return PlainTextResponse(st["prometheus"], media_type="text/plain; version=0.0.4")
+
+
 @app.get("/admin/entities")
 def admin_entities(limit: int = 50):
     with SessionLocal() as s:
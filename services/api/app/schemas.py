@@ -33,11 +33,39 @@ class GraphEdge(BaseModel):
     target: str
     label: str
 
+class PathStep(BaseModel):
+    edge_types: List[str] = Field(default_factory=list)
+    node_types: List[str] = Field(default_factory=list)
+
 class ExpandRequest(BaseModel):
     seed_ids: List[str] = Field(default_factory=list)
     max_hops: int = 2
     window_days: int = 14
+    # Graph engine only: type filters for every hop, and per-hop ones.
+    edge_types: List[str] = Field(default_factory=list)
+    node_types: List[str] = Field(default_factory=list)
+    path: List[PathStep] = Field(default_factory=list)
 
 class ExpandResponse(BaseModel):
     nodes: List[GraphNode]
     edges: List[GraphEdge]
+
+class ExpandBatchRequest(BaseModel):
+    requests: List[ExpandRequest] = Field(default_factory=list)
+
+class ExpandBatchResponse(BaseModel):
+    results: List[ExpandResponse]
+
+class RankRequest(BaseModel):
+    seed_ids: List[str] = Field(default_factory=list)
+    method: str = "top_neighbors"  # "top_neighbors"|"pagerank"|"related_docs"|"related_entities"
+    k: int = 20
+    window_days: int = 14
+
+class RankedNode(GraphNode):
+    score: float
+
+class RankResponse(BaseModel):
+    nodes: List[RankedNode]
+    edges: List[GraphEdge]
+    truncated: bool = False
@@ -0,0 +1,435 @@
+#include "news_graph.hpp"
+#include "wire.hpp"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <map>
+
+namespace {
+
+constexpr int64_t kDayMs = 86400000;
+
+const NewsGraph& graph() {
+    static const NewsGraph g;
+    return g;
+}
+
+void load(Engine& eng, const NewsGraph& g, size_t batch) {
+    auto& ns = g.nodes();
+    auto& es = g.edges();
+    for (size_t i = 0; i < ns.size(); i += batch)
+        eng.upsert_nodes(std::vector<NodeIn>(ns.begin() + i, ns.begin() + std::min(ns.size(), i + batch)));
+    for (size_t i = 0; i < es.size(); i += batch)
+        eng.upsert_edges(std::vector<EdgeIn>(es.begin() + i, es.begin() + std::min(es.size(), i + batch)));
+}
+
+// Shared by the read benchmarks; built the way the server ingests, in batches.
+// One engine per expand thread count, 0 meaning the default.
+const Engine& loaded(unsigned threads = 0) {
+    static std::map<unsigned, std::unique_ptr<Engine>> engines;
+    auto& eng = engines[threads];
+    if (!eng) {
+        eng = std::make_unique<Engine>(UpsertPolicy{}, threads);
+        load(*eng, graph(), 1024);
+    }
+    return *eng;
+}
+
+// Whole graph per iteration into a fresh engine: nodes, then edges, in batches
+// of range(0). Items are edges.
+void BM_UpsertEdges(benchmark::State& state) {
+    const NewsGraph g({20000, 5000});
+    size_t batch = size_t(state.range(0));
+    std::vector<std::vector<EdgeIn>> batches;
+    for (size_t i = 0; i < g.edges().size(); i += batch)
+        batches.emplace_back(g.edges().begin() + i, g.edges().begin() + std::min(g.edges().size(), i + batch));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto eng = std::make_unique<Engine>();
+        eng->upsert_nodes(g.nodes());
+        state.ResumeTiming();
+        for (auto& b : batches) eng->upsert_edges(b);
+        state.PauseTiming();
+        eng.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * g.edges().size()));
+}
+BENCHMARK(BM_UpsertEdges)->Arg(16)->Arg(256)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+// The BulkIngest path: one IngestChunk per doc (its edges share the doc's ts),
+// each decoded and prepared, then applied range(0) chunks per upsert. Items are edges.
+void BM_BulkIngest(benchmark::State& state) {
+    const NewsGraph g({20000, 5000});
+    std::vector<std::string> chunks;
+    for (size_t i = 0; i < g.edges().size();) {
+        std::string chunk, body;
+        int64_t ts = g.edges()[i].ts;
+        for (; i < g.edges().size() && g.edges()[i].ts == ts; ++i) {
+            const EdgeIn& e = g.edges()[i];
+            body.clear();
+            wire::bytes(body, wire::edge::kSrc, e.src); wire::bytes(body, wire::edge::kDst, e.dst);
+            wire::float64(body, wire::edge::kWeight, e.weight); wire::int64(body, wire::edge::kTs, uint64_t(e.ts));
+            wire::bytes(body, wire::edge::kType, e.type);
+            wire::message(chunk, wire::ingest::kEdges, body);
+        }
+        chunks.push_back(std::move(chunk));
+    }
+    size_t run = size_t(state.range(0));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto eng = std::make_unique<Engine>();
+        eng->upsert_nodes(g.nodes());
+        state.ResumeTiming();
+        std::vector<Engine::Batch> batches;
+        for (size_t i = 0; i < chunks.size(); i += run) {
+            batches.clear();
+            batches.resize(std::min(run, chunks.size() - i));
+            for (size_t k = 0; k < batches.size(); ++k) {
+                Engine::decode(chunks[i + k], batches[k]);
+                eng->prepare(batches[k]);
+            }
+            eng->upsert(batches);
+        }
+        state.PauseTiming();
+        eng.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * g.edges().size()));
+    state.counters["chunks"] = double(chunks.size());
+}
+BENCHMARK(BM_BulkIngest)->ArgName("chunks")->Arg(1)->Arg(16)->Arg(256)->Unit(benchmark::kMillisecond);
+
+// Re-ingesting the same docs: every edge merges into an existing one.
+void BM_UpsertEdgesDuplicate(benchmark::State& state) {
+    const NewsGraph g({20000, 5000});
+    Engine eng;
+    load(eng, g, 1024);
+    std::vector<EdgeIn> batch(g.edges().begin(), g.edges().begin() + std::min<size_t>(1024, g.edges().size()));
+    for (auto _ : state) eng.upsert_edges(batch);
+    state.SetItemsProcessed(int64_t(state.iterations() * batch.size()));
+}
+BENCHMARK(BM_UpsertEdgesDuplicate);
+
+void BM_UpsertNodes(benchmark::State& state) {
+    const NewsGraph g({20000, 5000});
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto eng = std::make_unique<Engine>();
+        state.ResumeTiming();
+        for (size_t i = 0; i < g.nodes().size(); i += 1024)
+            eng->upsert_nodes(std::vector<NodeIn>(g.nodes().begin() + i,
+                                                  g.nodes().begin() + std::min(g.nodes().size(), i + 1024)));
+        state.PauseTiming();
+        eng.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * g.nodes().size()));
+}
+BENCHMARK(BM_UpsertNodes)->Unit(benchmark::kMillisecond);
+
+// Expand from a popularity-sampled entity with the API's default budgets.
+// Args: hops, window in days ending at the newest doc, budgets on (1) or off (0).
+void BM_Expand(benchmark::State& state) {
+    const Engine& eng = loaded();
+    const NewsGraph& g = graph();
+    uint32_t hops = uint32_t(state.range(0));
+    int64_t end = g.spec().end_ms, start = end - state.range(1) * kDayMs;
+    ExpandOptions opt;
+    if (state.range(2)) { opt.max_nodes = 2000; opt.max_edges = 5000; opt.dedup_edges = true; }
+
+    std::mt19937_64 rng(7);
+    std::vector<std::vector<std::string>> seeds(256);
+    for (auto& s : seeds) s.emplace_back(g.sample_entity(rng));
+    size_t i = 0, bytes = 0, truncated = 0;
+    for (auto _ : state) {
+        eng.expand_encoded(seeds[i++ % seeds.size()], start, end, hops, opt,
+                           [&](uint32_t, std::string& frag, bool cut) {
+                               bytes += frag.size();
+                               truncated += cut;
+                               return true;
+                           });
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+    state.counters["truncated"] = benchmark::Counter(double(truncated), benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_Expand)
+    ->ArgNames({"hops", "days", "budget"})
+    ->ArgsProduct({{1, 2, 3}, {1, 7, 30, 90}, {1}})
+    ->ArgsProduct({{2, 3}, {7, 90}, {0}})
+    ->Unit(benchmark::kMicrosecond);
+
+// Two hops over 7 days, budgets on, with no type filter (range(0) = 0), only
+// CO_OCCURS edges (1), or the entity -> doc -> entity path over MENTION (2).
+void BM_ExpandTyped(benchmark::State& state) {
+    const Engine& eng = loaded();
+    const NewsGraph& g = graph();
+    int64_t end = g.spec().end_ms, start = end - 7 * kDayMs;
+    ExpandOptions opt;
+    opt.max_nodes = 2000; opt.max_edges = 5000; opt.dedup_edges = true;
+    if (state.range(0) == 1) opt.edge_types = {"CO_OCCURS"};
+    if (state.range(0) == 2) opt.path = {{{"MENTION"}, {"doc"}}, {{"MENTION"}, {"entity"}}};
+
+    std::mt19937_64 rng(7);
+    std::vector<std::vector<std::string>> seeds(256);
+    for (auto& s : seeds) s.emplace_back(g.sample_entity(rng));
+    size_t i = 0, bytes = 0;
+    for (auto _ : state) {
+        eng.expand_encoded(seeds[i++ % seeds.size()], start, end, 2, opt, [&](uint32_t, std::string& frag, bool) {
+            bytes += frag.size();
+            return true;
+        });
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+}
+BENCHMARK(BM_ExpandTyped)->ArgName("filter")->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond);
+
+// The API's default expand (2 hops, 14 days, budgets on) over range(0) popular
+// seeds again and again, with the result cache on (range(1) = 1) or off.
+void BM_ExpandCached(benchmark::State& state) {
+    static const Engine& eng = []() -> const Engine& {
+        static Engine e;
+        e.cache_expands({256 << 20});
+        load(e, graph(), 1024);
+        return e;
+    }();
+    const NewsGraph& g = graph();
+    const Engine& use = state.range(1) ? eng : loaded();
+    ExpandOptions opt;
+    opt.max_nodes = 2000; opt.max_edges = 5000; opt.dedup_edges = true;
+    std::mt19937_64 rng(7);
+    std::vector<std::vector<std::string>> seeds(size_t(state.range(0)));
+    for (auto& s : seeds) s.emplace_back(g.sample_entity(rng));
+    size_t i = 0, bytes = 0;
+    for (auto _ : state) {
+        // Moments apart, as page reloads are.
+        int64_t end = g.spec().end_ms - int64_t(i % 1000);
+        use.expand_encoded(seeds[i++ % seeds.size()], end - 14 * kDayMs, end, 2, opt,
+                           [&](uint32_t, std::string& frag, bool) {
+                               bytes += frag.size();
+                               return true;
+                           });
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+}
+BENCHMARK(BM_ExpandCached)->ArgNames({"seeds", "cache"})->ArgsProduct({{16, 256}, {0, 1}})->Unit(benchmark::kMicrosecond);
+
+// A wide unbudgeted 3-hop expand over the whole span, whose frontiers are large
+// enough to be split across range(0) threads.
+void BM_ExpandThreads(benchmark::State& state) {
+    const Engine& eng = loaded(unsigned(state.range(0)));
+    const NewsGraph& g = graph();
+    std::mt19937_64 rng(7);
+    std::vector<std::vector<std::string>> seeds(64);
+    for (auto& s : seeds) s.emplace_back(g.sample_entity(rng));
+    size_t i = 0, bytes = 0;
+    for (auto _ : state) {
+        eng.expand_encoded(seeds[i++ % seeds.size()], g.spec().end_ms - g.spec().span_ms, g.spec().end_ms, 3,
+                           ExpandOptions{}, [&](uint32_t, std::string& frag, bool) {
+                               bytes += frag.size();
+                               return true;
+                           });
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+}
+BENCHMARK(BM_ExpandThreads)->ArgName("threads")->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// A dashboard load: 4 seed groups x {1, 2} hops x {7, 30} days, run as one
+// batch (range(0) = 1) or as separate expands.
+void BM_ExpandBatch(benchmark::State& state) {
+    const Engine& eng = loaded();
+    const NewsGraph& g = graph();
+    std::mt19937_64 rng(11);
+    std::vector<ExpandQuery> qs;
+    for (int s = 0; s < 4; ++s) {
+        std::vector<std::string> seeds{std::string(g.sample_entity(rng)), std::string(g.sample_entity(rng))};
+        for (uint32_t hops : {1, 2})
+            for (int64_t days : {7, 30}) {
+                ExpandQuery q;
+                q.seeds = seeds; q.hops = hops;
+                q.end_ms = g.spec().end_ms; q.start_ms = q.end_ms - days * kDayMs;
+                q.opt.max_nodes = 2000; q.opt.max_edges = 5000; q.opt.dedup_edges = true;
+                qs.push_back(q);
+            }
+    }
+    std::vector<Engine::EncodedResult> out;
+    for (auto _ : state) {
+        if (state.range(0)) {
+            eng.expand_batch_encoded(qs, out);
+        } else {
+            for (auto& q : qs)
+                eng.expand_encoded(q.seeds, q.start_ms, q.end_ms, q.hops, q.opt, [](uint32_t, std::string& frag, bool) {
+                    benchmark::DoNotOptimize(frag.data());
+                    return true;
+                });
+        }
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * qs.size()));
+}
+BENCHMARK(BM_ExpandBatch)->ArgName("batched")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Ranks k=20 nodes around a popularity-sampled entity, with range(0) the
+// method (0 top neighbors, 1 personalized PageRank) and range(1) the window in days.
+void BM_Rank(benchmark::State& state) {
+    const Engine& eng = loaded();
+    const NewsGraph& g = graph();
+    RankOptions opt;
+    opt.method = state.range(0) ? RankOptions::kPageRank : RankOptions::kTopNeighbors;
+    opt.max_edges = 5000;
+    int64_t end = g.spec().end_ms, start = end - state.range(1) * kDayMs;
+    std::mt19937_64 rng(7);
+    std::vector<std::vector<std::string>> seeds(256);
+    for (auto& s : seeds) s.emplace_back(g.sample_entity(rng));
+    size_t i = 0, bytes = 0;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        eng.rank_encoded(seeds[i++ % seeds.size()], start, end, opt, out);
+        bytes += out.size();
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+}
+BENCHMARK(BM_Rank)->ArgNames({"pagerank", "days"})->ArgsProduct({{0, 1}, {7, 30}})->Unit(benchmark::kMicrosecond);
+
+// The synthetic graph's edge types.
+RelatedPolicy news_related() {
+    RelatedPolicy p;
+    p.cooccur_type = "CO_OCCURS";
+    p.mention_type = "MENTION";
+    return p;
+}
+
+// The BM_UpsertEdges load at batch 256 with the related index maintained, for
+// its cost on ingest. Items are edges.
+void BM_UpsertEdgesRelated(benchmark::State& state) {
+    const NewsGraph g({20000, 5000});
+    std::vector<std::vector<EdgeIn>> batches;
+    for (size_t i = 0; i < g.edges().size(); i += 256)
+        batches.emplace_back(g.edges().begin() + i, g.edges().begin() + std::min(g.edges().size(), i + 256));
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto eng = std::make_unique<Engine>();
+        eng->upsert_nodes(g.nodes());
+        eng->index_related(news_related());
+        state.ResumeTiming();
+        for (auto& b : batches) eng->upsert_edges(b);
+        state.PauseTiming();
+        eng.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * g.edges().size()));
+}
+BENCHMARK(BM_UpsertEdgesRelated)->Unit(benchmark::kMillisecond);
+
+// The k=20 entities (range(0) 0) or docs (1) most related to a popularity-
+// sampled entity over range(1) days, merged from the related index's day
+// summaries; BM_Rank's top neighbors answers the first by scanning the window.
+void BM_Related(benchmark::State& state) {
+    static const Engine& eng = []() -> const Engine& {
+        static Engine e;
+        load(e, graph(), 1024);
+        e.index_related(news_related());
+        return e;
+    }();
+    const NewsGraph& g = graph();
+    RelatedOptions opt;
+    opt.docs = state.range(0);
+    int64_t end = g.spec().end_ms, start = end - state.range(1) * kDayMs;
+    std::mt19937_64 rng(7);
+    std::vector<std::vector<std::string>> seeds(256);
+    for (auto& s : seeds) s.emplace_back(g.sample_entity(rng));
+    size_t i = 0, bytes = 0;
+    std::string out;
+    for (auto _ : state) {
+        out.clear();
+        eng.related_encoded(seeds[i++ % seeds.size()], start, end, opt, out);
+        bytes += out.size();
+    }
+    state.SetBytesProcessed(int64_t(bytes));
+}
+BENCHMARK(BM_Related)->ArgNames({"docs", "days"})->ArgsProduct({{0, 1}, {7, 30}})->Unit(benchmark::kMicrosecond);
+
+void BM_WindowEdges(benchmark::State& state) {
+    const Engine& eng = loaded();
+    int64_t end = graph().spec().end_ms, start = end - state.range(0) * kDayMs;
+    std::vector<EdgeRec> out;
+    for (auto _ : state) {
+        out.clear();
+        eng.window_edges(start, end, out);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * out.size()));
+}
+BENCHMARK(BM_WindowEdges)->ArgName("days")->Arg(1)->Arg(7)->Unit(benchmark::kMillisecond);
+
+// Expires the oldest range(0) days of the 90 into a fresh generation. Items are
+// edges kept; "freed_B" is what the engine holds less after it.
+void BM_Compact(benchmark::State& state) {
+    const NewsGraph& g = graph();
+    int64_t cutoff = g.spec().end_ms - g.spec().span_ms + state.range(0) * kDayMs;
+    auto total = [](const Engine::Stats& st) { return double(st.bytes()); };
+    double freed = 0;
+    size_t kept = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto eng = std::make_unique<Engine>();
+        load(*eng, g, 1024);
+        double before = total(eng->stats());
+        state.ResumeTiming();
+        eng->compact(cutoff);
+        state.PauseTiming();
+        freed = before - total(eng->stats());
+        kept = eng->stats().edges;
+        eng.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * kept));
+    state.counters["freed_B"] = freed;
+}
+BENCHMARK(BM_Compact)->ArgName("days")->Arg(10)->Arg(45)->Unit(benchmark::kMillisecond);
+
+// One pass; the interesting output is the per-edge counters from Engine::stats().
+void BM_MemoryPerEdge(benchmark::State& state) {
+    Engine::Stats st;
+    for (auto _ : state) {
+        Engine eng;
+        load(eng, graph(), 1024);
+        st = eng.stats();
+    }
+    double edges = double(std::max<size_t>(1, st.edges));
+    state.counters["edges"] = double(st.edges);
+    state.counters["nodes"] = double(st.nodes);
+    state.counters["edge_B"] = double(st.edge_bytes) / edges;
+    state.counters["attr_B"] = double(st.attr_bytes) / edges;
+    state.counters["adjacency_B"] = double(st.adjacency_bytes) / edges;
+    state.counters["string_B"] = double(st.string_bytes) / edges;
+    state.counters["total_B"] = double(st.bytes()) / edges;
+}
+BENCHMARK(BM_MemoryPerEdge)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// BM_UpsertEdges at batches of 1024 with a memory budget set (that is never
+// reached) or not: what checking Stats::bytes() on every batch costs.
+void BM_UpsertEdgesBudget(benchmark::State& state) {
+    const NewsGraph g({20000, 5000});
+    std::vector<std::vector<EdgeIn>> batches;
+    for (size_t i = 0; i < g.edges().size(); i += 1024)
+        batches.emplace_back(g.edges().begin() + i, g.edges().begin() + std::min(g.edges().size(), i + 1024));
+    RetentionPolicy budget;
+    budget.hard_bytes = state.range(0) ? size_t(1) << 40 : 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto eng = std::make_unique<Engine>();
+        eng->retain(budget);
+        eng->upsert_nodes(g.nodes());
+        state.ResumeTiming();
+        for (auto& b : batches) eng->upsert_edges(b);
+        state.PauseTiming();
+        eng.reset();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(int64_t(state.iterations() * g.edges().size()));
+}
+BENCHMARK(BM_UpsertEdgesBudget)->ArgName("budget")->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+
+BENCHMARK_MAIN();
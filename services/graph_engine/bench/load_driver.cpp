@@ -0,0 +1,166 @@
+// Replays a recorded expand trace against a running engine at a fixed rate and
+// reports latency quantiles.
+//
+//   graph_engine_load --trace=FILE [--target=HOST:PORT] [--qps=200] [--seconds=30]
+//                     [--max-inflight=256] [--timeout-ms=10000]
+//   graph_engine_load --synthesize=N --out=FILE
+//
+// Traces are written by the server (GRAPH_EXPAND_TRACE_DIR) or synthesized
+// here from a NewsGraph with the default spec, matching a generated graph
+// loaded into the engine. Requests are replayed in order, wrapping around.
+//
+// The load is open loop: request i is due at start + i/qps whether or not
+// earlier ones have finished, and latency is measured from the due time, so a
+// stalled server shows up in the tail instead of just lowering the rate.
+// Requests that would exceed --max-inflight are counted as dropped.
+#include "graph_engine.pb.h"
+#include "metrics.hpp"
+#include "news_graph.hpp"
+#include "wal.hpp"
+#include <grpcpp/generic/generic_stub.h>
+#include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr int64_t kDayMs = 86400000;
+
+std::map<std::string, std::string> flags(int argc, char** argv) {
+    std::map<std::string, std::string> out;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a.rfind("--", 0) != 0) continue;
+        auto eq = a.find('=');
+        out[a.substr(2, eq == std::string::npos ? std::string::npos : eq - 2)] =
+            eq == std::string::npos ? "1" : a.substr(eq + 1);
+    }
+    return out;
+}
+
+// Popularity-sampled seeds, mostly 1-2 hops over the last week, with the budgets the API sends.
+int synthesize(size_t n, const std::string& out) {
+    NewsGraph g;
+    std::mt19937_64 rng(1);
+    const int64_t days[] = {1, 7, 7, 7, 30, 90};
+    const uint32_t hops[] = {1, 2, 2, 2, 3};
+    // Written as segment 0 of a scratch directory, then moved into place.
+    std::string dir = out + ".tmp";
+    std::filesystem::create_directories(dir);
+    {
+        Wal w(dir, 0, false);
+        for (size_t i = 0; i < n; ++i) {
+            graph::ExpandRequest req;
+            req.add_seed_ids(std::string(g.sample_entity(rng)));
+            req.mutable_window()->set_end_ms(g.spec().end_ms);
+            req.mutable_window()->set_start_ms(g.spec().end_ms - days[rng() % std::size(days)] * kDayMs);
+            req.set_max_hops(hops[rng() % std::size(hops)]);
+            req.set_max_nodes(2000); req.set_max_edges(5000); req.set_dedup_edges(true);
+            w.append(Wal::kExpand, req.SerializeAsString());
+        }
+    }
+    std::filesystem::rename(Wal::path(dir, 0), out);
+    std::filesystem::remove_all(dir);
+    std::printf("wrote %zu requests to %s\n", n, out.c_str());
+    return 0;
+}
+
+void report(const char* name, const metrics::Histogram& h) {
+    auto ms = [](uint64_t us) { return double(us) / 1000.0; };
+    std::printf("%-8s n=%-8lu p50=%.2fms p90=%.2fms p99=%.2fms p99.9=%.2fms max=%.2fms\n", name,
+                (unsigned long)h.count(), ms(h.quantile(0.5)), ms(h.quantile(0.9)), ms(h.quantile(0.99)),
+                ms(h.quantile(0.999)), ms(h.max()));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    auto f = flags(argc, argv);
+    auto get = [&](const char* k, const char* def) { return f.count(k) ? f[k] : std::string(def); };
+    try {
+        if (f.count("synthesize")) return synthesize(std::stoull(f["synthesize"]), get("out", "expand.trace"));
+        if (!f.count("trace")) {
+            std::fprintf(stderr, "usage: %s --trace=FILE [--target=HOST:PORT] [--qps=N] [--seconds=N] "
+                                 "[--max-inflight=N] [--timeout-ms=N] | --synthesize=N --out=FILE\n", argv[0]);
+            return 2;
+        }
+
+        std::vector<grpc::ByteBuffer> reqs;
+        Wal::replay(f["trace"], [&](Wal::Kind kind, std::string_view body) {
+            if (kind != Wal::kExpand) return;
+            grpc::Slice s(body.data(), body.size());
+            reqs.emplace_back(&s, 1);
+        }, true);
+        if (reqs.empty()) throw std::runtime_error("no expand requests in " + f["trace"]);
+
+        double qps = std::stod(get("qps", "200"));
+        auto seconds = std::stod(get("seconds", "30"));
+        int max_inflight = std::stoi(get("max-inflight", "256"));
+        auto timeout = std::chrono::milliseconds(std::stoll(get("timeout-ms", "10000")));
+        grpc::GenericStub stub(grpc::CreateChannel(get("target", "localhost:50061"), grpc::InsecureChannelCredentials()));
+
+        metrics::Histogram latency, service;  // from due time, from send time (us)
+        std::atomic<uint64_t> errors{0}, dropped{0};
+        std::mutex mu;
+        std::condition_variable idle;
+        int inflight = 0;
+
+        struct Call {
+            grpc::ClientContext ctx;
+            grpc::ByteBuffer resp;
+            Clock::time_point due, sent;
+        };
+        auto us = [](Clock::duration d) { return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(d).count()); };
+        auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / qps));
+        auto start = Clock::now(), stop = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+        size_t sent = 0;
+        for (auto due = start; due < stop; due += period) {
+            std::this_thread::sleep_until(due);
+            {
+                std::lock_guard<std::mutex> lk(mu);
+                if (inflight >= max_inflight) { dropped++; continue; }
+                ++inflight;
+            }
+            auto* c = new Call;
+            c->due = due; c->sent = Clock::now();
+            c->ctx.set_deadline(std::chrono::system_clock::now() + timeout);
+            stub.UnaryCall(&c->ctx, "/graph.GraphEngine/ExpandTimeWindow", grpc::StubOptions(),
+                           &reqs[sent++ % reqs.size()], &c->resp, [&, c](grpc::Status st) {
+                               auto now = Clock::now();
+                               if (st.ok()) {
+                                   latency.record(us(now - c->due));
+                                   service.record(us(now - c->sent));
+                               } else {
+                                   errors++;
+                               }
+                               delete c;
+                               std::lock_guard<std::mutex> lk(mu);
+                               if (--inflight == 0) idle.notify_one();
+                           });
+        }
+        {
+            std::unique_lock<std::mutex> lk(mu);
+            idle.wait(lk, [&] { return inflight == 0; });
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        std::printf("sent=%zu ok=%lu errors=%lu dropped=%lu achieved=%.1f qps (target %.1f)\n", sent,
+                    (unsigned long)latency.count(), (unsigned long)errors.load(), (unsigned long)dropped.load(),
+                    double(latency.count()) / elapsed, qps);
+        report("latency", latency);
+        report("service", service);
+        return errors.load() ? 1 : 0;
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "graph_engine_load: %s\n", e.what());
+        return 1;
+    }
+}
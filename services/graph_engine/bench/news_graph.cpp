@@ -0,0 +1,79 @@
+#include "news_graph.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr int64_t kDayMs = 86400000;
+
+struct Doc {
+    int64_t ts;
+    std::vector<uint32_t> ents;
+};
+}
+
+NewsGraph::NewsGraph(const NewsGraphSpec& spec) : spec_(spec) {
+    std::mt19937_64 rng(spec.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    int64_t start = spec.end_ms - spec.span_ms;
+
+    cdf_.resize(spec.entities);
+    double total = 0;
+    for (uint32_t i = 0; i < spec.entities; ++i) cdf_[i] = total += std::pow(double(i + 1), -spec.zipf);
+    for (double& c : cdf_) c /= total;
+
+    std::vector<std::pair<int64_t, uint32_t>> bursts(spec.bursts);
+    for (auto& b : bursts) b = {start + int64_t(unit(rng) * double(spec.span_ms)), popular(rng)};
+
+    std::exponential_distribution<double> decay(1.0 / double(spec.burst_decay_ms));
+    std::geometric_distribution<uint32_t> extra(1.0 / std::max(1u, spec.mentions));
+    std::vector<Doc> docs(spec.docs);
+    for (auto& d : docs) {
+        if (!bursts.empty() && unit(rng) < spec.burst_share) {
+            auto& b = bursts[rng() % bursts.size()];
+            d.ts = std::min(spec.end_ms, b.first + int64_t(decay(rng)));
+            d.ents.push_back(b.second);
+        } else {
+            // Twice as many stories at the daily peak as at the trough.
+            do d.ts = start + int64_t(unit(rng) * double(spec.span_ms));
+            while (unit(rng) > 0.75 + 0.25 * std::sin(2 * M_PI * double(d.ts % kDayMs) / kDayMs));
+        }
+        for (uint32_t n = 1 + extra(rng); d.ents.size() < n && d.ents.size() < spec.entities;) {
+            uint32_t e = popular(rng);
+            if (std::find(d.ents.begin(), d.ents.end(), e) == d.ents.end()) d.ents.push_back(e);
+        }
+    }
+    std::sort(docs.begin(), docs.end(), [](const Doc& a, const Doc& b) { return a.ts < b.ts; });
+
+    // All strings exist before any view is taken.
+    ids_.reserve(spec.entities + spec.docs);
+    titles_.reserve(spec.entities + spec.docs);
+    for (uint32_t i = 0; i < spec.entities; ++i) {
+        titles_.push_back("E" + std::to_string(i));
+        ids_.push_back("ent:" + titles_.back());
+    }
+    for (uint32_t i = 0; i < spec.docs; ++i) {
+        ids_.push_back("doc:" + std::to_string(i));
+        titles_.push_back("Story " + std::to_string(i) + " about " + titles_[docs[i].ents[0]]);
+    }
+
+    static const std::string kName = "name", kTitle = "title";
+    nodes_.reserve(ids_.size());
+    for (uint32_t i = 0; i < spec.entities; ++i) nodes_.push_back({ids_[i], "entity", 0, {{kName, titles_[i]}}});
+    for (uint32_t i = 0; i < spec.docs; ++i) {
+        uint32_t d = spec.entities + i;
+        nodes_.push_back({ids_[d], "doc", docs[i].ts, {{kTitle, titles_[d]}}});
+        auto& ents = docs[i].ents;
+        for (size_t k = 0; k < ents.size(); ++k) {
+            edges_.push_back({ids_[d], ids_[ents[k]], "MENTION", 1.0, docs[i].ts, {}});
+            if (k > 0) edges_.push_back({ids_[ents[k - 1]], ids_[ents[k]], "CO_OCCURS", 1.0, docs[i].ts, {}});
+        }
+    }
+}
+
+uint32_t NewsGraph::popular(std::mt19937_64& rng) const {
+    double u = std::uniform_real_distribution<double>(0.0, 1.0)(rng);
+    auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+    return uint32_t(std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1));
+}
+
+std::string_view NewsGraph::sample_entity(std::mt19937_64& rng) const { return ids_[popular(rng)]; }
@@ -0,0 +1,49 @@
+#pragma once
+#include "engine.hpp"
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// Synthetic news graph shaped like what the ingest pipeline produces: "doc:<n>"
+// nodes MENTION "ent:<NAME>" nodes, and entities mentioned together get a
+// CO_OCCURS edge at the doc's timestamp.
+//
+// Entity popularity is Zipf, so a few entities are hubs and most are seen a
+// handful of times. Doc timestamps follow a diurnal cycle over the span, and a
+// share of docs belongs to news bursts: a story breaks at a random time, its
+// lead entity is in every burst doc, and coverage decays exponentially.
+struct NewsGraphSpec {
+    uint32_t docs = 100000;
+    uint32_t entities = 20000;
+    double zipf = 1.1;              // popularity exponent of entities
+    uint32_t mentions = 6;          // mean entities per doc (geometric, at least 1)
+    double burst_share = 0.3;       // fraction of docs that belong to a burst
+    uint32_t bursts = 200;
+    int64_t burst_decay_ms = 86400000;
+    int64_t end_ms = 1767225600000;  // 2026-01-01
+    int64_t span_ms = 90 * 86400000ll;
+    uint64_t seed = 42;
+};
+
+class NewsGraph {
+public:
+    explicit NewsGraph(const NewsGraphSpec& spec = {});
+
+    const NewsGraphSpec& spec() const { return spec_; }
+    // Views into this object, ready for Engine::upsert_*. Edges are in doc order,
+    // i.e. roughly the order a crawler would ingest them.
+    const std::vector<NodeIn>& nodes() const { return nodes_; }
+    const std::vector<EdgeIn>& edges() const { return edges_; }
+    // Entity ids drawn by popularity, as query seeds would be.
+    std::string_view sample_entity(std::mt19937_64& rng) const;
+private:
+    uint32_t popular(std::mt19937_64& rng) const;
+
+    NewsGraphSpec spec_;
+    std::vector<std::string> ids_;  // entities first, then docs
+    std::vector<std::string> titles_;
+    std::vector<double> cdf_;       // entity popularity
+    std::vector<NodeIn> nodes_;
+    std::vector<EdgeIn> edges_;
+};
@@ -0,0 +1,71 @@
+#pragma once
+#include "array.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Append-only vector in fixed-size blocks that never move. A View captures the
+// block table and length at publication time, so readers can index it while a
+// single writer keeps appending past the end; the table is copied (not mutated)
+// whenever a new block is added.
+template <class T>
+class AppendLog {
+    static constexpr size_t kBlockBits = 12, kBlock = size_t(1) << kBlockBits;
+    using Blocks = std::vector<std::shared_ptr<T[]>>;
+public:
+    class View {
+    public:
+        const T& operator[](size_t i) const { return (*blocks_)[i >> kBlockBits][i & (kBlock - 1)]; }
+        size_t size() const { return size_; }
+        size_t bytes() const { return blocks_ ? blocks_->size() * kBlock * sizeof(T) : 0; }  // blocks held
+        // f(const T*, n) over the contiguous runs, in order.
+        template <class F>
+        void for_each_block(F&& f) const {
+            for (size_t i = 0; i < size_; i += kBlock) f(&(*this)[i], std::min(kBlock, size_ - i));
+        }
+    private:
+        friend class AppendLog;
+        std::shared_ptr<const Blocks> blocks_;
+        size_t size_ = 0;
+    };
+
+    AppendLog() : blocks_(std::make_shared<const Blocks>()) {}
+    // Uses `a` in place, one block per full kBlock run; only a partial tail is
+    // copied, since that block is the one appends write into. The memory must
+    // be writable (e.g. a MAP_PRIVATE mapping) if elements are later patched.
+    static AppendLog adopt(const Array<T>& a) {
+        static_assert(std::is_trivially_copyable<T>::value, "adopted elements are used as raw bytes");
+        AppendLog log;
+        auto blocks = std::make_shared<Blocks>();
+        size_t full = a.size() & ~(kBlock - 1);
+        for (size_t i = 0; i < full; i += kBlock) blocks->emplace_back(a.owner(), const_cast<T*>(a.data() + i));
+        if (full < a.size()) {
+            blocks->emplace_back(new T[kBlock]);
+            std::copy(a.begin() + full, a.end(), blocks->back().get());
+        }
+        log.blocks_ = std::move(blocks);
+        log.size_ = a.size();
+        return log;
+    }
+
+    size_t push_back(T v) {
+        if ((size_ & (kBlock - 1)) == 0) {
+            auto grown = std::make_shared<Blocks>(*blocks_);
+            grown->emplace_back(new T[kBlock]);
+            blocks_ = std::move(grown);
+        }
+        (*blocks_)[size_ >> kBlockBits][size_ & (kBlock - 1)] = std::move(v);
+        return size_++;
+    }
+    T& operator[](size_t i) { return (*blocks_)[i >> kBlockBits][i & (kBlock - 1)]; }
+    const T& operator[](size_t i) const { return (*blocks_)[i >> kBlockBits][i & (kBlock - 1)]; }
+    size_t size() const { return size_; }
+
+    View view() const { View v; v.blocks_ = blocks_; v.size_ = size_; return v; }
+private:
+    std::shared_ptr<const Blocks> blocks_;
+    size_t size_ = 0;
+};
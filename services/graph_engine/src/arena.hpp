@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Bump allocator for bytes that live as long as the arena: copies are packed
+// into chunks that never move or shrink, so views of them stay valid while a
+// single writer keeps copying in, and nothing is freed one by one.
+class Arena {
+public:
+    std::string_view copy(std::string_view s) {
+        if (s.empty()) return {};
+        if (s.size() > kChunk / 4) {  // its own chunk, leaving the current one's room
+            chunks_.emplace_back(new char[s.size()]);
+            bytes_ += s.size();
+            std::memcpy(chunks_.back().get(), s.data(), s.size());
+            return {chunks_.back().get(), s.size()};
+        }
+        if (s.size() > room_) {
+            chunks_.emplace_back(new char[kChunk]);
+            next_ = chunks_.back().get();
+            room_ = kChunk;
+            bytes_ += kChunk;
+        }
+        char* p = next_;
+        std::memcpy(p, s.data(), s.size());
+        next_ += s.size();
+        room_ -= s.size();
+        return {p, s.size()};
+    }
+    size_t bytes() const { return bytes_; }  // chunks allocated
+private:
+    static constexpr size_t kChunk = 64 << 10;
+
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* next_ = nullptr;
+    size_t room_ = 0, bytes_ = 0;
+};
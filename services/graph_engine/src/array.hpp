@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Read-only contiguous array that either owns a vector or points into memory
+// kept alive by `owner` (e.g. an mmap'd snapshot), so loaded structures can be
+// used in place without copying.
+template <class T>
+class Array {
+public:
+    Array() = default;
+    Array(std::vector<T>&& v) {
+        auto owned = std::make_shared<const std::vector<T>>(std::move(v));
+        data_ = owned->data(); size_ = owned->size(); owner_ = std::move(owned);
+    }
+    Array(const T* data, size_t size, std::shared_ptr<const void> owner)
+        : data_(data), size_(size), owner_(std::move(owner)) {}
+
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    const T& operator[](size_t i) const { return data_[i]; }
+    const T& back() const { return data_[size_ - 1]; }
+    const std::shared_ptr<const void>& owner() const { return owner_; }
+private:
+    const T* data_ = nullptr;
+    size_t size_ = 0;
+    std::shared_ptr<const void> owner_;
+};
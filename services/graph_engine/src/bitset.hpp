@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Visited set over dense indices. clear() only zeroes the words that were
+// written, so one bitset can be reused across many small traversals of a
+// large graph without paying for its full size each time.
+class Bitset {
+public:
+    // Grows to hold [0, n); never shrinks.
+    void resize(size_t n) {
+        if ((n + 63) / 64 > words_.size()) words_.resize((n + 63) / 64);
+    }
+    bool test(size_t i) const { return words_[i >> 6] >> (i & 63) & 1; }
+    // True if `i` was not set before.
+    bool insert(size_t i) {
+        uint64_t& w = words_[i >> 6];
+        uint64_t bit = uint64_t(1) << (i & 63);
+        if (w & bit) return false;
+        if (!w) touched_.push_back(static_cast<uint32_t>(i >> 6));
+        w |= bit;
+        return true;
+    }
+    void clear() {
+        for (uint32_t t : touched_) words_[t] = 0;
+        touched_.clear();
+    }
+private:
+    std::vector<uint64_t> words_;
+    std::vector<uint32_t> touched_;
+};
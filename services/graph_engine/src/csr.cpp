@@ -0,0 +1,132 @@
+#include "csr.hpp"
+#include "snapshot.hpp"
+#include <stdexcept>
+
+namespace {
+bool by_ts(const Csr::Entry& a, const Csr::Entry& b) { return a.ts < b.ts; }
+bool stamp_less(const Csr::Stamp& a, const Csr::Stamp& b) { return a.ts < b.ts || (a.ts == b.ts && a.edge < b.edge); }
+}
+
+Csr::Row Csr::row(uint32_t u) const {
+    size_t r;
+    if (keys_.empty()) {
+        if (size_t(u) + 1 >= offsets_.size()) return {};
+        r = u;
+    } else {
+        auto it = std::lower_bound(keys_.begin(), keys_.end(), u);
+        if (it == keys_.end() || *it != u) return {};
+        r = size_t(it - keys_.begin());
+    }
+    return {entries_.data() + offsets_[r], entries_.data() + offsets_[r + 1]};
+}
+
+// Rows are assembled oldest source first; stable_sort keeps that order among
+// equal timestamps. News mostly arrives in time order, so the check usually wins.
+void Csr::sort_rows(const std::vector<uint64_t>& offsets, std::vector<Entry>& entries) {
+    for (size_t r = 0; r + 1 < offsets.size(); ++r) {
+        auto b = entries.begin() + offsets[r], e = entries.begin() + offsets[r + 1];
+        if (!std::is_sorted(b, e, by_ts)) std::stable_sort(b, e, by_ts);
+    }
+}
+
+Csr Csr::sparse(std::vector<std::pair<uint32_t, Entry>> pairs) {
+    std::stable_sort(pairs.begin(), pairs.end(), [](auto& a, auto& b) { return a.first < b.first; });
+    std::vector<uint32_t> keys;
+    std::vector<uint64_t> offsets{0};
+    std::vector<Entry> entries;
+    std::vector<Stamp> by_ts;
+    entries.reserve(pairs.size());
+    for (auto& [u, en] : pairs) {
+        if (keys.empty() || keys.back() != u) {
+            if (!keys.empty()) offsets.push_back(entries.size());
+            keys.push_back(u);
+        }
+        entries.push_back(en);
+        by_ts.push_back({en.ts, en.edge});
+    }
+    if (!keys.empty()) offsets.push_back(entries.size());
+    sort_rows(offsets, entries);
+    // Each edge was paired once per endpoint.
+    std::sort(by_ts.begin(), by_ts.end(), stamp_less);
+    by_ts.erase(std::unique(by_ts.begin(), by_ts.end(), [](auto& a, auto& b) { return a.edge == b.edge && a.ts == b.ts; }),
+                by_ts.end());
+    return Csr(std::move(keys), std::move(offsets), std::move(entries), std::move(by_ts));
+}
+
+Csr Csr::merge_sparse(const Csr& a, const Csr& b) {
+    std::vector<uint32_t> keys;
+    std::vector<uint64_t> offsets{0};
+    std::vector<Entry> entries;
+    keys.reserve(a.keys_.size() + b.keys_.size());
+    entries.reserve(a.entries_.size() + b.entries_.size());
+    size_t i = 0, j = 0;
+    auto take = [&](const Csr& c, size_t r) {
+        entries.insert(entries.end(), c.entries_.begin() + c.offsets_[r], c.entries_.begin() + c.offsets_[r + 1]);
+    };
+    while (i < a.keys_.size() || j < b.keys_.size()) {
+        uint32_t u = std::min(i < a.keys_.size() ? a.keys_[i] : UINT32_MAX, j < b.keys_.size() ? b.keys_[j] : UINT32_MAX);
+        if (i < a.keys_.size() && a.keys_[i] == u) take(a, i++);
+        if (j < b.keys_.size() && b.keys_[j] == u) take(b, j++);
+        keys.push_back(u);
+        offsets.push_back(entries.size());
+    }
+    sort_rows(offsets, entries);
+    std::vector<Stamp> by_ts(a.by_ts_.size() + b.by_ts_.size());
+    std::merge(a.by_ts_.begin(), a.by_ts_.end(), b.by_ts_.begin(), b.by_ts_.end(), by_ts.begin(), stamp_less);
+    return Csr(std::move(keys), std::move(offsets), std::move(entries), std::move(by_ts));
+}
+
+Csr Csr::merge(const Csr& base, uint32_t num_nodes, const Segments& segs) {
+    std::vector<uint64_t> offsets(size_t(num_nodes) + 1, 0);
+    uint32_t bn = base.keys_.empty() && !base.offsets_.empty() ? static_cast<uint32_t>(base.offsets_.size() - 1) : 0;
+    for (uint32_t u = 0; u < bn; ++u) offsets[u + 1] = base.offsets_[u + 1] - base.offsets_[u];
+    for (auto& s : segs)
+        for (size_t r = 0; r < s->keys_.size(); ++r) offsets[s->keys_[r] + 1] += s->offsets_[r + 1] - s->offsets_[r];
+    for (uint32_t u = 0; u < num_nodes; ++u) offsets[u + 1] += offsets[u];
+
+    // Base rows first, then each segment in age order; only rows a segment
+    // touched can be out of ts order afterwards.
+    std::vector<Entry> entries(offsets[num_nodes]);
+    std::vector<uint64_t> cur(offsets.begin(), offsets.end() - 1);
+    for (uint32_t u = 0; u < bn; ++u) {
+        auto r = base.row(u);
+        cur[u] = std::copy(r.begin(), r.end(), entries.begin() + cur[u]) - entries.begin();
+    }
+    for (auto& s : segs)
+        for (size_t r = 0; r < s->keys_.size(); ++r) {
+            uint32_t u = s->keys_[r];
+            auto b = s->entries_.begin() + s->offsets_[r], e = s->entries_.begin() + s->offsets_[r + 1];
+            cur[u] = std::copy(b, e, entries.begin() + cur[u]) - entries.begin();
+        }
+    sort_rows(offsets, entries);
+
+    std::vector<Stamp> by_ts(base.by_ts_.begin(), base.by_ts_.end());
+    for (auto& s : segs) {
+        std::vector<Stamp> m(by_ts.size() + s->by_ts_.size());
+        std::merge(by_ts.begin(), by_ts.end(), s->by_ts_.begin(), s->by_ts_.end(), m.begin(), stamp_less);
+        by_ts.swap(m);
+    }
+    return Csr({}, std::move(offsets), std::move(entries), std::move(by_ts));
+}
+
+void Csr::save(SnapshotWriter& w) const {
+    w.array(keys_.data(), keys_.size());
+    w.array(offsets_.data(), offsets_.size());
+    w.array(entries_.data(), entries_.size());
+    w.array(by_ts_.data(), by_ts_.size());
+}
+
+Csr Csr::load(SnapshotReader& r, size_t num_nodes, size_t num_edges) {
+    auto keys = r.array<uint32_t>();
+    auto offsets = r.array<uint64_t>();
+    auto entries = r.array<Entry>();
+    auto ts_index = r.array<Stamp>();
+    bool ok = keys.empty() ? offsets.size() <= num_nodes + 1 : offsets.size() == keys.size() + 1;
+    for (size_t i = 0; ok && i < keys.size(); ++i) ok = keys[i] < num_nodes && (i == 0 || keys[i - 1] < keys[i]);
+    ok = ok && (offsets.empty() ? entries.empty() : offsets[0] == 0 && offsets.back() == entries.size());
+    for (size_t i = 1; ok && i < offsets.size(); ++i) ok = offsets[i - 1] <= offsets[i];
+    for (size_t i = 0; ok && i < entries.size(); ++i) ok = entries[i].nbr < num_nodes && entries[i].edge < num_edges;
+    for (size_t i = 0; ok && i < ts_index.size(); ++i) ok = ts_index[i].edge < num_edges;
+    if (!ok) throw std::runtime_error("malformed snapshot: adjacency");
+    return Csr(std::move(keys), std::move(offsets), std::move(entries), std::move(ts_index));
+}
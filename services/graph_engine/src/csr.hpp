@@ -0,0 +1,75 @@
+#pragma once
+#include "array.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Compressed-sparse-row adjacency, immutable once built. The base graph is a
+// dense CSR over node indices [0, num_nodes); recent upserts are small sparse
+// segments (rows only for touched nodes, found by binary search on keys_) that
+// are periodically folded into a new base by merge().
+//
+// Rows are sorted by edge ts (ties in arrival order) so a time window is two
+// binary searches, and every segment also carries a ts-sorted index of the
+// edges it introduced for "what arrived in [s, e]" queries.
+//
+// Storage is Array-backed, so a base loaded from a snapshot points straight
+// into the mapping and is paged in as rows are touched.
+class SnapshotWriter;
+class SnapshotReader;
+
+class Csr {
+public:
+    struct Entry { int64_t ts; uint32_t nbr; uint32_t edge; };
+    struct Stamp { int64_t ts; uint32_t edge; };
+    template <class T>
+    struct Range {
+        const T* b = nullptr; const T* e = nullptr;
+        const T* begin() const { return b; }
+        const T* end() const { return e; }
+        size_t size() const { return size_t(e - b); }
+        Range window(int64_t start_ms, int64_t end_ms) const;
+    };
+    using Row = Range<Entry>;
+    using Segments = std::vector<std::shared_ptr<const Csr>>;
+
+    // Sparse segment from (node, entry) pairs.
+    static Csr sparse(std::vector<std::pair<uint32_t, Entry>> pairs);
+    static Csr merge_sparse(const Csr& older, const Csr& newer);
+    // Dense CSR from `base` plus `segs` (oldest first).
+    static Csr merge(const Csr& base, uint32_t num_nodes, const Segments& segs);
+    void save(SnapshotWriter& w) const;
+    // Throws std::runtime_error unless every row, neighbor and edge index is in
+    // range for a graph of num_nodes nodes and num_edges edges.
+    static Csr load(SnapshotReader& r, size_t num_nodes, size_t num_edges);
+
+    Row row(uint32_t u) const;
+    Range<Stamp> stamps() const { return {by_ts_.begin(), by_ts_.end()}; }
+    Range<Stamp> arrivals(int64_t start_ms, int64_t end_ms) const { return stamps().window(start_ms, end_ms); }
+    size_t num_entries() const { return entries_.size(); }
+    size_t bytes() const {
+        return keys_.size() * sizeof(uint32_t) + offsets_.size() * sizeof(uint64_t) + entries_.size() * sizeof(Entry) +
+               by_ts_.size() * sizeof(Stamp);
+    }
+    Csr() = default;
+private:
+    Csr(Array<uint32_t> keys, Array<uint64_t> offsets, Array<Entry> entries, Array<Stamp> by_ts)
+        : keys_(std::move(keys)), offsets_(std::move(offsets)), entries_(std::move(entries)), by_ts_(std::move(by_ts)) {}
+    static void sort_rows(const std::vector<uint64_t>& offsets, std::vector<Entry>& entries);
+
+    Array<uint32_t> keys_;  // sparse only: sorted node ids, one per row
+    Array<uint64_t> offsets_;  // rows + 1
+    Array<Entry> entries_;
+    Array<Stamp> by_ts_;  // one per edge, sorted by ts
+};
+
+template <class T>
+Csr::Range<T> Csr::Range<T>::window(int64_t s, int64_t e) const {
+    auto lo = [](const T& x, int64_t t) { return x.ts < t; };
+    auto hi = [](int64_t t, const T& x) { return t < x.ts; };
+    const T* first = std::lower_bound(b, this->e, s, lo);
+    return {first, std::upper_bound(first, this->e, e, hi)};
+}
@@ -1,37 +1,953 @@
 #include "engine.hpp"
-#include <queue>
+#include "louvain.hpp"
+#include "wal.hpp"
+#include "wire.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <tuple>
+
+Engine::Engine(const UpsertPolicy& policy, unsigned expand_threads)
+    : policy_(policy), expand_threads_(expand_threads ? expand_threads : std::max(1u, std::thread::hardware_concurrency())) {
+    publish({});
+}
+
+Engine::~Engine() {
+    {
+        std::lock_guard<std::mutex> lk(retention_mu_);
+        stopping_ = true;
+    }
+    retention_cv_.notify_all();
+    if (retention_thread_.joinable()) retention_thread_.join();
+    if (snap_thread_.joinable()) snap_thread_.join();
+}
+
+uint32_t Engine::node_index(std::string_view id) {
+    uint32_t u = ids_->intern(id);
+    if (u >= nodes_.size()) nodes_.push_back({});
+    return u;
+}
+
+void Engine::publish(std::vector<Partition> parts) {
+    auto g = std::make_shared<Graph>();
+    g->ids = ids_->view(); g->types = types_.view();
+    g->attr_keys = attr_keys_.view(); g->attr_values = attr_values_->view();
+    g->id_index = ids_; g->value_index = attr_values_;
+    g->generation = generation_;
+    g->seq = ++seq_;
+    g->nodes = nodes_.view(); g->edges = edges_.view();
+    g->edge_cols.reserve(edge_cols_.size());
+    for (auto& c : edge_cols_) g->edge_cols.push_back({c.base, c.values.view()});
+    g->parts = std::move(parts);
+    g->merges = merges_;
+    g->edge_index_bytes = edge_index_.bytes();
+    std::atomic_store(&graph_, std::shared_ptr<const Graph>(std::move(g)));
+}
+
+namespace {
+std::vector<AttrView> attr_views(const std::unordered_map<std::string, std::string>& attrs) {
+    return {attrs.begin(), attrs.end()};
+}
+}
 
 void Engine::upsert_nodes(const std::vector<NodeRec>& ns) {
-    for (auto& n : ns) nodes_[n.id] = n;
+    std::vector<NodeIn> in; in.reserve(ns.size());
+    for (auto& n : ns) in.push_back({n.id, n.type, n.ts, attr_views(n.attrs)});
+    upsert_nodes(in);
 }
 
 void Engine::upsert_edges(const std::vector<EdgeRec>& es) {
-    size_t base = edges_.size();
-    edges_.insert(edges_.end(), es.begin(), es.end());
+    std::vector<EdgeIn> in; in.reserve(es.size());
+    for (auto& e : es) in.push_back({e.src, e.dst, e.type, e.weight, e.ts, attr_views(e.attrs)});
+    upsert_edges(in);
+}
+
+// A copy of `old` with the set fields of `n` applied; the engine swaps it in
+// whole, so readers see either version.
+std::shared_ptr<Engine::NodeData> Engine::patch_node(const NodeIn& n, const NodeData* old) {
+    auto d = std::make_shared<NodeData>();
+    d->type = n.type.empty() && old ? old->type : types_.intern(n.type);
+    d->ts = n.ts == 0 && old ? old->ts : n.ts;
+    std::vector<AttrView> attrs;
+    if (old)
+        wire::for_each_entry(old->wire, wire::node::kAttrs,
+                             [&](std::string_view k, std::string_view v) { attrs.emplace_back(k, v); });
+    for (auto& kv : n.attrs) {
+        auto it = std::find_if(attrs.begin(), attrs.end(), [&](const AttrView& a) { return a.first == kv.first; });
+        if (it != attrs.end()) it->second = kv.second;
+        else attrs.push_back(kv);
+    }
+    wire::bytes(d->wire, wire::node::kId, n.id);
+    wire::int64(d->wire, wire::node::kTs, uint64_t(d->ts));
+    wire::bytes(d->wire, wire::node::kType, types_.name(d->type));
+    for (auto& [k, v] : attrs) wire::map_entry(d->wire, wire::node::kAttrs, k, v);
+    return d;
+}
+
+void Engine::patch_nodes(const std::vector<NodeIn>& ns, NodePatches& p) {
+    p.us.reserve(p.us.size() + ns.size()); p.ds.reserve(p.ds.size() + ns.size());
+    for (auto& n : ns) {
+        uint32_t u = node_index(n.id);
+        auto it = p.latest.find(u);
+        auto old = it != p.latest.end() ? p.ds[it->second] : std::atomic_load(&nodes_[u].data);
+        p.latest[u] = p.ds.size();
+        p.us.push_back(u);
+        p.ds.push_back(patch_node(n, old.get()));
+    }
+}
+
+void Engine::store_nodes(NodePatches& p) {
+    if (wal_) {
+        // Log the patched records, not the patches: they are graph.Node bytes
+        // already, so the record is an UpsertNodesRequest and replay is idempotent.
+        std::string batch;
+        for (auto& d : p.ds) wire::message(batch, wire::upsert::kItems, d->wire);
+        wal_->append(Wal::kNodes, batch);
+    }
+    for (size_t i = 0; i < p.us.size(); ++i) {
+        if (compacting_) compact_nodes_.push_back(p.us[i]);
+        auto old = std::atomic_load(&nodes_[p.us[i]].data);
+        node_data_bytes_ += p.ds[i]->bytes() - (old ? old->bytes() : 0);
+        std::atomic_store(&nodes_[p.us[i]].data, std::move(p.ds[i]));
+        touch(p.us[i]);
+    }
+}
+
+void Engine::upsert_nodes(const std::vector<NodeIn>& ns) {
+    std::lock_guard<std::mutex> lk(write_mu_);
+    admit();
+    NodePatches p;
+    patch_nodes(ns, p);
+    store_nodes(p);
+    publish(snapshot()->parts);
+    maybe_checkpoint();
+}
+
+int64_t Engine::bucket(int64_t ts) const {
+    int64_t b = policy_.bucket_ms;
+    return ts >= 0 ? ts / b : -((-(ts + 1)) / b) - 1;
+}
+
+// Endpoint order is ignored: expand walks edges from both ends anyway, and
+// retried documents need not list entity pairs in the same order.
+uint64_t Engine::edge_hash(uint32_t a, uint32_t b, uint32_t type, int64_t bkt) const {
+    auto [lo, hi] = std::minmax(a, b);
+    return KeyIndex::mix(KeyIndex::mix((uint64_t(lo) << 32) | hi) ^ (uint64_t(type) << 40) ^ uint64_t(bkt));
+}
+
+uint32_t Engine::find_edge(uint32_t src, uint32_t dst, uint32_t type, int64_t ts) const {
+    int64_t bkt = bucket(ts);
+    auto key = std::minmax(src, dst);
+    return edge_index_.find(edge_hash(src, dst, type, bkt), [&](uint32_t i) {
+        const Edge& ed = edges_[i];
+        return ed.type == type && std::minmax(ed.src, ed.dst) == key && bucket(ed.ts.load()) == bkt;
+    });
+}
+
+void Engine::index_edge(uint32_t ei) {
+    auto hash = [&](uint32_t i) {
+        const Edge& ed = edges_[i];
+        return edge_hash(ed.src, ed.dst, ed.type, bucket(ed.ts.load()));
+    };
+    edge_index_.insert(hash(ei), ei, hash);
+}
+
+// Returns whether the stored edge changed.
+bool Engine::merge_edge(uint32_t ei, const EdgeIn& e) {
+    Edge& ed = edges_[ei];
+    double w = ed.weight.load(), nw = policy_.weight == UpsertPolicy::kSum   ? w + e.weight
+                                      : policy_.weight == UpsertPolicy::kMax ? std::max(w, e.weight)
+                                                                             : e.weight;
+    int64_t t = ed.ts.load(), nt = policy_.latest_ts ? std::max(t, e.ts) : t;
+    if (nw == w && nt == t) return false;
+    save_undo(ei);
+    if (compacting_) compact_merged_.push_back(ei);
+    if (related_) related_->merged.emplace_back(ei, std::max(0.0, nw) - std::max(0.0, w));
+    ed.weight.store(nw);
+    ed.ts.store(nt);
+    touch(ed.src); touch(ed.dst);
+    ++merges_;
+    return true;
+}
+
+void Engine::insert_edges(const std::vector<EdgeIn>& es, const Batch* prepared, Pairs& pairs) {
+    bool dedup = policy_.bucket_ms > 0;
+    if (dedup)  // edges adopted from a snapshot are indexed on first use
+        while (indexed_ < edges_.size()) index_edge(indexed_++);
+    // Ids resolved before a compaction are in the old numbering.
+    const uint32_t* ids = prepared && prepared->generation == generation_ && prepared->ids.size() == 3 * es.size()
+                              ? prepared->ids.data() : nullptr;
     for (size_t i = 0; i < es.size(); ++i) {
-        adj_[es[i].src].push_back(base + i);
-        adj_[es[i].dst].push_back(base + i);
+        const EdgeIn& e = es[i];
+        Edge ed;
+        if (ids && ids[3 * i] != Interner::kNone) ed.src = ids[3 * i];
+        else ed.src = node_index(e.src);
+        if (ids && ids[3 * i + 1] != Interner::kNone) ed.dst = ids[3 * i + 1];
+        else ed.dst = node_index(e.dst);
+        ed.type = ids && ids[3 * i + 2] != Interner::kNone ? ids[3 * i + 2] : types_.intern(e.type);
+        if (dedup) {
+            uint32_t dup = find_edge(ed.src, ed.dst, ed.type, e.ts);
+            if (dup != KeyIndex::kNone) { merge_edge(dup, e); continue; }
+        }
+        ed.weight.v = e.weight; ed.ts.v = e.ts;
+        uint32_t ei = static_cast<uint32_t>(edges_.push_back(ed));
+        if (dedup) index_edge(indexed_++);
+        touch(ed.src); touch(ed.dst);
+        for (auto& [k, v] : e.attrs) set_attr(edge_cols_, attr_keys_.intern(k), ei, attr_values_->intern(v));
+        pairs.push_back({ed.src, {e.ts, ed.dst, ei}});
+        pairs.push_back({ed.dst, {e.ts, ed.src, ei}});
+    }
+}
+
+std::vector<Engine::Pairs> Engine::by_type(Pairs pairs, const AppendLog<Edge>& edges) {
+    std::vector<Pairs> out;
+    if (pairs.empty()) return out;
+    auto type = [&](const std::pair<uint32_t, Csr::Entry>& p) { return edges[p.second.edge].type; };
+    uint32_t first = type(pairs[0]);
+    // Batches are mostly of one type; those are moved, not copied.
+    if (std::all_of(pairs.begin(), pairs.end(), [&](auto& p) { return type(p) == first; })) {
+        out.resize(first + 1);
+        out[first] = std::move(pairs);
+        return out;
+    }
+    for (auto& p : pairs) {
+        uint32_t t = type(p);
+        if (t >= out.size()) out.resize(t + 1);
+        out[t].push_back(p);
+    }
+    return out;
+}
+
+void Engine::add_delta(Partition& p, Pairs pairs) const {
+    // Size-tiered: fold the newest segment into its predecessor while they are
+    // of similar size, so each entry is rewritten O(log n) times before the base merge.
+    size_t delta_entries = p.delta_entries + pairs.size();
+    Csr::Segments delta = std::move(p.delta);
+    delta.push_back(std::make_shared<const Csr>(Csr::sparse(std::move(pairs))));
+    while (delta.size() > 1 && delta[delta.size() - 2]->num_entries() <= 2 * delta.back()->num_entries()) {
+        auto merged = std::make_shared<const Csr>(Csr::merge_sparse(*delta[delta.size() - 2], *delta.back()));
+        delta.pop_back();
+        delta.back() = std::move(merged);
+    }
+    if (delta_entries > std::max(kMinDelta, p.base->num_entries() / 8)) {
+        p.base = std::make_shared<const Csr>(Csr::merge(*p.base, static_cast<uint32_t>(nodes_.size()), delta));
+        p.delta.clear();
+        p.delta_entries = 0;
+    } else {
+        p.delta = std::move(delta);
+        p.delta_entries = delta_entries;
+    }
+}
+
+void Engine::publish_edges(Pairs pairs) {
+    std::vector<Partition> parts = snapshot()->parts;
+    auto split = by_type(std::move(pairs), edges_);
+    if (parts.size() < split.size()) parts.resize(split.size());
+    for (size_t t = 0; t < split.size(); ++t)
+        if (!split[t].empty()) add_delta(parts[t], std::move(split[t]));
+    if (related_) relate();
+    publish(std::move(parts));
+}
+
+void Engine::upsert_edges(const std::vector<EdgeIn>& es) {
+    std::lock_guard<std::mutex> lk(write_mu_);
+    admit();
+    if (wal_) wal_->append(Wal::kEdges, wal_edges(es));
+    Pairs pairs;
+    pairs.reserve(es.size() * 2);
+    insert_edges(es, nullptr, pairs);
+    publish_edges(std::move(pairs));
+    maybe_checkpoint();
+}
+
+EdgeRec Engine::edge_rec(const Graph& g, uint32_t ei) {
+    const auto& ed = g.edges[ei];
+    EdgeRec r; r.src = g.ids[ed.src]; r.dst = g.ids[ed.dst]; r.type = g.types[ed.type];
+    r.weight = ed.weight.load(); r.ts = ed.ts.load();
+    for (uint32_t k = 0; k < g.edge_cols.size(); ++k)
+        if (uint32_t v = g.edge_cols[k].at(ei); v != Interner::kNone) r.attrs.emplace(g.attr_keys[k], g.attr_values[v]);
+    return r;
+}
+
+bool Engine::node_rec(const Graph& g, uint32_t u, NodeRec& r) {
+    auto n = std::atomic_load(&g.nodes[u].data);
+    if (!n) return false;
+    r.id = g.ids[u]; r.type = g.types[n->type]; r.ts = n->ts;
+    wire::for_each_entry(n->wire, wire::node::kAttrs,
+                         [&](std::string_view k, std::string_view v) { r.attrs.emplace(k, v); });
+    return true;
+}
+
+// Writes one `edges` field of a GraphFragment straight from the interned names.
+void Engine::encode_edge(const Graph& g, uint32_t ei, uint32_t field, std::string& out) {
+    using namespace wire;
+    const auto& ed = g.edges[ei];
+    std::string_view src = g.ids[ed.src], dst = g.ids[ed.dst], type = g.types[ed.type];
+    double weight = ed.weight.load();
+    int64_t ts = ed.ts.load();
+    size_t len = bytes_size(edge::kSrc, src) + bytes_size(edge::kDst, dst) + double_size(edge::kWeight, weight) +
+                 int_size(edge::kTs, uint64_t(ts)) + bytes_size(edge::kType, type);
+    for (uint32_t k = 0; k < g.edge_cols.size(); ++k)
+        if (uint32_t v = g.edge_cols[k].at(ei); v != Interner::kNone)
+            len += map_entry_size(edge::kAttrs, g.attr_keys[k], g.attr_values[v]);
+    tag(out, field, kLen); varint(out, len);
+    bytes(out, edge::kSrc, src); bytes(out, edge::kDst, dst);
+    float64(out, edge::kWeight, weight); int64(out, edge::kTs, uint64_t(ts));
+    bytes(out, edge::kType, type);
+    for (uint32_t k = 0; k < g.edge_cols.size(); ++k)
+        if (uint32_t v = g.edge_cols[k].at(ei); v != Interner::kNone)
+            map_entry(out, edge::kAttrs, g.attr_keys[k], g.attr_values[v]);
+}
+
+template <class T, class F>
+void Engine::in_window(const Graph& g, Csr::Range<T> r, int64_t s, int64_t e, F&& f) const {
+    if (policy_.bucket_ms <= 0 || !policy_.latest_ts) {
+        for (auto& x : r.window(s, e)) f(x);
+        return;
+    }
+    // An entry's edge ts lies in [entry ts, entry ts + slack].
+    int64_t slack = policy_.bucket_ms - 1;
+    int64_t lo = s >= INT64_MIN + slack ? s - slack : INT64_MIN, inner = e >= INT64_MIN + slack ? e - slack : INT64_MIN;
+    for (auto& x : r.window(lo, e)) {
+        if (x.ts >= s && x.ts <= inner) { f(x); continue; }
+        int64_t t = g.edges[x.edge].ts.load();
+        if (t >= s && t <= e) f(x);
+    }
+}
+
+void Engine::hop_rows_encoded(const std::vector<std::string>& ids, int64_t s, int64_t e, bool edges,
+                              const ExpandOptions& opt, std::string& out) const {
+    auto g = snapshot();
+    EdgeFilter filter = edge_filter(*g, opt);
+    std::vector<Csr::Entry> cand;
+    std::string row;
+    size_t scanned = 0;
+    for (auto& id : ids) {
+        row.clear();
+        uint32_t u = g->id_index->find(id);
+        if (u < g->nodes.size()) {
+            wire::int64(row, wire::hop_row::kFound, 1);
+            if (auto n = std::atomic_load(&g->nodes[u].data)) wire::message(row, wire::hop_row::kNode, n->wire);
+            if (edges) {
+                cand.clear();
+                collect(*g, u, s, e, opt, filter, cand, scanned);
+                for (auto& en : cand) encode_edge(*g, en.edge, wire::hop_row::kEdges, row);
+            }
+        }
+        wire::message(out, wire::hop::kRows, row);
+    }
+    expand_metrics_.edges_scanned.add(scanned);
+}
+
+void Engine::window_edges(int64_t s, int64_t e, std::vector<EdgeRec>& oe) const {
+    auto g = snapshot();
+    auto add = [&](const Csr::Stamp& st) { oe.push_back(edge_rec(*g, st.edge)); };
+    g->for_each_csr([&](const Csr& c) { in_window(*g, c.stamps(), s, e, add); });
+}
+
+Engine::TypeSet Engine::type_set(const std::vector<std::string>& a, const std::vector<std::string>* b) const {
+    TypeSet ts;
+    auto ids = [&](const std::vector<std::string>& names) {
+        std::vector<uint32_t> v;
+        for (auto& n : names)
+            if (uint32_t t = types_.find(n); t != Interner::kNone) v.push_back(t);
+        std::sort(v.begin(), v.end());
+        return v;
+    };
+    bool has_b = b && !b->empty();
+    if (a.empty() && !has_b) return ts;
+    ts.all = false;
+    if (a.empty() || !has_b) {
+        ts.ids = ids(a.empty() ? *b : a);
+        return ts;
+    }
+    auto x = ids(a), y = ids(*b);
+    std::set_intersection(x.begin(), x.end(), y.begin(), y.end(), std::back_inserter(ts.ids));
+    return ts;
+}
+
+// Attr filters compare dictionary ids; a key or value this version has never
+// seen matches no edge.
+Engine::EdgeFilter Engine::edge_filter(const Graph& g, const ExpandOptions& opt, const ExpandOptions::Step* step) const {
+    EdgeFilter f;
+    for (auto& [k, v] : opt.edge_attrs) {
+        uint32_t key = attr_keys_.find(k), val = g.value_index->find(v);
+        if (key >= g.edge_cols.size() || val == Interner::kNone) f.none = true;
+        else f.want.emplace_back(key, val);
+    }
+    f.types = type_set(opt.edge_types, step ? &step->edge_types : nullptr);
+    return f;
+}
+
+// Appends u's candidate edges to `out`; safe to call from several threads.
+void Engine::collect(const Graph& g, uint32_t u, int64_t s, int64_t e, const ExpandOptions& opt, const EdgeFilter& f,
+                     std::vector<Csr::Entry>& out, size_t& scanned) const {
+    if (f.none) return;
+    size_t from = out.size();
+    auto gather = [&](Csr::Row row) {
+        in_window(g, row, s, e, [&](const Csr::Entry& en) {
+            ++scanned;
+            bool ok = true;
+            for (auto& [key, val] : f.want) ok = ok && g.edge_cols[key].at(en.edge) == val;
+            if (ok) out.push_back(en);
+        });
+    };
+    auto scan = [&](const Partition& p) {
+        gather(p.base->row(u));
+        for (auto& seg : p.delta) gather(seg->row(u));
+    };
+    if (f.types.all) {
+        for (auto& p : g.parts) scan(p);
+    } else {
+        for (uint32_t t : f.types.ids)
+            if (t < g.parts.size()) scan(g.parts[t]);
+    }
+    if (opt.top_k && out.size() - from > opt.top_k) {
+        auto heavier = [&](const Csr::Entry& a, const Csr::Entry& b) {
+            return g.edges[a.edge].weight.load() > g.edges[b.edge].weight.load();
+        };
+        std::nth_element(out.begin() + from, out.begin() + from + opt.top_k, out.end(), heavier);
+        out.resize(from + opt.top_k);
     }
 }
 
+WorkPool* Engine::expand_pool() const {
+    if (expand_threads_ <= 1) return nullptr;
+    std::call_once(pool_once_, [&] { pool_ = std::make_unique<WorkPool>(expand_threads_ - 1); });
+    return pool_.get();
+}
+
+// Level-synchronous BFS shared by the record, encoded and batch expand paths.
+// on_hop(hop, items, truncated) gets what each hop emitted and returns false
+// to stop. With `rows`, gathered rows are looked up there first and added to it.
+//
+// On a large frontier the rows are gathered in parallel, chunk by chunk. The
+// pass that applies budgets and marks nodes visited stays sequential: budgets
+// cut in discovery order, and keeping that order makes the result the same
+// however the hop was split.
+template <class OnHop>
+void Engine::walk(const Graph& g, const std::vector<std::string>& seeds, int64_t s, int64_t e, uint32_t hops,
+                  const ExpandOptions& opt, WalkScratch& ws, RowCache* rows, OnHop&& on_hop) const {
+    ws.seen.clear(); ws.seen.resize(g.nodes.size());
+    ws.seen_edges.clear(); ws.seen_edges.resize(g.edges.size());
+    auto &frontier = ws.frontier, &next = ws.next;
+    frontier.clear(); next.clear(); ws.items.clear(); ws.rejected.clear();
+    if (!opt.path.empty()) hops = std::min<uint32_t>(hops, static_cast<uint32_t>(opt.path.size()));
+    size_t nodes_out = 0, edges_out = 0;
+    bool truncated = false;
+    auto reach = [&](uint32_t u) {
+        if (ws.seen.test(u)) return true;
+        if (opt.max_nodes && nodes_out >= opt.max_nodes) { truncated = true; return false; }
+        ws.seen.insert(u);
+        ++nodes_out;
+        next.push_back(u);
+        ws.items.push_back({u, false});
+        return true;
+    };
+    for (auto& id : seeds) {
+        uint32_t u = g.id_index->find(id);
+        if (u < g.nodes.size() && !reach(u)) break;
+    }
+    // Without a path every hop filters alike; with one, both are set per hop.
+    EdgeFilter filter = edge_filter(g, opt);
+    TypeSet node_types = type_set(opt.node_types, nullptr);
+    size_t scanned = 0;
+    // The candidate edges of u, valid until the next call.
+    auto row_of = [&](uint32_t u) -> std::pair<const Csr::Entry*, size_t> {
+        if (rows) {
+            auto it = rows->span.find(u);
+            if (it != rows->span.end()) return {rows->pool.data() + it->second.first, it->second.second};
+        }
+        auto& cand = ws.cand;
+        cand.clear();
+        collect(g, u, s, e, opt, filter, cand, scanned);
+        if (rows) {
+            rows->span.emplace(u, std::make_pair(static_cast<uint32_t>(rows->pool.size()), static_cast<uint32_t>(cand.size())));
+            rows->pool.insert(rows->pool.end(), cand.begin(), cand.end());
+        }
+        return {cand.data(), cand.size()};
+    };
+    // Keeps u's candidates in order until a budget runs out.
+    auto take = [&](const Csr::Entry* cand, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            const Csr::Entry& en = cand[i];
+            if (!node_types.all) {
+                auto d = std::atomic_load(&g.nodes[en.nbr].data);
+                if (!d || !node_types.has(d->type)) {
+                    ws.rejected.push_back(en.nbr);
+                    continue;
+                }
+            }
+            if (opt.dedup_edges && !ws.seen_edges.insert(en.edge)) continue;
+            if (opt.max_edges && edges_out >= opt.max_edges) { truncated = true; break; }
+            // An edge is only kept if its far end made it into the result.
+            if (!reach(en.nbr)) break;
+            ws.items.push_back({en.edge, true});
+            ++edges_out;
+        }
+    };
+
+    for (uint32_t hop = 0;; ++hop) {
+        if (!on_hop(hop, ws.items, truncated) || truncated || hop >= hops || next.empty()) break;
+        ws.items.clear();
+        frontier.swap(next);
+        next.clear();
+        if (!opt.path.empty()) {
+            filter = edge_filter(g, opt, &opt.path[hop]);
+            node_types = type_set(opt.node_types, &opt.path[hop].node_types);
+        }
+        expand_metrics_.frontier[std::min<size_t>(hop, kFrontierHops - 1)].record(frontier.size());
+        WorkPool* pool = frontier.size() >= kParallelFrontier && !rows ? expand_pool() : nullptr;
+        if (!pool) {
+            for (uint32_t u : frontier) {
+                auto [cand, n] = row_of(u);
+                take(cand, n);
+                if (truncated) break;
+            }
+            continue;
+        }
+        size_t chunks = (frontier.size() + kFrontierGrain - 1) / kFrontierGrain;
+        if (ws.chunk_rows.size() < chunks) ws.chunk_rows.resize(chunks);
+        ws.row_len.resize(frontier.size());
+        std::atomic<size_t> chunk_scanned{0};
+        pool->parallel_for(frontier.size(), kFrontierGrain, [&](size_t b, size_t end) {
+            auto& out = ws.chunk_rows[b / kFrontierGrain];
+            out.clear();
+            size_t sc = 0;
+            for (size_t i = b; i < end; ++i) {
+                size_t before = out.size();
+                collect(g, frontier[i], s, e, opt, filter, out, sc);
+                ws.row_len[i] = static_cast<uint32_t>(out.size() - before);
+            }
+            chunk_scanned += sc;
+        });
+        scanned += chunk_scanned;
+        for (size_t c = 0; c < chunks && !truncated; ++c) {
+            const Csr::Entry* p = ws.chunk_rows[c].data();
+            for (size_t i = c * kFrontierGrain; i < std::min(frontier.size(), (c + 1) * kFrontierGrain); ++i) {
+                take(p, ws.row_len[i]);
+                if (truncated) break;
+                p += ws.row_len[i];
+            }
+        }
+    }
+    auto& m = expand_metrics_;
+    m.calls.add();
+    if (truncated) m.truncated.add();
+    m.nodes_returned.add(nodes_out);
+    m.edges_scanned.add(scanned);
+    m.edges_returned.add(edges_out);
+}
+
+void Engine::encode_items(const Graph& g, const std::vector<Item>& items, std::string& out) const {
+    auto encode = [&](const Item& it, std::string& to) {
+        if (it.edge) encode_edge(g, it.index, wire::fragment::kEdges, to);
+        else if (auto n = std::atomic_load(&g.nodes[it.index].data)) wire::message(to, wire::fragment::kNodes, n->wire);
+    };
+    WorkPool* pool = items.size() >= kParallelItems ? expand_pool() : nullptr;
+    if (!pool) {
+        for (auto& it : items) encode(it, out);
+        return;
+    }
+    std::vector<std::string> parts((items.size() + kItemGrain - 1) / kItemGrain);
+    pool->parallel_for(items.size(), kItemGrain, [&](size_t b, size_t end) {
+        for (size_t i = b; i < end; ++i) encode(items[i], parts[b / kItemGrain]);
+    });
+    size_t total = out.size();
+    for (auto& p : parts) total += p.size();
+    out.reserve(total);
+    for (auto& p : parts) out += p;
+}
+
+void Engine::expand(const std::vector<std::string>& seeds, int64_t s, int64_t e, uint32_t hops,
+                    const ExpandOptions& opt, const HopSink& sink) const {
+    auto g = snapshot();
+    WalkScratch ws;
+    std::vector<NodeRec> on;
+    std::vector<EdgeRec> oe;
+    walk(*g, seeds, s, e, hops, opt, ws, nullptr, [&](uint32_t hop, const std::vector<Item>& items, bool truncated) {
+        for (auto& it : items) {
+            NodeRec r;
+            if (it.edge) oe.push_back(edge_rec(*g, it.index));
+            else if (node_rec(*g, it.index, r)) on.push_back(std::move(r));
+        }
+        bool more = sink(hop, on, oe, truncated);
+        on.clear(); oe.clear();
+        return more;
+    });
+}
+
 void Engine::expand(const std::vector<std::string>& seeds, int64_t s, int64_t e, uint32_t hops,
                     std::vector<NodeRec>& on, std::vector<EdgeRec>& oe) const {
-    std::unordered_set<std::string> seen;
-    std::queue<std::pair<std::string,uint32_t>> q;
-    for (auto& id : seeds) { q.push({id, 0}); seen.insert(id); }
-    while (!q.empty()) {
-        auto [u, d] = q.front(); q.pop();
-        auto it = nodes_.find(u);
-        if (it != nodes_.end()) on.push_back(it->second);
-        if (d >= hops) continue;
-        auto ait = adj_.find(u);
-        if (ait == adj_.end()) continue;
-        for (auto ei : ait->second) {
-            const auto& ed = edges_[ei];
-            if (ed.ts < s || ed.ts > e) continue;
-            oe.push_back(ed);
-            std::string v = (ed.src == u ? ed.dst : ed.src);
-            if (!seen.count(v)) { seen.insert(v); q.push({v, d+1}); }
+    expand(seeds, s, e, hops, ExpandOptions{}, [&](uint32_t, std::vector<NodeRec>& ns, std::vector<EdgeRec>& es, bool) {
+        std::move(ns.begin(), ns.end(), std::back_inserter(on));
+        std::move(es.begin(), es.end(), std::back_inserter(oe));
+        return true;
+    });
+}
+
+namespace {
+// Unambiguous keys for grouping batch queries and caching expands.
+void put(std::string& key, std::string_view v) {
+    uint64_t n = v.size();
+    key.append(reinterpret_cast<const char*>(&n), sizeof n).append(v);
+}
+void put(std::string& key, int64_t v) { key.append(reinterpret_cast<const char*>(&v), sizeof v); }
+void put(std::string& key, const std::vector<std::string>& vs) {
+    put(key, int64_t(vs.size()));
+    for (auto& v : vs) put(key, v);
+}
+
+std::string scan_key(const ExpandQuery& q) {
+    std::string k;
+    put(k, q.start_ms); put(k, q.end_ms); put(k, int64_t(q.opt.top_k)); put(k, int64_t(q.opt.edge_attrs.size()));
+    for (auto& [a, v] : q.opt.edge_attrs) { put(k, a); put(k, v); }
+    put(k, q.opt.edge_types);
+    put(k, int64_t(q.opt.path.size()));
+    for (auto& step : q.opt.path) { put(k, step.edge_types); put(k, step.node_types); }
+    return k;
+}
+// Everything but hops: queries with the same walk key differ only in depth.
+std::string walk_key(const ExpandQuery& q, const std::string& scan) {
+    std::string k = scan;
+    put(k, int64_t(q.opt.max_nodes)); put(k, int64_t(q.opt.max_edges)); put(k, int64_t(q.opt.dedup_edges));
+    put(k, q.opt.node_types);
+    for (auto& id : q.seeds) put(k, id);
+    return k;
+}
+}
+
+void Engine::expand_encoded(const std::vector<std::string>& seeds, int64_t s, int64_t e, uint32_t hops,
+                            const ExpandOptions& opt, const EncodedSink& sink, ExpandTiming* timing) const {
+    auto g = snapshot();
+    std::string key;
+    std::shared_ptr<CachedExpand> fill;
+    if (cache_) {
+        ExpandQuery q{seeds, s, e, hops, opt};
+        key = walk_key(q, scan_key(q));
+        put(key, int64_t(hops));
+        if (auto c = cached(*g, key)) {
+            if (timing) timing->cached = true;
+            std::string frag;
+            size_t from = 0;
+            for (uint32_t hop = 0; hop < c->hops.size(); ++hop) {
+                auto [to, truncated] = c->hops[hop];
+                frag.assign(c->fragment, from, to - from);
+                from = to;
+                if (!sink(hop, frag, truncated)) break;
+            }
+            return;
+        }
+        // A seed upserted later would change the result without touching any
+        // node in it, so walks from unknown seeds are not kept.
+        bool found = std::all_of(seeds.begin(), seeds.end(),
+                                 [&](const std::string& id) { return g->id_index->find(id) < g->nodes.size(); });
+        if (found) {
+            fill = std::make_shared<CachedExpand>();
+            fill->generation = g->generation;
+            fill->seq = g->seq;
+        }
+    }
+    using Clock = std::chrono::steady_clock;
+    auto us = [](Clock::time_point a, Clock::time_point b) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(b - a).count();
+    };
+    Clock::time_point mark = timing ? Clock::now() : Clock::time_point();
+    WalkScratch ws;
+    std::string out;
+    walk(*g, seeds, s, e, hops, opt, ws, nullptr, [&](uint32_t hop, const std::vector<Item>& items, bool truncated) {
+        Clock::time_point walked = timing ? Clock::now() : mark;
+        encode_items(*g, items, out);
+        if (timing) timing->hops.push_back({us(mark, walked), us(walked, Clock::now())});
+        if (fill) {
+            fill->fragment += out;
+            fill->hops.emplace_back(fill->fragment.size(), truncated);
+            for (auto& it : items)
+                if (!it.edge) fill->nodes.push_back(it.index);
+        }
+        bool more = sink(hop, out, truncated);
+        if (timing) mark = Clock::now();
+        out.clear();
+        if (!more) fill.reset();  // only complete walks are kept
+        return more;
+    });
+    if (fill) {
+        // A turned-away node whose type changes would now be reached.
+        fill->nodes.insert(fill->nodes.end(), ws.rejected.begin(), ws.rejected.end());
+        cache(std::move(key), std::move(fill));
+    }
+}
+
+void Engine::cache_expands(const ExpandCachePolicy& policy) {
+    if (!policy.max_bytes) return;
+    cache_ = std::make_unique<ExpandCache>();
+    cache_->policy = policy;
+}
+
+std::shared_ptr<const Engine::CachedExpand> Engine::cached(const Graph& g, const std::string& key) const {
+    ExpandCache& c = *cache_;
+    std::shared_ptr<const CachedExpand> r;
+    {
+        std::lock_guard<std::mutex> lk(c.mu);
+        auto it = c.index.find(key);
+        if (it == c.index.end()) {
+            c.misses.add();
+            return nullptr;
         }
+        c.lru.splice(c.lru.begin(), c.lru, it->second);
+        r = it->second->second;
+    }
+    // Filled from a version newer than g: fine to keep, not to check against g.
+    if (r->generation == g.generation && r->seq > g.seq) {
+        c.misses.add();
+        return nullptr;
+    }
+    bool valid = r->generation == g.generation;
+    for (size_t i = 0; valid && i < r->nodes.size(); ++i) valid = g.nodes[r->nodes[i]].changed.load() <= r->seq;
+    if (valid) {
+        c.hits.add();
+        return r;
+    }
+    c.misses.add();
+    c.stale.add();
+    std::lock_guard<std::mutex> lk(c.mu);
+    auto it = c.index.find(key);
+    if (it != c.index.end() && it->second->second == r) {
+        c.bytes -= key.size() + r->bytes();
+        c.lru.erase(it->second);
+        c.index.erase(it);
+    }
+    return nullptr;
+}
+
+void Engine::cache(std::string key, std::shared_ptr<const CachedExpand> r) const {
+    ExpandCache& c = *cache_;
+    size_t bytes = key.size() + r->bytes();
+    if (bytes > c.policy.max_bytes / 4) return;  // would push out most of the rest
+    std::lock_guard<std::mutex> lk(c.mu);
+    if (auto it = c.index.find(key); it != c.index.end()) {
+        // Filled concurrently: keep whichever saw the later version.
+        const CachedExpand& old = *it->second->second;
+        if (std::tie(old.generation, old.seq) >= std::tie(r->generation, r->seq)) return;
+        c.bytes -= key.size() + old.bytes();
+        c.lru.erase(it->second);
+        c.index.erase(it);
+    }
+    c.lru.emplace_front(std::move(key), std::move(r));
+    c.index.emplace(c.lru.front().first, c.lru.begin());
+    c.bytes += bytes;
+    while (c.bytes > c.policy.max_bytes) {
+        auto& [k, v] = c.lru.back();
+        c.bytes -= k.size() + v->bytes();
+        c.index.erase(k);
+        c.lru.pop_back();
+        c.evicted.add();
+    }
+}
+
+// A walk emits exactly what a shallower one with the same walk key would have
+// up to that depth, so each group of such queries runs once, to its greatest
+// depth, and the others get prefixes of its output. Groups in the same scan
+// class share gathered rows.
+void Engine::expand_batch_encoded(const std::vector<ExpandQuery>& qs, std::vector<EncodedResult>& out) const {
+    auto g = snapshot();
+    out.assign(qs.size(), {});
+    struct Group {
+        size_t deepest;
+        std::vector<size_t> members;
+        RowCache* rows = nullptr;
+    };
+    std::vector<Group> groups;
+    std::unordered_map<std::string, size_t> by_walk;
+    std::unordered_map<std::string, std::pair<std::vector<size_t>, std::unique_ptr<RowCache>>> classes;
+    for (size_t i = 0; i < qs.size(); ++i) {
+        std::string scan = scan_key(qs[i]);
+        auto [it, fresh] = by_walk.emplace(walk_key(qs[i], scan), groups.size());
+        if (fresh) {
+            groups.push_back({i, {}});
+            classes[scan].first.push_back(it->second);
+        }
+        Group& gr = groups[it->second];
+        gr.members.push_back(i);
+        if (qs[i].hops > qs[gr.deepest].hops) gr.deepest = i;
+    }
+    for (auto& [k, c] : classes) {
+        // Rows are cached by node alone, while a path filters them per hop.
+        if (c.first.size() < 2 || !qs[groups[c.first[0]].deepest].opt.path.empty()) continue;
+        c.second = std::make_unique<RowCache>();
+        for (size_t gi : c.first) groups[gi].rows = c.second.get();
+    }
+
+    WalkScratch ws;
+    std::string frag;
+    std::vector<std::pair<size_t, bool>> marks;  // output size and truncated as each hop was flushed
+    for (auto& gr : groups) {
+        auto& q = qs[gr.deepest];
+        frag.clear();
+        marks.clear();
+        walk(*g, q.seeds, q.start_ms, q.end_ms, q.hops, q.opt, ws, gr.rows,
+             [&](uint32_t, const std::vector<Item>& items, bool truncated) {
+                 encode_items(*g, items, frag);
+                 marks.emplace_back(frag.size(), truncated);
+                 return true;
+             });
+        for (size_t m : gr.members) {
+            auto [size, truncated] = marks[std::min<size_t>(qs[m].hops, marks.size() - 1)];
+            out[m].fragment.assign(frag, 0, size);
+            out[m].truncated = truncated;
+        }
+    }
+}
+
+void Engine::communities(int64_t s, int64_t e, std::vector<std::pair<std::string, uint32_t>>& out) const {
+    auto g = snapshot();
+    std::vector<uint32_t> win;  // edges in the window
+    auto take = [&](const Csr::Stamp& st) { win.push_back(st.edge); };
+    g->for_each_csr([&](const Csr& c) { in_window(*g, c.stamps(), s, e, take); });
+
+    std::shared_ptr<const Communities> prev;
+    {
+        std::lock_guard<std::mutex> lk(comm_mu_);
+        auto it = comm_cache_.find({s, e});
+        if (it != comm_cache_.end() && it->second.result->generation == g->generation) prev = it->second.result;
+    }
+    size_t total = win.size(), added = 0;
+    if (prev) for (uint32_t ei : win) added += ei >= prev->edges_seen;
+    // Merges are counted engine-wide, so some may have hit edges outside the window.
+    size_t changed = prev ? added + (prev->window_edges + added - total) +
+                                std::min<uint64_t>(g->merges - prev->merges_seen, total)
+                          : total;
+
+    std::shared_ptr<const Communities> res;
+    if (prev && changed == 0) {
+        res = prev;
+    } else {
+        std::unordered_map<uint32_t, uint32_t> local;
+        std::vector<uint32_t> global;
+        auto local_id = [&](uint32_t u) {
+            auto [it, fresh] = local.emplace(u, static_cast<uint32_t>(global.size()));
+            if (fresh) global.push_back(u);
+            return it->second;
+        };
+        std::vector<std::tuple<uint32_t, uint32_t, double>> es;
+        es.reserve(total);
+        for (uint32_t ei : win) {
+            const auto& ed = g->edges[ei];
+            es.emplace_back(local_id(ed.src), local_id(ed.dst), ed.weight.load());
+        }
+        auto wg = WeightedGraph::from_edges(static_cast<uint32_t>(global.size()), std::move(es));
+
+        std::vector<uint32_t> init;
+        if (prev && changed <= kWarmStartFraction * total) {
+            // Nodes new to the window start as singletons past the old label range.
+            uint32_t next = 0;
+            for (auto& [u, c] : prev->labels) next = std::max(next, c + 1);
+            init.resize(global.size());
+            for (size_t i = 0; i < global.size(); ++i) {
+                auto it = prev->labels.find(global[i]);
+                init[i] = it != prev->labels.end() ? it->second : next++;
+            }
+        }
+        auto labels = louvain(wg, init.empty() ? nullptr : &init);
+
+        auto c = std::make_shared<Communities>();
+        c->generation = g->generation;
+        c->edges_seen = g->edges.size();
+        c->merges_seen = g->merges;
+        c->window_edges = total;
+        c->labels.reserve(global.size());
+        for (size_t i = 0; i < global.size(); ++i) c->labels.emplace(global[i], labels[i]);
+        res = c;
+    }
+
+    {
+        std::lock_guard<std::mutex> lk(comm_mu_);
+        comm_cache_[{s, e}] = {res, ++comm_tick_};
+        if (comm_cache_.size() > kCommunityCacheSize) {
+            auto lru = comm_cache_.begin();
+            for (auto it = comm_cache_.begin(); it != comm_cache_.end(); ++it)
+                if (it->second.used < lru->second.used) lru = it;
+            comm_cache_.erase(lru);
+        }
+    }
+    out.reserve(out.size() + res->labels.size());
+    for (auto& [u, c] : res->labels) out.emplace_back(g->ids[u], c);
+}
+
+Engine::Stats Engine::stats() const {
+    auto g = snapshot();
+    Stats st;
+    st.nodes = g->nodes.size();
+    st.edges = g->edges.size();
+    for (auto& p : g->parts) st.delta_segments += p.delta.size();
+    st.node_bytes = g->nodes.bytes() + node_data_bytes_.load();
+    st.edge_bytes = g->edges.bytes() + g->edge_index_bytes;
+    for (auto& c : g->edge_cols) st.attr_bytes += c.values.bytes();
+    g->for_each_csr([&](const Csr& c) { st.adjacency_bytes += c.bytes(); });
+    st.string_bytes = g->id_index->bytes() + types_.bytes() + attr_keys_.bytes() + g->value_index->bytes();
+    if (cache_) {
+        std::lock_guard<std::mutex> lk(cache_->mu);
+        st.cache_bytes = cache_->bytes;
+    }
+    if (related_) {
+        std::lock_guard<std::mutex> lk(related_->mu);
+        st.related_bytes = related_->entries * kRelatedEntryBytes + related_->doc_links * sizeof(std::pair<uint32_t, int64_t>);
+    }
+    return st;
+}
+
+void Engine::register_metrics(metrics::Registry& r) const {
+    auto& m = expand_metrics_;
+    r.add("graph_expand_total", "Expand traversals run.", "", m.calls);
+    r.add("graph_expand_truncated_total", "Expand traversals cut short by a budget.", "", m.truncated);
+    r.add("graph_expand_nodes_returned_total", "Nodes returned by expand.", "", m.nodes_returned);
+    r.add("graph_expand_edges_scanned_total", "In-window adjacency entries examined by expand.", "", m.edges_scanned);
+    r.add("graph_expand_edges_returned_total", "Edges returned by expand.", "", m.edges_returned);
+    for (size_t h = 0; h < kFrontierHops; ++h) {
+        std::string hop = h + 1 < kFrontierHops ? std::to_string(h) : std::to_string(h) + "+";
+        r.add("graph_expand_frontier_nodes", "BFS frontier size when expanding a hop.", "hop=\"" + hop + "\"",
+              m.frontier[h]);
+    }
+    if (cache_) {
+        auto& c = *cache_;
+        r.add("graph_expand_cache_hits_total", "Expands answered from the result cache.", "", c.hits);
+        r.add("graph_expand_cache_misses_total", "Expands the result cache could not answer.", "", c.misses);
+        r.add("graph_expand_cache_stale_total", "Cached expands dropped because a node in them changed.", "", c.stale);
+        r.add("graph_expand_cache_evicted_total", "Cached expands evicted for space.", "", c.evicted);
+        r.gauge("graph_expand_cache_bytes", "Bytes held by the expand result cache.", [&c] {
+            std::lock_guard<std::mutex> lk(c.mu);
+            return double(c.bytes);
+        });
+    }
+    if (related_) {
+        auto& ri = *related_;
+        r.gauge("graph_related_entries", "Node pairs held by the related index, per bucket and relation.", [&ri] {
+            std::lock_guard<std::mutex> lk(ri.mu);
+            return double(ri.entries);
+        });
     }
+    auto& rm = retention_metrics_;
+    r.add("graph_compactions_total", "Retention compactions run.", "", rm.compactions);
+    r.add("graph_retention_edges_dropped_total", "Expired edges dropped by compaction.", "", rm.edges_dropped);
+    r.add("graph_retention_nodes_dropped_total", "Nodes dropped by compaction, expired or left without edges.", "",
+          rm.nodes_dropped);
+    r.add("graph_budget_compactions_total", "Compactions run to bring the engine back under its memory budget.", "",
+          rm.budget_compactions);
+    r.add("graph_upserts_refused_total", "Upsert batches refused while over the memory budget.", "", rm.refused);
+    // Each gauge takes its own stats(); that is a handful of loads per segment and column.
+    r.gauge("graph_nodes", "Nodes in the current version.", [this] { return double(stats().nodes); });
+    r.gauge("graph_edges", "Edges in the current version.", [this] { return double(stats().edges); });
+    r.gauge("graph_delta_segments", "Sparse delta segments not yet folded into the base CSR.",
+            [this] { return double(stats().delta_segments); });
+    r.gauge("graph_node_bytes", "Bytes held by node slots and records.", [this] { return double(stats().node_bytes); });
+    r.gauge("graph_edge_bytes", "Bytes held by the edge table and its dedup index.",
+            [this] { return double(stats().edge_bytes); });
+    r.gauge("graph_attr_bytes", "Bytes held by edge attr columns.", [this] { return double(stats().attr_bytes); });
+    r.gauge("graph_adjacency_bytes", "Bytes held by the base CSR and delta segments.",
+            [this] { return double(stats().adjacency_bytes); });
+    r.gauge("graph_string_bytes", "Bytes held by interned names and their index.",
+            [this] { return double(stats().string_bytes); });
+    r.gauge("graph_related_bytes", "Estimated bytes held by the related-node index.",
+            [this] { return double(stats().related_bytes); });
+    r.gauge("graph_bytes", "Bytes held by the engine, all parts together.", [this] { return double(stats().bytes()); });
 }
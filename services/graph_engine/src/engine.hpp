@@ -1,5 +1,22 @@
 #pragma once
+#include "append_log.hpp"
+#include "bitset.hpp"
+#include "csr.hpp"
+#include "interner.hpp"
+#include "key_index.hpp"
+#include "metrics.hpp"
+#include "work_pool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -18,14 +35,614 @@ struct EdgeRec {
     std::unordered_map<std::string, std::string> attrs;
 };
 
+// Upsert inputs borrow their strings (e.g. straight from a parsed request), so
+// the only copies made are the ones the engine keeps.
+using AttrView = std::pair<std::string_view, std::string_view>;
+struct NodeIn {
+    std::string_view id, type;
+    int64_t ts = 0;
+    std::vector<AttrView> attrs;
+};
+struct EdgeIn {
+    std::string_view src, dst, type;
+    double weight = 1.0;
+    int64_t ts = 0;
+    std::vector<AttrView> attrs;
+};
+
+struct ExpandOptions {
+    uint32_t max_nodes = 0;    // 0 = unlimited; counts seeds
+    uint32_t max_edges = 0;    // 0 = unlimited
+    uint32_t top_k = 0;        // keep only the k heaviest in-window edges per expanded node
+    bool dedup_edges = false;  // emit each edge once, not once per endpoint
+    std::vector<std::pair<std::string, std::string>> edge_attrs;  // walk only edges carrying all of these
+    // Type filters; empty allows every type. An edge is walked only if it has
+    // one of edge_types and leads to a node with one of node_types; nodes only
+    // seen as edge endpoints have no type. Seeds are taken whatever their type.
+    std::vector<std::string> edge_types, node_types;
+    // A path pattern: hop i also obeys path[i - 1]'s filters, and the walk
+    // ends with the path. E.g. {{{}, {"doc"}}, {{}, {"entity"}}} goes from
+    // entities through their docs to co-mentioned entities.
+    struct Step { std::vector<std::string> edge_types, node_types; };
+    std::vector<Step> path;
+};
+
+// Where one expand_encoded spent its time, when asked: per hop, the walk up
+// to the hop's output and its encoding. A walk served from the expand cache
+// has no hops and `cached` set.
+struct ExpandTiming {
+    struct Hop { int64_t walk_us = 0, encode_us = 0; };
+    std::vector<Hop> hops;
+    bool cached = false;
+};
+
+// Ranking around a seed set by in-window edge weight; see Engine::rank().
+// Edges with weight <= 0 carry no score.
+struct RankOptions {
+    enum Method { kTopNeighbors, kPageRank };
+    Method method = kTopNeighbors;
+    uint32_t k = 20;          // nodes ranked, seeds excluded
+    double alpha = 0.15;      // PageRank: probability of restarting at the seeds
+    double epsilon = 1e-4;    // PageRank: push while residual > epsilon * weighted degree
+    uint32_t max_edges = 0;   // edges returned among seeds and ranked nodes; 0 = unlimited
+    std::vector<std::pair<std::string, std::string>> edge_attrs;  // score only edges carrying all of these
+};
+
+// The related-node index behind Engine::related(); see index_related(). Edge
+// types are matched by name: co-occurrence edges join two entities, mention
+// edges run from a doc to an entity.
+struct RelatedPolicy {
+    uint32_t summary_k = 32;        // entries a query reads per node and bucket; 0 disables the index
+    uint32_t max_entity_docs = 16;  // docs an entity relates to each other; later ones are not paired
+    std::string cooccur_type = "CO_OCCUR", mention_type = "MENTIONS";
+};
+
+struct RelatedOptions {
+    // Entities: co-occurring ones for an entity, those mentioned for a doc.
+    // Docs: those sharing entities with a doc, those mentioning an entity.
+    bool docs = false;
+    uint32_t k = 20;  // nodes returned, the ids asked about excluded
+};
+
+struct ExpandQuery {
+    std::vector<std::string> seeds;
+    int64_t start_ms = 0, end_ms = 0;
+    uint32_t hops = 0;
+    ExpandOptions opt;
+};
+
+// Edges with the same endpoints (either direction) and type whose ts fall in
+// the same bucket are one edge: a re-upsert merges into it instead of adding a
+// duplicate. The defaults make re-ingesting a document a no-op.
+struct UpsertPolicy {
+    enum Weight { kMax, kSum, kLast };
+    int64_t bucket_ms = 86400000;  // 0 keeps every upsert as its own edge
+    Weight weight = kMax;
+    bool latest_ts = true;  // merged edge takes the newest ts (always within its bucket), else the first
+};
+
+// Recent expand_encoded results kept for reuse; see Engine::cache_expands().
+struct ExpandCachePolicy {
+    size_t max_bytes = 0;  // 0 disables the cache
+};
+
+struct PersistOptions {
+    std::string dir;                       // snapshot and WAL segments live here
+    size_t snapshot_wal_bytes = 256 << 20;  // snapshot once the live WAL segment reaches this
+    bool sync = false;                     // fdatasync every WAL record, not just snapshots
+};
+
+// Edges expire once their ts is older than ttl_ms against the wall clock, or
+// oldest first once the engine outgrows its memory budget; see Engine::retain().
+struct RetentionPolicy {
+    int64_t ttl_ms = 0;             // 0 keeps everything
+    double compact_fraction = 0.1;  // compact once about this share of the edges has expired
+    int64_t check_ms = 60000;
+    // Caps on Engine::Stats::bytes(), 0 for none. Past soft_bytes the oldest
+    // edges are compacted away until about low_water of it is left; past
+    // hard_bytes upserts are refused. A compaction copies the survivors before
+    // the old generation goes, so leave it room between the two.
+    size_t soft_bytes = 0, hard_bytes = 0;
+    double low_water = 0.8;
+};
+
+class Wal;
+
+// Node ids are interned to dense indices. Adjacency is partitioned by edge
+// type, so a type-filtered walk never reads the rows of other types; each
+// partition is a base CSR plus a short list of sparse delta segments holding
+// recent upserts, folded into a new base once they grow past a fraction of it.
+//
+// Nodes are stored as pre-encoded graph.Node bytes, so expand_encoded can
+// splice them into a response verbatim. Edge attrs live in one column per
+// interned key holding dictionary-encoded value ids; records only get an attrs
+// map when they are returned.
+//
+// Node upserts patch: attrs are merged key by key into the stored record, and
+// an empty type or zero ts keeps the previous value. Duplicate edges merge
+// weight and ts per UpsertPolicy and keep the attrs they were first seen with.
+//
+// Thread safety: all methods may be called concurrently. Upserts are serialised
+// on a writer mutex and publish a new immutable Graph version when done; expand
+// runs lock-free on whichever version was current when it started, so readers
+// never wait for an ingest batch.
+//
+// Persistence is optional (see open()): each upsert batch is appended to a
+// write-ahead log before it is applied, and once the log grows past a threshold
+// a background thread writes the then-current version as a flat snapshot. A
+// restart maps the snapshot in place and replays only the log written since.
 class Engine {
 public:
+    // Expands whose frontier grows past kParallelFrontier split each hop over
+    // `expand_threads` cores (0 = all, 1 = never); the pool starts on first use.
+    explicit Engine(const UpsertPolicy& policy = {}, unsigned expand_threads = 0);
+    ~Engine();
+    // Restores state from opt.dir and logs every later upsert there. Call once,
+    // on a fresh engine, before serving. Throws std::runtime_error on I/O errors
+    // or a corrupt snapshot; upserts throw if their WAL append fails.
+    void open(const PersistOptions& opt);
+    // Snapshots the current version now and drops the WAL segments it covers.
+    void checkpoint();
+    // Drops edges with ts < cutoff_ms, then nodes left without edges whose own
+    // ts is older too. Survivors are copied into a new, renumbered generation
+    // off the writer lock, from the version current at the start; upserts made
+    // meanwhile are caught up under the lock before it is published. Expands
+    // on older versions keep the storage they hold until they finish. With
+    // persistence a snapshot follows, so expired data leaves the disk as well.
+    // Returns the number of edges dropped.
+    size_t compact(int64_t cutoff_ms);
+    // Starts a thread that checks every policy.check_ms and compacts once about
+    // policy.compact_fraction of the edges have expired, or sooner once an
+    // upsert takes the engine past policy.soft_bytes; from then on upserts
+    // throw OverBudget while it is past policy.hard_bytes. Call at most once,
+    // after open().
+    void retain(const RetentionPolicy& policy);
+    // Keeps expand_encoded results, up to policy.max_bytes of them, least recently
+    // used evicted first. Entries are keyed by the exact window, so a hit returns
+    // what the walk would; "the last 14 days" asked moments apart shares one
+    // only if the client rounds its "now". An entry is reused only while none
+    // of the nodes it returned has changed: upserts stamp the nodes they patch
+    // and both ends of the edges they add or merge with the version publishing
+    // the change. Call at most once, before serving.
+    void cache_expands(const ExpandCachePolicy& policy);
+    // Maintains the related-node index: per bucket of UpsertPolicy::bucket_ms
+    // (a day if 0), the weight each node has to every other node it relates to,
+    // indexed from the edges present now and then from every upsert. Entities
+    // relate to entities by co-occurrence weight and to docs by mention weight
+    // both ways; two docs sharing an entity relate by 1 per entity shared, in
+    // the bucket of the other doc's mention. An entity mentioned by more than
+    // policy.max_entity_docs docs does not relate new ones to each other.
+    // Compaction drops the buckets wholly before its cutoff. Call at most
+    // once, after open() and before serving.
+    void index_related(const RelatedPolicy& policy);
+
+    // Sizes of the current version. Bytes count what the engine allocated (or
+    // mapped) for each part, whole blocks and chunks included, but not
+    // allocator overhead; the related index is estimated from its entries.
+    struct Stats {
+        size_t nodes = 0, edges = 0, delta_segments = 0;
+        size_t node_bytes = 0;       // node slots and encoded records
+        size_t edge_bytes = 0;       // edge table and its dedup index
+        size_t attr_bytes = 0;       // edge attr columns
+        size_t adjacency_bytes = 0;  // base CSR and delta segments
+        size_t string_bytes = 0;     // interned ids, types, attr keys and values
+        size_t cache_bytes = 0;      // cached expands
+        size_t related_bytes = 0;    // related-node index
+        size_t bytes() const {
+            return node_bytes + edge_bytes + attr_bytes + adjacency_bytes + string_bytes + cache_bytes + related_bytes;
+        }
+    };
+    // Thrown by upserts while Stats::bytes() is past RetentionPolicy::hard_bytes;
+    // nothing of the batch was logged or applied.
+    struct OverBudget : std::runtime_error {
+        using std::runtime_error::runtime_error;
+    };
+    Stats stats() const;
+    // Exports the expand counters and histograms and the Stats gauges.
+    void register_metrics(metrics::Registry& r) const;
+    void upsert_nodes(const std::vector<NodeIn>& ns);
+    void upsert_edges(const std::vector<EdgeIn>& es);
     void upsert_nodes(const std::vector<NodeRec>& ns);
     void upsert_edges(const std::vector<EdgeRec>& es);
+    // One chunk of a bulk ingest (a graph.IngestChunk), decoded in place. The
+    // stages of a bulk ingest may run on different threads, beside any other
+    // call: decode() and prepare() work off the writer lock, so that upsert()
+    // mostly only appends.
+    struct Batch {
+        std::unique_ptr<const std::string> bytes;  // nodes and edges view into it
+        std::vector<NodeIn> nodes;
+        std::vector<EdgeIn> edges;
+        // From prepare(): src, dst and type of each edge as interned in
+        // `generation`, kNone where not yet, and the edges' WAL record.
+        uint64_t generation = 0;
+        std::vector<uint32_t> ids;
+        std::string wal;
+    };
+    // False if `bytes` is not a well-formed IngestChunk.
+    static bool decode(std::string bytes, Batch& out);
+    // After open(), if at all.
+    void prepare(Batch& b) const;
+    // Applies the batches in order as one upsert, logged and published once:
+    // all their nodes, then all their edges.
+    void upsert(const std::vector<Batch>& batches);
+    // Called once per hop with the nodes first reached at that hop and the edges
+    // walked from the previous frontier; `truncated` is set on the hop where a
+    // budget ran out. Returning false stops the expansion.
+    using HopSink = std::function<bool(uint32_t hop, std::vector<NodeRec>& nodes, std::vector<EdgeRec>& edges,
+                                       bool truncated)>;
+    void expand(const std::vector<std::string>& seeds, int64_t start_ms, int64_t end_ms, uint32_t hops,
+                const ExpandOptions& opt, const HopSink& sink) const;
     void expand(const std::vector<std::string>& seeds, int64_t start_ms, int64_t end_ms, uint32_t hops,
                 std::vector<NodeRec>& out_nodes, std::vector<EdgeRec>& out_edges) const;
+    // Same traversal, but each hop arrives as the serialized nodes/edges fields
+    // of a graph.GraphFragment, built from the stored bytes without materializing records.
+    // `timing`, if given, gets where the time went; time spent in `sink` is not counted.
+    using EncodedSink = std::function<bool(uint32_t hop, std::string& fragment, bool truncated)>;
+    void expand_encoded(const std::vector<std::string>& seeds, int64_t start_ms, int64_t end_ms, uint32_t hops,
+                        const ExpandOptions& opt, const EncodedSink& sink, ExpandTiming* timing = nullptr) const;
+    // Runs every query against one version; out[i] is what expand_encoded gives
+    // query i, hops concatenated. Queries with the same window, attr filter and
+    // top_k share the rows they gather, so overlapping seeds and frontiers are
+    // scanned once, and identical queries run once.
+    struct EncodedResult {
+        std::string fragment;
+        bool truncated = false;
+    };
+    void expand_batch_encoded(const std::vector<ExpandQuery>& qs, std::vector<EncodedResult>& out) const;
+    // One hop of a sharded expand, asked of the shard owning `ids`: a graph.HopRow
+    // per id, in order, under HopResponse.rows. A row holds the stored node and,
+    // with `edges`, the edges a walk from it would consider: in the window,
+    // attr-filtered and top_k-cut. Budgets and visited sets are the caller's.
+    void hop_rows_encoded(const std::vector<std::string>& ids, int64_t start_ms, int64_t end_ms, bool edges,
+                          const ExpandOptions& opt, std::string& out) const;
+    // The opt.k best nodes around `seeds` by the edges in [start_ms, end_ms],
+    // best first. kTopNeighbors scores each neighbor of the seeds by its total
+    // edge weight to them. kPageRank approximates personalized PageRank with
+    // restarts spread evenly over the seeds by forward push: only nodes whose
+    // residual mass exceeds epsilon times their weighted degree are expanded,
+    // so the work depends on epsilon and alpha, not on the size of the graph
+    // or the degree of the seeds' neighbors. Ties go to the lower node index.
+    void rank(const std::vector<std::string>& seeds, int64_t start_ms, int64_t end_ms, const RankOptions& opt,
+              std::vector<std::pair<std::string, double>>& out) const;
+    // Same ranking as a graph.RankResponse: the seeds found, then the ranked
+    // nodes, each with its score, and the in-window edges among all of them.
+    void rank_encoded(const std::vector<std::string>& seeds, int64_t start_ms, int64_t end_ms,
+                      const RankOptions& opt, std::string& out) const;
+    // Every edge with ts in [start_ms, end_ms], found through the segment time indexes.
+    void window_edges(int64_t start_ms, int64_t end_ms, std::vector<EdgeRec>& out_edges) const;
+    // Louvain communities of the subgraph formed by edges in the window. Results
+    // are cached per window: reused as-is if no edge in it changed since, and
+    // used to warm-start the next run if only a small fraction did.
+    void communities(int64_t start_ms, int64_t end_ms, std::vector<std::pair<std::string, uint32_t>>& out) const;
+    // The opt.k nodes most related to `ids` by the related index, summed over
+    // the buckets overlapping [start_ms, end_ms], best first, ties to the lower
+    // node index. Each bucket contributes only the summary_k heaviest entries
+    // of each row, so the work is O(ids x buckets x summary_k) and scores are
+    // exact unless `approximate` is set: then some row had more entries than
+    // its summary and the ones left out were not counted. False, with nothing
+    // found, unless index_related() was called.
+    bool related(const std::vector<std::string>& ids, int64_t start_ms, int64_t end_ms, const RelatedOptions& opt,
+                 std::vector<std::pair<std::string, double>>& out, bool* approximate = nullptr) const;
+    // Same as a graph.RankResponse: the ids found with score 0, then the related
+    // nodes, without edges; truncated is `approximate`.
+    bool related_encoded(const std::vector<std::string>& ids, int64_t start_ms, int64_t end_ms,
+                         const RelatedOptions& opt, std::string& out) const;
 private:
-    std::unordered_map<std::string, NodeRec> nodes_;
-    std::vector<EdgeRec> edges_;
-    std::unordered_map<std::string, std::vector<size_t>> adj_;
+    struct NodeData {
+        uint32_t type = 0;
+        int64_t ts = 0;
+        std::string wire;  // serialized graph.Node
+        size_t bytes() const { return sizeof(NodeData) + wire.capacity(); }
+    };
+    // Plain storage accessed with relaxed atomics, so fields merged in place can
+    // be read concurrently while Edge stays trivially copyable for snapshots.
+    template <class T>
+    struct Relaxed {
+        T v{};
+        T load() const { T r; __atomic_load(&v, &r, __ATOMIC_RELAXED); return r; }
+        void store(T x) { __atomic_store(&v, &x, __ATOMIC_RELAXED); }
+    };
+    // `data` is replaced wholesale on upsert via std::atomic_store; null for ids
+    // only seen as edge endpoints. `changed` is the seq of the version that
+    // last changed the node's data or edges, within its generation.
+    struct Node {
+        std::shared_ptr<const NodeData> data;
+        Relaxed<uint64_t> changed;
+    };
+    struct Edge {
+        uint32_t src = 0, dst = 0, type = 0;
+        Relaxed<double> weight;  // weight and ts change when a duplicate is merged
+        Relaxed<int64_t> ts;
+    };
+    // Value ids for one attr key, indexed by edge from the first edge that set
+    // it; the tail is only padded with kNone when the key is next written.
+    struct Column {
+        uint32_t base = 0;
+        AppendLog<uint32_t> values;
+    };
+    struct ColumnView {
+        uint32_t base = 0;
+        AppendLog<uint32_t>::View values;
+        uint32_t at(uint32_t ei) const {
+            return ei >= base && ei - base < values.size() ? values[ei - base] : Interner::kNone;
+        }
+    };
+    // The adjacency of one edge type.
+    struct Partition {
+        std::shared_ptr<const Csr> base = std::make_shared<const Csr>();
+        Csr::Segments delta;  // oldest first
+        size_t delta_entries = 0;
+    };
+    using Pairs = std::vector<std::pair<uint32_t, Csr::Entry>>;
+    struct Graph {
+        AppendLog<std::string_view>::View ids, types, attr_keys, attr_values;
+        // Name lookups in this version's numbering, which compact() changes.
+        std::shared_ptr<const Interner> id_index, value_index;
+        uint64_t generation = 0;  // compactions before this version
+        uint64_t seq = 0;         // versions published before this one
+        AppendLog<Node>::View nodes;
+        AppendLog<Edge>::View edges;
+        std::vector<ColumnView> edge_cols;  // by attr key id
+        uint64_t merges = 0;  // duplicate edges merged so far
+        size_t edge_index_bytes = 0;   // of edge_index_ as published
+        std::vector<Partition> parts;  // by edge type id
+        // f(const Csr&) over every base and segment.
+        template <class F>
+        void for_each_csr(F&& f) const {
+            for (auto& p : parts) {
+                f(*p.base);
+                for (auto& seg : p.delta) f(*seg);
+            }
+        }
+    };
+
+    struct Communities {
+        uint64_t generation = 0;  // of the version it was computed on, as are:
+        size_t edges_seen = 0;    // its edge count
+        uint64_t merges_seen = 0;
+        size_t window_edges = 0;
+        std::unordered_map<uint32_t, uint32_t> labels;  // node index -> community
+    };
+    struct CommunitySlot { std::shared_ptr<const Communities> result; uint64_t used = 0; };
+
+    // One cached expand, valid while its generation is current and none of
+    // `nodes` has changed after `seq`.
+    struct CachedExpand {
+        uint64_t generation = 0, seq = 0;
+        std::vector<uint32_t> nodes;
+        std::string fragment;                       // every hop, concatenated
+        std::vector<std::pair<size_t, bool>> hops;  // fragment size and truncated after each hop
+        size_t bytes() const {
+            return sizeof(CachedExpand) + fragment.capacity() + nodes.capacity() * sizeof(uint32_t) +
+                   hops.capacity() * sizeof(hops[0]);
+        }
+    };
+    struct ExpandCache {
+        using Lru = std::list<std::pair<std::string, std::shared_ptr<const CachedExpand>>>;  // most recent first
+        ExpandCachePolicy policy;
+        std::mutex mu;
+        Lru lru;
+        std::unordered_map<std::string_view, Lru::iterator> index;  // keys point into lru
+        size_t bytes = 0;
+        metrics::Counter hits, misses, stale, evicted;
+    };
+
+    // One node's related nodes in one bucket: exact weights and, for a row
+    // with more than summary_k, the heaviest summary_k of them, best first,
+    // rebuilt by the first query after a change.
+    struct RelatedRow {
+        std::unordered_map<uint32_t, double> weights;
+        std::vector<std::pair<uint32_t, double>> top;
+        bool stale = false;
+        const std::vector<std::pair<uint32_t, double>>& summary(size_t k);
+    };
+    // Node indices are in the numbering of the engine's current generation;
+    // compact() renumbers the index with the rest. Written under write_mu_ and
+    // mu, read under mu.
+    struct RelatedIndex {
+        enum Relation { kEntities, kDocs };
+        using Rows = std::unordered_map<uint32_t, std::map<int64_t, RelatedRow>>;  // node -> bucket -> row
+        RelatedPolicy policy;
+        std::mutex mu;
+        Rows rows[2];  // by Relation
+        std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, int64_t>>> docs;  // entity -> docs, with bucket
+        size_t entries = 0, doc_links = 0;  // row weights; docs listed under entities
+        // What queries resolve and encode ids with, current as of the last update.
+        std::shared_ptr<const Interner> ids;
+        AppendLog<std::string_view>::View names;
+        AppendLog<Node>::View nodes;
+        // Edges [0, edges) are indexed; an upsert notes the weight older ones
+        // gained by merges, and both are applied as it publishes.
+        uint32_t edges = 0;
+        std::vector<std::pair<uint32_t, double>> merged;
+
+        void add(Relation rel, uint32_t u, int64_t bucket, uint32_t v, double w);
+    };
+
+    static constexpr size_t kMinDelta = 4096;
+    static constexpr size_t kCommunityCacheSize = 16;
+    static constexpr double kWarmStartFraction = 0.1;
+    // A related row weight: its hash node and bucket slot.
+    static constexpr size_t kRelatedEntryBytes = 40;
+    static constexpr size_t kFrontierHops = 8;  // frontier histograms by hop, the last one is "7+"
+    // Below these a hop's gather / encode stays on the calling thread.
+    static constexpr size_t kParallelFrontier = 2048, kFrontierGrain = 64;
+    static constexpr size_t kParallelItems = 8192, kItemGrain = 1024;
+    static constexpr size_t kMaxPushes = 1 << 18;  // PageRank pushes per query
+
+    struct ExpandMetrics {
+        metrics::Counter calls, truncated, nodes_returned, edges_scanned, edges_returned;
+        metrics::Histogram frontier[kFrontierHops];
+    };
+    struct RetentionMetrics {
+        metrics::Counter compactions, edges_dropped, nodes_dropped, budget_compactions, refused;
+    };
+
+    // Filtered, top_k-cut rows of one scan class, shared by the queries of a batch.
+    struct RowCache {
+        std::unordered_map<uint32_t, std::pair<uint32_t, uint32_t>> span;  // node -> offset, count in pool
+        std::vector<Csr::Entry> pool;
+    };
+    // What a hop emits, in discovery order: nodes as they are first reached,
+    // edges as they are kept.
+    struct Item {
+        uint32_t index;
+        bool edge;
+    };
+    // Traversal buffers, reused across the queries of a batch.
+    struct WalkScratch {
+        Bitset seen, seen_edges;
+        std::vector<uint32_t> frontier, next;
+        std::vector<Csr::Entry> cand;
+        std::vector<Item> items;
+        std::vector<std::vector<Csr::Entry>> chunk_rows;  // parallel gather: rows of each frontier chunk
+        std::vector<uint32_t> row_len;                    // and of each frontier node
+        std::vector<uint32_t> rejected;                   // nodes a node type filter turned away
+    };
+
+    // Type names resolved to ids; names never interned match nothing.
+    struct TypeSet {
+        bool all = true;
+        std::vector<uint32_t> ids;  // sorted, unless all
+        bool has(uint32_t t) const { return all || std::binary_search(ids.begin(), ids.end(), t); }
+    };
+    // opt.edge_attrs and edge types, and those of `step` if given, resolved against one version.
+    struct EdgeFilter {
+        std::vector<std::pair<uint32_t, uint32_t>> want;  // attr key id, value id
+        bool none = false;                                // some pair can never match
+        TypeSet types;                                    // partitions to scan
+    };
+
+    std::shared_ptr<const Graph> snapshot() const { return std::atomic_load(&graph_); }
+    static EdgeRec edge_rec(const Graph& g, uint32_t ei);
+    static bool node_rec(const Graph& g, uint32_t u, NodeRec& out);
+    // Appends edge ei as a graph.Edge submessage under `field`.
+    static void encode_edge(const Graph& g, uint32_t ei, uint32_t field, std::string& out);
+    // Names allowed by both lists, an empty one allowing all.
+    TypeSet type_set(const std::vector<std::string>& a, const std::vector<std::string>* b) const;
+    EdgeFilter edge_filter(const Graph& g, const ExpandOptions& opt, const ExpandOptions::Step* step = nullptr) const;
+    void collect(const Graph& g, uint32_t u, int64_t s, int64_t e, const ExpandOptions& opt, const EdgeFilter& f,
+                 std::vector<Csr::Entry>& out, size_t& scanned) const;
+    template <class OnHop>
+    void walk(const Graph& g, const std::vector<std::string>& seeds, int64_t s, int64_t e, uint32_t hops,
+              const ExpandOptions& opt, WalkScratch& ws, RowCache* rows, OnHop&& on_hop) const;
+    // The cached result for `key`, if still valid on g; a stale one is dropped.
+    std::shared_ptr<const CachedExpand> cached(const Graph& g, const std::string& key) const;
+    void cache(std::string key, std::shared_ptr<const CachedExpand> c) const;
+    // Marks u as changed by the version the current upsert will publish.
+    void touch(uint32_t u) { nodes_[u].changed.store(seq_ + 1); }
+    // Appends the GraphFragment fields of `items`, in parallel chunks when there are many.
+    void encode_items(const Graph& g, const std::vector<Item>& items, std::string& out) const;
+    WorkPool* expand_pool() const;
+    uint32_t node_index(std::string_view id);
+    // The parts of an upsert, all under write_mu_. Nodes are patched first and
+    // stored once logged; insert_edges() takes ids from prepare() if given.
+    struct NodePatches {
+        std::vector<uint32_t> us;
+        std::vector<std::shared_ptr<const NodeData>> ds;
+        std::unordered_map<uint32_t, size_t> latest;  // a node repeated in the batch patches its own earlier entry
+    };
+    void patch_nodes(const std::vector<NodeIn>& ns, NodePatches& p);
+    void store_nodes(NodePatches& p);
+    void insert_edges(const std::vector<EdgeIn>& es, const Batch* prepared, Pairs& pairs);
+    void publish_edges(Pairs pairs);
+    // Adds pairs of one edge type to its partition as a new delta segment.
+    void add_delta(Partition& p, Pairs pairs) const;
+    // Pairs grouped by the type of their edge, indexed by type id.
+    static std::vector<Pairs> by_type(Pairs pairs, const AppendLog<Edge>& edges);
+    void publish(std::vector<Partition> parts);
+    // Time windows over CSR entries, which keep the ts an edge was first seen
+    // with: when merges may move ts forward (within the bucket), the search is
+    // widened by a bucket and the stored ts decides.
+    template <class T, class F>
+    void in_window(const Graph& g, Csr::Range<T> r, int64_t s, int64_t e, F&& f) const;
+    uint64_t edge_hash(uint32_t a, uint32_t b, uint32_t type, int64_t bucket) const;
+    int64_t bucket(int64_t ts) const;
+    uint32_t find_edge(uint32_t src, uint32_t dst, uint32_t type, int64_t ts) const;
+    void index_edge(uint32_t ei);
+    bool merge_edge(uint32_t ei, const EdgeIn& e);
+    std::shared_ptr<NodeData> patch_node(const NodeIn& n, const NodeData* old);
+    // Ranking, in rank.cpp: the seeds found (first, in order) and the ranked
+    // nodes with their scores, and with `edges` the edges among them.
+    struct Ranking {
+        std::vector<std::pair<uint32_t, double>> nodes;
+        size_t seeds = 0;
+        std::vector<uint32_t> edges;
+        bool truncated = false;  // the push budget or max_edges ran out
+    };
+    void rank(const Graph& g, const std::vector<std::string>& seeds, int64_t s, int64_t e, const RankOptions& opt,
+              bool edges, Ranking& out) const;
+    // The related index, in related.cpp. relate() applies the edges an upsert
+    // noted, remap_related() follows a compaction.
+    int64_t related_bucket(int64_t ts) const;
+    void relate();
+    void remap_related(const std::vector<uint32_t>& node_map, int64_t cutoff);
+    bool related(const std::vector<std::string>& ids, int64_t s, int64_t e, const RelatedOptions& opt, Ranking& out,
+                 AppendLog<std::string_view>::View& names, AppendLog<Node>::View& nodes) const;
+    // graph.Node / graph.Edge bodies; false if malformed. In ingest.cpp.
+    static bool decode_node(std::string_view body, NodeIn& out);
+    static bool decode_edge(std::string_view body, EdgeIn& out);
+    // Persistence, in persist.cpp.
+    static std::string wal_edges(const std::vector<EdgeIn>& es);
+    void replay(uint8_t kind, std::string_view batch);
+    uint64_t load_snapshot(const std::string& path);
+    void write_snapshot(const Graph& g, const std::string& path, uint64_t wal_seq) const;
+    void save_undo(uint32_t ei);
+    void maybe_checkpoint(bool force = false);
+    // Retention, in retention.cpp.
+    struct Generation;
+    static void set_attr(std::vector<Column>& cols, uint32_t key, uint32_t ei, uint32_t val);
+    static size_t expired(const Graph& g, int64_t cutoff);  // edges first seen before cutoff
+    static int64_t budget_cutoff(const Graph& g, double share);
+    void admit();  // throws OverBudget
+
+    const UpsertPolicy policy_;
+    std::mutex write_mu_;
+    // Ids and attr values are renumbered by compact(); types and attr keys are few and kept.
+    std::shared_ptr<Interner> ids_ = std::make_shared<Interner>(), attr_values_ = std::make_shared<Interner>();
+    Interner types_, attr_keys_;
+    AppendLog<Node> nodes_;
+    AppendLog<Edge> edges_;
+    std::vector<Column> edge_cols_;
+    KeyIndex edge_index_;  // by edge key; covers edges [0, indexed_)
+    uint32_t indexed_ = 0;
+    uint64_t merges_ = 0;
+    uint64_t generation_ = 0;
+    uint64_t seq_ = 0;
+    std::atomic<uint64_t> node_data_bytes_{0};
+    mutable ExpandMetrics expand_metrics_;
+    const unsigned expand_threads_;
+    mutable std::once_flag pool_once_;
+    mutable std::unique_ptr<WorkPool> pool_;
+    std::shared_ptr<const Graph> graph_;
+
+    PersistOptions persist_;
+    std::unique_ptr<Wal> wal_;  // null unless open()ed
+    std::thread snap_thread_;
+    std::atomic<bool> snap_busy_{false};
+    // While a background snapshot writes edges [0, undo_limit_), merges save the
+    // pre-merge value here first so the file still shows the rotated version.
+    mutable std::mutex undo_mu_;
+    std::map<uint32_t, Edge> undo_;
+    std::atomic<uint32_t> undo_limit_{0};
+
+    std::mutex compact_mu_;  // one compaction at a time
+    // While a compaction copies the version it started from, upserts note the
+    // older nodes and edges they change here (under write_mu_).
+    bool compacting_ = false;
+    std::vector<uint32_t> compact_nodes_, compact_merged_;
+    RetentionMetrics retention_metrics_;
+    std::thread retention_thread_;
+    std::mutex retention_mu_;
+    std::condition_variable retention_cv_;
+    bool stopping_ = false;
+    bool over_soft_ = false;  // an upsert found the engine past soft_bytes_; under retention_mu_
+    std::atomic<size_t> soft_bytes_{0}, hard_bytes_{0};
+
+    std::unique_ptr<ExpandCache> cache_;  // null unless cache_expands()ed
+    std::unique_ptr<RelatedIndex> related_;  // null unless index_related()ed
+
+    mutable std::mutex comm_mu_;
+    mutable std::map<std::pair<int64_t, int64_t>, CommunitySlot> comm_cache_;
+    mutable uint64_t comm_tick_ = 0;
 };
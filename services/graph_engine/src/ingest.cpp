@@ -0,0 +1,91 @@
+#include "engine.hpp"
+#include "wal.hpp"
+#include "wire.hpp"
+
+namespace {
+auto push_attr(std::vector<AttrView>& attrs) {
+    return [&attrs](std::string_view k, std::string_view v) { attrs.emplace_back(k, v); };
+}
+}
+
+bool Engine::decode_node(std::string_view body, NodeIn& n) {
+    using namespace wire;
+    bool ok = for_each_field(body, [&](uint32_t f, uint32_t, uint64_t v, std::string_view b) {
+        if (f == node::kId) n.id = b;
+        else if (f == node::kTs) n.ts = int64_t(v);
+        else if (f == node::kType) n.type = b;
+    });
+    return ok && for_each_entry(body, node::kAttrs, push_attr(n.attrs));
+}
+
+bool Engine::decode_edge(std::string_view body, EdgeIn& e) {
+    using namespace wire;
+    e.weight = 0;  // proto3 omits a zero weight
+    bool ok = for_each_field(body, [&](uint32_t f, uint32_t, uint64_t v, std::string_view b) {
+        if (f == edge::kSrc) e.src = b;
+        else if (f == edge::kDst) e.dst = b;
+        else if (f == edge::kWeight) std::memcpy(&e.weight, &v, 8);
+        else if (f == edge::kTs) e.ts = int64_t(v);
+        else if (f == edge::kType) e.type = b;
+    });
+    return ok && for_each_entry(body, edge::kAttrs, push_attr(e.attrs));
+}
+
+bool Engine::decode(std::string bytes, Batch& out) {
+    out.bytes = std::make_unique<const std::string>(std::move(bytes));
+    bool ok = true;
+    bool parsed = wire::for_each_field(*out.bytes, [&](uint32_t f, uint32_t type, uint64_t, std::string_view body) {
+        if (type != wire::kLen || !ok) return;
+        if (f == wire::ingest::kNodes) {
+            out.nodes.emplace_back();
+            ok = decode_node(body, out.nodes.back());
+        } else if (f == wire::ingest::kEdges) {
+            out.edges.emplace_back();
+            ok = decode_edge(body, out.edges.back());
+        }
+    });
+    return parsed && ok;
+}
+
+// Lookups only: names new to the engine are interned by upsert(), and if a
+// compaction renumbers ids in between, upsert() resolves everything again.
+void Engine::prepare(Batch& b) const {
+    auto g = snapshot();
+    b.generation = g->generation;
+    b.ids.resize(3 * b.edges.size());
+    for (size_t i = 0; i < b.edges.size(); ++i) {
+        const EdgeIn& e = b.edges[i];
+        b.ids[3 * i] = g->id_index->find(e.src);
+        b.ids[3 * i + 1] = g->id_index->find(e.dst);
+        b.ids[3 * i + 2] = types_.find(e.type);
+    }
+    if (wal_ && !b.edges.empty()) b.wal = wal_edges(b.edges);
+}
+
+void Engine::upsert(const std::vector<Batch>& batches) {
+    // One WAL record per kind for the lot; unprepared batches are encoded here.
+    std::string log;
+    const std::string* wal = &log;
+    if (wal_) {
+        if (batches.size() == 1 && !batches[0].wal.empty()) wal = &batches[0].wal;
+        else for (auto& b : batches) log += b.wal.empty() ? wal_edges(b.edges) : b.wal;
+    }
+    size_t edges = 0;
+    for (auto& b : batches) edges += b.edges.size();
+
+    std::lock_guard<std::mutex> lk(write_mu_);
+    admit();
+    NodePatches p;
+    for (auto& b : batches) patch_nodes(b.nodes, p);
+    if (!p.us.empty()) store_nodes(p);
+    if (edges) {
+        if (wal_) wal_->append(Wal::kEdges, *wal);
+        Pairs pairs;
+        pairs.reserve(edges * 2);
+        for (auto& b : batches) insert_edges(b.edges, &b, pairs);
+        publish_edges(std::move(pairs));
+    } else {
+        publish(snapshot()->parts);
+    }
+    maybe_checkpoint();
+}
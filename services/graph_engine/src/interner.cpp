@@ -0,0 +1,19 @@
+#include "interner.hpp"
+#include <mutex>
+
+uint32_t Interner::intern(std::string_view s) {
+    // Only the writer mutates, so it can probe without the lock.
+    uint64_t h = hash(s);
+    auto eq = [&](uint32_t id) { return names_[id] == s; };
+    if (uint32_t id = index_.find(h, eq); id != kNone) return id;
+    std::unique_lock<std::shared_mutex> lk(mu_);
+    uint32_t id = static_cast<uint32_t>(names_.push_back(arena_.copy(s)));
+    index_.insert(h, id, [&](uint32_t o) { return hash(names_[o]); });
+    bytes_.store(arena_.bytes() + names_.view().bytes() + index_.bytes(), std::memory_order_relaxed);
+    return id;
+}
+
+uint32_t Interner::find(std::string_view s) const {
+    std::shared_lock<std::shared_mutex> lk(mu_);
+    return index_.find(hash(s), [&](uint32_t id) { return names_[id] == s; });
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "append_log.hpp"
+#include "arena.hpp"
+#include "key_index.hpp"
+#include <atomic>
+#include <cstdint>
+#include <shared_mutex>
+#include <string_view>
+
+// Maps string ids to dense uint32_t indices. Names are copied once into an
+// Arena and listed in an AppendLog of views (stable addresses); the hash index
+// only holds their indices. intern() is for the single writer; find() may run
+// concurrently with it, and readers resolve names through a published view(),
+// which stays valid while the Interner lives.
+class Interner {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    uint32_t intern(std::string_view s);
+    uint32_t find(std::string_view s) const;
+    std::string_view name(uint32_t id) const { return names_[id]; }
+    uint32_t size() const { return static_cast<uint32_t>(names_.size()); }
+    // Allocated for the names, their views and the index.
+    size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+    AppendLog<std::string_view>::View view() const { return names_.view(); }
+private:
+    static uint64_t hash(std::string_view s) { return KeyIndex::mix(std::hash<std::string_view>()(s)); }
+
+    Arena arena_;
+    AppendLog<std::string_view> names_;
+    KeyIndex index_;
+    mutable std::shared_mutex mu_;  // find() against the writer's appends
+    std::atomic<size_t> bytes_{0};
+};
@@ -0,0 +1,53 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Open-addressing hash set of uint32_t ids whose keys live elsewhere (e.g. in
+// the edge table): callers pass the key's hash and an equality test against a
+// stored id, so each slot costs 4 bytes. Linear probing, at most half full.
+class KeyIndex {
+public:
+    static constexpr uint32_t kNone = UINT32_MAX;
+
+    static uint64_t mix(uint64_t h) {  // splitmix64 finalizer
+        h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 27; h *= 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    // The stored id eq() accepts, or kNone.
+    template <class Eq>
+    uint32_t find(uint64_t h, Eq&& eq) const {
+        if (slots_.empty()) return kNone;
+        for (size_t i = h & mask_;; i = (i + 1) & mask_) {
+            uint32_t id = slots_[i];
+            if (id == kNone || eq(id)) return id;
+        }
+    }
+    // `id` must not be present. hash(id) recomputes stored keys when the table grows.
+    template <class Hash>
+    void insert(uint64_t h, uint32_t id, Hash&& hash) {
+        if (2 * (size_ + 1) > slots_.size()) {
+            std::vector<uint32_t> old(std::max<size_t>(16, slots_.size() * 2), kNone);
+            old.swap(slots_);
+            mask_ = slots_.size() - 1;
+            for (uint32_t o : old)
+                if (o != kNone) place(hash(o), o);
+        }
+        place(h, id);
+        ++size_;
+    }
+    size_t size() const { return size_; }
+    size_t bytes() const { return slots_.capacity() * sizeof(uint32_t); }
+private:
+    void place(uint64_t h, uint32_t id) {
+        size_t i = h & mask_;
+        while (slots_[i] != kNone) i = (i + 1) & mask_;
+        slots_[i] = id;
+    }
+
+    std::vector<uint32_t> slots_;
+    size_t mask_ = 0, size_ = 0;
+};
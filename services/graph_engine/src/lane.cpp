@@ -0,0 +1,82 @@
+#include "lane.hpp"
+#include <algorithm>
+
+namespace {
+uint64_t micros(Lane::Clock::duration d) {
+    return uint64_t(std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(d).count()));
+}
+}
+
+Lane::Lane(const std::string& name, const Options& opt, metrics::Registry& r)
+    : threads_(std::max(1u, opt.threads)), max_inflight_(std::max<size_t>(1, opt.max_inflight)),
+      full_(r.counter("graph_lane_rejected_total", "Calls a lane turned away or dropped.",
+                      "lane=\"" + name + "\",reason=\"full\"")),
+      late_(r.counter("graph_lane_rejected_total", "Calls a lane turned away or dropped.",
+                      "lane=\"" + name + "\",reason=\"deadline\"")),
+      expired_(r.counter("graph_lane_rejected_total", "Calls a lane turned away or dropped.",
+                         "lane=\"" + name + "\",reason=\"expired\"")),
+      queue_wait_(r.histogram("graph_lane_queue_seconds", "Time calls waited for a lane thread.",
+                              "lane=\"" + name + "\"", 1e-6)) {
+    r.gauge("graph_lane_inflight", "Calls queued or running on a lane.", "lane=\"" + name + "\"", [this] {
+        std::lock_guard<std::mutex> lk(mu_);
+        return double(queue_.size() + running_);
+    });
+    for (unsigned i = 0; i < threads_; ++i) workers_.emplace_back([this] { run(); });
+}
+
+Lane::~Lane() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+Lane::Admit Lane::submit(Clock::time_point deadline, Task task) {
+    auto now = Clock::now();
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (queue_.size() + running_ >= max_inflight_) {
+            full_.add();
+            return kFull;
+        }
+        // A call waits for the calls queued ahead of it to clear the threads,
+        // once they are all busy, and then runs for about as long as the others.
+        uint64_t ahead = running_ < threads_ ? 0 : queue_.size() / threads_ + 1;
+        auto estimate = std::chrono::microseconds((ahead + 1) * service_us_);
+        if (deadline != Clock::time_point::max() && (deadline <= now || deadline - now < estimate)) {
+            late_.add();
+            return kLate;
+        }
+        queue_.push_back({deadline, now, std::move(task)});
+    }
+    wake_.notify_one();
+    return kAdmitted;
+}
+
+void Lane::run() {
+    std::unique_lock<std::mutex> lk(mu_);
+    for (;;) {
+        wake_.wait(lk, [this] { return stop_ || !queue_.empty(); });
+        if (queue_.empty()) return;
+        Call c = std::move(queue_.front());
+        queue_.pop_front();
+        ++running_;
+        bool serve = !stop_;
+        lk.unlock();
+
+        auto start = Clock::now();
+        queue_wait_.record(micros(start - c.queued));
+        if (serve && start >= c.deadline) {
+            serve = false;
+            expired_.add();
+        }
+        c.task(serve);
+        uint64_t took = micros(Clock::now() - start);
+
+        lk.lock();
+        --running_;
+        if (serve) service_us_ = service_us_ ? (service_us_ * 7 + took) / 8 : took;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "metrics.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Admission control for one class of RPCs. A lane runs its calls on its own
+// threads in arrival order and holds at most max_inflight of them, queued or
+// running; past that submit() turns calls away at once rather than let the
+// queue grow. It also turns away a call whose deadline would pass before it
+// could finish, judging by the queue ahead of it and the lane's recent service
+// times, and a call whose deadline passes while queued is dropped unrun.
+//
+// Lanes share nothing, so a flood of calls on one only costs the others the
+// cores its threads keep busy.
+class Lane {
+public:
+    using Clock = std::chrono::steady_clock;
+    struct Options {
+        unsigned threads = 1;
+        size_t max_inflight = 64;
+    };
+    enum Admit { kAdmitted, kFull, kLate };
+    // Called once, on a lane thread: with true to serve the call, with false
+    // if its deadline passed while queued or the lane is shutting down, when
+    // it should only finish the call. How long a served task runs is the
+    // service time deadline estimates go by, so it should not wait on the
+    // client, e.g. for a write to complete.
+    using Task = std::function<void(bool serve)>;
+
+    // Exports inflight, queue wait and rejection metrics labelled lane="<name>".
+    Lane(const std::string& name, const Options& opt, metrics::Registry& r);
+    // Queued calls are finished unserved.
+    ~Lane();
+    Lane(const Lane&) = delete;
+    Lane& operator=(const Lane&) = delete;
+
+    // Clock::time_point::max() means no deadline. Unless kAdmitted, `task` is
+    // dropped without being called.
+    Admit submit(Clock::time_point deadline, Task task);
+private:
+    struct Call {
+        Clock::time_point deadline, queued;
+        Task task;
+    };
+    void run();
+
+    const unsigned threads_;
+    const size_t max_inflight_;
+    mutable std::mutex mu_;
+    std::condition_variable wake_;
+    std::deque<Call> queue_;
+    size_t running_ = 0;
+    uint64_t service_us_ = 0;  // moving average over served calls
+    bool stop_ = false;
+    metrics::Counter &full_, &late_, &expired_;
+    metrics::Histogram& queue_wait_;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,177 @@
+#include "louvain.hpp"
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+
+constexpr int kMaxSweeps = 32;
+constexpr double kMinGain = 1e-7;
+constexpr uint32_t kParallelMin = 4096;
+
+template <class F>
+void parallel_for(uint32_t n, unsigned threads, F&& fn) {
+    if (threads <= 1 || n < kParallelMin) { fn(0u, n, 0u); return; }
+    std::vector<std::thread> ts;
+    uint32_t step = (n + threads - 1) / threads;
+    for (unsigned t = 0; t < threads; ++t) {
+        uint32_t b = t * step, e = std::min(n, b + step);
+        if (b < e) ts.emplace_back([&fn, b, e, t] { fn(b, e, t); });
+    }
+    for (auto& t : ts) t.join();
+}
+
+// Dense labels in order of first appearance; returns the label count.
+uint32_t renumber(std::vector<uint32_t>& comm) {
+    std::unordered_map<uint32_t, uint32_t> map;
+    for (auto& c : comm) c = map.emplace(c, static_cast<uint32_t>(map.size())).first->second;
+    return static_cast<uint32_t>(map.size());
+}
+
+// Sweeps until no node moves or modularity stops improving. Moves are chosen in
+// parallel against the previous sweep's labels, then applied in one pass.
+// Two singletons that would swap into each other only move toward the lower label.
+void local_move(const WeightedGraph& g, std::vector<uint32_t>& comm, unsigned threads) {
+    std::vector<double> k(g.n), tot(g.n, 0.0);
+    std::vector<uint32_t> size(g.n, 0), target(g.n);
+    double m2 = 0;
+    for (uint32_t i = 0; i < g.n; ++i) {
+        k[i] = g.self[i];
+        for (uint64_t j = g.off[i]; j < g.off[i + 1]; ++j) k[i] += g.w[j];
+        m2 += k[i];
+        tot[comm[i]] += k[i];
+        ++size[comm[i]];
+    }
+    if (m2 <= 0) return;
+
+    std::vector<std::vector<double>> acc(std::max(1u, threads), std::vector<double>());
+    auto modularity = [&] {
+        std::vector<double> in(g.n, 0.0);
+        for (uint32_t i = 0; i < g.n; ++i) {
+            in[comm[i]] += g.self[i];
+            for (uint64_t j = g.off[i]; j < g.off[i + 1]; ++j)
+                if (comm[g.nbr[j]] == comm[i]) in[comm[i]] += g.w[j];
+        }
+        double q = 0;
+        for (uint32_t c = 0; c < g.n; ++c) if (tot[c] > 0) q += in[c] / m2 - (tot[c] / m2) * (tot[c] / m2);
+        return q;
+    };
+
+    double q = modularity();
+    for (int sweep = 0; sweep < kMaxSweeps; ++sweep) {
+        parallel_for(g.n, threads, [&](uint32_t b, uint32_t e, unsigned t) {
+            auto& a = acc[t];
+            if (a.size() < g.n) a.assign(g.n, 0.0);
+            std::vector<uint32_t> touched;
+            for (uint32_t i = b; i < e; ++i) {
+                uint32_t own = comm[i];
+                touched.clear();
+                for (uint64_t j = g.off[i]; j < g.off[i + 1]; ++j) {
+                    uint32_t c = comm[g.nbr[j]];
+                    if (a[c] == 0) touched.push_back(c);
+                    a[c] += g.w[j];
+                }
+                double best_gain = a[own] - (tot[own] - k[i]) * k[i] / m2;
+                uint32_t best = own;
+                for (uint32_t c : touched) {
+                    if (c != own) {
+                        double gain = a[c] - tot[c] * k[i] / m2;
+                        if (gain > best_gain + kMinGain) { best_gain = gain; best = c; }
+                    }
+                    a[c] = 0;
+                }
+                a[own] = 0;
+                target[i] = best;
+            }
+        });
+        uint32_t moved = 0;
+        std::vector<uint32_t> was_single(g.n);
+        for (uint32_t c = 0; c < g.n; ++c) was_single[c] = size[c] == 1;
+        for (uint32_t i = 0; i < g.n; ++i) {
+            uint32_t from = comm[i], to = target[i];
+            if (from == to || (was_single[from] && was_single[to] && to > from)) continue;
+            tot[from] -= k[i]; tot[to] += k[i];
+            --size[from]; ++size[to];
+            comm[i] = to;
+            ++moved;
+        }
+        if (moved == 0) break;
+        double nq = modularity();
+        if (nq - q < kMinGain) break;
+        q = nq;
+    }
+}
+
+WeightedGraph aggregate(const WeightedGraph& g, const std::vector<uint32_t>& comm, uint32_t nc) {
+    WeightedGraph out;
+    out.n = nc;
+    out.self.assign(nc, 0.0);
+    std::vector<std::vector<uint32_t>> members(nc);
+    for (uint32_t i = 0; i < g.n; ++i) members[comm[i]].push_back(i);
+    out.off.push_back(0);
+    std::unordered_map<uint32_t, double> acc;
+    for (uint32_t c = 0; c < nc; ++c) {
+        acc.clear();
+        for (uint32_t i : members[c]) {
+            out.self[c] += g.self[i];
+            for (uint64_t j = g.off[i]; j < g.off[i + 1]; ++j) {
+                uint32_t d = comm[g.nbr[j]];
+                if (d == c) out.self[c] += g.w[j];
+                else acc[d] += g.w[j];
+            }
+        }
+        for (auto& [d, w] : acc) { out.nbr.push_back(d); out.w.push_back(w); }
+        out.off.push_back(out.nbr.size());
+    }
+    return out;
+}
+
+}  // namespace
+
+WeightedGraph WeightedGraph::from_edges(uint32_t n, std::vector<std::tuple<uint32_t, uint32_t, double>> edges) {
+    for (auto& [u, v, w] : edges) if (u > v) std::swap(u, v);
+    std::sort(edges.begin(), edges.end());
+    WeightedGraph g;
+    g.n = n;
+    g.self.assign(n, 0.0);
+    g.off.assign(size_t(n) + 1, 0);
+    std::vector<std::tuple<uint32_t, uint32_t, double>> uniq;
+    for (auto& [u, v, w] : edges) {
+        if (u == v) continue;
+        if (!uniq.empty() && std::get<0>(uniq.back()) == u && std::get<1>(uniq.back()) == v) std::get<2>(uniq.back()) += w;
+        else uniq.emplace_back(u, v, w);
+    }
+    for (auto& [u, v, w] : uniq) { ++g.off[u + 1]; ++g.off[v + 1]; }
+    for (uint32_t i = 0; i < n; ++i) g.off[i + 1] += g.off[i];
+    g.nbr.resize(g.off[n]); g.w.resize(g.off[n]);
+    std::vector<uint64_t> cur(g.off.begin(), g.off.end() - 1);
+    for (auto& [u, v, w] : uniq) {
+        g.nbr[cur[u]] = v; g.w[cur[u]++] = w;
+        g.nbr[cur[v]] = u; g.w[cur[v]++] = w;
+    }
+    return g;
+}
+
+std::vector<uint32_t> louvain(const WeightedGraph& g0, const std::vector<uint32_t>* init, unsigned threads) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<uint32_t> labels(g0.n);
+    for (uint32_t i = 0; i < g0.n; ++i) labels[i] = i;
+    if (g0.n == 0) return labels;
+
+    std::vector<uint32_t> comm = init && init->size() == g0.n ? *init : labels;
+    renumber(comm);
+    WeightedGraph level;
+    const WeightedGraph* g = &g0;
+    for (;;) {
+        local_move(*g, comm, threads);
+        uint32_t nc = renumber(comm);
+        for (auto& l : labels) l = comm[l];
+        if (nc == g->n) break;
+        level = aggregate(*g, comm, nc);
+        g = &level;
+        comm.resize(nc);
+        for (uint32_t i = 0; i < nc; ++i) comm[i] = i;
+    }
+    renumber(labels);
+    return labels;
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+// Weighted undirected graph over dense local ids, symmetric CSR without self
+// loops; self-loop weight (from aggregation) is kept per node.
+struct WeightedGraph {
+    uint32_t n = 0;
+    std::vector<uint64_t> off;
+    std::vector<uint32_t> nbr;
+    std::vector<double> w;
+    std::vector<double> self;
+
+    // Parallel edges are summed; input self loops are dropped.
+    static WeightedGraph from_edges(uint32_t n, std::vector<std::tuple<uint32_t, uint32_t, double>> edges);
+};
+
+// Multi-level Louvain with parallel (synchronous) local-moving sweeps. Returns a
+// community label per node, densely numbered in order of first appearance.
+// `init`, if given, holds one label per node and seeds the first level instead
+// of singletons, so a slightly changed graph converges in a few sweeps.
+std::vector<uint32_t> louvain(const WeightedGraph& g, const std::vector<uint32_t>* init = nullptr,
+                              unsigned threads = 0);
@@ -0,0 +1,133 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace metrics {
+
+size_t Counter::shard() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t mine = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return mine;
+}
+
+uint64_t Counter::value() const {
+    uint64_t v = 0;
+    for (auto& s : shards_) v += s.v.load(std::memory_order_relaxed);
+    return v;
+}
+
+// Values below kSub get a bucket each; above that, each power of two is split
+// into kSub equal sub-buckets.
+size_t Histogram::bucket(uint64_t v) {
+    if (v < kSub) return size_t(v);
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= kMaxBits) return kBuckets - 1;
+    size_t sub = size_t(v >> (msb - kSubBits)) & (kSub - 1);
+    return size_t(msb - kSubBits + 1) * kSub + sub;
+}
+
+uint64_t Histogram::upper(size_t b) {
+    if (b < kSub) return b;
+    int shift = int(b / kSub) - 1;
+    return ((kSub + b % kSub + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t v) {
+    buckets_[bucket(v)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(v, std::memory_order_relaxed);
+    uint64_t m = max_.load(std::memory_order_relaxed);
+    while (v > m && !max_.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+}
+
+uint64_t Histogram::quantile(double q) const {
+    uint64_t n = 0;
+    std::vector<uint64_t> counts(kBuckets);
+    for (size_t b = 0; b < kBuckets; ++b) n += counts[b] = buckets_[b].load(std::memory_order_relaxed);
+    if (n == 0) return 0;
+    uint64_t rank = uint64_t(std::max(1.0, q * double(n) + 0.5)), seen = 0;
+    for (size_t b = 0; b < kBuckets; ++b)
+        if ((seen += counts[b]) >= rank) return std::min(upper(b), max());
+    return max();
+}
+
+uint64_t Histogram::count_below_pow2(int k) const {
+    size_t end = k <= kSubBits ? size_t(1) << k : size_t(k - kSubBits + 1) * kSub;
+    uint64_t n = 0;
+    for (size_t b = 0; b < std::min(end, kBuckets); ++b) n += buckets_[b].load(std::memory_order_relaxed);
+    return n;
+}
+
+Registry::Family& Registry::family(const std::string& name, const std::string& help, const char* type) {
+    auto& f = families_[name];
+    f.help = help; f.type = type;
+    return f;
+}
+
+Counter& Registry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> lk(mu_);
+    counters_.push_back(std::make_unique<Counter>());
+    family(name, help, "counter").series.push_back({labels, counters_.back().get(), nullptr, {}, 1.0});
+    return *counters_.back();
+}
+
+Histogram& Registry::histogram(const std::string& name, const std::string& help, const std::string& labels,
+                               double scale) {
+    std::lock_guard<std::mutex> lk(mu_);
+    histograms_.push_back(std::make_unique<Histogram>());
+    family(name, help, "histogram").series.push_back({labels, nullptr, histograms_.back().get(), {}, scale});
+    return *histograms_.back();
+}
+
+void Registry::add(const std::string& name, const std::string& help, const std::string& labels, const Counter& c) {
+    std::lock_guard<std::mutex> lk(mu_);
+    family(name, help, "counter").series.push_back({labels, &c, nullptr, {}, 1.0});
+}
+
+void Registry::add(const std::string& name, const std::string& help, const std::string& labels, const Histogram& h,
+                   double scale) {
+    std::lock_guard<std::mutex> lk(mu_);
+    family(name, help, "histogram").series.push_back({labels, nullptr, &h, {}, scale});
+}
+
+void Registry::gauge(const std::string& name, const std::string& help, const std::string& labels,
+                     std::function<double()> fn) {
+    std::lock_guard<std::mutex> lk(mu_);
+    family(name, help, "gauge").series.push_back({labels, nullptr, nullptr, std::move(fn), 1.0});
+}
+
+// Histogram buckets are exported at every other power of two; a value v lands
+// in le=2^k when v < 2^k, which is as fine as the sub-buckets allow.
+std::string Registry::prometheus() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    std::string out;
+    char num[64];
+    auto fmt = [&](double v) { std::snprintf(num, sizeof num, "%.12g", v); return std::string(num); };
+    auto join = [](const std::string& a, const std::string& b) { return a.empty() ? b : b.empty() ? a : a + "," + b; };
+    auto braces = [](const std::string& l) { return l.empty() ? std::string() : "{" + l + "}"; };
+    for (auto& [name, f] : families_) {
+        out += "# HELP " + name + " " + f.help + "\n# TYPE " + name + " " + f.type + "\n";
+        for (auto& s : f.series) {
+            if (s.counter) {
+                out += name + braces(s.labels) + " " + std::to_string(s.counter->value()) + "\n";
+            } else if (s.gauge) {
+                out += name + braces(s.labels) + " " + fmt(s.gauge()) + "\n";
+            } else {
+                const Histogram& h = *s.histogram;
+                uint64_t count = h.count();
+                for (int k = 0; k <= 36; k += 2) {
+                    std::string le = "le=\"" + fmt(std::ldexp(1.0, k) * s.scale) + "\"";
+                    out += name + "_bucket{" + join(s.labels, le) + "} " +
+                           std::to_string(std::min(h.count_below_pow2(k), count)) + "\n";
+                }
+                out += name + "_bucket{" + join(s.labels, "le=\"+Inf\"") + "} " + std::to_string(count) + "\n";
+                out += name + "_sum" + braces(s.labels) + " " + fmt(double(h.sum()) * s.scale) + "\n";
+                out += name + "_count" + braces(s.labels) + " " + std::to_string(count) + "\n";
+            }
+        }
+    }
+    return out;
+}
+
+}  // namespace metrics
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Low-overhead instrumentation. Counters are sharded over cache lines by
+// thread so hot paths never contend on one atomic; histograms are log-linear
+// ("HDR style": 16 sub-buckets per power of two, ~6% relative error) over
+// relaxed atomic buckets. Recording never locks; reads are for monitoring
+// and need not be a consistent cut.
+namespace metrics {
+
+class Counter {
+public:
+    void add(uint64_t n = 1) { shards_[shard()].v.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const;
+private:
+    static constexpr size_t kShards = 16;
+    struct alignas(64) Shard { std::atomic<uint64_t> v{0}; };
+    static size_t shard();
+    Shard shards_[kShards];
+};
+
+class Histogram {
+public:
+    void record(uint64_t v);
+    uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the q-quantile; 0 when empty.
+    uint64_t quantile(double q) const;
+    // Number of recorded values <= 2^k - 1, for k in [0, kMaxBits].
+    uint64_t count_below_pow2(int k) const;
+
+    static constexpr int kSubBits = 4, kMaxBits = 48;
+private:
+    static constexpr size_t kSub = size_t(1) << kSubBits;
+    static constexpr size_t kBuckets = (kMaxBits - kSubBits + 1) * kSub;
+    static size_t bucket(uint64_t v);
+    static uint64_t upper(size_t b);
+
+    std::atomic<uint64_t> buckets_[kBuckets] = {};
+    std::atomic<uint64_t> count_{0}, sum_{0}, max_{0};
+};
+
+// Named metrics rendered in the Prometheus text format. Registration takes a
+// lock and is meant for startup; the returned references stay valid for the
+// registry's lifetime. Labels are passed preformatted, e.g. `rpc="Stats"`.
+class Registry {
+public:
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    // Values in microseconds are exported in seconds, as Prometheus expects.
+    Histogram& histogram(const std::string& name, const std::string& help, const std::string& labels = "",
+                         double scale = 1.0);
+    // Metrics owned elsewhere (e.g. by the engine), which must outlive the registry's use.
+    void add(const std::string& name, const std::string& help, const std::string& labels, const Counter& c);
+    void add(const std::string& name, const std::string& help, const std::string& labels, const Histogram& h,
+             double scale = 1.0);
+    void gauge(const std::string& name, const std::string& help, std::function<double()> fn) {
+        gauge(name, help, "", std::move(fn));
+    }
+    void gauge(const std::string& name, const std::string& help, const std::string& labels, std::function<double()> fn);
+    std::string prometheus() const;
+private:
+    struct Series {
+        std::string labels;
+        const Counter* counter = nullptr;
+        const Histogram* histogram = nullptr;
+        std::function<double()> gauge;
+        double scale = 1.0;
+    };
+    struct Family {
+        std::string help, type;
+        std::vector<Series> series;
+    };
+    Family& family(const std::string& name, const std::string& help, const char* type);
+
+    mutable std::mutex mu_;
+    std::map<std::string, Family> families_;
+    std::vector<std::unique_ptr<Counter>> counters_;
+    std::vector<std::unique_ptr<Histogram>> histograms_;
+};
+
+}  // namespace metrics
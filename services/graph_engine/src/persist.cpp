@@ -0,0 +1,261 @@
+#include "engine.hpp"
+#include "snapshot.hpp"
+#include "wal.hpp"
+#include "wire.hpp"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+// Fixed-size part of a node in the snapshot; the encoded bytes follow as strings.
+struct NodeFix {
+    int64_t ts;
+    uint32_t type;
+    uint32_t present;
+};
+
+[[noreturn]] void corrupt_wal() { throw std::runtime_error("malformed WAL record"); }
+}
+
+void Engine::open(const PersistOptions& opt) {
+    fs::create_directories(opt.dir);
+    std::string snap = opt.dir + "/snapshot";
+    uint64_t from = fs::exists(snap) ? load_snapshot(snap) : 0, next = from;
+    std::vector<uint64_t> segs = Wal::segments(opt.dir);
+    segs.erase(segs.begin(), std::lower_bound(segs.begin(), segs.end(), from));
+    for (uint64_t seq : segs) {
+        // Only the last segment can have been torn by a crash; cut its tail off
+        // so that a later open, which sees it as an earlier segment, reads it whole.
+        std::string path = Wal::path(opt.dir, seq);
+        bool last = seq == segs.back();
+        size_t good = Wal::replay(path, [&](Wal::Kind kind, std::string_view batch) { replay(kind, batch); }, last);
+        if (last && good < fs::file_size(path)) {
+            std::cerr << "graph_engine: dropping torn WAL tail of " << path << " after byte " << good << std::endl;
+            fs::resize_file(path, good);
+        }
+        next = seq + 1;
+    }
+    std::lock_guard<std::mutex> lk(write_mu_);
+    persist_ = opt;
+    wal_ = std::make_unique<Wal>(opt.dir, next, opt.sync);
+}
+
+void Engine::checkpoint() {
+    std::lock_guard<std::mutex> lk(write_mu_);
+    if (!wal_) return;
+    if (snap_thread_.joinable()) snap_thread_.join();
+    uint64_t seq = wal_->rotate();
+    write_snapshot(*snapshot(), persist_.dir + "/snapshot", seq);
+    Wal::drop_before(persist_.dir, seq);
+}
+
+// Called under write_mu_ after each batch, and with `force` after a compaction.
+// The version published at rotation is exactly what the closed segments hold,
+// so the snapshot can be written off the lock while ingest continues into the
+// new segment.
+void Engine::maybe_checkpoint(bool force) {
+    if (!wal_ || (!force && wal_->bytes() < persist_.snapshot_wal_bytes) || snap_busy_.exchange(true)) return;
+    if (snap_thread_.joinable()) snap_thread_.join();
+    try {
+        uint64_t seq = wal_->rotate();
+        auto g = snapshot();
+        {
+            std::lock_guard<std::mutex> lk(undo_mu_);
+            undo_.clear();
+            undo_limit_ = static_cast<uint32_t>(g->edges.size());
+        }
+        snap_thread_ = std::thread([this, g, seq] {
+            try {
+                write_snapshot(*g, persist_.dir + "/snapshot", seq);
+                Wal::drop_before(persist_.dir, seq);
+            } catch (const std::exception& e) {
+                std::cerr << "graph_engine: snapshot failed, keeping WAL: " << e.what() << std::endl;
+            }
+            {
+                std::lock_guard<std::mutex> lk(undo_mu_);
+                undo_limit_ = 0;
+                undo_.clear();
+            }
+            snap_busy_ = false;
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "graph_engine: WAL rotation failed: " << e.what() << std::endl;
+        snap_busy_ = false;
+    }
+}
+
+// Writer side, before edge `ei` is merged in place.
+void Engine::save_undo(uint32_t ei) {
+    if (ei >= undo_limit_.load()) return;
+    std::lock_guard<std::mutex> lk(undo_mu_);
+    if (ei < undo_limit_) undo_.emplace(ei, edges_[ei]);  // keeps the first, i.e. rotated, value
+}
+
+std::string Engine::wal_edges(const std::vector<EdgeIn>& es) {
+    using namespace wire;
+    std::string out, body;
+    for (auto& e : es) {
+        body.clear();
+        bytes(body, edge::kSrc, e.src); bytes(body, edge::kDst, e.dst);
+        float64(body, edge::kWeight, e.weight); int64(body, edge::kTs, uint64_t(e.ts));
+        bytes(body, edge::kType, e.type);
+        for (auto& [k, v] : e.attrs) map_entry(body, edge::kAttrs, k, v);
+        message(out, upsert::kItems, body);
+    }
+    return out;
+}
+
+// Re-applies one logged batch; the views point into the replay buffer.
+void Engine::replay(uint8_t kind, std::string_view batch) {
+    using namespace wire;
+    if (kind == Wal::kNodes) {
+        std::vector<NodeIn> ns;
+        bool ok = for_each_field(batch, [&](uint32_t f, uint32_t, uint64_t, std::string_view body) {
+            if (f != upsert::kItems) return;
+            ns.emplace_back();
+            if (!decode_node(body, ns.back())) corrupt_wal();
+        });
+        if (!ok) corrupt_wal();
+        upsert_nodes(ns);
+    } else if (kind == Wal::kEdges) {
+        std::vector<EdgeIn> es;
+        bool ok = for_each_field(batch, [&](uint32_t f, uint32_t, uint64_t, std::string_view body) {
+            if (f != upsert::kItems) return;
+            es.emplace_back();
+            if (!decode_edge(body, es.back())) corrupt_wal();
+        });
+        if (!ok) corrupt_wal();
+        upsert_edges(es);
+    }
+}
+
+// Layout: WAL seq; ids, types, attr keys, attr values; nodes; edges; edge
+// columns; then per edge type, its base CSR with the delta folded in (version
+// 1 files have a single CSR of all types instead).
+void Engine::write_snapshot(const Graph& g, const std::string& path, uint64_t wal_seq) const {
+    SnapshotWriter w(path);
+    w.u64(wal_seq);
+    for (auto* names : {&g.ids, &g.types, &g.attr_keys, &g.attr_values})
+        w.strings(names->size(), [&](size_t i) { return (*names)[i]; });
+
+    // Node data may be newer than `g`; the WAL tail replays those upserts again,
+    // which just rewrites the same value.
+    std::vector<std::shared_ptr<const NodeData>> data(g.nodes.size());
+    for (size_t i = 0; i < data.size(); ++i) data[i] = std::atomic_load(&g.nodes[i].data);
+    w.begin<NodeFix>(data.size());
+    for (auto& d : data) {
+        NodeFix f{d ? d->ts : 0, d ? d->type : 0, d ? 1u : 0u};
+        w.append(&f, 1);
+    }
+    w.end();
+    static const std::string kEmpty;
+    w.strings(data.size(), [&](size_t i) -> const std::string& { return data[i] ? data[i]->wire : kEmpty; });
+
+    // Edges merged since `g` was published are put back to their saved values.
+    std::vector<Edge> buf;
+    size_t at = 0;
+    w.begin<Edge>(g.edges.size());
+    g.edges.for_each_block([&](const Edge* p, size_t n) {
+        buf.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            buf[i] = Edge{p[i].src, p[i].dst, p[i].type, {}, {}};
+            buf[i].weight.v = p[i].weight.load(); buf[i].ts.v = p[i].ts.load();
+        }
+        {
+            std::lock_guard<std::mutex> lk(undo_mu_);
+            for (auto it = undo_.lower_bound(uint32_t(at)); it != undo_.end() && it->first < at + n; ++it)
+                buf[it->first - at] = it->second;
+        }
+        w.append(buf.data(), n);
+        at += n;
+    });
+    w.end();
+    w.u64(g.edge_cols.size());
+    for (auto& c : g.edge_cols) {
+        w.u64(c.base);
+        w.begin<uint32_t>(c.values.size());
+        c.values.for_each_block([&](const uint32_t* p, size_t n) { w.append(p, n); });
+        w.end();
+    }
+
+    w.u64(g.parts.size());
+    for (auto& p : g.parts) {
+        if (p.delta.empty()) p.base->save(w);
+        else Csr::merge(*p.base, static_cast<uint32_t>(g.nodes.size()), p.delta).save(w);
+    }
+    w.commit();
+}
+
+// Strings are copied into the interners and node records; edges, attr columns
+// and the base CSR stay in the mapping. Every index read from the file is
+// checked against what it indexes, so a damaged snapshot throws.
+uint64_t Engine::load_snapshot(const std::string& path) {
+    SnapshotReader r(path);
+    uint64_t wal_seq = r.u64();
+    for (Interner* in : {ids_.get(), &types_, &attr_keys_, attr_values_.get()}) {
+        auto names = r.strings();
+        for (size_t i = 0; i < names.size(); ++i) in->intern(names[i]);
+        if (in->size() != names.size()) throw std::runtime_error("malformed snapshot: duplicate names");
+    }
+
+    auto fix = r.array<NodeFix>();
+    auto wires = r.strings();
+    if (fix.size() != ids_->size() || wires.size() != fix.size()) throw std::runtime_error("malformed snapshot: node table");
+    for (size_t i = 0; i < fix.size(); ++i) {
+        Node n;
+        if (fix[i].present) {
+            if (fix[i].type >= types_.size()) throw std::runtime_error("malformed snapshot: node table");
+            auto d = std::make_shared<NodeData>();
+            d->type = fix[i].type; d->ts = fix[i].ts; d->wire = std::string(wires[i]);
+            node_data_bytes_ += d->bytes();
+            n.data = std::move(d);
+        }
+        nodes_.push_back(std::move(n));
+    }
+
+    auto edges = r.array<Edge>();
+    for (auto& e : edges)
+        if (e.src >= nodes_.size() || e.dst >= nodes_.size() || e.type >= types_.size())
+            throw std::runtime_error("malformed snapshot: edge table");
+    const size_t num_edges = edges.size();
+    edges_ = AppendLog<Edge>::adopt(edges);
+    uint64_t cols = r.u64();
+    if (cols > attr_keys_.size()) throw std::runtime_error("malformed snapshot: attr columns");
+    for (uint64_t c = 0; c < cols; ++c) {
+        uint64_t base = r.u64();
+        auto values = r.array<uint32_t>();
+        bool ok = base <= num_edges && values.size() <= num_edges - base;
+        for (size_t i = 0; ok && i < values.size(); ++i)
+            ok = values[i] == Interner::kNone || values[i] < attr_values_->size();
+        if (!ok) throw std::runtime_error("malformed snapshot: attr columns");
+        edge_cols_.push_back({static_cast<uint32_t>(base), AppendLog<uint32_t>::adopt(values)});
+    }
+    std::vector<Partition> parts;
+    if (r.version() >= 2) {
+        uint64_t n = r.u64();
+        if (n > types_.size()) throw std::runtime_error("malformed snapshot: adjacency partitions");
+        parts.resize(n);
+        for (auto& p : parts) p.base = std::make_shared<const Csr>(Csr::load(r, nodes_.size(), num_edges));
+    } else {
+        // Split by type once, in memory; the next snapshot maps in place again.
+        Csr all = Csr::load(r, nodes_.size(), num_edges);
+        Pairs pairs;
+        pairs.reserve(all.num_entries());
+        for (uint32_t u = 0; u < nodes_.size(); ++u)
+            for (auto& en : all.row(u)) pairs.push_back({u, en});
+        auto split = by_type(std::move(pairs), edges_);
+        parts.resize(split.size());
+        for (size_t t = 0; t < split.size(); ++t) {
+            if (split[t].empty()) continue;
+            auto seg = std::make_shared<const Csr>(Csr::sparse(std::move(split[t])));
+            parts[t].base = std::make_shared<const Csr>(Csr::merge(Csr(), static_cast<uint32_t>(nodes_.size()), {seg}));
+        }
+    }
+    publish(std::move(parts));
+    return wal_seq;
+}
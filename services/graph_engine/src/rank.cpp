@@ -0,0 +1,150 @@
+#include "engine.hpp"
+#include "wire.hpp"
+#include <algorithm>
+#include <deque>
+#include <unordered_set>
+
+void Engine::rank(const Graph& g, const std::vector<std::string>& seeds, int64_t s, int64_t e, const RankOptions& opt,
+                  bool edges, Ranking& out) const {
+    ExpandOptions eo;
+    eo.edge_attrs = opt.edge_attrs;
+    EdgeFilter filter = edge_filter(g, eo);
+    size_t scanned = 0;
+    // Candidate edges and weighted degree of every node scanned so far.
+    struct Row {
+        std::vector<Csr::Entry> cand;
+        double degree = 0;
+    };
+    std::unordered_map<uint32_t, Row> rows;
+    auto weight = [&](const Csr::Entry& en) { return g.edges[en.edge].weight.load(); };
+    auto row = [&](uint32_t u) -> const Row& {
+        auto [it, fresh] = rows.try_emplace(u);
+        if (fresh) {
+            collect(g, u, s, e, eo, filter, it->second.cand, scanned);
+            for (auto& en : it->second.cand) it->second.degree += std::max(0.0, weight(en));
+        }
+        return it->second;
+    };
+
+    std::vector<uint32_t> seed_ids;
+    std::unordered_set<uint32_t> is_seed;
+    for (auto& id : seeds) {
+        uint32_t u = g.id_index->find(id);
+        if (u < g.nodes.size() && is_seed.insert(u).second) seed_ids.push_back(u);
+    }
+    std::unordered_map<uint32_t, double> score;
+    if (opt.method == RankOptions::kTopNeighbors) {
+        for (uint32_t u : seed_ids)
+            for (auto& en : row(u).cand)
+                if (double w = weight(en); w > 0 && !is_seed.count(en.nbr)) score[en.nbr] += w;
+    } else if (!seed_ids.empty()) {
+        // Forward push: p is the estimate, r the mass not yet spread. A node
+        // with no in-window edges keeps all the mass it is given.
+        struct Mass {
+            double p = 0, r = 0;
+            bool queued = false;
+        };
+        std::unordered_map<uint32_t, Mass> mass;
+        std::deque<uint32_t> queue;
+        for (uint32_t u : seed_ids) {
+            mass[u] = {0, 1.0 / double(seed_ids.size()), true};
+            queue.push_back(u);
+        }
+        for (size_t pushes = 0; !queue.empty(); ++pushes) {
+            if (pushes == kMaxPushes) { out.truncated = true; break; }
+            uint32_t u = queue.front();
+            queue.pop_front();
+            Mass& m = mass[u];
+            m.queued = false;
+            const Row& r = row(u);
+            if (r.degree <= 0) { m.p += m.r; m.r = 0; continue; }
+            if (m.r < opt.epsilon * r.degree) continue;
+            double spread = (1 - opt.alpha) * m.r / r.degree;
+            m.p += opt.alpha * m.r;
+            m.r = 0;
+            for (auto& en : r.cand) {
+                double w = weight(en);
+                if (w <= 0) continue;
+                Mass& v = mass[en.nbr];
+                v.r += spread * w;
+                // A row not scanned yet has an unknown degree, of which the
+                // weight the mass came over is a lower bound.
+                auto it = rows.find(en.nbr);
+                if (!v.queued && v.r >= opt.epsilon * (it != rows.end() ? it->second.degree : w)) {
+                    v.queued = true;
+                    queue.push_back(en.nbr);
+                }
+            }
+        }
+        for (auto& [u, m] : mass)
+            if (m.p > 0) score[u] = m.p;
+    }
+
+    for (uint32_t u : seed_ids) {
+        auto it = score.find(u);
+        out.nodes.emplace_back(u, it != score.end() ? it->second : 0);
+    }
+    out.seeds = seed_ids.size();
+    std::vector<std::pair<uint32_t, double>> ranked;
+    ranked.reserve(score.size());
+    for (auto& [u, sc] : score)
+        if (!is_seed.count(u)) ranked.emplace_back(u, sc);
+    auto better = [](const std::pair<uint32_t, double>& a, const std::pair<uint32_t, double>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    };
+    if (ranked.size() > opt.k) {
+        std::nth_element(ranked.begin(), ranked.begin() + opt.k, ranked.end(), better);
+        ranked.resize(opt.k);
+    }
+    std::sort(ranked.begin(), ranked.end(), better);
+    out.nodes.insert(out.nodes.end(), ranked.begin(), ranked.end());
+
+    if (edges) {
+        // Each edge once, in node order; only the rows of ranked neighbors are
+        // new scans, the seeds' and pushed nodes' are reused.
+        std::unordered_set<uint32_t> in, seen;
+        for (auto& [u, sc] : out.nodes) in.insert(u);
+        for (auto& [u, sc] : out.nodes) {
+            for (auto& en : row(u).cand) {
+                if (!in.count(en.nbr) || !seen.insert(en.edge).second) continue;
+                if (opt.max_edges && out.edges.size() >= opt.max_edges) { out.truncated = true; break; }
+                out.edges.push_back(en.edge);
+            }
+            if (opt.max_edges && out.edges.size() >= opt.max_edges) break;
+        }
+    }
+    expand_metrics_.edges_scanned.add(scanned);
+}
+
+void Engine::rank(const std::vector<std::string>& seeds, int64_t s, int64_t e, const RankOptions& opt,
+                  std::vector<std::pair<std::string, double>>& out) const {
+    auto g = snapshot();
+    Ranking r;
+    rank(*g, seeds, s, e, opt, false, r);
+    for (size_t i = r.seeds; i < r.nodes.size(); ++i) out.emplace_back(g->ids[r.nodes[i].first], r.nodes[i].second);
+}
+
+void Engine::rank_encoded(const std::vector<std::string>& seeds, int64_t s, int64_t e, const RankOptions& opt,
+                          std::string& out) const {
+    using namespace wire;
+    auto g = snapshot();
+    Ranking r;
+    rank(*g, seeds, s, e, opt, true, r);
+    std::vector<double> scores;
+    scores.reserve(r.nodes.size());
+    std::string body;
+    for (auto& [u, sc] : r.nodes) {
+        // Scores line up with nodes, so ids seen only as edge endpoints get a bare record.
+        if (auto n = std::atomic_load(&g->nodes[u].data)) {
+            message(out, rank::kNodes, n->wire);
+        } else {
+            body.clear();
+            bytes(body, node::kId, g->ids[u]);
+            message(out, rank::kNodes, body);
+        }
+        scores.push_back(sc);
+    }
+    for (uint32_t ei : r.edges) encode_edge(*g, ei, rank::kEdges, out);
+    packed_doubles(out, rank::kScores, scores.data(), scores.size());
+    int64(out, rank::kTruncated, r.truncated);
+}
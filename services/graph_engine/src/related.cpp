@@ -0,0 +1,219 @@
+#include "engine.hpp"
+#include "wire.hpp"
+#include <algorithm>
+#include <unordered_set>
+
+namespace {
+
+constexpr int64_t kDayMs = 86400000;
+
+bool heavier(const std::pair<uint32_t, double>& a, const std::pair<uint32_t, double>& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+}
+
+}  // namespace
+
+const std::vector<std::pair<uint32_t, double>>& Engine::RelatedRow::summary(size_t k) {
+    if (stale) {
+        top.resize(std::min(k, weights.size()));
+        std::partial_sort_copy(weights.begin(), weights.end(), top.begin(), top.end(), heavier);
+        stale = false;
+    }
+    return top;
+}
+
+void Engine::RelatedIndex::add(Relation rel, uint32_t u, int64_t bucket, uint32_t v, double w) {
+    if (w == 0) return;
+    auto& buckets = rows[rel][u];
+    auto b = buckets.try_emplace(bucket).first;
+    RelatedRow& row = b->second;
+    auto [it, fresh] = row.weights.try_emplace(v, 0.0);
+    entries += fresh;
+    row.stale = true;
+    if ((it->second += w) > 0) return;
+    // Only a merge lowers a weight, and never below what its edge still carries.
+    row.weights.erase(it);
+    --entries;
+    if (!row.weights.empty()) return;
+    buckets.erase(b);
+    if (buckets.empty()) rows[rel].erase(u);
+}
+
+int64_t Engine::related_bucket(int64_t ts) const {
+    if (policy_.bucket_ms > 0) return bucket(ts);  // a merged edge stays in its bucket
+    return ts >= 0 ? ts / kDayMs : -((-(ts + 1)) / kDayMs) - 1;
+}
+
+void Engine::index_related(const RelatedPolicy& policy) {
+    if (!policy.summary_k) return;
+    std::lock_guard<std::mutex> lk(write_mu_);
+    related_ = std::make_unique<RelatedIndex>();
+    related_->policy = policy;
+    relate();
+}
+
+void Engine::relate() {
+    using R = RelatedIndex;
+    R& r = *related_;
+    const uint32_t cooccur = types_.find(r.policy.cooccur_type), mention = types_.find(r.policy.mention_type);
+    std::lock_guard<std::mutex> lk(r.mu);
+    auto apply = [&](const Edge& ed, double w, bool fresh) {
+        if (ed.src == ed.dst) return;
+        int64_t b = related_bucket(ed.ts.load());
+        if (ed.type == cooccur) {
+            r.add(R::kEntities, ed.src, b, ed.dst, w);
+            r.add(R::kEntities, ed.dst, b, ed.src, w);
+        } else if (ed.type == mention) {
+            uint32_t doc = ed.src, ent = ed.dst;
+            r.add(R::kEntities, doc, b, ent, w);
+            r.add(R::kDocs, ent, b, doc, w);
+            if (!fresh) return;
+            // Docs already paired through this entity, by an earlier bucket's mention, are not paired again.
+            auto& docs = r.docs[ent];
+            if (docs.size() >= r.policy.max_entity_docs ||
+                std::any_of(docs.begin(), docs.end(), [&](auto& d) { return d.first == doc; }))
+                return;
+            for (auto& [other, ob] : docs) {
+                r.add(R::kDocs, doc, ob, other, 1);
+                r.add(R::kDocs, other, b, doc, 1);
+            }
+            docs.emplace_back(doc, b);
+            ++r.doc_links;
+        }
+    };
+    // New edges count with the weight they have now, merges included.
+    for (auto& [ei, gained] : r.merged)
+        if (ei < r.edges) apply(edges_[ei], gained, false);
+    for (uint32_t ei = r.edges; ei < edges_.size(); ++ei) apply(edges_[ei], std::max(0.0, edges_[ei].weight.load()), true);
+    r.merged.clear();
+    r.edges = static_cast<uint32_t>(edges_.size());
+    r.ids = ids_;
+    r.names = ids_->view();
+    r.nodes = nodes_.view();
+}
+
+void Engine::remap_related(const std::vector<uint32_t>& node_map, int64_t cutoff) {
+    RelatedIndex& r = *related_;
+    auto to = [&](uint32_t u) { return u < node_map.size() ? node_map[u] : Interner::kNone; };
+    const int64_t first = related_bucket(cutoff);
+    std::lock_guard<std::mutex> lk(r.mu);
+    r.entries = 0;
+    for (auto& rows : r.rows) {
+        RelatedIndex::Rows kept;
+        for (auto& [u, buckets] : rows) {
+            uint32_t nu = to(u);
+            if (nu == Interner::kNone) continue;
+            std::map<int64_t, RelatedRow> nb;
+            for (auto it = buckets.lower_bound(first); it != buckets.end(); ++it) {
+                RelatedRow row;
+                for (auto& [v, w] : it->second.weights)
+                    if (uint32_t nv = to(v); nv != Interner::kNone) row.weights.emplace(nv, w);
+                if (row.weights.empty()) continue;
+                r.entries += row.weights.size();
+                row.stale = true;
+                nb.emplace(it->first, std::move(row));
+            }
+            if (!nb.empty()) kept.emplace(nu, std::move(nb));
+        }
+        rows.swap(kept);
+    }
+    decltype(r.docs) docs;
+    r.doc_links = 0;
+    for (auto& [ent, ds] : r.docs) {
+        uint32_t ne = to(ent);
+        if (ne == Interner::kNone) continue;
+        std::vector<std::pair<uint32_t, int64_t>> nd;
+        for (auto& [d, b] : ds)
+            if (uint32_t n = to(d); n != Interner::kNone && b >= first) nd.emplace_back(n, b);
+        r.doc_links += nd.size();
+        if (!nd.empty()) docs.emplace(ne, std::move(nd));
+    }
+    r.docs.swap(docs);
+    r.merged.clear();
+    r.edges = static_cast<uint32_t>(edges_.size());
+    r.ids = ids_;
+    r.names = ids_->view();
+    r.nodes = nodes_.view();
+}
+
+bool Engine::related(const std::vector<std::string>& ids, int64_t s, int64_t e, const RelatedOptions& opt,
+                     Ranking& out, AppendLog<std::string_view>::View& names, AppendLog<Node>::View& nodes) const {
+    if (!related_) return false;
+    RelatedIndex& r = *related_;
+    std::lock_guard<std::mutex> lk(r.mu);
+    names = r.names;
+    nodes = r.nodes;
+    std::vector<uint32_t> seeds;
+    std::unordered_set<uint32_t> is_seed;
+    for (auto& id : ids) {
+        uint32_t u = r.ids->find(id);
+        if (u < names.size() && is_seed.insert(u).second) seeds.push_back(u);
+    }
+    for (uint32_t u : seeds) out.nodes.emplace_back(u, 0.0);
+    out.seeds = seeds.size();
+
+    auto& rows = r.rows[opt.docs ? RelatedIndex::kDocs : RelatedIndex::kEntities];
+    const int64_t b0 = related_bucket(s), b1 = related_bucket(e);
+    std::unordered_map<uint32_t, double> score;
+    for (uint32_t u : seeds) {
+        auto it = rows.find(u);
+        if (it == rows.end()) continue;
+        for (auto b = it->second.lower_bound(b0); b != it->second.end() && b->first <= b1; ++b) {
+            auto add = [&](auto& entries) {
+                for (auto& [v, w] : entries)
+                    if (!is_seed.count(v)) score[v] += w;
+            };
+            RelatedRow& row = b->second;
+            if (row.weights.size() <= r.policy.summary_k) {
+                add(row.weights);
+            } else {
+                add(row.summary(r.policy.summary_k));
+                out.truncated = true;
+            }
+        }
+    }
+    std::vector<std::pair<uint32_t, double>> ranked(score.begin(), score.end());
+    if (ranked.size() > opt.k) {
+        std::nth_element(ranked.begin(), ranked.begin() + opt.k, ranked.end(), heavier);
+        ranked.resize(opt.k);
+    }
+    std::sort(ranked.begin(), ranked.end(), heavier);
+    out.nodes.insert(out.nodes.end(), ranked.begin(), ranked.end());
+    return true;
+}
+
+bool Engine::related(const std::vector<std::string>& ids, int64_t s, int64_t e, const RelatedOptions& opt,
+                     std::vector<std::pair<std::string, double>>& out, bool* approximate) const {
+    Ranking r;
+    AppendLog<std::string_view>::View names;
+    AppendLog<Node>::View nodes;
+    if (!related(ids, s, e, opt, r, names, nodes)) return false;
+    for (size_t i = r.seeds; i < r.nodes.size(); ++i) out.emplace_back(names[r.nodes[i].first], r.nodes[i].second);
+    if (approximate) *approximate = r.truncated;
+    return true;
+}
+
+bool Engine::related_encoded(const std::vector<std::string>& ids, int64_t s, int64_t e, const RelatedOptions& opt,
+                             std::string& out) const {
+    using namespace wire;
+    Ranking r;
+    AppendLog<std::string_view>::View names;
+    AppendLog<Node>::View nodes;
+    if (!related(ids, s, e, opt, r, names, nodes)) return false;
+    std::vector<double> scores;
+    scores.reserve(r.nodes.size());
+    std::string body;
+    for (auto& [u, sc] : r.nodes) {
+        if (auto n = std::atomic_load(&nodes[u].data)) {
+            message(out, rank::kNodes, n->wire);
+        } else {
+            body.clear();
+            bytes(body, node::kId, names[u]);
+            message(out, rank::kNodes, body);
+        }
+        scores.push_back(sc);
+    }
+    packed_doubles(out, rank::kScores, scores.data(), scores.size());
+    int64(out, rank::kTruncated, r.truncated);
+    return true;
+}
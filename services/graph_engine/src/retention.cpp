@@ -0,0 +1,266 @@
+#include "engine.hpp"
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+// The survivors of a compaction, renumbered densely in the order they are
+// copied. Maps run from the old numbering to the new one, kNone if dropped.
+struct Engine::Generation {
+    std::shared_ptr<Interner> ids = std::make_shared<Interner>(), values = std::make_shared<Interner>();
+    AppendLog<Node> nodes;
+    AppendLog<Edge> edges;
+    std::vector<Column> cols;
+    KeyIndex index;
+    uint64_t node_bytes = 0;
+    std::vector<uint32_t> node_map, edge_map, value_map;
+    Pairs pairs;
+
+    uint32_t node(uint32_t u, std::string_view id) {
+        if (u >= node_map.size()) node_map.resize(u + 1, Interner::kNone);
+        if (node_map[u] == Interner::kNone) {
+            node_map[u] = ids->intern(id);
+            nodes.push_back({});
+        }
+        return node_map[u];
+    }
+    void data(uint32_t nu, std::shared_ptr<const NodeData> d) {
+        auto& slot = nodes[nu].data;
+        node_bytes -= slot ? slot->bytes() : 0;
+        node_bytes += d ? d->bytes() : 0;
+        slot = std::move(d);
+    }
+    uint32_t value(uint32_t v, std::string_view name) {
+        if (v >= value_map.size()) value_map.resize(v + 1, Interner::kNone);
+        if (value_map[v] == Interner::kNone) value_map[v] = values->intern(name);
+        return value_map[v];
+    }
+};
+
+void Engine::set_attr(std::vector<Column>& cols, uint32_t key, uint32_t ei, uint32_t val) {
+    if (key == cols.size()) cols.emplace_back();
+    auto& col = cols[key];
+    if (!col.values.size()) col.base = ei;
+    while (col.base + col.values.size() <= ei) col.values.push_back(Interner::kNone);
+    col.values[ei - col.base] = val;
+}
+
+// Stamps keep the ts an edge was first seen with, so edges merged forward
+// since are counted as expired too: this only decides when to compact.
+size_t Engine::expired(const Graph& g, int64_t cutoff) {
+    if (cutoff == INT64_MIN) return 0;
+    size_t n = 0;
+    g.for_each_csr([&](const Csr& c) { n += c.arrivals(INT64_MIN, cutoff - 1).size(); });
+    return n;
+}
+
+size_t Engine::compact(int64_t cutoff) {
+    std::lock_guard<std::mutex> one(compact_mu_);
+    std::shared_ptr<const Graph> g;
+    {
+        std::lock_guard<std::mutex> lk(write_mu_);
+        g = snapshot();
+        compacting_ = true;
+    }
+    auto stop = [this] {
+        compacting_ = false;
+        compact_nodes_.clear(); compact_nodes_.shrink_to_fit();
+        compact_merged_.clear(); compact_merged_.shrink_to_fit();
+    };
+    const uint32_t n0 = static_cast<uint32_t>(g->nodes.size()), e0 = static_cast<uint32_t>(g->edges.size());
+    bool dedup = policy_.bucket_ms > 0;
+    Generation gen;
+    size_t dropped = 0;
+    // The old tables a copy reads: `g`'s off the lock, the live ones under it.
+    struct Source {
+        AppendLog<std::string_view>::View ids, values;
+        AppendLog<Node>::View nodes;
+        std::vector<ColumnView> cols;
+    };
+    auto keep_node = [&](uint32_t u, const Source& src) {
+        bool fresh = u >= gen.node_map.size() || gen.node_map[u] == Interner::kNone;
+        uint32_t nu = gen.node(u, src.ids[u]);
+        if (fresh) gen.data(nu, std::atomic_load(&src.nodes[u].data));
+        return nu;
+    };
+    // Copies old edge ei with its current weight and ts, unless it has expired.
+    auto copy_edge = [&](uint32_t ei, const Edge& ed, const Source& src) {
+        int64_t ts = ed.ts.load();
+        if (ts < cutoff) { ++dropped; return; }
+        Edge ne;
+        ne.src = keep_node(ed.src, src); ne.dst = keep_node(ed.dst, src); ne.type = ed.type;
+        ne.weight.v = ed.weight.load(); ne.ts.v = ts;
+        uint32_t ni = static_cast<uint32_t>(gen.edges.push_back(ne));
+        if (ei >= gen.edge_map.size()) gen.edge_map.resize(ei + 1, Interner::kNone);
+        gen.edge_map[ei] = ni;
+        if (gen.cols.size() < src.cols.size()) gen.cols.resize(src.cols.size());
+        for (uint32_t k = 0; k < src.cols.size(); ++k)
+            if (uint32_t v = src.cols[k].at(ei); v != Interner::kNone) set_attr(gen.cols, k, ni, gen.value(v, src.values[v]));
+        if (dedup) {
+            auto hash = [&](uint32_t i) {
+                const Edge& x = gen.edges[i];
+                return edge_hash(x.src, x.dst, x.type, bucket(x.ts.load()));
+            };
+            gen.index.insert(hash(ni), ni, hash);
+        }
+        gen.pairs.push_back({ne.src, {ts, ne.dst, ni}});
+        gen.pairs.push_back({ne.dst, {ts, ne.src, ni}});
+    };
+
+    std::vector<Partition> parts;
+    try {
+        // Off the lock: everything in `g`. Nodes keep their relative order, so
+        // rows stay where the old ones were, more or less.
+        std::vector<bool> linked(n0);
+        for (uint32_t ei = 0; ei < e0; ++ei) {
+            const Edge& ed = g->edges[ei];
+            if (ed.ts.load() >= cutoff) linked[ed.src] = linked[ed.dst] = true;
+        }
+        Source src{g->ids, g->attr_values, g->nodes, g->edge_cols};
+        for (uint32_t u = 0; u < n0; ++u) {
+            auto d = std::atomic_load(&g->nodes[u].data);
+            if (linked[u] || (d && d->ts >= cutoff)) keep_node(u, src);
+        }
+        for (uint32_t ei = 0; ei < e0; ++ei) copy_edge(ei, g->edges[ei], src);
+        auto split = by_type(std::move(gen.pairs), gen.edges);
+        parts.resize(split.size());
+        for (size_t t = 0; t < split.size(); ++t) {
+            if (split[t].empty()) continue;
+            auto seg = std::make_shared<const Csr>(Csr::sparse(std::move(split[t])));
+            parts[t].base = std::make_shared<const Csr>(Csr::merge(Csr(), static_cast<uint32_t>(gen.nodes.size()), {seg}));
+        }
+        gen.pairs.clear();
+    } catch (...) {
+        std::lock_guard<std::mutex> lk(write_mu_);
+        stop();
+        throw;
+    }
+
+    std::lock_guard<std::mutex> lk(write_mu_);
+    if (snap_thread_.joinable()) snap_thread_.join();  // it may still be reading the old tables
+    Source live{ids_->view(), attr_values_->view(), nodes_.view(), {}};
+    for (auto& c : edge_cols_) live.cols.push_back({c.base, c.values.view()});
+    const uint32_t n1 = static_cast<uint32_t>(nodes_.size()), e1 = static_cast<uint32_t>(edges_.size());
+    // Nodes added or patched since `g` are kept as they are now.
+    for (uint32_t u = n0; u < n1; ++u) keep_node(u, live);
+    for (uint32_t u : compact_nodes_)
+        if (u < n0) gen.data(keep_node(u, live), std::atomic_load(&nodes_[u].data));
+    // Edges merged since: live ones take the new weight and ts, expired ones
+    // that a merge brought back into the window are copied like new edges.
+    gen.edge_map.resize(e0, Interner::kNone);
+    for (uint32_t ei : compact_merged_) {
+        if (ei >= e0) continue;
+        const Edge& ed = edges_[ei];
+        if (uint32_t ni = gen.edge_map[ei]; ni != Interner::kNone) {
+            gen.edges[ni].weight.v = ed.weight.load();
+            gen.edges[ni].ts.v = ed.ts.load();
+        } else if (ed.ts.load() >= cutoff) {
+            --dropped;  // counted when it was skipped above
+            copy_edge(ei, ed, live);
+        }
+    }
+    for (uint32_t ei = e0; ei < e1; ++ei) copy_edge(ei, edges_[ei], live);
+    size_t nodes_dropped = n1 - gen.nodes.size();
+
+    ids_ = std::move(gen.ids); attr_values_ = std::move(gen.values);
+    nodes_ = std::move(gen.nodes); edges_ = std::move(gen.edges);
+    edge_cols_ = std::move(gen.cols);
+    edge_index_ = std::move(gen.index);
+    indexed_ = dedup ? static_cast<uint32_t>(edges_.size()) : 0;
+    node_data_bytes_ = gen.node_bytes;
+    ++generation_;
+    if (related_) remap_related(gen.node_map, cutoff);
+    stop();
+    auto split = by_type(std::move(gen.pairs), edges_);
+    if (parts.size() < split.size()) parts.resize(split.size());
+    for (size_t t = 0; t < split.size(); ++t) {
+        if (split[t].empty()) continue;
+        parts[t].delta_entries = split[t].size();
+        parts[t].delta = {std::make_shared<const Csr>(Csr::sparse(std::move(split[t])))};
+    }
+    publish(std::move(parts));
+    {
+        std::lock_guard<std::mutex> clk(comm_mu_);
+        comm_cache_.clear();
+    }
+    retention_metrics_.compactions.add();
+    retention_metrics_.edges_dropped.add(dropped);
+    retention_metrics_.nodes_dropped.add(nodes_dropped);
+    maybe_checkpoint(true);
+    return dropped;
+}
+
+// The earliest cutoff that drops about `share` of g's edges by first-seen ts,
+// or INT64_MIN for none.
+int64_t Engine::budget_cutoff(const Graph& g, double share) {
+    size_t want = static_cast<size_t>(std::ceil(share * g.edges.size()));
+    int64_t lo = INT64_MAX, hi = INT64_MIN;
+    g.for_each_csr([&](const Csr& c) {
+        auto s = c.stamps();
+        if (!s.size()) return;
+        lo = std::min(lo, s.begin()->ts);
+        hi = std::max(hi, (s.end() - 1)->ts);
+    });
+    if (!want || lo > hi) return INT64_MIN;
+    int64_t a = lo, b = hi == INT64_MAX ? hi : hi + 1;  // expired() grows with the cutoff
+    while (a < b) {
+        int64_t m = a + static_cast<int64_t>((uint64_t(b) - uint64_t(a)) / 2);
+        if (expired(g, m) >= want) b = m;
+        else a = m + 1;
+    }
+    return a;
+}
+
+void Engine::admit() {
+    size_t soft = soft_bytes_.load(std::memory_order_relaxed), hard = hard_bytes_.load(std::memory_order_relaxed);
+    if (!soft && !hard) return;
+    size_t bytes = stats().bytes();
+    if (soft && bytes > soft) {
+        std::lock_guard<std::mutex> lk(retention_mu_);
+        over_soft_ = true;
+        retention_cv_.notify_one();
+    }
+    if (hard && bytes > hard) {
+        retention_metrics_.refused.add();
+        throw OverBudget("graph engine holds " + std::to_string(bytes >> 20) + " MiB, over its " +
+                         std::to_string(hard >> 20) + " MiB budget");
+    }
+}
+
+void Engine::retain(const RetentionPolicy& policy) {
+    soft_bytes_ = policy.soft_bytes;
+    hard_bytes_ = policy.hard_bytes;
+    if (policy.ttl_ms <= 0 && !policy.soft_bytes) return;
+    retention_thread_ = std::thread([this, policy] {
+        std::unique_lock<std::mutex> lk(retention_mu_);
+        while (!stopping_) {
+            over_soft_ = false;
+            lk.unlock();
+            using namespace std::chrono;
+            auto g = snapshot();
+            int64_t cutoff = INT64_MIN;
+            if (policy.ttl_ms > 0) {
+                int64_t expiry = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() - policy.ttl_ms;
+                size_t n = expired(*g, expiry);
+                if (n && n >= policy.compact_fraction * g->edges.size()) cutoff = expiry;
+            }
+            // Bytes shrink with the edges more or less in proportion, so drop
+            // the oldest share that brings them down to low_water.
+            bool budget = false;
+            if (size_t bytes = stats().bytes(); policy.soft_bytes && bytes > policy.soft_bytes) {
+                int64_t oldest = budget_cutoff(*g, 1 - policy.low_water * double(policy.soft_bytes) / double(bytes));
+                if (oldest > cutoff && expired(*g, oldest)) cutoff = oldest, budget = true;
+            }
+            if (cutoff != INT64_MIN) {
+                g.reset();  // let the old generation go once compacted
+                try {
+                    compact(cutoff);
+                    if (budget) retention_metrics_.budget_compactions.add();
+                } catch (const std::exception& e) {
+                    std::cerr << "graph_engine: compaction failed: " << e.what() << std::endl;
+                }
+            }
+            lk.lock();
+            retention_cv_.wait_for(lk, milliseconds(policy.check_ms), [this] { return stopping_ || over_soft_; });
+        }
+    });
+}
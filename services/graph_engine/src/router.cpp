@@ -0,0 +1,351 @@
+#include "router.hpp"
+#include "graph_engine.grpc.pb.h"
+#include "louvain.hpp"
+#include "metrics.hpp"
+#include "rpc.hpp"
+#include "shards.hpp"
+#include "wire.hpp"
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
+using grpc::ByteBuffer;
+using grpc::CallbackServerContext;
+using grpc::ServerContext;
+using grpc::Status;
+using graph::GraphEngine;
+using rpc::Clock;
+using rpc::parse;
+using rpc::to_buffer;
+
+namespace {
+
+// A node's type is only known to its owner, a hop after the edge leading to it
+// was kept or not, so routed expands filter by edge type alone.
+Status routable(const graph::ExpandRequest& req) {
+    bool typed = req.node_types_size() > 0;
+    for (auto& st : req.path()) typed = typed || st.node_types_size() > 0;
+    return typed ? Status(grpc::StatusCode::UNIMPLEMENTED, "node type filters are not supported on a sharded engine")
+                 : Status::OK;
+}
+
+// Streams a routed expand one hop per write. The next hop is only asked of the
+// shards once the previous one is written, which paces them to the client.
+class RoutedStream final : public grpc::ServerWriteReactor<ByteBuffer> {
+public:
+    RoutedStream(ShardSet& shards, CallbackServerContext* ctx, ExpandQuery q, const rpc::Metrics& m)
+        : metrics_(m), start_(Clock::now()), ctx_(ctx), timing_(*ctx, start_),
+          expand_(std::make_shared<ShardedExpand>(shards, std::move(q), timing_.traceparent())) {
+        step();
+    }
+    void OnWriteDone(bool ok) override {
+        timing_.span("hop" + std::to_string(hop_) + ".write");
+        if (!ok) { ok_ = false; Finish(Status::CANCELLED); }
+        else if (last_) { timing_.finish(*ctx_); Finish(Status::OK); }
+        else step();
+    }
+    void OnDone() override {
+        metrics_.observe(start_, ok_);
+        delete this;
+    }
+private:
+    void step() {
+        expand_->next([this](const Status& st, uint32_t hop, std::string& frag, bool truncated, bool last) {
+            if (!st.ok()) {
+                ok_ = false;
+                Finish(st);
+                return false;
+            }
+            timing_.span("hop" + std::to_string(hop) + ".shards");
+            wire::int64(frag, wire::fragment::kHop, hop);
+            wire::int64(frag, wire::fragment::kTruncated, truncated);
+            last_ = last;
+            hop_ = hop;
+            buf_ = to_buffer(std::move(frag));
+            StartWrite(&buf_);
+            return false;
+        });
+    }
+
+    const rpc::Metrics& metrics_;
+    Clock::time_point start_;
+    CallbackServerContext* ctx_;
+    rpc::Timing timing_;
+    std::shared_ptr<ShardedExpand> expand_;
+    bool ok_ = true, last_ = false;
+    uint32_t hop_ = 0;
+    ByteBuffer buf_;
+};
+
+class ShardRouter final
+    : public GraphEngine::WithRawCallbackMethod_ExpandBatch<GraphEngine::WithRawCallbackMethod_ExpandTimeWindow<
+          GraphEngine::WithRawCallbackMethod_ExpandTimeWindowStream<GraphEngine::Service>>> {
+public:
+    ShardRouter(const std::vector<std::string>& shards, std::chrono::milliseconds timeout) : shards_(shards, timeout) {}
+
+    Status UpsertNodes(ServerContext*, const graph::UpsertNodesRequest* req, graph::Ack* ack) override {
+        auto t0 = Clock::now();
+        std::vector<graph::UpsertNodesRequest> parts(shards_.size());
+        split(req->nodes(), parts);
+        Status st = upsert("/graph.GraphEngine/UpsertNodes", parts, ack);
+        upsert_nodes_.observe(t0, st.ok());
+        return st;
+    }
+    Status UpsertEdges(ServerContext*, const graph::UpsertEdgesRequest* req, graph::Ack* ack) override {
+        auto t0 = Clock::now();
+        std::vector<graph::UpsertEdgesRequest> parts(shards_.size());
+        split(req->edges(), parts);
+        Status st = upsert("/graph.GraphEngine/UpsertEdges", parts, ack);
+        upsert_edges_.observe(t0, st.ok());
+        return st;
+    }
+    // Chunks are gathered into runs of about kRouteItems nodes and edges, each
+    // sent as one UpsertNodes and one UpsertEdges per shard; the watermark
+    // only moves past a run once every shard has taken it.
+    Status BulkIngest(ServerContext* ctx, grpc::ServerReader<graph::IngestChunk>* in, graph::IngestAck* ack) override {
+        auto t0 = Clock::now();
+        std::vector<graph::UpsertNodesRequest> nodes(shards_.size());
+        std::vector<graph::UpsertEdgesRequest> edges(shards_.size());
+        uint64_t chunks = 0, run_nodes = 0, run_edges = 0;
+        Status st;
+        auto flush = [&] {
+            graph::Ack ok;
+            st = upsert("/graph.GraphEngine/UpsertNodes", nodes, &ok);
+            if (st.ok()) st = upsert("/graph.GraphEngine/UpsertEdges", edges, &ok);
+            if (!st.ok()) return;
+            ack->set_chunks(chunks); ack->set_nodes(ack->nodes() + run_nodes); ack->set_edges(ack->edges() + run_edges);
+            for (auto& p : nodes) p.Clear();
+            for (auto& p : edges) p.Clear();
+            run_nodes = run_edges = 0;
+        };
+        graph::IngestChunk c;
+        while (in->Read(&c)) {
+            ++chunks;
+            split(c.nodes(), nodes);
+            split(c.edges(), edges);
+            run_nodes += c.nodes_size(); run_edges += c.edges_size();
+            if (run_nodes + run_edges < kRouteItems) continue;
+            flush();
+            if (!st.ok()) break;
+        }
+        if (st.ok() && run_nodes + run_edges) flush();
+        if (!st.ok()) ctx->AddTrailingMetadata("graph-ingest-chunks", std::to_string(ack->chunks()));
+        bulk_ingest_.observe(t0, st.ok());
+        return st;
+    }
+    grpc::ServerUnaryReactor* ExpandTimeWindow(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        auto t0 = Clock::now();
+        auto* reactor = ctx->DefaultReactor();
+        graph::ExpandRequest req;
+        if (!parse(in, &req)) {
+            expand_.observe(t0, false);
+            reactor->Finish(Status(grpc::StatusCode::INVALID_ARGUMENT, "bad ExpandRequest"));
+            return reactor;
+        }
+        if (Status st = routable(req); !st.ok()) {
+            expand_.observe(t0, false);
+            reactor->Finish(st);
+            return reactor;
+        }
+        auto timing = std::make_shared<rpc::Timing>(*ctx, t0);
+        timing->span("decode");
+        auto done = [this, t0, ctx, reactor, out, timing](const Status& st, std::string& frag) {
+            if (st.ok()) *out = to_buffer(std::move(frag));
+            expand_.observe(t0, st.ok());
+            timing->finish(*ctx);
+            reactor->Finish(st);
+        };
+        run(rpc::query(req), timing->traceparent(), std::move(done), timing.get());
+        return reactor;
+    }
+    grpc::ServerWriteReactor<ByteBuffer>* ExpandTimeWindowStream(CallbackServerContext* ctx, const ByteBuffer* in) override {
+        graph::ExpandRequest req;
+        Status st = parse(in, &req) ? routable(req) : Status(grpc::StatusCode::INVALID_ARGUMENT, "bad ExpandRequest");
+        if (!st.ok()) {
+            expand_stream_.errors->add();
+            struct Reject : grpc::ServerWriteReactor<ByteBuffer> {
+                explicit Reject(const Status& st) { Finish(st); }
+                void OnDone() override { delete this; }
+            };
+            return new Reject(st);
+        }
+        return new RoutedStream(shards_, ctx, rpc::query(req), expand_stream_);
+    }
+    // The queries run side by side, each at its own pace across the shards.
+    grpc::ServerUnaryReactor* ExpandBatch(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        auto t0 = Clock::now();
+        auto* reactor = ctx->DefaultReactor();
+        graph::ExpandBatchRequest req;
+        if (!parse(in, &req)) {
+            expand_batch_.observe(t0, false);
+            reactor->Finish(Status(grpc::StatusCode::INVALID_ARGUMENT, "bad ExpandBatchRequest"));
+            return reactor;
+        }
+        for (auto& r : req.requests()) {
+            if (Status st = routable(r); !st.ok()) {
+                expand_batch_.observe(t0, false);
+                reactor->Finish(st);
+                return reactor;
+            }
+        }
+        struct Batch {
+            std::vector<std::string> results;
+            std::atomic<size_t> pending;
+            std::mutex mu;
+            Status st;
+        };
+        auto b = std::make_shared<Batch>();
+        b->results.resize(req.requests_size());
+        b->pending = req.requests_size() + 1;
+        auto finish = [this, t0, reactor, out, b] {
+            if (--b->pending) return;
+            std::string body;
+            for (auto& r : b->results) wire::message(body, wire::batch::kResults, r);
+            if (b->st.ok()) *out = to_buffer(std::move(body));
+            expand_batch_.observe(t0, b->st.ok());
+            reactor->Finish(b->st);
+        };
+        const std::string trace = rpc::traceparent(*ctx);
+        for (int i = 0; i < req.requests_size(); ++i) {
+            run(rpc::query(req.requests(i)), trace, [b, i, finish](const Status& st, std::string& frag) {
+                if (!st.ok()) {
+                    std::lock_guard<std::mutex> lk(b->mu);
+                    b->st = st;
+                }
+                b->results[i] = std::move(frag);
+                finish();
+            });
+        }
+        finish();
+        return reactor;
+    }
+    // Each edge is counted once, from the shard owning the lesser of its
+    // endpoints: shards may store a merged edge either way round.
+    Status CommunitiesLouvain(ServerContext*, const graph::CommunitiesRequest* req,
+                              graph::CommunitiesResponse* out) override {
+        auto t0 = Clock::now();
+        auto replies = shards_.call("/graph.GraphEngine/WindowEdges", all(req->window().SerializeAsString()));
+        Status st = ShardSet::status(replies);
+        std::unordered_map<std::string, uint32_t> local;
+        std::vector<const std::string*> ids;
+        std::vector<graph::WindowEdgesResponse> parts(replies.size());
+        std::vector<std::tuple<uint32_t, uint32_t, double>> es;
+        auto local_id = [&](const std::string& id) {
+            auto [it, fresh] = local.emplace(id, static_cast<uint32_t>(ids.size()));
+            if (fresh) ids.push_back(&it->first);
+            return it->second;
+        };
+        for (size_t s = 0; s < replies.size() && st.ok(); ++s) {
+            if (!parts[s].ParseFromString(replies[s].body)) {
+                st = Status(grpc::StatusCode::INTERNAL, "bad WindowEdgesResponse from shard " + std::to_string(s));
+                break;
+            }
+            for (const auto& e : parts[s].edges())
+                if (shards_.owner(std::min(e.src(), e.dst())) == s)
+                    es.emplace_back(local_id(e.src()), local_id(e.dst()), e.weight());
+        }
+        if (st.ok()) {
+            auto labels = louvain(WeightedGraph::from_edges(static_cast<uint32_t>(ids.size()), std::move(es)));
+            for (size_t i = 0; i < ids.size(); ++i) {
+                auto* l = out->add_labels(); l->set_node_id(*ids[i]); l->set_community(labels[i]);
+            }
+        }
+        communities_.observe(t0, st.ok());
+        return st;
+    }
+    // Graph sizes are summed over the shards, so an edge between two shards and
+    // the endpoint it adds to the other one are counted on both.
+    Status Stats(ServerContext*, const graph::StatsRequest* req, graph::StatsResponse* out) override {
+        auto t0 = Clock::now();
+        auto replies = shards_.call("/graph.GraphEngine/Stats", all(req->SerializeAsString()));
+        Status st = ShardSet::status(replies);
+        for (size_t s = 0; s < replies.size() && st.ok(); ++s) {
+            graph::StatsResponse r;
+            if (!r.ParseFromString(replies[s].body)) {
+                st = Status(grpc::StatusCode::INTERNAL, "bad StatsResponse from shard " + std::to_string(s));
+                break;
+            }
+            out->set_nodes(out->nodes() + r.nodes()); out->set_edges(out->edges() + r.edges());
+            out->set_delta_segments(out->delta_segments() + r.delta_segments());
+            out->set_node_bytes(out->node_bytes() + r.node_bytes()); out->set_edge_bytes(out->edge_bytes() + r.edge_bytes());
+            out->set_adjacency_bytes(out->adjacency_bytes() + r.adjacency_bytes());
+            out->set_string_bytes(out->string_bytes() + r.string_bytes());
+            out->set_attr_bytes(out->attr_bytes() + r.attr_bytes()); out->set_cache_bytes(out->cache_bytes() + r.cache_bytes());
+            out->set_related_bytes(out->related_bytes() + r.related_bytes()); out->set_bytes(out->bytes() + r.bytes());
+        }
+        if (st.ok()) rpcs_.fill(*out);
+        stats_.observe(t0, st.ok());
+        return st;
+    }
+private:
+    using Done = std::function<void(const Status& st, std::string& fragment)>;
+    // Runs a routed expand to the end; `done` gets the hops concatenated, with
+    // `truncated` set as ExpandTimeWindow sets it. The caller's traceparent goes
+    // on to the shards. `timing`, if given, gets a span per hop's round trip to
+    // the shards and must outlive `done`.
+    void run(ExpandQuery q, const std::string& traceparent, Done done, rpc::Timing* timing = nullptr) {
+        struct Result {
+            std::string frag;
+            bool cut = false;
+        };
+        auto r = std::make_shared<Result>();
+        std::make_shared<ShardedExpand>(shards_, std::move(q), traceparent)
+            ->next([r, timing, done = std::move(done)](const Status& st, uint32_t h, std::string& hop, bool truncated,
+                                                       bool last) {
+                if (timing) timing->span("hop" + std::to_string(h) + ".shards");
+                r->frag += hop;
+                r->cut = r->cut || truncated;
+                if (!st.ok()) {
+                    done(st, r->frag);
+                } else if (last) {
+                    wire::int64(r->frag, wire::fragment::kTruncated, r->cut);
+                    done(st, r->frag);
+                }
+                return true;
+            });
+    }
+    static constexpr uint64_t kRouteItems = 16384;
+
+    // Nodes go to their owner, edges to the owners of both endpoints.
+    void split(const google::protobuf::RepeatedPtrField<graph::Node>& ns, std::vector<graph::UpsertNodesRequest>& parts) {
+        for (const auto& n : ns) *parts[shards_.owner(n.id())].add_nodes() = n;
+    }
+    void split(const google::protobuf::RepeatedPtrField<graph::Edge>& es, std::vector<graph::UpsertEdgesRequest>& parts) {
+        for (const auto& e : es) {
+            uint32_t a = shards_.owner(e.src()), b = shards_.owner(e.dst());
+            *parts[a].add_edges() = e;
+            if (b != a) *parts[b].add_edges() = e;
+        }
+    }
+    template <class Req>
+    Status upsert(const std::string& method, std::vector<Req>& parts, graph::Ack* ack) {
+        std::vector<std::optional<std::string>> bodies(parts.size());
+        for (size_t s = 0; s < parts.size(); ++s)
+            if (parts[s].ByteSizeLong()) bodies[s] = parts[s].SerializeAsString();
+        Status st = ShardSet::status(shards_.call(method, std::move(bodies)));
+        if (st.ok()) ack->set_ok(true);
+        return st;
+    }
+    std::vector<std::optional<std::string>> all(const std::string& body) const {
+        return std::vector<std::optional<std::string>>(shards_.size(), body);
+    }
+
+    metrics::Registry registry_;
+    rpc::MetricsTable rpcs_{registry_};
+    const rpc::Metrics& upsert_nodes_ = rpcs_.add("UpsertNodes");
+    const rpc::Metrics& upsert_edges_ = rpcs_.add("UpsertEdges");
+    const rpc::Metrics& bulk_ingest_ = rpcs_.add("BulkIngest");
+    const rpc::Metrics& expand_ = rpcs_.add("ExpandTimeWindow");
+    const rpc::Metrics& expand_stream_ = rpcs_.add("ExpandTimeWindowStream");
+    const rpc::Metrics& expand_batch_ = rpcs_.add("ExpandBatch");
+    const rpc::Metrics& communities_ = rpcs_.add("CommunitiesLouvain");
+    const rpc::Metrics& stats_ = rpcs_.add("Stats");
+    ShardSet shards_;
+};
+
+}  // namespace
+
+std::unique_ptr<grpc::Service> make_shard_router(const std::vector<std::string>& shards,
+                                                 std::chrono::milliseconds timeout) {
+    return std::make_unique<ShardRouter>(shards, timeout);
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <grpcpp/grpcpp.h>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A GraphEngine service with no graph of its own, fronting the engine servers
+// at `shards` (see ShardSet). Nodes are hash-partitioned by id; an edge is
+// stored on the shards of both endpoints, so every shard can walk all edges
+// of the nodes it owns. Expands run hop by hop across the shards (see
+// ShardedExpand); Louvain runs here, on the window's edges gathered from all
+// of them. Upserts are not atomic across shards: one that failed may still
+// have been applied on some of them.
+std::unique_ptr<grpc::Service> make_shard_router(const std::vector<std::string>& shards,
+                                                 std::chrono::milliseconds timeout);
@@ -0,0 +1,174 @@
+#pragma once
+#include "engine.hpp"
+#include "graph_engine.pb.h"
+#include "lane.hpp"
+#include "metrics.hpp"
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/impl/codegen/proto_utils.h>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+
+// Helpers shared by the GraphEngine service implementations: the engine server
+// and the shard router.
+namespace rpc {
+
+using Clock = Lane::Clock;
+
+inline int64_t micros(Clock::time_point since) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - since).count();
+}
+
+// Server-side latency, in microseconds, and failures of one RPC.
+struct Metrics {
+    metrics::Histogram* latency;
+    metrics::Counter* errors;
+
+    void observe(Clock::time_point start, bool ok) const {
+        latency->record(uint64_t(micros(start)));
+        if (!ok) errors->add();
+    }
+};
+
+// The Metrics of every RPC a service serves, registered under one Registry.
+class MetricsTable {
+public:
+    explicit MetricsTable(metrics::Registry& r) : registry_(r) {}
+    const Metrics& add(const std::string& name) {
+        std::string label = "rpc=\"" + name + "\"";
+        Metrics m{&registry_.histogram("graph_rpc_latency_seconds", "Server-side RPC latency.", label, 1e-6),
+                  &registry_.counter("graph_rpc_errors_total", "RPCs that did not finish OK.", label)};
+        return rpcs_.emplace(name, m).first->second;
+    }
+    // Fills the per-RPC rows and the Prometheus text of a StatsResponse.
+    void fill(graph::StatsResponse& out) const {
+        for (auto& [name, m] : rpcs_) {
+            const metrics::Histogram& h = *m.latency;
+            auto* r = out.add_rpcs();
+            r->set_rpc(name); r->set_count(h.count()); r->set_errors(m.errors->value());
+            r->set_p50_us(h.quantile(0.5)); r->set_p90_us(h.quantile(0.9)); r->set_p99_us(h.quantile(0.99));
+            r->set_p999_us(h.quantile(0.999)); r->set_max_us(h.max());
+        }
+        out.set_prometheus(registry_.prometheus());
+    }
+private:
+    metrics::Registry& registry_;
+    std::map<std::string, Metrics> rpcs_;
+};
+
+// The W3C traceparent the client sent, or "".
+inline std::string traceparent(const grpc::ServerContextBase& ctx) {
+    auto it = ctx.client_metadata().find("traceparent");
+    return it == ctx.client_metadata().end() ? std::string() : std::string(it->second.data(), it->second.size());
+}
+
+// Server-side spans of a call whose client sent a W3C traceparent, returned
+// in the "server-timing" trailing metadata as comma-separated `name;dur=<ms>`
+// entries. Dotted names nest ("hop1.walk"). Calls without a traceparent
+// record nothing.
+class Timing {
+public:
+    Timing(const grpc::ServerContextBase& ctx, Clock::time_point start)
+        : traceparent_(rpc::traceparent(ctx)), on_(!traceparent_.empty()), mark_(start) {}
+    bool on() const { return on_; }
+    const std::string& traceparent() const { return traceparent_; }
+    // Ends a span that began where the last one ended (or at start).
+    void span(const std::string& name) {
+        if (!on_) return;
+        add(name, micros(mark_));
+        mark_ = Clock::now();
+    }
+    // A span timed elsewhere.
+    void add(const std::string& name, int64_t us) {
+        if (!on_) return;
+        char dur[32];
+        std::snprintf(dur, sizeof dur, ";dur=%.3f", double(us) / 1000);
+        if (!header_.empty()) header_ += ", ";
+        header_ += name;
+        header_ += dur;
+    }
+    // An expand that just finished; the next span() starts after it.
+    void expand(const ExpandTiming& t) {
+        if (t.cached) span("cached");
+        for (size_t h = 0; h < t.hops.size(); ++h) {
+            add("hop" + std::to_string(h) + ".walk", t.hops[h].walk_us);
+            add("hop" + std::to_string(h) + ".encode", t.hops[h].encode_us);
+        }
+        mark_ = Clock::now();
+    }
+    // Before the call finishes.
+    void finish(grpc::ServerContextBase& ctx) const {
+        if (on_ && !header_.empty()) ctx.AddTrailingMetadata("server-timing", header_);
+    }
+private:
+    std::string traceparent_;
+    bool on_;
+    Clock::time_point mark_;
+    std::string header_;
+};
+
+// Hands a string to gRPC without copying; the slice frees it when sent.
+inline grpc::ByteBuffer to_buffer(std::string&& bytes) {
+    auto* owned = new std::string(std::move(bytes));
+    grpc::Slice slice(owned->data(), owned->size(), [](void* p) { delete static_cast<std::string*>(p); }, owned);
+    return grpc::ByteBuffer(&slice, 1);
+}
+
+inline std::string to_string(const grpc::ByteBuffer& buf) {
+    std::vector<grpc::Slice> slices;
+    std::string out;
+    if (!buf.Dump(&slices).ok()) return out;
+    out.reserve(buf.Length());
+    for (auto& s : slices) out.append(reinterpret_cast<const char*>(s.begin()), s.size());
+    return out;
+}
+
+// The call's deadline on Clock; max() if it has none.
+inline Clock::time_point deadline(const grpc::ServerContextBase& ctx) {
+    auto d = ctx.deadline();
+    if (d == std::chrono::system_clock::time_point::max()) return Clock::time_point::max();
+    return Clock::now() + std::chrono::duration_cast<Clock::duration>(d - std::chrono::system_clock::now());
+}
+
+// The status of a call a lane did not admit, or dropped unserved.
+inline grpc::Status rejected(Lane::Admit why) {
+    return why == Lane::kFull ? grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED, "server busy, retry later")
+                              : grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED, "deadline too close to queue for");
+}
+inline grpc::Status expired() { return grpc::Status(grpc::StatusCode::DEADLINE_EXCEEDED, "deadline passed while queued"); }
+
+template <class Msg>
+bool parse(const grpc::ByteBuffer* in, Msg* req) {
+    grpc::ByteBuffer copy(*in);  // Deserialize consumes its input; this only bumps slice refcounts.
+    return grpc::SerializationTraits<Msg>::Deserialize(&copy, req).ok();
+}
+
+inline ExpandOptions options(const graph::ExpandRequest& req) {
+    ExpandOptions o;
+    o.max_nodes = req.max_nodes(); o.max_edges = req.max_edges(); o.top_k = req.top_k(); o.dedup_edges = req.dedup_edges();
+    o.edge_attrs.assign(req.edge_attrs().begin(), req.edge_attrs().end());
+    o.edge_types.assign(req.edge_types().begin(), req.edge_types().end());
+    o.node_types.assign(req.node_types().begin(), req.node_types().end());
+    for (auto& st : req.path())
+        o.path.push_back({{st.edge_types().begin(), st.edge_types().end()}, {st.node_types().begin(), st.node_types().end()}});
+    return o;
+}
+
+inline ExpandQuery query(const graph::ExpandRequest& req) {
+    return {{req.seed_ids().begin(), req.seed_ids().end()}, req.window().start_ms(), req.window().end_ms(),
+            req.max_hops(), options(req)};
+}
+
+inline RankOptions options(const graph::RankRequest& req, RankOptions::Method method) {
+    RankOptions o;
+    o.method = method;
+    if (req.k()) o.k = req.k();
+    if (req.alpha() > 0) o.alpha = req.alpha();
+    if (req.epsilon() > 0) o.epsilon = req.epsilon();
+    o.max_edges = req.max_edges();
+    o.edge_attrs.assign(req.edge_attrs().begin(), req.edge_attrs().end());
+    return o;
+}
+
+}  // namespace rpc
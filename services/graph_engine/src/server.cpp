@@ -1,59 +1,679 @@
 #include "engine.hpp"
 #include "graph_engine.grpc.pb.h"
+#include "metrics.hpp"
+#include "router.hpp"
+#include "rpc.hpp"
+#include "wal.hpp"
+#include "wire.hpp"
 #include <grpcpp/grpcpp.h>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <map>
 #include <memory>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 
 using grpc::Server;
 using grpc::ServerBuilder;
 using grpc::ServerContext;
 using grpc::Status;
+using grpc::ByteBuffer;
+using grpc::CallbackServerContext;
 using graph::GraphEngine;
 using graph::Ack;
+using rpc::Clock;
+using rpc::parse;
+using rpc::to_buffer;
 
-class GraphServiceImpl final : public GraphEngine::Service {
+namespace {
+
+// Runs an encoded expand on a query lane thread, queueing each hop as soon as
+// it is ready, and writes the queue out one hop at a time from OnWriteDone, as
+// the callback API requires. The lane thread is free once the walk is done: a
+// slow reader holds its result in memory but no thread, and adds nothing to
+// the lane's service time.
+class FragmentStream final : public grpc::ServerWriteReactor<ByteBuffer> {
 public:
-    Status UpsertNodes(ServerContext*, const graph::UpsertNodesRequest* req, Ack* ack) override {
-        std::vector<NodeRec> ns; ns.reserve(req->nodes_size());
-        for (const auto& n : req->nodes()) {
-            NodeRec r; r.id=n.id(); r.ts=n.ts(); r.type=n.type();
-            for (const auto& kv : n.attrs()) r.attrs[kv.first]=kv.second;
-            ns.push_back(std::move(r));
-        }
-        eng_.upsert_nodes(ns); ack->set_ok(true); return Status::OK;
-    }
-    Status UpsertEdges(ServerContext*, const graph::UpsertEdgesRequest* req, Ack* ack) override {
-        std::vector<EdgeRec> es; es.reserve(req->edges_size());
-        for (const auto& e : req->edges()) {
-            EdgeRec r; r.src=e.src(); r.dst=e.dst(); r.weight=e.weight(); r.ts=e.ts(); r.type=e.type();
-            for (const auto& kv : e.attrs()) r.attrs[kv.first]=kv.second;
-            es.push_back(std::move(r));
-        }
-        eng_.upsert_edges(es); ack->set_ok(true); return Status::OK;
-    }
-    Status ExpandTimeWindow(ServerContext*, const graph::ExpandRequest* req, graph::GraphFragment* out) override {
-        std::vector<std::string> seeds(req->seed_ids().begin(), req->seed_ids().end());
-        std::vector<NodeRec> ns; std::vector<EdgeRec> es;
-        eng_.expand(seeds, req->window().start_ms(), req->window().end_ms(), req->max_hops(), ns, es);
-        for (auto& n : ns) {
-            auto* nn = out->add_nodes(); nn->set_id(n.id); nn->set_ts(n.ts); nn->set_type(n.type);
-            for (auto& kv : n.attrs) (*nn->mutable_attrs())[kv.first]=kv.second;
-        }
-        for (auto& e : es) {
-            auto* ee = out->add_edges(); ee->set_src(e.src); ee->set_dst(e.dst);
-            ee->set_weight(e.weight); ee->set_ts(e.ts); ee->set_type(e.type);
-            for (auto& kv : e.attrs) (*ee->mutable_attrs())[kv.first]=kv.second;
+    // Hop i's write span runs from the start of its write to its completion.
+    FragmentStream(const Engine& eng, Lane& lane, CallbackServerContext* ctx, graph::ExpandRequest req,
+                   const rpc::Metrics& m)
+        : metrics_(m), start_(Clock::now()), ctx_(ctx), timing_(*ctx, start_) {
+        auto admit = lane.submit(rpc::deadline(*ctx), [this, &eng, req = std::move(req)](bool serve) {
+            {
+                std::lock_guard<std::mutex> lk(mu_);
+                timing_.span("queue");
+            }
+            ExpandTiming et;
+            if (serve) {
+                std::vector<std::string> seeds(req.seed_ids().begin(), req.seed_ids().end());
+                eng.expand_encoded(seeds, req.window().start_ms(), req.window().end_ms(), req.max_hops(),
+                                   rpc::options(req), [&](uint32_t hop, std::string& frag, bool truncated) {
+                                       wire::int64(frag, wire::fragment::kHop, hop);
+                                       wire::int64(frag, wire::fragment::kTruncated, truncated);
+                                       std::unique_lock<std::mutex> lk(mu_);
+                                       if (!ok_) return false;
+                                       ready_.push_back(std::move(frag));
+                                       pump(lk);
+                                       return true;
+                                   }, timing_.on() ? &et : nullptr);
+            }
+            std::unique_lock<std::mutex> lk(mu_);
+            if (serve) timing_.expand(et);
+            if (!serve) status_ = rpc::expired();
+            ok_ = ok_ && serve;
+            walked_ = true;
+            pump(lk);
+        });
+        if (admit != Lane::kAdmitted) {
+            ok_ = false;
+            finished_ = true;
+            Finish(rpc::rejected(admit));
         }
-        return Status::OK;
+    }
+    void OnWriteDone(bool ok) override {
+        std::unique_lock<std::mutex> lk(mu_);
+        timing_.add("hop" + std::to_string(written_++) + ".write", rpc::micros(write_start_));
+        writing_ = false; ok_ = ok_ && ok;
+        pump(lk);
+    }
+    void OnCancel() override {
+        std::unique_lock<std::mutex> lk(mu_);
+        ok_ = false;
+        pump(lk);
+    }
+    // Latency runs until the last write is acknowledged or the call is cancelled.
+    void OnDone() override {
+        metrics_.observe(start_, ok_);
+        delete this;
+    }
+private:
+    // Starts the next write, or finishes the call once the walk is done and
+    // nothing is left to write; the walk must be done before `this` can go.
+    // Called with mu_ held, which it releases before calling into gRPC.
+    void pump(std::unique_lock<std::mutex>& lk) {
+        if (writing_ || finished_) return;
+        if (ok_ && !ready_.empty()) {
+            buf_ = to_buffer(std::move(ready_.front()));
+            ready_.pop_front();
+            writing_ = true;
+            write_start_ = Clock::now();
+            lk.unlock();
+            StartWrite(&buf_);
+            return;
+        }
+        if (!walked_) return;
+        finished_ = true;
+        Status st = ok_ ? Status::OK : status_;
+        timing_.span("flush");
+        timing_.finish(*ctx_);
+        lk.unlock();
+        Finish(st);
+    }
+
+    const rpc::Metrics& metrics_;
+    Clock::time_point start_, write_start_;
+    CallbackServerContext* ctx_;
+    std::mutex mu_;
+    rpc::Timing timing_;  // under mu_
+    std::deque<std::string> ready_;  // encoded hops not yet written
+    bool writing_ = false, walked_ = false, finished_ = false, ok_ = true;
+    Status status_ = Status::CANCELLED;  // what a call that is not ok_ finishes with
+    uint32_t written_ = 0;
+    ByteBuffer buf_;
+};
+
+// Applies a BulkIngest stream as a pipeline on the ingest lane. Each chunk is
+// decoded and resolved (Engine::prepare) on a lane thread as soon as it is
+// read, several at once, while the thread that finishes the oldest pending
+// chunk applies the run of ready ones after it, in order, as one upsert. Reads
+// stay at most kWindow chunks ahead of the last chunk applied, so an engine
+// that falls behind slows the client instead of buffering the stream here.
+class IngestStream final : public grpc::ServerReadReactor<ByteBuffer> {
+public:
+    IngestStream(Engine& eng, Lane& lane, CallbackServerContext* ctx, ByteBuffer* out, const rpc::Metrics& m)
+        : eng_(eng), lane_(lane), ctx_(ctx), out_(out), metrics_(m), start_(Clock::now()),
+          deadline_(rpc::deadline(*ctx)) {
+        reading_ = true;
+        StartRead(&in_);
+    }
+    void OnReadDone(bool ok) override {
+        std::unique_lock<std::mutex> lk(mu_);
+        if (ok && st_.ok()) {
+            uint64_t seq = read_++;
+            ++staging_;
+            lk.unlock();  // reading_ stays set until in_ is copied
+            auto admit = lane_.submit(deadline_, [this, seq, bytes = rpc::to_string(in_)](bool serve) mutable {
+                stage(seq, std::move(bytes), serve);
+            });
+            lk.lock();
+            if (admit != Lane::kAdmitted) {
+                --staging_;
+                fail(rpc::rejected(admit));
+            }
+        }
+        eof_ = eof_ || !ok;
+        reading_ = false;
+        resume(lk);
+    }
+    void OnCancel() override {
+        std::unique_lock<std::mutex> lk(mu_);
+        fail(Status::CANCELLED);
+        resume(lk);
+    }
+    void OnDone() override {
+        metrics_.observe(start_, ok_);
+        delete this;
+    }
+private:
+    static constexpr uint64_t kWindow = 4;
+    static constexpr size_t kApplyItems = 16384;  // nodes and edges per upsert
+
+    void stage(uint64_t seq, std::string bytes, bool serve) {
+        Engine::Batch b;
+        Status st;
+        if (!serve) st = rpc::expired();
+        else if (!Engine::decode(std::move(bytes), b))
+            st = Status(grpc::StatusCode::INVALID_ARGUMENT, "bad IngestChunk #" + std::to_string(seq));
+        else eng_.prepare(b);
+
+        std::unique_lock<std::mutex> lk(mu_);
+        --staging_;
+        if (!st.ok()) fail(st);
+        else ready_.emplace(seq, std::move(b));
+        // One applier at a time keeps the chunks in order; the others leave
+        // theirs in ready_ for it.
+        while (!applying_ && st_.ok() && !ready_.empty() && ready_.begin()->first == applied_) {
+            applying_ = true;
+            std::vector<Engine::Batch> run;
+            size_t items = 0, nodes = 0;
+            for (auto it = ready_.begin(); it != ready_.end() && it->first == applied_ + run.size() && items < kApplyItems;
+                 it = ready_.erase(it)) {
+                items += it->second.nodes.size() + it->second.edges.size();
+                nodes += it->second.nodes.size();
+                run.push_back(std::move(it->second));
+            }
+            lk.unlock();
+            Status applied;
+            try {
+                eng_.upsert(run);
+            } catch (const Engine::OverBudget& e) {
+                applied = Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+            } catch (const std::exception& e) {
+                applied = Status(grpc::StatusCode::INTERNAL, e.what());
+            }
+            lk.lock();
+            applying_ = false;
+            if (!applied.ok()) {
+                fail(applied);
+            } else {
+                applied_ += run.size();
+                nodes_ += nodes;
+                edges_ += items - nodes;
+            }
+        }
+        resume(lk);
+    }
+    void fail(const Status& st) {
+        if (st_.ok()) st_ = st;
+        ready_.clear();
+    }
+    // Under mu_, which it releases: reads on while the window allows, or
+    // finishes once no chunk is being staged or applied. A failed stream does
+    // not wait for the read in flight.
+    void resume(std::unique_lock<std::mutex>& lk) {
+        if (finished_) return;
+        bool idle = staging_ == 0 && !applying_;
+        if (idle && (eof_ || !st_.ok())) {
+            finished_ = true;
+            ok_ = st_.ok();
+            graph::IngestAck ack;
+            ack.set_chunks(applied_); ack.set_nodes(nodes_); ack.set_edges(edges_);
+            if (ok_) *out_ = to_buffer(ack.SerializeAsString());
+            else ctx_->AddTrailingMetadata("graph-ingest-chunks", std::to_string(applied_));
+            Status st = st_;
+            lk.unlock();
+            Finish(st);
+        } else if (st_.ok() && !eof_ && !reading_ && read_ - applied_ < kWindow) {
+            reading_ = true;
+            lk.unlock();
+            StartRead(&in_);
+        }
+    }
+
+    Engine& eng_;
+    Lane& lane_;
+    CallbackServerContext* ctx_;
+    ByteBuffer* out_;
+    const rpc::Metrics& metrics_;
+    Clock::time_point start_, deadline_;
+    ByteBuffer in_;
+    std::mutex mu_;
+    Status st_;
+    uint64_t read_ = 0, applied_ = 0, nodes_ = 0, edges_ = 0;
+    size_t staging_ = 0;
+    std::map<uint64_t, Engine::Batch> ready_;
+    bool reading_ = false, eof_ = false, applying_ = false, finished_ = false, ok_ = false;
+};
+
+}  // namespace
+
+// What engine_from_env reads; see there.
+struct EngineServerOptions {
+    UpsertPolicy policy;
+    PersistOptions persist;  // in-memory only if dir is empty
+    unsigned expand_threads = 0;
+    RetentionPolicy retention;
+    ExpandCachePolicy cache{64 << 20};
+    RelatedPolicy related;
+    Lane::Options ingest{2, 32};
+    Lane::Options query{std::max(1u, std::thread::hardware_concurrency()), 256};
+};
+
+// Every method is a callback: handlers only hand the call to a lane, upserts
+// to the ingest one and reads to the query one, and a lane thread finishes it.
+// Each lane bounds its threads and the calls it holds, so an ingest flood is
+// pushed back on with RESOURCE_EXHAUSTED while expands keep their own threads.
+// Stats is answered inline, so it still works when both lanes are saturated.
+//
+// Expand responses are raw: the engine emits GraphFragment bytes from its
+// pre-encoded records and they go out without a protobuf message in between.
+class GraphServiceImpl final
+    : public GraphEngine::WithRawCallbackMethod_TopNeighbors<GraphEngine::WithRawCallbackMethod_PersonalizedPageRank<
+          GraphEngine::WithRawCallbackMethod_RelatedNodes<GraphEngine::WithRawCallbackMethod_BulkIngest<
+              GraphEngine::WithRawCallbackMethod_ExpandHop<GraphEngine::WithRawCallbackMethod_ExpandBatch<
+                  GraphEngine::WithRawCallbackMethod_ExpandTimeWindow<
+                      GraphEngine::WithRawCallbackMethod_ExpandTimeWindowStream<GraphEngine::CallbackService>>>>>>>> {
+public:
+    // With a data dir, state is restored from it before the server starts listening.
+    explicit GraphServiceImpl(const EngineServerOptions& opt)
+        : eng_(opt.policy, opt.expand_threads), ingest_("ingest", opt.ingest, registry_),
+          query_("query", opt.query, registry_) {
+        if (!opt.persist.dir.empty()) eng_.open(opt.persist);
+        eng_.index_related(opt.related);
+        eng_.retain(opt.retention);
+        eng_.cache_expands(opt.cache);
+        eng_.register_metrics(registry_);
+    }
+    // Appends every expand request to a new segment in `dir`, for replay by graph_engine_load.
+    void trace_expands(const std::string& dir) {
+        auto segs = Wal::segments(dir);
+        trace_ = std::make_unique<Wal>(dir, segs.empty() ? 0 : segs.back() + 1, false);
+        tracing_ = true;
+    }
+
+    grpc::ServerUnaryReactor* UpsertNodes(CallbackServerContext* ctx, const graph::UpsertNodesRequest* req,
+                                          Ack* ack) override {
+        return serve(ctx, ingest_, upsert_nodes_, [this, req, ack] {
+            std::vector<NodeIn> ns; ns.reserve(req->nodes_size());
+            for (const auto& n : req->nodes()) {
+                NodeIn r{n.id(), n.type(), n.ts(), {}};
+                r.attrs.assign(n.attrs().begin(), n.attrs().end());
+                ns.push_back(std::move(r));
+            }
+            return upsert([&] { eng_.upsert_nodes(ns); }, ack);
+        });
+    }
+    grpc::ServerUnaryReactor* UpsertEdges(CallbackServerContext* ctx, const graph::UpsertEdgesRequest* req,
+                                          Ack* ack) override {
+        return serve(ctx, ingest_, upsert_edges_, [this, req, ack] {
+            std::vector<EdgeIn> es; es.reserve(req->edges_size());
+            for (const auto& e : req->edges()) {
+                EdgeIn r{e.src(), e.dst(), e.type(), e.weight(), e.ts(), {}};
+                r.attrs.assign(e.attrs().begin(), e.attrs().end());
+                es.push_back(std::move(r));
+            }
+            return upsert([&] { eng_.upsert_edges(es); }, ack);
+        });
+    }
+    // Chunks arrive raw and are decoded off the gRPC threads; see IngestStream.
+    grpc::ServerReadReactor<ByteBuffer>* BulkIngest(CallbackServerContext* ctx, ByteBuffer* out) override {
+        return new IngestStream(eng_, ingest_, ctx, out, bulk_ingest_);
+    }
+    grpc::ServerUnaryReactor* ExpandTimeWindow(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        auto t0 = Clock::now();
+        return serve(ctx, query_, expand_, [this, ctx, t0, in, out] {
+            rpc::Timing timing(*ctx, t0);
+            timing.span("queue");
+            graph::ExpandRequest req;
+            if (!parse(in, &req)) return Status(grpc::StatusCode::INVALID_ARGUMENT, "bad ExpandRequest");
+            timing.span("decode");
+            trace(req);
+            std::string frag;
+            bool cut = false;
+            ExpandTiming et;
+            eng_.expand_encoded(seeds(req), req.window().start_ms(), req.window().end_ms(), req.max_hops(),
+                                rpc::options(req), [&](uint32_t, std::string& hop, bool truncated) {
+                                    frag += hop;  // repeated fields concatenate
+                                    cut = cut || truncated;
+                                    return true;
+                                }, timing.on() ? &et : nullptr);
+            timing.expand(et);
+            wire::int64(frag, wire::fragment::kTruncated, cut);
+            *out = to_buffer(std::move(frag));
+            timing.finish(*ctx);
+            return Status::OK;
+        });
+    }
+    grpc::ServerWriteReactor<ByteBuffer>* ExpandTimeWindowStream(CallbackServerContext* ctx, const ByteBuffer* in) override {
+        graph::ExpandRequest req;
+        if (!parse(in, &req)) {
+            expand_stream_.errors->add();
+            struct Reject : grpc::ServerWriteReactor<ByteBuffer> {
+                Reject() { Finish(Status(grpc::StatusCode::INVALID_ARGUMENT, "bad ExpandRequest")); }
+                void OnDone() override { delete this; }
+            };
+            return new Reject;
+        }
+        trace(req);
+        return new FragmentStream(eng_, query_, ctx, std::move(req), expand_stream_);
+    }
+    grpc::ServerUnaryReactor* ExpandBatch(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        auto t0 = Clock::now();
+        return serve(ctx, query_, expand_batch_, [this, ctx, t0, in, out] {
+            rpc::Timing timing(*ctx, t0);
+            timing.span("queue");
+            graph::ExpandBatchRequest req;
+            if (!parse(in, &req)) return Status(grpc::StatusCode::INVALID_ARGUMENT, "bad ExpandBatchRequest");
+            std::vector<ExpandQuery> qs;
+            qs.reserve(req.requests_size());
+            for (const auto& r : req.requests()) {
+                trace(r);
+                qs.push_back(rpc::query(r));
+            }
+            timing.span("decode");
+            std::vector<Engine::EncodedResult> results;
+            eng_.expand_batch_encoded(qs, results);
+            timing.span("expand");
+            std::string body;
+            for (auto& r : results) {
+                wire::int64(r.fragment, wire::fragment::kTruncated, r.truncated);
+                wire::message(body, wire::batch::kResults, r.fragment);
+            }
+            *out = to_buffer(std::move(body));
+            timing.span("respond");
+            timing.finish(*ctx);
+            return Status::OK;
+        });
+    }
+    grpc::ServerUnaryReactor* CommunitiesLouvain(CallbackServerContext* ctx, const graph::CommunitiesRequest* req,
+                                                 graph::CommunitiesResponse* out) override {
+        return serve(ctx, query_, communities_, [this, req, out] {
+            std::vector<std::pair<std::string, uint32_t>> labels;
+            eng_.communities(req->window().start_ms(), req->window().end_ms(), labels);
+            for (auto& [id, c] : labels) {
+                auto* l = out->add_labels(); l->set_node_id(id); l->set_community(c);
+            }
+            return Status::OK;
+        });
+    }
+    grpc::ServerUnaryReactor* Stats(CallbackServerContext* ctx, const graph::StatsRequest*,
+                                    graph::StatsResponse* out) override {
+        auto t0 = Clock::now();
+        auto st = eng_.stats();
+        out->set_nodes(st.nodes); out->set_edges(st.edges); out->set_delta_segments(st.delta_segments);
+        out->set_node_bytes(st.node_bytes); out->set_edge_bytes(st.edge_bytes);
+        out->set_adjacency_bytes(st.adjacency_bytes); out->set_string_bytes(st.string_bytes);
+        out->set_attr_bytes(st.attr_bytes); out->set_cache_bytes(st.cache_bytes);
+        out->set_related_bytes(st.related_bytes); out->set_bytes(st.bytes());
+        rpcs_.fill(*out);
+        stats_.observe(t0, true);
+        auto* reactor = ctx->DefaultReactor();
+        reactor->Finish(Status::OK);
+        return reactor;
+    }
+    grpc::ServerUnaryReactor* ExpandHop(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        return serve(ctx, query_, expand_hop_, [this, in, out] {
+            graph::HopRequest req;
+            if (!parse(in, &req)) return Status(grpc::StatusCode::INVALID_ARGUMENT, "bad HopRequest");
+            ExpandOptions opt;
+            opt.top_k = req.top_k();
+            opt.edge_attrs.assign(req.edge_attrs().begin(), req.edge_attrs().end());
+            opt.edge_types.assign(req.edge_types().begin(), req.edge_types().end());
+            std::string body;
+            eng_.hop_rows_encoded({req.ids().begin(), req.ids().end()}, req.window().start_ms(), req.window().end_ms(),
+                                  req.with_edges(), opt, body);
+            *out = to_buffer(std::move(body));
+            return Status::OK;
+        });
+    }
+    grpc::ServerUnaryReactor* TopNeighbors(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        return rank(ctx, in, out, RankOptions::kTopNeighbors, top_neighbors_);
+    }
+    grpc::ServerUnaryReactor* PersonalizedPageRank(CallbackServerContext* ctx, const ByteBuffer* in,
+                                                   ByteBuffer* out) override {
+        return rank(ctx, in, out, RankOptions::kPageRank, pagerank_);
+    }
+    grpc::ServerUnaryReactor* RelatedNodes(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out) override {
+        return serve(ctx, query_, related_, [this, in, out] {
+            graph::RelatedRequest req;
+            if (!parse(in, &req)) return Status(grpc::StatusCode::INVALID_ARGUMENT, "bad RelatedRequest");
+            RelatedOptions opt;
+            opt.docs = req.docs();
+            if (req.k()) opt.k = req.k();
+            std::string body;
+            if (!eng_.related_encoded({req.ids().begin(), req.ids().end()}, req.window().start_ms(),
+                                      req.window().end_ms(), opt, body))
+                return Status(grpc::StatusCode::FAILED_PRECONDITION, "related index is off (GRAPH_RELATED_SUMMARY_K=0)");
+            *out = to_buffer(std::move(body));
+            return Status::OK;
+        });
+    }
+    grpc::ServerUnaryReactor* WindowEdges(CallbackServerContext* ctx, const graph::TimeWindow* req,
+                                          graph::WindowEdgesResponse* out) override {
+        return serve(ctx, query_, window_edges_, [this, req, out] {
+            std::vector<EdgeRec> es;
+            eng_.window_edges(req->start_ms(), req->end_ms(), es);
+            for (auto& e : es) {
+                auto* m = out->add_edges();
+                m->set_src(e.src); m->set_dst(e.dst); m->set_type(e.type); m->set_weight(e.weight); m->set_ts(e.ts);
+                m->mutable_attrs()->insert(e.attrs.begin(), e.attrs.end());
+            }
+            return Status::OK;
+        });
     }
 private:
-    Engine eng_;
+    grpc::ServerUnaryReactor* rank(CallbackServerContext* ctx, const ByteBuffer* in, ByteBuffer* out,
+                                   RankOptions::Method method, const rpc::Metrics& m) {
+        return serve(ctx, query_, m, [this, in, out, method] {
+            graph::RankRequest req;
+            if (!parse(in, &req)) return Status(grpc::StatusCode::INVALID_ARGUMENT, "bad RankRequest");
+            std::string body;
+            eng_.rank_encoded({req.seed_ids().begin(), req.seed_ids().end()}, req.window().start_ms(),
+                              req.window().end_ms(), rpc::options(req, method), body);
+            *out = to_buffer(std::move(body));
+            return Status::OK;
+        });
+    }
+    // Queues `work` on `lane`; the Status it returns finishes the call. Calls
+    // the lane turns away, or drops once their deadline passes, never run it.
+    template <class F>
+    static grpc::ServerUnaryReactor* serve(CallbackServerContext* ctx, Lane& lane, const rpc::Metrics& m, F work) {
+        auto t0 = Clock::now();
+        auto* reactor = ctx->DefaultReactor();
+        auto admit = lane.submit(rpc::deadline(*ctx), [ctx, reactor, &m, t0, work](bool serve) {
+            Status st = !serve ? rpc::expired() : ctx->IsCancelled() ? Status::CANCELLED : work();
+            m.observe(t0, st.ok());
+            reactor->Finish(st);
+        });
+        if (admit != Lane::kAdmitted) {
+            m.observe(t0, false);
+            reactor->Finish(rpc::rejected(admit));
+        }
+        return reactor;
+    }
+    // A batch that could not be logged was not applied either.
+    template <class F>
+    static Status upsert(F&& apply, Ack* ack) {
+        try {
+            apply();
+        } catch (const Engine::OverBudget& e) {
+            return Status(grpc::StatusCode::RESOURCE_EXHAUSTED, e.what());
+        } catch (const std::exception& e) {
+            return Status(grpc::StatusCode::INTERNAL, e.what());
+        }
+        ack->set_ok(true);
+        return Status::OK;
+    }
+    void trace(const graph::ExpandRequest& req) {
+        if (!tracing_.load(std::memory_order_relaxed)) return;
+        std::lock_guard<std::mutex> lk(trace_mu_);
+        if (!trace_) return;
+        try {
+            trace_->append(Wal::kExpand, req.SerializeAsString());
+        } catch (const std::exception& e) {
+            std::cerr << "GraphEngine: expand trace stopped: " << e.what() << std::endl;
+            trace_.reset();
+            tracing_ = false;
+        }
+    }
+    static std::vector<std::string> seeds(const graph::ExpandRequest& req) {
+        return {req.seed_ids().begin(), req.seed_ids().end()};
+    }
+
+    metrics::Registry registry_;
+    rpc::MetricsTable rpcs_{registry_};
+    const rpc::Metrics& upsert_nodes_ = rpcs_.add("UpsertNodes");
+    const rpc::Metrics& upsert_edges_ = rpcs_.add("UpsertEdges");
+    const rpc::Metrics& bulk_ingest_ = rpcs_.add("BulkIngest");
+    const rpc::Metrics& expand_ = rpcs_.add("ExpandTimeWindow");
+    const rpc::Metrics& expand_stream_ = rpcs_.add("ExpandTimeWindowStream");
+    const rpc::Metrics& expand_batch_ = rpcs_.add("ExpandBatch");
+    const rpc::Metrics& communities_ = rpcs_.add("CommunitiesLouvain");
+    const rpc::Metrics& top_neighbors_ = rpcs_.add("TopNeighbors");
+    const rpc::Metrics& pagerank_ = rpcs_.add("PersonalizedPageRank");
+    const rpc::Metrics& related_ = rpcs_.add("RelatedNodes");
+    const rpc::Metrics& stats_ = rpcs_.add("Stats");
+    const rpc::Metrics& expand_hop_ = rpcs_.add("ExpandHop");
+    const rpc::Metrics& window_edges_ = rpcs_.add("WindowEdges");
+    std::atomic<bool> tracing_{false};
+    std::mutex trace_mu_;
+    std::unique_ptr<Wal> trace_;
+    Engine eng_;  // thread-safe: shared by the lane threads
+    Lane ingest_, query_;  // last, so their threads stop before anything they use goes
 };
 
+namespace {
+
+// Reads the variable `name` into out if it is set: true if it was, and
+// std::invalid_argument naming it if it is not a whole number that fits a T.
+template <class T>
+bool env(const char* name, T& out) {
+    const char* v = std::getenv(name);
+    if (!v) return false;
+    const char* end = v + std::strlen(v);
+    T x{};
+    auto [p, ec] = std::from_chars(v, end, x);
+    if (ec != std::errc() || p != end || p == v)
+        throw std::invalid_argument(std::string(name) + "=\"" + v + "\" is not " +
+                                    (std::is_floating_point_v<T> ? "a number" : "a whole number in range"));
+    out = x;
+    return true;
+}
+
+// The engine service, configured from GRAPH_* variables; null if it cannot start.
+std::unique_ptr<grpc::Service> engine_from_env() {
+    EngineServerOptions opt;
+    PersistOptions& persist = opt.persist;
+    UpsertPolicy& policy = opt.policy;
+    try {
+        // GRAPH_DATA_DIR enables the WAL and snapshots; without it the engine is in-memory only.
+        if (const char* dir = std::getenv("GRAPH_DATA_DIR")) persist.dir = dir;
+        if (uint64_t mb; env("GRAPH_SNAPSHOT_WAL_MB", mb)) persist.snapshot_wal_bytes = mb << 20;
+        if (const char* sync = std::getenv("GRAPH_WAL_SYNC")) persist.sync = std::string(sync) == "1";
+        env("GRAPH_EDGE_BUCKET_MS", policy.bucket_ms);
+        if (const char* w = std::getenv("GRAPH_EDGE_WEIGHT")) {  // max | sum | last
+            std::string m(w);
+            if (m != "max" && m != "sum" && m != "last")
+                throw std::invalid_argument("GRAPH_EDGE_WEIGHT=\"" + m + "\" is not max, sum or last");
+            policy.weight = m == "sum" ? UpsertPolicy::kSum : m == "last" ? UpsertPolicy::kLast : UpsertPolicy::kMax;
+        }
+        if (const char* ts = std::getenv("GRAPH_EDGE_TS")) policy.latest_ts = std::string(ts) != "first";
+        // GRAPH_EXPAND_THREADS caps the cores one expand may use; 1 keeps every expand on its lane thread.
+        env("GRAPH_EXPAND_THREADS", opt.expand_threads);
+        // GRAPH_RETENTION_DAYS expires edges (and nodes left without any) that much
+        // older than now; GRAPH_RETENTION_COMPACT_FRACTION is the expired share that
+        // triggers a compaction.
+        if (double d; env("GRAPH_RETENTION_DAYS", d)) opt.retention.ttl_ms = int64_t(d * 86400000);
+        env("GRAPH_RETENTION_COMPACT_FRACTION", opt.retention.compact_fraction);
+        // GRAPH_MEMORY_SOFT_MB compacts the oldest edges away once the engine holds
+        // more, down to GRAPH_MEMORY_LOW_WATER of it; past GRAPH_MEMORY_HARD_MB
+        // upserts fail with RESOURCE_EXHAUSTED.
+        if (uint64_t mb; env("GRAPH_MEMORY_SOFT_MB", mb)) opt.retention.soft_bytes = mb << 20;
+        if (uint64_t mb; env("GRAPH_MEMORY_HARD_MB", mb)) opt.retention.hard_bytes = mb << 20;
+        env("GRAPH_MEMORY_LOW_WATER", opt.retention.low_water);
+        // GRAPH_EXPAND_CACHE_MB bounds the expand result cache (0 turns it off).
+        if (uint64_t mb; env("GRAPH_EXPAND_CACHE_MB", mb)) opt.cache.max_bytes = mb << 20;
+        // GRAPH_RELATED_SUMMARY_K sizes the related index's per-bucket summaries (0
+        // turns it off); GRAPH_RELATED_MAX_ENTITY_DOCS caps the docs one entity pairs.
+        env("GRAPH_RELATED_SUMMARY_K", opt.related.summary_k);
+        env("GRAPH_RELATED_MAX_ENTITY_DOCS", opt.related.max_entity_docs);
+        // GRAPH_{INGEST,QUERY}_THREADS and _MAX_INFLIGHT size the two lanes.
+        for (auto [prefix, lane] : {std::pair{"GRAPH_INGEST_", &opt.ingest}, std::pair{"GRAPH_QUERY_", &opt.query}}) {
+            env((std::string(prefix) + "THREADS").c_str(), lane->threads);
+            env((std::string(prefix) + "MAX_INFLIGHT").c_str(), lane->max_inflight);
+        }
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "GraphEngine: " << e.what() << std::endl;
+        return nullptr;
+    }
+    std::unique_ptr<GraphServiceImpl> svc;
+    try {
+        svc = std::make_unique<GraphServiceImpl>(opt);
+    } catch (const std::exception& e) {
+        std::cerr << "GraphEngine: cannot restore " << persist.dir << ": " << e.what() << std::endl;
+        return nullptr;
+    }
+    // GRAPH_EXPAND_TRACE_DIR records expand requests for load testing.
+    if (const char* dir = std::getenv("GRAPH_EXPAND_TRACE_DIR")) {
+        try {
+            std::filesystem::create_directories(dir);
+            svc->trace_expands(dir);
+        } catch (const std::exception& e) {
+            std::cerr << "GraphEngine: cannot trace to " << dir << ": " << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+    return svc;
+}
+
+}  // namespace
+
 int main() {
     std::string addr("0.0.0.0:50061");
+    // GRAPH_SHARDS, a comma-separated list of engine servers, makes this a
+    // router over them instead. Every router must list them in the same order.
+    std::vector<std::string> shards;
+    if (const char* list = std::getenv("GRAPH_SHARDS")) {
+        std::stringstream in(list);
+        for (std::string a; std::getline(in, a, ',');)
+            if (!a.empty()) shards.push_back(a);
+    }
+    std::unique_ptr<grpc::Service> svc;
+    if (shards.empty()) {
+        if (!(svc = engine_from_env())) return 1;
+    } else {
+        int64_t ms = 10000;
+        try {
+            env("GRAPH_SHARD_TIMEOUT_MS", ms);
+        } catch (const std::invalid_argument& e) {
+            std::cerr << "GraphEngine: " << e.what() << std::endl;
+            return 1;
+        }
+        auto timeout = std::chrono::milliseconds(ms);
+        svc = make_shard_router(shards, timeout);
+        std::cout << "GraphEngine routing to " << shards.size() << " shards" << std::endl;
+    }
     ServerBuilder b; b.AddListeningPort(addr, grpc::InsecureServerCredentials());
-    GraphServiceImpl svc; b.RegisterService(&svc);
+    b.RegisterService(svc.get());
     std::unique_ptr<Server> server(b.BuildAndStart());
     std::cout << "GraphEngine listening on " << addr << std::endl;
     server->Wait();
@@ -0,0 +1,194 @@
+#include "shards.hpp"
+#include "rpc.hpp"
+#include "wire.hpp"
+#include <atomic>
+#include <future>
+
+uint32_t shard_of(std::string_view id, size_t shards) {
+    uint64_t h = 14695981039346656037ull;  // FNV-1a
+    for (unsigned char c : id) { h ^= c; h *= 1099511628211ull; }
+    return static_cast<uint32_t>(h % shards);
+}
+
+ShardSet::ShardSet(const std::vector<std::string>& addrs, std::chrono::milliseconds timeout) : timeout_(timeout) {
+    for (auto& a : addrs)
+        stubs_.push_back(std::make_unique<grpc::GenericStub>(grpc::CreateChannel(a, grpc::InsecureChannelCredentials())));
+}
+
+void ShardSet::call(const std::string& method, std::vector<std::optional<std::string>> bodies, Done done,
+                    const std::string& traceparent) {
+    struct Fanout {
+        std::vector<Reply> replies;
+        std::vector<std::unique_ptr<grpc::ClientContext>> ctx;
+        std::vector<grpc::ByteBuffer> req, resp;
+        std::atomic<size_t> pending{1};  // held by this loop until every call is started
+        Done done;
+        void finish() {
+            if (--pending) return;
+            done(replies);
+            delete this;
+        }
+    };
+    auto* f = new Fanout;
+    f->replies.resize(stubs_.size());
+    f->ctx.resize(stubs_.size());
+    f->req.resize(stubs_.size());
+    f->resp.resize(stubs_.size());
+    f->done = std::move(done);
+    for (size_t i = 0; i < stubs_.size() && i < bodies.size(); ++i) {
+        if (!bodies[i]) continue;
+        ++f->pending;
+        f->ctx[i] = std::make_unique<grpc::ClientContext>();
+        f->ctx[i]->set_deadline(std::chrono::system_clock::now() + timeout_);
+        if (!traceparent.empty()) f->ctx[i]->AddMetadata("traceparent", traceparent);
+        f->req[i] = rpc::to_buffer(std::move(*bodies[i]));
+        stubs_[i]->UnaryCall(f->ctx[i].get(), method, grpc::StubOptions(), &f->req[i], &f->resp[i],
+                             [f, i](grpc::Status st) {
+                                 if (st.ok()) f->replies[i].body = rpc::to_string(f->resp[i]);
+                                 f->replies[i].status = std::move(st);
+                                 f->finish();
+                             });
+    }
+    f->finish();
+}
+
+std::vector<ShardSet::Reply> ShardSet::call(const std::string& method, std::vector<std::optional<std::string>> bodies,
+                                            const std::string& traceparent) {
+    std::promise<std::vector<Reply>> p;
+    auto replies = p.get_future();
+    call(method, std::move(bodies), [&](std::vector<Reply>& r) { p.set_value(std::move(r)); }, traceparent);
+    return replies.get();
+}
+
+grpc::Status ShardSet::status(const std::vector<Reply>& replies) {
+    for (auto& r : replies)
+        if (!r.status.ok()) return r.status;
+    return grpc::Status::OK;
+}
+
+ShardedExpand::ShardedExpand(ShardSet& shards, ExpandQuery q, std::string traceparent)
+    : shards_(shards), q_(std::move(q)), traceparent_(std::move(traceparent)) {
+    if (!q_.opt.path.empty()) q_.hops = std::min<uint32_t>(q_.hops, static_cast<uint32_t>(q_.opt.path.size()));
+    std::unordered_set<std::string> dup;
+    for (auto& id : q_.seeds)
+        if (dup.insert(id).second) frontier_.push_back(id);
+}
+
+void ShardedExpand::next(Sink sink) {
+    std::vector<graph::HopRequest> reqs(shards_.size());
+    at_.clear();
+    for (auto& id : frontier_) {
+        uint32_t s = shards_.owner(id);
+        at_.emplace_back(s, static_cast<uint32_t>(reqs[s].ids_size()));
+        reqs[s].add_ids(id);
+    }
+    // This hop's edge types: the query's, narrowed by its path step. Lists
+    // that share no type leave nothing to walk.
+    std::vector<std::string> types = q_.opt.edge_types;
+    bool walk = !truncated_ && hop_ < q_.hops;
+    if (walk && !q_.opt.path.empty() && !q_.opt.path[hop_].edge_types.empty()) {
+        auto& step = q_.opt.path[hop_].edge_types;
+        if (types.empty()) {
+            types = step;
+        } else {
+            types.erase(std::remove_if(types.begin(), types.end(),
+                                       [&](const std::string& t) { return std::find(step.begin(), step.end(), t) == step.end(); }),
+                        types.end());
+            walk = !types.empty();
+        }
+    }
+    std::vector<std::optional<std::string>> bodies(shards_.size());
+    for (size_t s = 0; s < reqs.size(); ++s) {
+        auto& r = reqs[s];
+        if (!r.ids_size()) continue;
+        r.mutable_window()->set_start_ms(q_.start_ms);
+        r.mutable_window()->set_end_ms(q_.end_ms);
+        r.set_with_edges(walk);
+        r.set_top_k(q_.opt.top_k);
+        for (auto& [k, v] : q_.opt.edge_attrs) (*r.mutable_edge_attrs())[k] = v;
+        for (auto& t : types) r.add_edge_types(t);
+        bodies[s] = r.SerializeAsString();
+    }
+    auto self = shared_from_this();
+    shards_.call("/graph.GraphEngine/ExpandHop", std::move(bodies),
+                 [self, sink = std::move(sink)](std::vector<ShardSet::Reply>& replies) { self->on_rows(replies, sink); },
+                 traceparent_);
+}
+
+bool ShardedExpand::reach(const std::string& id) {
+    if (seen_.count(id)) return true;
+    if (q_.opt.max_nodes && nodes_out_ >= q_.opt.max_nodes) { truncated_ = true; return false; }
+    seen_.insert(id);
+    ++nodes_out_;
+    next_.push_back(id);
+    items_.push_back({{}, static_cast<uint32_t>(next_.size() - 1), false});
+    return true;
+}
+
+void ShardedExpand::on_rows(std::vector<ShardSet::Reply>& replies, const Sink& sink) {
+    std::string frag;
+    grpc::Status st = ShardSet::status(replies);
+    std::vector<std::vector<Row>> rows(replies.size());
+    for (size_t s = 0; s < replies.size() && st.ok(); ++s) {
+        bool ok = wire::for_each_field(replies[s].body, [&](uint32_t f, uint32_t type, uint64_t, std::string_view body) {
+            if (f != wire::hop::kRows || type != wire::kLen) return;
+            Row r;
+            wire::for_each_field(body, [&](uint32_t rf, uint32_t, uint64_t v, std::string_view b) {
+                if (rf == wire::hop_row::kFound) r.found = v;
+                else if (rf == wire::hop_row::kNode) r.node = b;
+                else if (rf == wire::hop_row::kEdges) r.edges.push_back(b);
+            });
+            rows[s].push_back(std::move(r));
+        });
+        if (!ok) st = grpc::Status(grpc::StatusCode::INTERNAL, "bad HopResponse from shard " + std::to_string(s));
+    }
+    for (auto& [s, i] : at_)
+        if (st.ok() && i >= rows[s].size())
+            st = grpc::Status(grpc::StatusCode::INTERNAL, "short HopResponse from shard " + std::to_string(s));
+    if (!st.ok()) {
+        sink(st, hop_, frag, false, true);
+        return;
+    }
+    auto row = [&](uint32_t i) -> const Row& { return rows[at_[i].first][at_[i].second]; };
+
+    // Seeds their owners have never seen are skipped, as Engine::walk skips unknown ids.
+    if (hop_ == 0) {
+        auto at = std::move(at_);
+        at_.clear();
+        for (size_t i = 0; i < frontier_.size(); ++i) {
+            if (!rows[at[i].first][at[i].second].found) continue;
+            if (!reach(frontier_[i])) break;
+            at_.push_back(at[i]);
+        }
+        frontier_.swap(next_);
+        next_.clear();
+    }
+    for (auto& it : items_) {
+        if (it.is_edge) wire::message(frag, wire::fragment::kEdges, it.edge);
+        else if (auto& r = row(it.node); !r.node.empty()) wire::message(frag, wire::fragment::kNodes, r.node);
+    }
+    uint32_t hop = hop_;
+    bool cut = truncated_, last = truncated_ || hop_ >= q_.hops || frontier_.empty();
+    if (!last) {
+        items_.clear();
+        for (uint32_t i = 0; i < frontier_.size() && !truncated_; ++i) {
+            for (std::string_view body : row(i).edges) {
+                if (q_.opt.dedup_edges && !seen_edges_.emplace(body).second) continue;
+                if (q_.opt.max_edges && edges_out_ >= q_.opt.max_edges) { truncated_ = true; break; }
+                std::string_view src, dst;
+                wire::for_each_field(body, [&](uint32_t f, uint32_t, uint64_t, std::string_view b) {
+                    if (f == wire::edge::kSrc) src = b;
+                    else if (f == wire::edge::kDst) dst = b;
+                });
+                // An edge is only kept if its far end made it into the result.
+                if (!reach(std::string(src == frontier_[i] ? dst : src))) break;
+                items_.push_back({std::string(body), 0, true});
+                ++edges_out_;
+            }
+        }
+        frontier_.swap(next_);
+        next_.clear();
+        ++hop_;
+    }
+    if (sink(grpc::Status::OK, hop, frag, cut, last) && !last) next(sink);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include "engine.hpp"
+#include <grpcpp/generic/generic_stub.h>
+#include <grpcpp/grpcpp.h>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+// Index of the shard owning node `id` out of `shards`. Placement hashes the id
+// alone, so the order and length of the shard list are part of the data layout:
+// changing either means re-ingesting.
+uint32_t shard_of(std::string_view id, size_t shards);
+
+// Clients for the engine servers of a sharded deployment, called with raw
+// request bytes so routed fragments are never parsed into messages.
+class ShardSet {
+public:
+    ShardSet(const std::vector<std::string>& addrs, std::chrono::milliseconds timeout);
+    size_t size() const { return stubs_.size(); }
+    uint32_t owner(std::string_view id) const { return shard_of(id, stubs_.size()); }
+
+    struct Reply {
+        grpc::Status status;
+        std::string body;
+    };
+    using Done = std::function<void(std::vector<Reply>& replies)>;
+    // Sends bodies[i] to shard i as `method` (e.g. "/graph.GraphEngine/Stats"),
+    // skipping shards without a body, whose replies are empty and OK. `done` runs
+    // once every call has finished, on a gRPC thread or, if nothing was sent, inline.
+    // A non-empty traceparent is sent along, so the shards time their part.
+    void call(const std::string& method, std::vector<std::optional<std::string>> bodies, Done done,
+              const std::string& traceparent = {});
+    // Blocking form of call().
+    std::vector<Reply> call(const std::string& method, std::vector<std::optional<std::string>> bodies,
+                            const std::string& traceparent = {});
+    // The first failed reply's status, or OK.
+    static grpc::Status status(const std::vector<Reply>& replies);
+private:
+    std::vector<std::unique_ptr<grpc::GenericStub>> stubs_;
+    std::chrono::milliseconds timeout_;
+};
+
+// One expand run across the shards as a distributed level-synchronous BFS.
+// Each hop sends the frontier to its owners, one HopRequest per shard, which
+// return the stored nodes and their candidate edges; visited sets and budgets
+// are applied here, in frontier order, the way Engine::walk applies them. A
+// node's record arrives with the request for its own edges, so a hop costs one
+// round trip to each shard involved, plus one at the end for the last frontier.
+//
+// Shards answer each hop from whatever version is current there, so unlike a
+// single engine a routed expand does not see one consistent snapshot.
+class ShardedExpand : public std::enable_shared_from_this<ShardedExpand> {
+public:
+    // `fragment` holds the nodes/edges fields of a graph.GraphFragment, as from
+    // Engine::expand_encoded; on an error `last` is set and the rest is empty.
+    // Returning true goes on to the next hop at once, false waits for next().
+    using Sink = std::function<bool(const grpc::Status& st, uint32_t hop, std::string& fragment, bool truncated,
+                                    bool last)>;
+    ShardedExpand(ShardSet& shards, ExpandQuery q, std::string traceparent = {});
+    // Runs the next hop and hands it to `sink`, on a gRPC thread. Must be held
+    // in a shared_ptr; it keeps itself alive while a hop is in flight.
+    void next(Sink sink);
+private:
+    struct Row {
+        bool found = false;
+        std::string_view node;
+        std::vector<std::string_view> edges;  // graph.Edge bodies
+    };
+    // A hop's output in discovery order: an edge body, or a frontier node.
+    struct Item {
+        std::string edge;
+        uint32_t node = 0;
+        bool is_edge = false;
+    };
+    void on_rows(std::vector<ShardSet::Reply>& replies, const Sink& sink);
+    bool reach(const std::string& id);
+
+    ShardSet& shards_;
+    ExpandQuery q_;
+    std::string traceparent_;
+    uint32_t hop_ = 0;
+    std::vector<std::string> frontier_, next_;  // nodes reached at hop_, at hop_ + 1
+    std::vector<Item> items_;                   // hop_'s output but for node records
+    std::vector<std::pair<uint32_t, uint32_t>> at_;  // frontier_[i] is rows #second of shard #first
+    std::unordered_set<std::string> seen_, seen_edges_;
+    size_t nodes_out_ = 0, edges_out_ = 0;
+    bool truncated_ = false;
+};
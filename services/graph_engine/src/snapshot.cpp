@@ -0,0 +1,107 @@
+#include "snapshot.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+// "!GESNAP" and a version digit; the writer always writes kVersion.
+constexpr uint64_t kMagic = 0x0050414e53454721ull, kDigit = uint64_t(1) << 56;
+constexpr uint64_t kVersion = 2;
+
+[[noreturn]] void fail(const std::string& what, const std::string& path) {
+    throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+struct Mapping {
+    void* p = MAP_FAILED;
+    size_t n = 0;
+    ~Mapping() { if (p != MAP_FAILED) munmap(p, n); }
+};
+}
+
+SnapshotWriter::SnapshotWriter(std::string path) : path_(std::move(path)), tmp_(path_ + ".tmp") {
+    f_ = std::fopen(tmp_.c_str(), "wb");
+    if (!f_) fail("cannot create", tmp_);
+    u64(kMagic + ('0' + kVersion) * kDigit);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+    if (!f_) return;
+    std::fclose(f_);
+    std::remove(tmp_.c_str());
+}
+
+void SnapshotWriter::raw(const void* p, size_t n) {
+    if (n && std::fwrite(p, 1, n, f_) != n) fail("write failed on", tmp_);
+}
+
+void SnapshotWriter::end() {
+    static const char zeros[8] = {};
+    raw(zeros, (8 - pending_ % 8) % 8);
+    pending_ = 0;
+}
+
+void SnapshotWriter::commit() {
+    u64(kMagic + ('0' + kVersion) * kDigit);
+    if (std::fflush(f_) != 0 || fsync(fileno(f_)) != 0) fail("cannot sync", tmp_);
+    std::fclose(f_);
+    f_ = nullptr;
+    if (std::rename(tmp_.c_str(), path_.c_str()) != 0) fail("cannot rename", tmp_);
+    // Make the rename itself durable.
+    std::string dir = path_.substr(0, path_.find_last_of('/') + 1);
+    int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) { fsync(fd); ::close(fd); }
+}
+
+SnapshotReader::SnapshotReader(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) fail("cannot open", path);
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        ::close(fd);
+        errno = err;
+        fail("cannot stat", path);
+    }
+    if (st.st_size < 16) {
+        ::close(fd);
+        bad();
+    }
+    auto m = std::make_shared<Mapping>();
+    m->n = size_t(st.st_size);
+    // Private and writable: adopted arrays may be patched in place, which
+    // copies just the touched pages and never writes back to the file.
+    m->p = mmap(nullptr, m->n, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    int err = errno;
+    ::close(fd);
+    errno = err;
+    if (m->p == MAP_FAILED) fail("cannot map", path);
+    base_ = static_cast<const char*>(m->p);
+    size_ = m->n;
+    map_ = m;
+    uint64_t head = u64(), tail;
+    std::memcpy(&tail, base_ + size_ - 8, 8);
+    version_ = (head >> 56) - '0';
+    if (head != tail || head % kDigit != kMagic || version_ < 1 || version_ > kVersion) bad();
+    size_ -= 8;
+}
+
+uint64_t SnapshotReader::u64() {
+    uint64_t v;
+    std::memcpy(&v, take(8), 8);
+    return v;
+}
+
+const char* SnapshotReader::take(uint64_t n) {
+    uint64_t padded = (n + 7) & ~uint64_t(7);
+    if (padded > size_ - pos_) bad();
+    const char* p = base_ + pos_;
+    pos_ += padded;
+    return p;
+}
+
+void SnapshotReader::bad() const { throw std::runtime_error("malformed snapshot"); }
@@ -0,0 +1,98 @@
+#pragma once
+#include "array.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Flat snapshot file: a magic number carrying the format version, then a sequence of u64 values and
+// length-prefixed arrays of trivially copyable elements, every item padded to
+// 8 bytes, then the magic again. Because arrays stay aligned in the file, the
+// reader maps it once and hands out Arrays pointing into the mapping; pages are
+// faulted in as queries touch them rather than read up front.
+//
+// Both sides throw std::runtime_error on I/O errors or a malformed file. The
+// reader checks the framing and string offsets; what the arrays index into is
+// for the caller to check.
+class SnapshotWriter {
+public:
+    // Writes to `path`.tmp; commit() makes it durable and renames it over `path`.
+    explicit SnapshotWriter(std::string path);
+    ~SnapshotWriter();
+    SnapshotWriter(const SnapshotWriter&) = delete;
+    SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+    void u64(uint64_t v) { raw(&v, sizeof v); }
+    // An array may be written in pieces: begin() with the total count, then
+    // append() runs that add up to it.
+    template <class T>
+    void begin(size_t n) { static_assert(std::is_trivially_copyable<T>::value, "raw array"); u64(n); }
+    template <class T>
+    void append(const T* p, size_t n) { raw(p, n * sizeof(T)); pending_ += n * sizeof(T); }
+    void end();
+    template <class T>
+    void array(const T* p, size_t n) { begin<T>(n); append(p, n); end(); }
+    // n strings produced by get(i); read back with SnapshotReader::strings().
+    template <class Get>
+    void strings(size_t n, Get&& get) {
+        begin<uint64_t>(n + 1);
+        uint64_t off = 0;
+        append(&off, 1);
+        for (size_t i = 0; i < n; ++i) { off += std::string_view(get(i)).size(); append(&off, 1); }
+        end();
+        begin<char>(off);
+        for (size_t i = 0; i < n; ++i) { std::string_view s = get(i); append(s.data(), s.size()); }
+        end();
+    }
+    void commit();
+private:
+    void raw(const void* p, size_t n);
+
+    std::string path_, tmp_;
+    FILE* f_ = nullptr;
+    size_t pending_ = 0;  // bytes of the array being written, for padding
+};
+
+class SnapshotReader {
+public:
+    struct Strings {
+        Array<uint64_t> offsets;
+        Array<char> chars;
+        size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+        std::string_view operator[](size_t i) const {
+            return {chars.data() + offsets[i], size_t(offsets[i + 1] - offsets[i])};
+        }
+    };
+
+    explicit SnapshotReader(const std::string& path);
+    // The format the file was written in; the writer always writes the latest.
+    uint64_t version() const { return version_; }
+    uint64_t u64();
+    template <class T>
+    Array<T> array() {
+        static_assert(std::is_trivially_copyable<T>::value, "raw array");
+        uint64_t n = u64();
+        if (n > (size_ - pos_) / sizeof(T)) bad();
+        const char* p = take(n * sizeof(T));
+        return Array<T>(reinterpret_cast<const T*>(p), n, map_);
+    }
+    Strings strings() {
+        Strings s;
+        s.offsets = array<uint64_t>();
+        s.chars = array<char>();
+        if (s.offsets.empty() ? !s.chars.empty() : s.offsets[0] != 0 || s.offsets.back() != s.chars.size()) bad();
+        for (size_t i = 1; i < s.offsets.size(); ++i)
+            if (s.offsets[i] < s.offsets[i - 1]) bad();
+        return s;
+    }
+private:
+    const char* take(uint64_t n);
+    [[noreturn]] void bad() const;
+
+    std::shared_ptr<const void> map_;
+    const char* base_ = nullptr;
+    size_t size_ = 0, pos_ = 0;
+    uint64_t version_ = 0;
+};
@@ -0,0 +1,120 @@
+#include "wal.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr size_t kHeader = 9;
+
+uint32_t checksum(uint8_t kind, std::string_view payload) {
+    uint32_t h = 2166136261u ^ kind;  // FNV-1a
+    for (char c : payload) h = (h ^ uint8_t(c)) * 16777619u;
+    return h;
+}
+
+[[noreturn]] void fail(const std::string& what, const std::string& path) {
+    throw std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+}
+
+Wal::Wal(std::string dir, uint64_t seq, bool sync) : dir_(std::move(dir)), seq_(seq), sync_(sync) { open_segment(); }
+
+Wal::~Wal() { if (fd_ >= 0) ::close(fd_); }
+
+std::string Wal::path(const std::string& dir, uint64_t seq) { return dir + "/wal." + std::to_string(seq); }
+
+void Wal::open_segment() {
+    std::string p = path(dir_, seq_);
+    fd_ = ::open(p.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd_ < 0) fail("cannot open", p);
+    bytes_ = 0;
+}
+
+void Wal::append(Kind kind, std::string_view payload) {
+    std::string rec(kHeader, '\0');
+    uint32_t len = static_cast<uint32_t>(payload.size()), sum = checksum(kind, payload);
+    std::memcpy(&rec[0], &len, 4);
+    std::memcpy(&rec[4], &sum, 4);
+    rec[8] = char(kind);
+    rec.append(payload.data(), payload.size());
+    auto failed = [&] {
+        int err = errno;
+        // Cut the partial record off; if even that fails, replay reports it.
+        int rc = ftruncate(fd_, off_t(bytes_));
+        (void)rc;
+        errno = err;
+        fail("cannot append to", path(dir_, seq_));
+    };
+    for (size_t done = 0; done < rec.size();) {
+        ssize_t n = ::write(fd_, rec.data() + done, rec.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) failed();
+        done += size_t(n);
+    }
+    if (sync_ && fdatasync(fd_) != 0) failed();
+    bytes_ += rec.size();
+}
+
+uint64_t Wal::rotate() {
+    ::close(fd_);
+    fd_ = -1;
+    ++seq_;
+    open_segment();
+    return seq_;
+}
+
+std::vector<uint64_t> Wal::segments(const std::string& dir) {
+    std::vector<uint64_t> out;
+    std::error_code ec;
+    for (auto& e : fs::directory_iterator(dir, ec)) {
+        std::string name = e.path().filename().string();
+        if (name.rfind("wal.", 0) != 0 || name.size() == 4) continue;
+        if (!std::all_of(name.begin() + 4, name.end(), [](char c) { return c >= '0' && c <= '9'; })) continue;
+        out.push_back(std::stoull(name.substr(4)));
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+}
+
+size_t Wal::replay(const std::string& path, const std::function<void(Kind, std::string_view)>& fn, bool tail_ok) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) fail("cannot open", path);
+    std::string buf((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::string_view s(buf);
+    size_t p = 0;
+    auto bad = [&](bool torn) {
+        if (!(tail_ok && torn))
+            throw std::runtime_error("corrupt WAL record at byte " + std::to_string(p) + " of " + path);
+        return p;
+    };
+    while (p < s.size()) {
+        if (s.size() - p < kHeader) return bad(true);
+        uint32_t len, sum;
+        std::memcpy(&len, s.data() + p, 4);
+        std::memcpy(&sum, s.data() + p + 4, 4);
+        uint8_t kind = uint8_t(s[p + 8]);
+        if (len > s.size() - p - kHeader) return bad(true);
+        std::string_view payload = s.substr(p + kHeader, len);
+        if (checksum(kind, payload) != sum || kind < kNodes || kind > kExpand)
+            return bad(p + kHeader + len == s.size());
+        fn(Kind(kind), payload);
+        p += kHeader + len;
+    }
+    return p;
+}
+
+void Wal::drop_before(const std::string& dir, uint64_t seq) {
+    for (uint64_t s : segments(dir)) {
+        if (s >= seq) break;
+        std::error_code ec;
+        fs::remove(path(dir, s), ec);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Write-ahead log of upsert batches, split into numbered segment files
+// (<dir>/wal.<seq>) so the prefix a snapshot covers can be dropped whole.
+// Each record is [u32 length][u32 checksum][u8 kind][payload]. A crash can only
+// tear the last record of the segment being written, so a short or corrupt
+// record anywhere else means the log is damaged.
+//
+// The same format records expand request traces (kExpand) for bench/load_driver.
+//
+// Not thread-safe: the engine calls it under its writer mutex.
+class Wal {
+public:
+    enum Kind : uint8_t { kNodes = 1, kEdges = 2, kExpand = 3 };
+
+    // Opens segment `seq` for appending; `sync` fdatasyncs every record.
+    Wal(std::string dir, uint64_t seq, bool sync);
+    ~Wal();
+    Wal(const Wal&) = delete;
+    Wal& operator=(const Wal&) = delete;
+
+    // Throws std::runtime_error; a failed append is cut off again so the
+    // segment never holds a partial record followed by good ones.
+    void append(Kind kind, std::string_view payload);
+    // Closes the current segment and starts the next; returns its number.
+    uint64_t rotate();
+    uint64_t seq() const { return seq_; }
+    size_t bytes() const { return bytes_; }
+
+    static std::string path(const std::string& dir, uint64_t seq);
+    // Segment numbers present in `dir`, ascending.
+    static std::vector<uint64_t> segments(const std::string& dir);
+    // Calls fn on each record in order and returns the bytes they span. Throws
+    // std::runtime_error at a short or corrupt record, unless `tail_ok` and it
+    // runs to the end of the file, i.e. is a torn tail; replay stops there.
+    static size_t replay(const std::string& path, const std::function<void(Kind, std::string_view)>& fn,
+                         bool tail_ok = false);
+    static void drop_before(const std::string& dir, uint64_t seq);
+private:
+    void open_segment();
+
+    std::string dir_;
+    uint64_t seq_;
+    bool sync_;
+    int fd_ = -1;
+    size_t bytes_ = 0;
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// Minimal protobuf wire-format writer/reader for the messages the engine keeps
+// pre-encoded. Field numbers must track proto/graph_engine.proto.
+namespace wire {
+
+namespace node { enum : uint32_t { kId = 1, kTs = 2, kType = 3, kAttrs = 4 }; }
+namespace edge { enum : uint32_t { kSrc = 1, kDst = 2, kWeight = 3, kTs = 4, kType = 5, kAttrs = 6 }; }
+namespace upsert { enum : uint32_t { kItems = 1 }; }
+namespace ingest { enum : uint32_t { kNodes = 1, kEdges = 2 }; }
+namespace fragment { enum : uint32_t { kNodes = 1, kEdges = 2, kHop = 3, kTruncated = 4 }; }
+namespace batch { enum : uint32_t { kResults = 1 }; }
+namespace hop { enum : uint32_t { kRows = 1 }; }
+namespace hop_row { enum : uint32_t { kFound = 1, kNode = 2, kEdges = 3 }; }
+namespace rank { enum : uint32_t { kNodes = 1, kEdges = 2, kScores = 3, kTruncated = 4 }; }
+namespace entry { enum : uint32_t { kKey = 1, kValue = 2 }; }
+
+enum : uint32_t { kVarint = 0, kFixed64 = 1, kLen = 2 };
+
+inline size_t varint_size(uint64_t v) { size_t n = 1; while (v >= 0x80) { v >>= 7; ++n; } return n; }
+inline void varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) { out.push_back(char(v | 0x80)); v >>= 7; }
+    out.push_back(char(v));
+}
+inline void tag(std::string& out, uint32_t field, uint32_t type) { varint(out, (uint64_t(field) << 3) | type); }
+
+// proto3 omits default values; so do we, to match what protobuf would emit.
+inline size_t bytes_size(uint32_t field, std::string_view s) {
+    return s.empty() ? 0 : varint_size(field << 3) + varint_size(s.size()) + s.size();
+}
+inline void bytes(std::string& out, uint32_t field, std::string_view s) {
+    if (s.empty()) return;
+    tag(out, field, kLen); varint(out, s.size()); out.append(s.data(), s.size());
+}
+inline size_t int_size(uint32_t field, uint64_t v) { return v ? varint_size(field << 3) + varint_size(v) : 0; }
+inline void int64(std::string& out, uint32_t field, uint64_t v) {
+    if (!v) return;
+    tag(out, field, kVarint); varint(out, v);
+}
+inline size_t double_size(uint32_t field, double v) { return v != 0 ? varint_size(field << 3) + 8 : 0; }
+inline void float64(std::string& out, uint32_t field, double v) {
+    if (v == 0) return;
+    uint64_t bits; std::memcpy(&bits, &v, 8);
+    tag(out, field, kFixed64);
+    for (int i = 0; i < 8; ++i) out.push_back(char(bits >> (8 * i)));
+}
+// A packed repeated double.
+inline void packed_doubles(std::string& out, uint32_t field, const double* v, size_t n) {
+    if (!n) return;
+    tag(out, field, kLen); varint(out, 8 * n);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t bits; std::memcpy(&bits, &v[i], 8);
+        for (int b = 0; b < 8; ++b) out.push_back(char(bits >> (8 * b)));
+    }
+}
+// A length-delimited submessage whose encoded body is already known.
+inline void message(std::string& out, uint32_t field, std::string_view body) {
+    tag(out, field, kLen); varint(out, body.size()); out.append(body.data(), body.size());
+}
+inline size_t map_entry_size(uint32_t field, std::string_view k, std::string_view v) {
+    size_t body = bytes_size(entry::kKey, k) + bytes_size(entry::kValue, v);
+    return varint_size(field << 3) + varint_size(body) + body;
+}
+inline void map_entry(std::string& out, uint32_t field, std::string_view k, std::string_view v) {
+    tag(out, field, kLen);
+    varint(out, bytes_size(entry::kKey, k) + bytes_size(entry::kValue, v));
+    bytes(out, entry::kKey, k); bytes(out, entry::kValue, v);
+}
+
+inline bool read_varint(std::string_view s, size_t& p, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < s.size() && shift < 64; shift += 7) {
+        uint8_t b = uint8_t(s[p++]);
+        v |= uint64_t(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    return false;
+}
+
+// Calls fn(field, type, value, body) for each field in `msg`: `value` holds a
+// varint or the raw bits of a fixed64, `body` a length-delimited payload.
+// Returns false on malformed input.
+template <class F>
+bool for_each_field(std::string_view msg, F&& fn) {
+    for (size_t p = 0; p < msg.size();) {
+        uint64_t t, v = 0;
+        std::string_view body;
+        if (!read_varint(msg, p, t)) return false;
+        switch (uint32_t(t & 7)) {
+        case kVarint:
+            if (!read_varint(msg, p, v)) return false;
+            break;
+        case kFixed64:
+            if (msg.size() - p < 8) return false;
+            std::memcpy(&v, msg.data() + p, 8);
+            p += 8;
+            break;
+        case kLen:
+            if (!read_varint(msg, p, v) || v > msg.size() - p) return false;
+            body = msg.substr(p, v);
+            p += v;
+            break;
+        case 5:
+            if (msg.size() - p < 4) return false;
+            p += 4;
+            break;
+        default: return false;
+        }
+        fn(uint32_t(t >> 3), uint32_t(t & 7), v, body);
+    }
+    return true;
+}
+
+// Calls fn(key, value) for each map<string,string> entry under `field` in `msg`.
+// Returns false on malformed input.
+template <class F>
+bool for_each_entry(std::string_view msg, uint32_t field, F&& fn) {
+    bool ok = true;
+    bool parsed = for_each_field(msg, [&](uint32_t f, uint32_t type, uint64_t, std::string_view body) {
+        if (f != field || type != kLen || !ok) return;
+        std::string_view k, v;
+        ok = for_each_field(body, [&](uint32_t ef, uint32_t, uint64_t, std::string_view eb) {
+            if (ef == entry::kKey) k = eb;
+            else if (ef == entry::kValue) v = eb;
+        });
+        if (ok) fn(k, v);
+    });
+    return parsed && ok;
+}
+
+}  // namespace wire
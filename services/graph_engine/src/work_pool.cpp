@@ -0,0 +1,78 @@
+#include "work_pool.hpp"
+#include <algorithm>
+
+WorkPool::WorkPool(unsigned threads) {
+    for (unsigned i = 0; i <= threads; ++i) queues_.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; ++i) workers_.emplace_back([this, i] { run(i); });
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : workers_) t.join();
+}
+
+void WorkPool::parallel_for(size_t n, size_t grain, const Fn& fn) {
+    if (n == 0) return;
+    grain = grain ? grain : 1;
+    std::unique_lock<std::mutex> loop(loop_mu_, std::try_to_lock);
+    if (!loop || workers_.empty() || n <= grain) {
+        for (size_t b = 0; b < n; b += grain) fn(b, std::min(n, b + grain));
+        return;
+    }
+    size_t chunks = (n + grain - 1) / grain;
+    for (size_t c = 0; c < chunks; ++c) {
+        Queue& q = *queues_[c % queues_.size()];
+        std::lock_guard<std::mutex> lk(q.mu);
+        q.chunks.push_back({c * grain, std::min(n, (c + 1) * grain), &fn});
+    }
+    {
+        std::lock_guard<std::mutex> lk(mu_);
+        pending_ = chunks;
+        ++generation_;
+    }
+    wake_.notify_all();
+    drain(workers_.size());
+    std::unique_lock<std::mutex> lk(mu_);
+    done_.wait(lk, [&] { return pending_ == 0; });
+}
+
+void WorkPool::run(size_t self) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(mu_);
+            wake_.wait(lk, [&] { return stop_ || generation_ != seen; });
+            if (stop_) return;
+            seen = generation_;
+        }
+        drain(self);
+    }
+}
+
+// Own deque from the back (the chunks dealt last, still warm), then the others' fronts.
+bool WorkPool::take(size_t self, Chunk& c) {
+    for (size_t i = 0; i < queues_.size(); ++i) {
+        Queue& q = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> lk(q.mu);
+        if (q.chunks.empty()) continue;
+        if (i == 0) { c = q.chunks.back(); q.chunks.pop_back(); }
+        else { c = q.chunks.front(); q.chunks.pop_front(); }
+        return true;
+    }
+    return false;
+}
+
+// Chunks carry their loop's fn, so a worker that wakes late can only pick up
+// chunks of the loop that is running, whose fn is still alive.
+void WorkPool::drain(size_t self) {
+    Chunk c;
+    while (take(self, c)) {
+        (*c.fn)(c.begin, c.end);
+        std::lock_guard<std::mutex> lk(mu_);
+        if (--pending_ == 0) done_.notify_all();
+    }
+}
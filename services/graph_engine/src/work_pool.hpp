@@ -0,0 +1,53 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool for splitting one loop across cores. parallel_for deals
+// [0, n) out in grain-sized chunks round-robin onto per-thread deques; each
+// thread, the caller included, drains its own deque from the back and steals
+// from the front of the others' once it is empty, so a chunk holding a hub
+// does not leave the rest of the pool idle.
+//
+// One loop runs at a time. A caller that finds the pool busy runs its loop
+// inline rather than wait, so concurrent requests never queue behind each other.
+class WorkPool {
+public:
+    using Fn = std::function<void(size_t begin, size_t end)>;
+
+    explicit WorkPool(unsigned threads);
+    ~WorkPool();
+    WorkPool(const WorkPool&) = delete;
+    WorkPool& operator=(const WorkPool&) = delete;
+
+    // Calls fn(k * grain, min(n, (k + 1) * grain)) for every chunk k, in any
+    // order and on any thread; returns once all are done. fn must not throw.
+    void parallel_for(size_t n, size_t grain, const Fn& fn);
+    unsigned threads() const { return static_cast<unsigned>(workers_.size()); }
+private:
+    struct Chunk {
+        size_t begin, end;
+        const Fn* fn;
+    };
+    struct alignas(64) Queue {
+        std::mutex mu;
+        std::deque<Chunk> chunks;
+    };
+    void run(size_t self);
+    bool take(size_t self, Chunk& c);
+    void drain(size_t self);
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Queue>> queues_;  // one per worker, the last for the caller
+    std::mutex loop_mu_;                          // held for the duration of a loop
+    std::mutex mu_;
+    std::condition_variable wake_, done_;
+    uint64_t generation_ = 0;
+    size_t pending_ = 0;  // chunks of the current loop not yet finished
+    bool stop_ = false;
+};
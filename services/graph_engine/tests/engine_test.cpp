@@ -0,0 +1,648 @@
+// Engine checks run by ctest. No framework: a failed CHECK prints where, and
+// the exit status is the number of failures.
+#include "engine.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(cond)                                                                  \
+    do {                                                                             \
+        if (!(cond)) {                                                               \
+            ++failures;                                                              \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+        }                                                                            \
+    } while (0)
+
+constexpr int64_t kDay = 86400000;
+
+EdgeRec edge(std::string src, std::string dst, std::string type, double weight, int64_t ts) {
+    EdgeRec e;
+    e.src = std::move(src); e.dst = std::move(dst); e.type = std::move(type);
+    e.weight = weight; e.ts = ts;
+    return e;
+}
+
+std::vector<EdgeRec> all_edges(const Engine& eng) {
+    std::vector<EdgeRec> es;
+    eng.window_edges(INT64_MIN, INT64_MAX, es);
+    return es;
+}
+
+const EdgeRec* find(const std::vector<EdgeRec>& es, const std::string& type, int64_t bucket) {
+    for (auto& e : es)
+        if (e.type == type && e.ts / kDay == bucket) return &e;
+    return nullptr;
+}
+
+// Endpoints (either way round), type and day bucket make an edge; a repeat merges into it.
+void merge_on_duplicate() {
+    Engine eng;
+    eng.upsert_edges({edge("a", "b", "T", 1, 10), edge("b", "a", "T", 3, 20)});
+    eng.upsert_edges({edge("a", "b", "T", 2, 30)});
+    eng.upsert_edges({edge("a", "b", "U", 1, 10), edge("a", "b", "T", 1, kDay + 10)});
+    auto es = all_edges(eng);
+    CHECK(es.size() == 3);
+    const EdgeRec* t0 = find(es, "T", 0);
+    CHECK(t0 && t0->weight == 3 && t0->ts == 30);
+    CHECK(find(es, "T", 1) && find(es, "U", 0));
+
+    Engine sum(UpsertPolicy{kDay, UpsertPolicy::kSum, false});
+    sum.upsert_edges({edge("a", "b", "T", 1, 10)});
+    sum.upsert_edges({edge("b", "a", "T", 2, 30)});
+    es = all_edges(sum);
+    CHECK(es.size() == 1 && es[0].weight == 3 && es[0].ts == 10);
+
+    Engine every(UpsertPolicy{0});
+    every.upsert_edges({edge("a", "b", "T", 1, 10), edge("a", "b", "T", 1, 10)});
+    CHECK(all_edges(every).size() == 2);
+}
+
+// A node upsert merges attrs key by key and keeps an omitted type and ts.
+void node_patch() {
+    Engine eng;
+    NodeRec n;
+    n.id = "a"; n.type = "doc"; n.ts = 5; n.attrs = {{"title", "t"}, {"lang", "en"}};
+    eng.upsert_nodes(std::vector<NodeRec>{n});
+    n.type.clear(); n.ts = 0; n.attrs = {{"title", "t2"}};
+    eng.upsert_nodes(std::vector<NodeRec>{n});
+    std::vector<NodeRec> ns;
+    std::vector<EdgeRec> es;
+    eng.expand({"a"}, 0, 10, 0, ns, es);
+    CHECK(ns.size() == 1);
+    if (ns.size() == 1) {
+        CHECK(ns[0].type == "doc" && ns[0].ts == 5);
+        CHECK(ns[0].attrs.at("title") == "t2" && ns[0].attrs.at("lang") == "en");
+    }
+}
+
+// Small upserts pile up as delta segments until they outgrow a share of the
+// base, then fold into a new base; the adjacency reads the same either way.
+void delta_fold() {
+    Engine eng;
+    const int n = 5000;
+    bool folded = false;
+    for (int i = 0; i < n; ++i) {
+        eng.upsert_edges({edge("hub", "n" + std::to_string(i), "T", 1, i)});
+        folded = folded || eng.stats().delta_segments == 0;
+        if (i == 0) CHECK(eng.stats().delta_segments == 1);
+    }
+    CHECK(folded);
+    CHECK(eng.stats().edges == size_t(n));
+    std::vector<NodeRec> ns;
+    std::vector<EdgeRec> es;
+    eng.expand({"hub"}, 0, n, 1, ns, es);
+    CHECK(es.size() == size_t(n));
+}
+
+// Only edges with start <= ts <= end are walked, at every hop. The nodes here
+// have no records, so what a walk reached is read off its edges.
+void expand_window() {
+    Engine eng;
+    eng.upsert_edges({edge("a", "b", "T", 1, 100), edge("a", "c", "T", 1, 200), edge("a", "d", "T", 1, 300),
+                      edge("c", "e", "T", 1, 250), edge("c", "f", "T", 1, 400)});
+    auto reached = [&](int64_t s, int64_t e, uint32_t hops) {
+        std::vector<NodeRec> ns;
+        std::vector<EdgeRec> es;
+        eng.expand({"a"}, s, e, hops, ns, es);
+        std::set<std::string> ids{"a"};
+        for (auto& ed : es) {
+            CHECK(ed.ts >= s && ed.ts <= e);
+            ids.insert(ed.src);
+            ids.insert(ed.dst);
+        }
+        return ids;
+    };
+    CHECK((reached(150, 250, 1) == std::set<std::string>{"a", "c"}));
+    CHECK((reached(150, 250, 2) == std::set<std::string>{"a", "c", "e"}));
+    CHECK((reached(200, 200, 2) == std::set<std::string>{"a", "c"}));
+    CHECK((reached(0, 1000, 2) == std::set<std::string>{"a", "b", "c", "d", "e", "f"}));
+}
+
+// With the expand cache on, hits and misses answer exactly what an uncached
+// engine does, for windows that are not aligned to anything.
+void cached_expand_window() {
+    Engine plain, cached;
+    cached.cache_expands({1 << 20});
+    auto both = [&](const std::vector<EdgeRec>& es) { plain.upsert_edges(es); cached.upsert_edges(es); };
+    both({edge("a", "b", "T", 1, 60001), edge("a", "c", "T", 1, 60500), edge("b", "d", "T", 1, 61000)});
+    auto run = [](const Engine& eng, int64_t s, int64_t e) {
+        std::string out;
+        eng.expand_encoded({"a"}, s, e, 2, ExpandOptions{}, [&](uint32_t, std::string& frag, bool) {
+            out += frag;
+            return true;
+        });
+        return out;
+    };
+    for (int round = 0; round < 2; ++round) {
+        for (auto [s, e] : {std::pair<int64_t, int64_t>{60000, 60400}, {60002, 61000}, {60000, 120000}})
+            CHECK(run(cached, s, e) == run(plain, s, e));
+        both({edge("c", "e", "T", 1, 60700)});
+    }
+}
+
+namespace fs = std::filesystem;
+
+size_t reopened_edges(const std::string& dir) {
+    Engine eng;
+    eng.open(PersistOptions{dir});
+    return eng.stats().edges;
+}
+
+bool open_throws(const std::string& dir) {
+    try {
+        reopened_edges(dir);
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void flip_byte(const std::string& path, size_t at) {
+    std::fstream f(path, std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(at);
+    char c = char(f.get() ^ 0x5a);
+    f.seekp(at);
+    f.put(c);
+}
+
+// Reopening replays the WAL. A torn tail on the last segment is cut off and
+// the records before it kept; damage anywhere else fails the open.
+void wal_recovery() {
+    fs::path root = fs::temp_directory_path() / ("graph_engine_test." + std::to_string(::getpid()));
+    fs::remove_all(root);
+    std::string dir = (root / "base").string();
+    for (int seg = 0; seg < 2; ++seg) {  // wal.0, then wal.1 after a reopen
+        Engine eng;
+        eng.open(PersistOptions{dir});
+        for (int i = 0; i < 3; ++i)
+            eng.upsert_edges({edge("a", "n" + std::to_string(seg * 3 + i), "T", 1, i)});
+    }
+    auto copy = [&](const char* name) {
+        std::string d = (root / name).string();
+        fs::copy(dir, d);
+        return d;
+    };
+    CHECK(reopened_edges(copy("clean")) == 6);
+
+    std::string torn = copy("torn");
+    fs::resize_file(torn + "/wal.1", fs::file_size(torn + "/wal.1") - 3);
+    CHECK(reopened_edges(torn) == 5);
+    CHECK(reopened_edges(torn) == 5);  // wal.1 is no longer last, and was cut whole
+
+    std::string early = copy("early");
+    flip_byte(early + "/wal.0", 12);
+    CHECK(open_throws(early));
+
+    std::string mid = copy("mid");
+    flip_byte(mid + "/wal.1", 12);  // good records follow the bad one
+    CHECK(open_throws(mid));
+    fs::remove_all(root);
+}
+
+// A snapshot that is cut short or points outside its own tables fails the
+// open instead of being read out of bounds.
+void snapshot_corruption() {
+    fs::path root = fs::temp_directory_path() / ("graph_engine_test." + std::to_string(::getpid()));
+    fs::remove_all(root);
+    std::string dir = (root / "base").string();
+    const int64_t ts = 0x1122334455667788;  // easy to find in the file
+    {
+        Engine eng;
+        eng.open(PersistOptions{dir});
+        eng.upsert_edges({edge("a", "b", "T", 1, ts)});
+        eng.checkpoint();
+    }
+    std::ifstream in(dir + "/snapshot", std::ios::binary);
+    const std::string good((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    auto with = [&](const std::string& bytes) {
+        fs::remove_all(root / "bad");
+        fs::copy(dir, root / "bad");
+        std::ofstream((root / "bad" / "snapshot").string(), std::ios::binary | std::ios::trunc) << bytes;
+        return (root / "bad").string();
+    };
+    CHECK(reopened_edges(with(good)) == 1);
+    for (size_t n : {size_t(0), size_t(10), good.size() / 2, good.size() - 8})
+        CHECK(open_throws(with(good.substr(0, n))));
+
+    // The edge table is the first place the ts appears, at byte 24 of the
+    // edge; the adjacency entries after it hold a node or edge index at +8.
+    const std::string needle(reinterpret_cast<const char*>(&ts), sizeof ts);
+    size_t in_edges = good.find(needle), in_csr = good.find(needle, in_edges + 1);
+    CHECK(in_edges != std::string::npos && in_edges >= 24 && in_csr != std::string::npos);
+    if (in_edges == std::string::npos || in_edges < 24 || in_csr == std::string::npos) return;
+    for (size_t at : {in_edges - 24, in_csr + 8}) {
+        std::string bad = good;
+        bad.replace(at, 4, "\xff\xff\xff\x7f");
+        CHECK(open_throws(with(bad)));
+    }
+    fs::remove_all(root);
+}
+
+// What a walk from `seeds` reached, as edge (src, dst, type, ts) tuples and
+// node ids, independent of the order and numbering it came in.
+struct Reached {
+    std::set<std::tuple<std::string, std::string, std::string, int64_t>> edges;
+    std::set<std::string> nodes;
+    bool operator==(const Reached& o) const { return edges == o.edges && nodes == o.nodes; }
+};
+Reached reached(const Engine& eng, const std::vector<std::string>& seeds, int64_t s, int64_t e, uint32_t hops) {
+    std::vector<NodeRec> ns;
+    std::vector<EdgeRec> es;
+    eng.expand(seeds, s, e, hops, ns, es);
+    Reached r;
+    for (auto& n : ns) r.nodes.insert(n.id);
+    for (auto& ed : es) r.edges.emplace(ed.src, ed.dst, ed.type, ed.ts);
+    return r;
+}
+
+bool has_node(const Engine& eng, const std::string& id) {
+    std::vector<NodeRec> ns;
+    std::vector<EdgeRec> es;
+    eng.expand({id}, 0, 0, 0, ns, es);
+    return !ns.empty();
+}
+
+// Old edges and old nodes left without edges go; the rest reads as before.
+void compact_drops_old() {
+    Engine eng;
+    eng.index_related({});
+    NodeRec n;
+    n.type = "entity";
+    for (auto [id, ts] : {std::pair<const char*, int64_t>{"old", 10}, {"fresh", 5000}, {"a", 10}}) {
+        n.id = id; n.ts = ts;
+        eng.upsert_nodes(std::vector<NodeRec>{n});
+    }
+    eng.upsert_edges({edge("a", "old", "CO_OCCUR", 1, 100), edge("a", "b", "CO_OCCUR", 2, 900),
+                      edge("a", "c", "CO_OCCUR", 3, 1500), edge("c", "d", "CO_OCCUR", 4, 2000),
+                      edge("b", "d", "CO_OCCUR", 5, 300)});
+    auto before = reached(eng, {"a"}, 1000, 3000, 2);
+    std::vector<std::pair<std::string, double>> rel_before, rel_after;
+    eng.related({"c"}, 1000, 3000, RelatedOptions{}, rel_before);
+
+    CHECK(eng.compact(1000) == 3);
+    auto es = all_edges(eng);
+    CHECK(es.size() == 2);
+    for (auto& e : es) CHECK(e.ts >= 1000);
+    CHECK(!has_node(eng, "old") && has_node(eng, "fresh") && has_node(eng, "a"));
+    CHECK(reached(eng, {"a"}, 1000, 3000, 2) == before);
+    eng.related({"c"}, 1000, 3000, RelatedOptions{}, rel_after);
+    CHECK(!rel_before.empty() && rel_after == rel_before);
+    CHECK(eng.compact(1000) == 0);
+}
+
+// Upserts made while a compaction copies off the lock are caught up before
+// it publishes: new edges, merges into kept edges and node patches all stay.
+void compact_keeps_concurrent_upserts() {
+    Engine eng;
+    const int old_edges = 100000;
+    std::vector<EdgeRec> batch;
+    for (int i = 0; i < old_edges; ++i) batch.push_back(edge("o" + std::to_string(i), "o", "T", 1, 1));
+    batch.push_back(edge("keep", "k", "T", 1, 5000));
+    eng.upsert_edges(batch);
+
+    std::atomic<bool> done{false};
+    size_t dropped = 0;
+    std::thread compactor([&] { dropped = eng.compact(1000); done = true; });
+    int i = 0, during = 0;
+    NodeRec n;
+    n.id = "keep"; n.type = "entity";
+    for (; i < 50 || !done; ++i) {
+        bool running = !done;
+        eng.upsert_edges({edge("keep", "k", "T", 10 + i, 5000), edge("n" + std::to_string(i), "m", "T", 1, 6000)});
+        n.attrs = {{"v", std::to_string(i)}};
+        eng.upsert_nodes(std::vector<NodeRec>{n});
+        during += running && !done;
+    }
+    compactor.join();
+    CHECK(dropped == size_t(old_edges));
+    if (!during) std::fprintf(stderr, "note: no upsert overlapped the compaction\n");
+    auto es = all_edges(eng);
+    CHECK(es.size() == size_t(i) + 1);
+    const EdgeRec* keep = nullptr;
+    for (auto& e : es)
+        if (e.src == "keep" || e.dst == "keep") keep = &e;
+    CHECK(keep && keep->weight == 10 + i - 1);
+    std::vector<NodeRec> ns;
+    std::vector<EdgeRec> ignored;
+    eng.expand({"keep"}, 0, 0, 0, ns, ignored);
+    CHECK(ns.size() == 1 && ns[0].attrs["v"] == std::to_string(i - 1));
+}
+
+// A compaction checkpoints, and a reopen restores the compacted graph.
+void compact_then_reopen() {
+    fs::path root = fs::temp_directory_path() / ("graph_engine_test." + std::to_string(::getpid()));
+    fs::remove_all(root);
+    std::string dir = (root / "base").string();
+    Reached before;
+    size_t nodes = 0;
+    {
+        Engine eng;
+        eng.open(PersistOptions{dir});
+        eng.upsert_edges({edge("a", "b", "T", 1, 100), edge("a", "c", "T", 2, 2000), edge("c", "d", "T", 3, 2500)});
+        CHECK(eng.compact(1000) == 1);
+        eng.upsert_edges({edge("d", "e", "T", 4, 3000)});
+        before = reached(eng, {"a"}, 0, 5000, 3);
+        nodes = eng.stats().nodes;
+    }
+    Engine eng;
+    eng.open(PersistOptions{dir});
+    CHECK(reached(eng, {"a"}, 0, 5000, 3) == before);
+    CHECK(eng.stats().nodes == nodes && eng.stats().edges == 3);
+    fs::remove_all(root);
+}
+
+// Stats bytes cover each structure as it comes into use, and add up.
+void stats_bytes() {
+    Engine eng;
+    auto sum = [](const Engine::Stats& s) {
+        return s.node_bytes + s.edge_bytes + s.attr_bytes + s.adjacency_bytes + s.string_bytes + s.cache_bytes +
+               s.related_bytes;
+    };
+    auto s0 = eng.stats();
+    CHECK(s0.bytes() == sum(s0));
+    eng.cache_expands({1 << 20});
+    eng.index_related({});
+    EdgeRec e = edge("a", "b", "CO_OCCUR", 1, 10);
+    e.attrs = {{"src", "rss"}};
+    eng.upsert_edges({e, edge("b", "c", "CO_OCCUR", 1, 10)});
+    eng.expand_encoded({"a"}, 0, 100, 2, ExpandOptions{}, [](uint32_t, std::string&, bool) { return true; });
+    auto s1 = eng.stats();
+    CHECK(s1.bytes() == sum(s1));
+    CHECK(s1.edge_bytes > s0.edge_bytes && s1.adjacency_bytes > s0.adjacency_bytes);
+    CHECK(s1.string_bytes > s0.string_bytes && s1.node_bytes > s0.node_bytes);
+    CHECK(s1.attr_bytes > 0 && s1.cache_bytes > 0 && s1.related_bytes > 0);
+}
+
+// Past the hard budget upserts are refused whole; past the soft one the
+// oldest edges are compacted away without waiting for the next check.
+void memory_budget() {
+    {
+        Engine eng;
+        eng.upsert_edges({edge("a", "b", "T", 1, 10)});
+        RetentionPolicy p;
+        p.hard_bytes = eng.stats().bytes() + 64 * 1024;
+        eng.retain(p);
+        bool refused = false;
+        int i = 0;
+        for (; i < 10000 && !refused; ++i) {
+            size_t edges = eng.stats().edges;
+            try {
+                eng.upsert_edges({edge("n" + std::to_string(i), "m", "T", 1, 10)});
+            } catch (const Engine::OverBudget&) {
+                refused = true;
+                CHECK(eng.stats().edges == edges);
+                CHECK(eng.stats().bytes() > p.hard_bytes);
+            }
+        }
+        CHECK(refused);
+    }
+    Engine eng;
+    std::vector<EdgeRec> batch;
+    for (int i = 0; i < 20000; ++i) batch.push_back(edge("o" + std::to_string(i), "o", "T", 1, i));
+    eng.upsert_edges(batch);
+    const size_t bytes = eng.stats().bytes();
+    RetentionPolicy p;
+    p.soft_bytes = bytes + bytes / 4;
+    p.check_ms = 3600000;  // only an upsert past soft_bytes wakes it
+    eng.retain(p);
+    batch.clear();
+    for (int i = 0; i < 20000; ++i) batch.push_back(edge("p" + std::to_string(i), "p", "T", 1, 20000 + i));
+    eng.upsert_edges(batch);
+    eng.upsert_edges({edge("x", "y", "T", 1, 40000)});  // admitted past soft_bytes
+    for (int wait = 0; wait < 1000 && eng.stats().edges == 40001; ++wait)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    auto st = eng.stats();
+    CHECK(st.edges < 40001);
+    CHECK(st.bytes() <= p.soft_bytes);
+    int64_t oldest = INT64_MAX;
+    for (auto& e : all_edges(eng)) oldest = std::min(oldest, e.ts);
+    CHECK(oldest == int64_t(40001 - st.edges));
+}
+
+std::string encoded(const Engine& eng, const ExpandQuery& q, bool* truncated = nullptr) {
+    std::string out;
+    eng.expand_encoded(q.seeds, q.start_ms, q.end_ms, q.hops, q.opt, [&](uint32_t, std::string& frag, bool t) {
+        out += frag;
+        if (truncated) *truncated = *truncated || t;
+        return true;
+    });
+    return out;
+}
+
+// A batch answers each query byte for byte as it would be answered alone,
+// whatever it shares with the others.
+void expand_batch_matches_single() {
+    Engine eng;
+    std::vector<EdgeRec> es;
+    for (int i = 0; i < 60; ++i) {
+        EdgeRec e = edge("n" + std::to_string(i), "n" + std::to_string((i * 7 + 3) % 60), i % 3 ? "T" : "U", 1 + i % 5,
+                         100 + i * 10);
+        if (i % 4 == 0) e.attrs = {{"src", "rss"}};
+        es.push_back(e);
+    }
+    eng.upsert_edges(es);
+    NodeRec n;
+    n.type = "doc";
+    for (int i = 0; i < 60; i += 2) {
+        n.id = "n" + std::to_string(i);
+        eng.upsert_nodes(std::vector<NodeRec>{n});
+    }
+    auto q = [](std::vector<std::string> seeds, int64_t s, int64_t e, uint32_t hops, ExpandOptions opt = {}) {
+        return ExpandQuery{std::move(seeds), s, e, hops, std::move(opt)};
+    };
+    ExpandOptions budget, top, attrs, typed;
+    budget.max_nodes = 3;
+    top.top_k = 1;
+    attrs.edge_attrs = {{"src", "rss"}};
+    typed.edge_types = {"T"};
+    typed.node_types = {"doc"};
+    std::vector<ExpandQuery> qs = {q({"n0"}, 0, 1000, 2),       q({"n0", "n3"}, 0, 1000, 2),
+                                   q({"n3"}, 0, 1000, 3),       q({"n0"}, 0, 1000, 2),
+                                   q({"n0"}, 200, 400, 2),      q({"n0"}, 0, 1000, 3, budget),
+                                   q({"n0"}, 0, 1000, 2, top),  q({"n0", "n9"}, 0, 1000, 2, attrs),
+                                   q({"n0"}, 0, 1000, 2, typed), q({"missing", "n1"}, 0, 1000, 1)};
+    std::vector<Engine::EncodedResult> out;
+    eng.expand_batch_encoded(qs, out);
+    CHECK(out.size() == qs.size());
+    for (size_t i = 0; i < qs.size() && i < out.size(); ++i) {
+        bool truncated = false;
+        CHECK(out[i].fragment == encoded(eng, qs[i], &truncated));
+        CHECK(out[i].truncated == truncated);
+    }
+    CHECK(out.size() > 5 && out[5].truncated);
+}
+
+// A frontier big enough to split over the expand pool walks to the same
+// bytes, budgets included, as one thread does.
+void pooled_expand_matches_serial() {
+    Engine pooled(UpsertPolicy{}, 4), serial(UpsertPolicy{}, 1);
+    std::vector<EdgeRec> es;
+    const int fan = 3000;  // past Engine::kParallelFrontier
+    for (int i = 0; i < fan; ++i) {
+        std::string mid = "m" + std::to_string(i);
+        es.push_back(edge("hub", mid, "T", 1, i));
+        es.push_back(edge(mid, "l" + std::to_string(i % 700), "T", 1 + i % 3, i));
+        es.push_back(edge(mid, "m" + std::to_string((i + 1) % fan), "U", 1, i));
+    }
+    pooled.upsert_edges(es);
+    serial.upsert_edges(es);
+    ExpandOptions dedup, nodes, edges, top;
+    dedup.dedup_edges = true;
+    nodes.max_nodes = 4000;
+    edges.max_edges = 5000;
+    top.top_k = 2;
+    for (auto& opt : {ExpandOptions{}, dedup, nodes, edges, top})
+        for (uint32_t hops : {2u, 3u}) {
+            ExpandQuery q{{"hub"}, 0, fan, hops, opt};
+            bool pt = false, st = false;
+            std::string p = encoded(pooled, q, &pt), s = encoded(serial, q, &st);
+            CHECK(p == s && pt == st);
+        }
+}
+
+// Top neighbors rank by total edge weight to the seeds, ties to the lower
+// node index; personalized PageRank hands out at most the mass it starts with.
+void rank_order() {
+    Engine eng;
+    eng.upsert_edges({edge("s", "a", "T", 3, 10), edge("s", "b", "T", 1, 10), edge("s", "c", "T", 1, 10),
+                      edge("t", "c", "U", 1, 10), edge("s", "d", "T", 2, 10), edge("a", "e", "T", 5, 10),
+                      edge("s", "z", "T", 9, 5000)});
+    std::vector<std::pair<std::string, double>> out;
+    RankOptions opt;
+    eng.rank({"s", "t"}, 0, 100, opt, out);
+    std::vector<std::pair<std::string, double>> want = {{"a", 3}, {"c", 2}, {"d", 2}, {"b", 1}};
+    CHECK(out == want);
+
+    out.clear();
+    opt.k = 2;
+    eng.rank({"s", "t"}, 0, 100, opt, out);
+    CHECK(out.size() == 2 && out[0].first == "a" && out[1].first == "c");
+
+    out.clear();
+    opt.method = RankOptions::kPageRank;
+    opt.k = 100;
+    opt.epsilon = 1e-6;
+    eng.rank({"s"}, 0, 100, opt, out);
+    double total = 0;
+    for (size_t i = 0; i < out.size(); ++i) {
+        CHECK(out[i].second > 0 && out[i].first != "s" && out[i].first != "z");
+        CHECK(i == 0 || out[i - 1].second >= out[i].second);
+        total += out[i].second;
+    }
+    CHECK(!out.empty() && out[0].first == "a");
+    CHECK(total <= 1.0 + 1e-9);
+}
+
+// Related scores sum over the buckets a window overlaps, follow merges, and
+// stay put when nodes are upserted around them.
+void related_buckets() {
+    Engine eng;
+    eng.upsert_edges({edge("e1", "e2", "CO_OCCUR", 2, 1000)});
+    eng.index_related({});  // indexes what is there, then every upsert
+    eng.upsert_edges({edge("e1", "e3", "CO_OCCUR", 5, kDay + 1000), edge("d1", "e1", "MENTIONS", 1, 2000),
+                      edge("d2", "e1", "MENTIONS", 1, kDay + 2000)});
+    using Ranked = std::vector<std::pair<std::string, double>>;
+    auto related = [&](const std::string& id, int64_t s, int64_t e, bool docs = false) {
+        Ranked out;
+        RelatedOptions opt;
+        opt.docs = docs;
+        bool approx = true;
+        CHECK(eng.related({id}, s, e, opt, out, &approx) && !approx);
+        return out;
+    };
+    CHECK((related("e1", 0, kDay - 1) == Ranked{{"e2", 2}}));
+    CHECK((related("e1", kDay - 1, kDay) == Ranked{{"e3", 5}, {"e2", 2}}));
+    CHECK((related("e1", kDay, 2 * kDay - 1) == Ranked{{"e3", 5}}));
+    CHECK((related("d1", 0, 2 * kDay) == Ranked{{"e1", 1}}));
+    CHECK((related("e1", 0, 2 * kDay, true) == Ranked{{"d1", 1}, {"d2", 1}}));
+    CHECK((related("d2", 0, 2 * kDay, true) == Ranked{{"d1", 1}}));
+
+    eng.upsert_edges({edge("e2", "e1", "CO_OCCUR", 4, 1500)});  // merges, kMax: 2 -> 4
+    CHECK((related("e1", 0, kDay - 1) == Ranked{{"e2", 4}}));
+
+    NodeRec n;
+    n.id = "e1"; n.type = "entity"; n.attrs = {{"name", "E1"}};
+    eng.upsert_nodes(std::vector<NodeRec>{n});
+    n.id = "e4";
+    eng.upsert_nodes(std::vector<NodeRec>{n});
+    CHECK((related("e1", 0, kDay - 1) == Ranked{{"e2", 4}}));
+    CHECK(related("e4", 0, 2 * kDay).empty());
+    eng.upsert_edges({edge("e4", "e1", "CO_OCCUR", 3, kDay + 5)});
+    CHECK((related("e1", kDay, 2 * kDay - 1) == Ranked{{"e3", 5}, {"e4", 3}}));
+    CHECK((related("e4", 0, 2 * kDay) == Ranked{{"e1", 3}}));
+}
+
+std::map<std::string, uint32_t> communities(const Engine& eng, int64_t s, int64_t e) {
+    std::vector<std::pair<std::string, uint32_t>> out;
+    eng.communities(s, e, out);
+    return {out.begin(), out.end()};
+}
+
+// Two cliques joined by one light edge come out as two communities, and a
+// warm start after a small change agrees with a cold run on the same graph.
+void louvain_cliques() {
+    Engine warm, cold;
+    auto both = [&](const std::vector<EdgeRec>& es) { warm.upsert_edges(es); cold.upsert_edges(es); };
+    std::vector<EdgeRec> es;
+    for (const char* c : {"a", "b"})
+        for (int i = 0; i < 6; ++i)
+            for (int j = i + 1; j < 6; ++j)
+                es.push_back(edge(c + std::to_string(i), c + std::to_string(j), "T", 1, 10));
+    es.push_back(edge("a0", "b0", "T", 0.1, 10));
+    both(es);
+    auto labels = communities(warm, 0, 100);
+    CHECK(labels.size() == 12);
+    for (int i = 1; i < 6; ++i) {
+        CHECK(labels["a" + std::to_string(i)] == labels["a0"]);
+        CHECK(labels["b" + std::to_string(i)] == labels["b0"]);
+    }
+    CHECK(labels["a0"] != labels["b0"]);
+    CHECK(communities(warm, 0, 100) == labels);  // unchanged window: cached
+
+    // One new edge out of 32 is under the warm-start share.
+    both({edge("a1", "a6", "T", 1, 20)});
+    auto warmed = communities(warm, 0, 100);
+    CHECK(warmed == communities(cold, 0, 100));
+    CHECK(warmed["a6"] == warmed["a0"] && warmed["b1"] == warmed["b0"] && warmed["a0"] != warmed["b0"]);
+}
+
+}  // namespace
+
+int main() {
+    merge_on_duplicate();
+    node_patch();
+    delta_fold();
+    expand_window();
+    cached_expand_window();
+    wal_recovery();
+    snapshot_corruption();
+    compact_drops_old();
+    compact_keeps_concurrent_upserts();
+    compact_then_reopen();
+    stats_bytes();
+    memory_budget();
+    expand_batch_matches_single();
+    pooled_expand_matches_serial();
+    rank_order();
+    related_buckets();
+    louvain_cliques();
+    if (failures) std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return failures;
+}